@@ -103,6 +103,15 @@ public:
 		update_camera_vectors();
 	}
 
+	// Places the camera directly, used when replaying a recorded path
+	void set_pose(glm::vec3 position, float yaw, float pitch, float zoom) {
+		this->position = position;
+		this->yaw = yaw;
+		this->pitch = pitch;
+		this->zoom = zoom;
+		update_camera_vectors();
+	}
+
 	//Processes input received from a mouse scroll-wheel event. ONly requires input on vertical wheel axis
 	void process_mouse_scroll(float y_offset) {
 		if(zoom >= 1.0f && zoom <= 45.0f)
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <glm.hpp>
+#include <vector>
+#include <cstdio>
+#include <cmath>
+
+#include "Camera.h"
+
+// One sample of a recorded fly-through
+struct CameraKey {
+	float time;
+	glm::vec3 position;
+	float yaw;
+	float pitch;
+	float zoom;
+};
+
+// Records the camera pose every frame and plays it back at a fixed timestep,
+// so benchmark runs see exactly the same views regardless of frame rate.
+// Paths are stored as plain text, one key per line.
+class CameraPath {
+	public:
+		CameraPath() {
+
+		}
+
+		void clear() {
+			keys.clear();
+		}
+
+		// Appends the camera's pose at the given time (seconds since recording started)
+		void record(const Camera &camera, float time) {
+			CameraKey key;
+			key.time = time;
+			key.position = camera.position;
+			key.yaw = camera.yaw;
+			key.pitch = camera.pitch;
+			key.zoom = camera.zoom;
+			keys.push_back(key);
+		}
+
+		inline bool empty() const { return keys.empty(); }
+		inline size_t get_key_count() const { return keys.size(); }
+		inline float get_duration() const { return keys.empty() ? 0.0f : keys.back().time; }
+
+		// Number of fixed steps needed to play the whole path
+		int get_step_count(float timestep) const {
+			return (int)std::floor(get_duration() / timestep) + 1;
+		}
+
+		// Places the camera at step * timestep along the path, interpolating between keys
+		void apply(Camera &camera, int step, float timestep) const {
+			if(keys.empty())
+				return;
+
+			float time = step * timestep;
+			size_t next = 1;
+			while(next < keys.size() && keys[next].time < time)
+				next++;
+
+			if(next >= keys.size()) {
+				const CameraKey &last = keys.back();
+				camera.set_pose(last.position, last.yaw, last.pitch, last.zoom);
+				return;
+			}
+
+			const CameraKey &a = keys[next - 1];
+			const CameraKey &b = keys[next];
+			float span = b.time - a.time;
+			float t = span > 0.0f ? glm::clamp((time - a.time) / span, 0.0f, 1.0f) : 1.0f;
+
+			camera.set_pose(glm::mix(a.position, b.position, t), glm::mix(a.yaw, b.yaw, t), glm::mix(a.pitch, b.pitch, t), glm::mix(a.zoom, b.zoom, t));
+		}
+
+		bool save(const char* path) const {
+			FILE* file = fopen(path, "w");
+			if(!file)
+				return false;
+
+			fprintf(file, "# time x y z yaw pitch zoom\n");
+			for(size_t i = 0; i < keys.size(); i++) {
+				const CameraKey &key = keys[i];
+				// %.9g round-trips floats exactly, so replays are bit-identical
+				fprintf(file, "%.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", key.time, key.position.x, key.position.y, key.position.z, key.yaw, key.pitch, key.zoom);
+			}
+
+			fclose(file);
+			return true;
+		}
+
+		bool load(const char* path) {
+			FILE* file = fopen(path, "r");
+			if(!file)
+				return false;
+
+			keys.clear();
+			char line[256];
+			while(fgets(line, sizeof(line), file)) {
+				if(line[0] == '#')
+					continue;
+
+				CameraKey key;
+				if(sscanf(line, "%f %f %f %f %f %f %f", &key.time, &key.position.x, &key.position.y, &key.position.z, &key.yaw, &key.pitch, &key.zoom) == 7)
+					keys.push_back(key);
+			}
+
+			fclose(file);
+			return !keys.empty();
+		}
+
+	private:
+		std::vector<CameraKey> keys;
+};
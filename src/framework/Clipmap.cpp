@@ -0,0 +1,350 @@
+#include "Clipmap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "Shader.h"
+
+namespace {
+	// Rounds towards negative infinity, unlike integer division
+	int floor_shift(int value, int shift) {
+		return value >= 0 ? value >> shift : -((-value + (1 << shift) - 1) >> shift);
+	}
+
+	int wrap(int value) {
+		return value & (CLIPMAP_TEXTURE_SIZE - 1);
+	}
+}
+
+Clipmap::Clipmap(const HeightPyramid &pyramid, float spacing, float height_scale, UploadRing &uploads, JobSystem &jobs)
+	: pyramid(pyramid), spacing(spacing), height_scale(height_scale), uploads(uploads), jobs(jobs),
+	finished(1), uploaded_bytes(0), failed_reads(0) {
+	const int size = CLIPMAP_GRID_SIZE;
+
+	for(int i = 0; i < CLIPMAP_LEVELS; i++) {
+		Level &level = levels[i];
+		level.origin_x = 0;
+		level.origin_z = 0;
+		level.resident = false;
+
+		glGenTextures(1, &level.texture);
+		glBindTexture(GL_TEXTURE_2D, level.texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, CLIPMAP_TEXTURE_SIZE, CLIPMAP_TEXTURE_SIZE, 0, GL_RED, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Every level shares one grid of local vertex coordinates
+	std::vector<float> vertices(size * size * 2);
+	for(int z = 0; z < size; z++) {
+		for(int x = 0; x < size; x++) {
+			vertices[(z * size + x) * 2] = (float)x;
+			vertices[(z * size + x) * 2 + 1] = (float)z;
+		}
+	}
+
+	// Cells are stored row by row, so any run of cells within a row, or of whole
+	// rows, is one contiguous range of indices
+	std::vector<unsigned short> indices;
+	indices.reserve((size - 1) * (size - 1) * 6);
+	for(int z = 0; z < size - 1; z++) {
+		for(int x = 0; x < size - 1; x++) {
+			unsigned short top_left = (unsigned short)(z * size + x);
+			unsigned short bottom_left = (unsigned short)((z + 1) * size + x);
+			indices.push_back(top_left);
+			indices.push_back(bottom_left);
+			indices.push_back(top_left + 1);
+			indices.push_back(top_left + 1);
+			indices.push_back(bottom_left);
+			indices.push_back(bottom_left + 1);
+		}
+	}
+
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glGenBuffers(1, &ibo);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+Clipmap::~Clipmap() {
+	// The read in flight writes to finished
+	if(reading)
+		jobs.wait(reading);
+
+	for(int i = 0; i < CLIPMAP_LEVELS; i++)
+		glDeleteTextures(1, &levels[i].texture);
+	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ibo);
+	glDeleteVertexArrays(1, &vao);
+}
+
+void Clipmap::update(const glm::vec3 &camera_position) {
+	if(!pending) {
+		std::shared_ptr<Move> move;
+		if(finished.pop(move)) {
+			pending = move;
+			reading.reset();
+		}
+	}
+
+	bool moved = false;
+	if(pending) {
+		moved = apply_move(*pending);
+		// Done once every level read is uploaded, the ones after a failed read are dropped
+		if(pending->applied_levels == pending->read_levels) {
+			if(pending->read_levels < pending->levels.size())
+				failed_reads++;
+			pending.reset();
+		}
+	}
+
+	if(moved) {
+		for(int i = 0; i < CLIPMAP_LEVELS; i++)
+			build_runs(i);
+	}
+
+	// Planned from where the levels are now, so only one move is read at a time
+	if(!pending && !reading)
+		start_move(camera_position);
+}
+
+void Clipmap::draw(Shader &shader) {
+	shader.set_float("heightScale", height_scale);
+
+	glBindVertexArray(vao);
+	for(int i = 0; i < CLIPMAP_LEVELS; i++) {
+		const Level &level = levels[i];
+		if(!level.resident || level.counts.empty())
+			continue;
+
+		// Levels morph into the next coarser one, unless there is none to morph into
+		bool morph = i + 1 < CLIPMAP_LEVELS && levels[i + 1].resident;
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, level.texture);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, morph ? levels[i + 1].texture : level.texture);
+
+		shader.set_texture("fineHeights", 1);
+		shader.set_texture("coarseHeights", 2);
+		shader.set_vec2("levelOrigin", (float)level.origin_x, (float)level.origin_z);
+		shader.set_float("levelSpacing", spacing * (float)(1 << i));
+		shader.set_bool("morph", morph);
+
+		glMultiDrawElements(GL_TRIANGLES, level.counts.data(), GL_UNSIGNED_SHORT, level.offsets.data(),
+			(GLsizei)level.counts.size());
+	}
+	glBindVertexArray(0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void Clipmap::start_move(const glm::vec3 &camera_position) {
+	const int size = CLIPMAP_GRID_SIZE;
+	std::shared_ptr<Move> move = std::make_shared<Move>();
+	size_t samples = 0;
+
+	// Coarse to fine, the order they're uploaded in
+	for(int i = CLIPMAP_LEVELS - 1; i >= 0; i--) {
+		float level_spacing = spacing * (float)(1 << i);
+		int camera_x = (int)floorf(camera_position.x / level_spacing);
+		int camera_z = (int)floorf(camera_position.z / level_spacing);
+
+		// Even origins put the level's edges on grid points of the next coarser level
+		int origin_x = (camera_x - (CLIPMAP_GRID_SIZE - 1) / 2) & ~1;
+		int origin_z = (camera_z - (CLIPMAP_GRID_SIZE - 1) / 2) & ~1;
+
+		const Level &level = levels[i];
+		if(level.resident && level.origin_x == origin_x && level.origin_z == origin_z)
+			continue;
+
+		LevelMove target;
+		target.level = i;
+		target.origin_x = origin_x;
+		target.origin_z = origin_z;
+
+		// Only the columns and rows that entered the level need new samples
+		int dx = origin_x - level.origin_x;
+		int dz = origin_z - level.origin_z;
+		if(!level.resident || abs(dx) >= size || abs(dz) >= size) {
+			add_region(target.regions, origin_x, origin_z, size, size);
+		} else {
+			if(dx > 0)
+				add_region(target.regions, level.origin_x + size, origin_z, dx, size);
+			else if(dx < 0)
+				add_region(target.regions, origin_x, origin_z, -dx, size);
+			if(dz > 0)
+				add_region(target.regions, origin_x, level.origin_z + size, size, dz);
+			else if(dz < 0)
+				add_region(target.regions, origin_x, origin_z, size, -dz);
+		}
+
+		for(size_t j = 0; j < target.regions.size(); j++) {
+			target.regions[j].first = samples;
+			samples += (size_t)target.regions[j].width * target.regions[j].height;
+		}
+		move->levels.push_back(target);
+	}
+	if(move->levels.empty())
+		return;
+
+	move->read_levels = 0;
+	move->applied_levels = 0;
+	reading = jobs.submit([this, move, samples]() {
+		std::vector<float> scratch;
+		move->samples.resize(samples);
+		for(; move->read_levels < move->levels.size(); move->read_levels++) {
+			const LevelMove &target = move->levels[move->read_levels];
+			bool read_all = true;
+			for(size_t i = 0; i < target.regions.size() && read_all; i++)
+				read_all = read(target.level, target.regions[i], &move->samples[target.regions[i].first], scratch);
+			if(!read_all)
+				break;
+		}
+		// Never waits, the queue has room for the one move read at a time
+		finished.push(move);
+	}, JOB_PRIORITY_HIGH);
+}
+
+bool Clipmap::apply_move(Move &move) {
+	bool moved = false;
+
+	// A level that can't move holds back the finer ones after it, so each
+	// level stays inside the one around it
+	while(move.applied_levels < move.read_levels) {
+		LevelMove &target = move.levels[move.applied_levels];
+		Level &level = levels[target.level];
+		std::vector<Region> &regions = target.regions;
+
+		// Reserve everything first, a half written move would show stale samples
+		for(size_t i = 0; i < regions.size(); i++) {
+			Region &region = regions[i];
+			if(!uploads.allocate(region.width * region.height * sizeof(float), sizeof(float), region.allocation)) {
+				for(size_t j = 0; j < i; j++)
+					uploads.cancel(regions[j].allocation);
+				return moved;
+			}
+		}
+
+		for(size_t i = 0; i < regions.size(); i++) {
+			Region &region = regions[i];
+			memcpy(region.allocation.ptr, &move.samples[region.first], region.allocation.size);
+			uploads.submit_texture_copy(region.allocation, level.texture, 0, wrap(region.x), wrap(region.z),
+				region.width, region.height, GL_RED, GL_FLOAT);
+			uploaded_bytes += region.allocation.size;
+		}
+
+		level.origin_x = target.origin_x;
+		level.origin_z = target.origin_z;
+		level.resident = true;
+		move.applied_levels++;
+		moved = true;
+	}
+	return moved;
+}
+
+void Clipmap::add_region(std::vector<Region> &regions, int x, int z, int width, int height) const {
+	// Split where the texture wraps, so every piece is a plain rectangle of texels
+	int split_x = std::min(width, CLIPMAP_TEXTURE_SIZE - wrap(x));
+	int split_z = std::min(height, CLIPMAP_TEXTURE_SIZE - wrap(z));
+	int xs[2] = { x, x + split_x };
+	int zs[2] = { z, z + split_z };
+	int widths[2] = { split_x, width - split_x };
+	int heights[2] = { split_z, height - split_z };
+
+	for(int j = 0; j < 2; j++) {
+		for(int i = 0; i < 2; i++) {
+			if(widths[i] == 0 || heights[j] == 0)
+				continue;
+			Region region;
+			region.x = xs[i];
+			region.z = zs[j];
+			region.width = widths[i];
+			region.height = heights[j];
+			regions.push_back(region);
+		}
+	}
+}
+
+bool Clipmap::read(int index, const Region &region, float* out, std::vector<float> &scratch) const {
+	int x = region.x, z = region.z;
+	int width = region.width, height = region.height;
+	int last = (int)pyramid.get_level_count() - 1;
+	if(index <= last)
+		return pyramid.read(index, x, z, width, height, out);
+
+	// Past the pyramid's last level, repeat its samples
+	int shift = index - last;
+	int coarse_x = floor_shift(x, shift);
+	int coarse_z = floor_shift(z, shift);
+	int coarse_width = floor_shift(x + width - 1, shift) - coarse_x + 1;
+	int coarse_height = floor_shift(z + height - 1, shift) - coarse_z + 1;
+	scratch.resize(coarse_width * coarse_height);
+	if(!pyramid.read(last, coarse_x, coarse_z, coarse_width, coarse_height, scratch.data()))
+		return false;
+
+	for(int j = 0; j < height; j++) {
+		const float* row = scratch.data() + (floor_shift(z + j, shift) - coarse_z) * coarse_width;
+		for(int i = 0; i < width; i++)
+			out[j * width + i] = row[floor_shift(x + i, shift) - coarse_x];
+	}
+	return true;
+}
+
+void Clipmap::build_runs(int index) {
+	Level &level = levels[index];
+	const int cells = CLIPMAP_GRID_SIZE - 1;
+	level.counts.clear();
+	level.offsets.clear();
+
+	// The cells under the next finer level are left out, it draws them itself
+	int hole_x0 = 0, hole_x1 = 0, hole_z0 = 0, hole_z1 = 0;
+	if(index > 0 && levels[index - 1].resident) {
+		const Level &finer = levels[index - 1];
+		hole_x0 = std::max(0, std::min(cells, finer.origin_x / 2 - level.origin_x));
+		hole_z0 = std::max(0, std::min(cells, finer.origin_z / 2 - level.origin_z));
+		hole_x1 = std::max(0, std::min(cells, finer.origin_x / 2 - level.origin_x + cells / 2));
+		hole_z1 = std::max(0, std::min(cells, finer.origin_z / 2 - level.origin_z + cells / 2));
+	}
+
+	size_t start = 0, count = 0;
+	for(int z = 0; z < cells; z++) {
+		int segments[2][2] = { { 0, cells }, { cells, cells } };
+		if(z >= hole_z0 && z < hole_z1) {
+			segments[0][1] = hole_x0;
+			segments[1][0] = hole_x1;
+		}
+
+		for(int s = 0; s < 2; s++) {
+			if(segments[s][0] >= segments[s][1])
+				continue;
+			size_t first = ((size_t)z * cells + segments[s][0]) * 6;
+			size_t length = (size_t)(segments[s][1] - segments[s][0]) * 6;
+
+			// Runs that continue the previous one, like consecutive whole rows, merge into it
+			if(count > 0 && start + count == first) {
+				count += length;
+				continue;
+			}
+			if(count > 0) {
+				level.counts.push_back((GLsizei)count);
+				level.offsets.push_back((const void*)(start * sizeof(unsigned short)));
+			}
+			start = first;
+			count = length;
+		}
+	}
+	if(count > 0) {
+		level.counts.push_back((GLsizei)count);
+		level.offsets.push_back((const void*)(start * sizeof(unsigned short)));
+	}
+}
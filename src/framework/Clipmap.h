@@ -0,0 +1,120 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm.hpp>
+#include <memory>
+#include <vector>
+#include "HandoffQueue.h"
+#include "HeightPyramid.h"
+#include "JobSystem.h"
+#include "UploadRing.h"
+
+class Shader;
+
+// Vertices along each edge of a level's grid. One less than the texture size,
+// so the spare texel row and column take the samples wrapping in as it moves
+#define CLIPMAP_GRID_SIZE 255
+#define CLIPMAP_TEXTURE_SIZE 256
+
+#define CLIPMAP_LEVELS 8
+
+// Fraction of a level's half-width over which it morphs into the next coarser level
+#define CLIPMAP_MORPH_WIDTH 0.1f
+
+// Geometry clipmap over a HeightPyramid.
+//
+// Every level is the same CLIPMAP_GRID_SIZE^2 grid, with twice the spacing of
+// the level before it, centered on the camera. Each level but the finest
+// leaves out the cells the next finer level covers, so the vertex count never
+// changes however far the view reaches.
+//
+// Each level keeps its heights in its own texture, addressed toroidally: the
+// sample at grid point (x, z) lives in texel (x, z) mod CLIPMAP_TEXTURE_SIZE.
+// When the camera moves only the rows and columns entering the level are read
+// from the pyramid and written with glTexSubImage2D through the UploadRing,
+// so upload cost follows the camera's motion instead of the view distance.
+//
+// The reads run on the JobSystem, one move of every level that needs it at a
+// time, and come back to the GL thread through a HandoffQueue, so decoding or
+// paging in tiles never stalls a frame. The levels stay where they are until
+// their samples arrive. A level whose read failed isn't moved, nor are the
+// finer ones, and the next update reads it again.
+//
+// Near its outer edge every level blends into the heights of the coarser level
+// around it, so the rings meet without cracks.
+class Clipmap {
+	public:
+		// spacing is the world distance between samples of pyramid level 0, and
+		// height_scale the world height of a sample value of 1
+		Clipmap(const HeightPyramid &pyramid, float spacing, float height_scale, UploadRing &uploads, JobSystem &jobs);
+		~Clipmap();
+
+		// GL thread only, before UploadRing::flush(): queues the samples read for
+		// the last move, then starts reading the next one if the camera left the
+		// levels' centers
+		void update(const glm::vec3 &camera_position);
+
+		// Draws every level with shader, which has to be the clipmap shader. The
+		// height textures go to texture units 1 and 2
+		void draw(Shader &shader);
+
+		inline size_t get_uploaded_bytes() const { return uploaded_bytes; }
+		inline unsigned int get_failed_reads() const { return failed_reads; }
+
+	private:
+		struct Level {
+			unsigned int texture;
+			int origin_x, origin_z; // Grid point of the level's first vertex, in the level's spacing
+			bool resident; // False until the first full upload went through
+			std::vector<GLsizei> counts; // Index runs drawn for the level, rebuilt as the rings move
+			std::vector<const void*> offsets;
+		};
+
+		// A piece of a level to upload, already split where the texture wraps
+		struct Region {
+			int x, z;
+			int width, height;
+			size_t first; // Index of its first sample in the move's samples
+			UploadAllocation allocation;
+		};
+
+		// The samples entering one level, read for moving it to the origin
+		struct LevelMove {
+			int level;
+			int origin_x, origin_z;
+			std::vector<Region> regions;
+		};
+
+		// Levels to move together, coarse to fine, and the samples read for them.
+		// Only the worker reading it touches it until it's in finished
+		struct Move {
+			std::vector<LevelMove> levels;
+			std::vector<float> samples;
+			size_t read_levels; // Levels read in full, from the first
+			size_t applied_levels; // Levels uploaded so far, GL thread only
+		};
+
+		const HeightPyramid &pyramid;
+		float spacing;
+		float height_scale;
+		UploadRing &uploads;
+		JobSystem &jobs;
+
+		Level levels[CLIPMAP_LEVELS];
+		unsigned int vao;
+		unsigned int vbo;
+		unsigned int ibo;
+
+		JobHandle reading; // The job reading the move in flight, NULL when there's none
+		HandoffQueue<std::shared_ptr<Move>> finished;
+		std::shared_ptr<Move> pending; // Read, but not all uploaded, the upload ring was full
+
+		size_t uploaded_bytes;
+		unsigned int failed_reads;
+
+		void start_move(const glm::vec3 &camera_position);
+		bool apply_move(Move &move);
+		void add_region(std::vector<Region> &regions, int x, int z, int width, int height) const;
+		bool read(int level, const Region &region, float* out, std::vector<float> &scratch) const;
+		void build_runs(int level);
+};
@@ -0,0 +1,57 @@
+#include "FrameSnapshot.h"
+
+FrameExchange::FrameExchange(bool lockstep) : back(0), front(1), middle(2), closed(false), published(false),
+	lockstep(lockstep) {
+	for(int i = 0; i < 3; i++)
+		slots[i].tick = 0;
+}
+
+void FrameExchange::publish() {
+	if(lockstep) {
+		// The last snapshot has to be rendered before this one may replace it
+		std::unique_lock<std::mutex> guard(lock);
+		changed.wait(guard, [this] { return closed || !(middle & FRESH); });
+	}
+
+	back = middle.exchange(back | FRESH) & ~FRESH;
+
+	if(lockstep) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+		}
+		changed.notify_all();
+	}
+}
+
+const FrameSnapshot* FrameExchange::acquire() {
+	if(lockstep) {
+		std::unique_lock<std::mutex> guard(lock);
+		changed.wait(guard, [this] { return closed || (middle & FRESH); });
+	}
+	if(closed)
+		return NULL;
+
+	if(middle & FRESH) {
+		front = middle.exchange(front) & ~FRESH;
+		published = true;
+	}
+
+	if(lockstep) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+		}
+		changed.notify_all();
+	}
+	return published ? &slots[front] : NULL;
+}
+
+void FrameExchange::close() {
+	{
+		// In lockstep the last snapshot still gets rendered
+		std::unique_lock<std::mutex> guard(lock);
+		if(lockstep)
+			changed.wait(guard, [this] { return !(middle & FRESH); });
+		closed = true;
+	}
+	changed.notify_all();
+}
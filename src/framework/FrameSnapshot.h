@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glm.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// Everything the render thread needs from one simulation tick. A snapshot is
+// never modified once published, so the render thread reads it without locks
+struct FrameSnapshot {
+	unsigned long long tick; // 0 until the first tick is published
+	float delta; // Simulation time covered by the tick, in seconds
+
+	glm::vec3 camera_position;
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 view_projection;
+
+	int viewport_width, viewport_height;
+	bool wire_frame;
+};
+
+// Hands snapshots from the simulation thread to the render thread.
+//
+// Three snapshots rotate between the two: the one being written, the newest
+// published and the one being rendered. publish() and acquire() only swap
+// indices atomically, so neither thread ever waits on the other however long
+// a tick or a frame takes; ticks the renderer didn't get to are dropped.
+//
+// In lockstep mode each published snapshot is rendered exactly once instead,
+// with publish() waiting for the previous one to be taken and acquire() for a
+// new one, which is what replays need to measure every step.
+class FrameExchange {
+	public:
+		FrameExchange(bool lockstep = false);
+
+		// Simulation thread: the snapshot to fill in before the next publish()
+		inline FrameSnapshot &get_back() { return slots[back]; }
+
+		// Simulation thread: makes the back snapshot the newest one
+		void publish();
+
+		// Render thread: the newest snapshot, valid until the next acquire().
+		// NULL once closed, or before the first publish()
+		const FrameSnapshot* acquire();
+
+		// Simulation thread: releases the render thread for good, once it took
+		// the last snapshot in lockstep mode
+		void close();
+		inline bool is_closed() const { return closed; }
+
+	private:
+		// Index of the middle snapshot, with FRESH set when the render thread
+		// hasn't taken it yet
+		static const int FRESH = 4;
+
+		FrameSnapshot slots[3];
+		int back; // Simulation thread only
+		int front; // Render thread only
+		std::atomic<int> middle;
+		std::atomic<bool> closed;
+		bool published; // Render thread only, whether front holds a snapshot yet
+
+		bool lockstep;
+		std::mutex lock; // Only taken in lockstep mode
+		std::condition_variable changed;
+};
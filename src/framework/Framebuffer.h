@@ -0,0 +1,49 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <iostream>
+
+// Offscreen color + depth render target, used when there is no visible window to draw into
+class Framebuffer {
+	public:
+		unsigned int id;
+		unsigned int color;
+		unsigned int depth;
+		int width, height;
+
+		Framebuffer(int width, int height) : width(width), height(height) {
+			glGenFramebuffers(1, &id);
+			glBindFramebuffer(GL_FRAMEBUFFER, id);
+
+			glGenRenderbuffers(1, &color);
+			glBindRenderbuffer(GL_RENDERBUFFER, color);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+
+			glGenRenderbuffers(1, &depth);
+			glBindRenderbuffer(GL_RENDERBUFFER, depth);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+			if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+				std::cout << "Framebuffer " << id << " is not complete" << std::endl;
+
+			glBindRenderbuffer(GL_RENDERBUFFER, 0);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		}
+
+		~Framebuffer() {
+			glDeleteRenderbuffers(1, &depth);
+			glDeleteRenderbuffers(1, &color);
+			glDeleteFramebuffers(1, &id);
+		}
+
+		void bind() {
+			glBindFramebuffer(GL_FRAMEBUFFER, id);
+			glViewport(0, 0, width, height);
+		}
+
+		void unbind() {
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		}
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+
+// Bounded queue handing finished work from any number of worker threads to a
+// single consumer, usually the GL thread, without a lock either side can be
+// stuck behind.
+//
+// Every slot carries a sequence number telling whose turn it is: producers
+// claim a slot by advancing tail with a compare-and-swap and publish it by
+// bumping its sequence, and the consumer takes slots in order once they are
+// published. A producer preempted halfway only holds up the slots behind its
+// own, never the consumer's call, which returns at once with what is ready.
+//
+// The capacity is fixed. A producer finding the queue full waits for the
+// consumer, so size it to cover what usually finishes between two drains,
+// and give producers a way out through the cancelled flag of push() for when
+// the consumer stops draining, such as while it waits on them to shut down.
+template<typename T>
+class HandoffQueue {
+	public:
+		// capacity is rounded up to a power of two
+		HandoffQueue(size_t capacity) : tail(0), head(0) {
+			size_t size = 1;
+			while(size < capacity)
+				size *= 2;
+			mask = size - 1;
+			slots.reset(new Slot[size]);
+			for(size_t i = 0; i < size; i++)
+				slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		// Any thread. Moves value into the queue and returns true, or leaves it
+		// alone and returns false when the queue is full
+		bool try_push(T &value) {
+			size_t position = tail.load(std::memory_order_relaxed);
+			for(;;) {
+				Slot &slot = slots[position & mask];
+				size_t sequence = slot.sequence.load(std::memory_order_acquire);
+				std::ptrdiff_t difference = (std::ptrdiff_t)sequence - (std::ptrdiff_t)position;
+				if(difference == 0) {
+					// On failure position is reloaded with the current tail
+					if(tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+						slot.value = std::move(value);
+						slot.sequence.store(position + 1, std::memory_order_release);
+						return true;
+					}
+				} else if(difference < 0) {
+					return false; // The consumer hasn't taken this slot's last item yet
+				} else {
+					position = tail.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		// Any thread. Yields while the queue is full, so only the producer waits
+		void push(T value) {
+			while(!try_push(value))
+				std::this_thread::yield();
+		}
+
+		// As push(), but gives up and returns false once cancelled is set
+		bool push(T value, const std::atomic<bool> &cancelled) {
+			while(!try_push(value)) {
+				if(cancelled.load())
+					return false;
+				std::this_thread::yield();
+			}
+			return true;
+		}
+
+		// Consumer thread only. Takes the oldest published item, if any
+		bool pop(T &out) {
+			Slot &slot = slots[head & mask];
+			if(slot.sequence.load(std::memory_order_acquire) != head + 1)
+				return false;
+
+			out = std::move(slot.value);
+			slot.value = T(); // Don't keep what the item owns alive until the slot is reused
+			slot.sequence.store(head + mask + 1, std::memory_order_release);
+			head++;
+			return true;
+		}
+
+		inline size_t get_capacity() const { return mask + 1; }
+
+	private:
+		struct Slot {
+			std::atomic<size_t> sequence; // position when free, position + 1 once published
+			T value;
+		};
+
+		std::unique_ptr<Slot[]> slots;
+		size_t mask;
+		alignas(64) std::atomic<size_t> tail; // Next position to push to
+		alignas(64) size_t head; // Next position to pop, consumer only
+};
@@ -0,0 +1,379 @@
+#include "HeightCodec.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HEIGHT_CODEC_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define HEIGHT_CODEC_NOINLINE __declspec(noinline)
+#else
+#define HEIGHT_CODEC_NOINLINE __attribute__((noinline))
+#endif
+
+namespace {
+	enum Mode {
+		MODE_LOSSLESS,
+		MODE_QUANTIZED
+	};
+
+	// Quotients this large are followed by the raw value instead of the low bits
+	const unsigned int RICE_ESCAPE = 32;
+
+	// Bits of the Rice parameter stored ahead of each block
+	const unsigned int PARAMETER_BITS = 5;
+
+	// Zero bytes after the stream, so the reader can always load 8 at once
+	const size_t PADDING = 8;
+
+	// Header bytes: the mode, then for quantized tiles the base and step
+	const size_t LOSSLESS_HEADER = 4;
+	const size_t QUANTIZED_HEADER = 12;
+
+	// Float bit patterns to unsigned integers ordered like the floats, and back
+	inline uint32_t float_to_ordered(float value) {
+		uint32_t bits;
+		memcpy(&bits, &value, 4);
+		return bits ^ ((uint32_t)((int32_t)bits >> 31) | 0x80000000u);
+	}
+
+	inline float ordered_to_float(uint32_t ordered) {
+		uint32_t bits = ordered ^ (~(uint32_t)((int32_t)ordered >> 31) | 0x80000000u);
+		float value;
+		memcpy(&value, &bits, 4);
+		return value;
+	}
+
+	inline uint32_t zigzag(uint32_t residual) {
+		return (residual << 1) ^ (uint32_t)((int32_t)residual >> 31);
+	}
+
+	inline uint32_t unzigzag(uint32_t value) {
+		return (value >> 1) ^ (0u - (value & 1));
+	}
+
+	inline unsigned int trailing_zeros(uint64_t value) {
+#ifdef _MSC_VER
+		unsigned long index;
+#ifdef _M_X64
+		_BitScanForward64(&index, value);
+#else
+		if(_BitScanForward(&index, (unsigned long)value))
+			return index;
+		_BitScanForward(&index, (unsigned long)(value >> 32));
+		index += 32;
+#endif
+		return index;
+#else
+		return (unsigned int)__builtin_ctzll(value);
+#endif
+	}
+
+	class BitWriter {
+		public:
+			BitWriter(std::vector<unsigned char> &out) : out(out), buffer(0), count(0) {}
+
+			// bits <= 32
+			inline void put(uint32_t value, unsigned int bits) {
+				buffer |= (uint64_t)value << count;
+				count += bits;
+				while(count >= 8) {
+					out.push_back((unsigned char)buffer);
+					buffer >>= 8;
+					count -= 8;
+				}
+			}
+
+			inline void put_rice(uint32_t value, unsigned int k) {
+				uint32_t quotient = value >> k;
+				if(quotient >= RICE_ESCAPE) {
+					put(0, RICE_ESCAPE);
+					put(1, 1);
+					put(value, 32);
+					return;
+				}
+				// quotient zeros, then a one
+				put(1u << quotient, quotient + 1);
+				if(k > 0)
+					put(value & ((1u << k) - 1), k);
+			}
+
+			void finish() {
+				if(count > 0)
+					out.push_back((unsigned char)buffer);
+				out.insert(out.end(), PADDING, 0);
+			}
+
+		private:
+			std::vector<unsigned char> &out;
+			uint64_t buffer;
+			unsigned int count;
+	};
+
+	class BitReader {
+		public:
+			BitReader(const unsigned char* data, size_t size) : data(data), size(size), position(0) {}
+
+			// False once a read would run into the padding
+			inline bool valid() const { return (position >> 3) + PADDING <= size; }
+
+			inline uint64_t peek() const {
+				uint64_t window;
+				memcpy(&window, data + (position >> 3), 8);
+				return window >> (position & 7);
+			}
+
+			// bits <= 32
+			inline uint32_t get(unsigned int bits) {
+				uint32_t value = (uint32_t)(peek() & ((1ull << bits) - 1));
+				position += bits;
+				return value;
+			}
+
+			inline bool get_rice(unsigned int k, uint32_t &value) {
+				if(!valid())
+					return false;
+				uint64_t window = peek();
+				if(window == 0)
+					return false;
+				unsigned int quotient = trailing_zeros(window);
+				if(quotient > RICE_ESCAPE)
+					return false;
+				position += quotient + 1;
+				if(!valid())
+					return false;
+				if(quotient == RICE_ESCAPE)
+					value = get(32);
+				else
+					value = (quotient << k) | (k > 0 ? get(k) : 0);
+				return true;
+			}
+
+		private:
+			const unsigned char* data;
+			size_t size;
+			size_t position; // In bits
+	};
+
+	// Bits a block of zigzagged residuals takes with parameter k
+	uint64_t rice_cost(const uint32_t* values, unsigned int count, unsigned int k) {
+		uint64_t bits = PARAMETER_BITS;
+		for(unsigned int i = 0; i < count; i++) {
+			uint32_t quotient = values[i] >> k;
+			bits += quotient >= RICE_ESCAPE ? RICE_ESCAPE + 1 + 32 : quotient + 1 + k;
+		}
+		return bits;
+	}
+
+	void encode_rows(const uint32_t* values, unsigned int width, unsigned int height, std::vector<unsigned char> &out) {
+		BitWriter writer(out);
+		std::vector<uint32_t> residuals(width);
+		for(unsigned int y = 0; y < height; y++) {
+			const uint32_t* row = values + (size_t)y * width;
+			const uint32_t* up = y > 0 ? row - width : NULL;
+			for(unsigned int x = 0; x < width; x++) {
+				// Outside the grid counts as zero, so the first column predicts from above
+				uint32_t a = x > 0 ? row[x - 1] : 0;
+				uint32_t b = up ? up[x] : 0;
+				uint32_t c = up && x > 0 ? up[x - 1] : 0;
+				residuals[x] = zigzag(row[x] - (a + b - c));
+			}
+
+			for(unsigned int begin = 0; begin < width; begin += HEIGHT_CODEC_BLOCK) {
+				unsigned int count = std::min((unsigned int)HEIGHT_CODEC_BLOCK, width - begin);
+				const uint32_t* block = residuals.data() + begin;
+
+				// The best parameter is close to log2 of the mean, try around it
+				uint64_t sum = 0;
+				for(unsigned int i = 0; i < count; i++)
+					sum += block[i];
+				unsigned int guess = 0;
+				while(guess < 31 && ((uint64_t)count << (guess + 1)) <= sum)
+					guess++;
+				unsigned int k = guess;
+				uint64_t best = rice_cost(block, count, k);
+				for(unsigned int candidate = guess > 0 ? guess - 1 : 0; candidate <= std::min(guess + 1, 31u); candidate++) {
+					uint64_t cost = rice_cost(block, count, candidate);
+					if(cost < best) {
+						best = cost;
+						k = candidate;
+					}
+				}
+
+				writer.put(k, PARAMETER_BITS);
+				for(unsigned int i = 0; i < count; i++)
+					writer.put_rice(block[i], k);
+			}
+		}
+		writer.finish();
+	}
+
+	// row = running sum of residuals + up, with up = NULL above the first row
+	void integrate_row(uint32_t* row, const uint32_t* up, unsigned int width) {
+		unsigned int x = 0;
+		uint32_t sum = 0;
+#ifdef HEIGHT_CODEC_SSE2
+		__m128i carry = _mm_setzero_si128();
+		for(; x + 4 <= width; x += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(row + x));
+			v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+			v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+			v = _mm_add_epi32(v, carry);
+			carry = _mm_shuffle_epi32(v, 0xFF);
+			if(up)
+				v = _mm_add_epi32(v, _mm_loadu_si128((const __m128i*)(up + x)));
+			_mm_storeu_si128((__m128i*)(row + x), v);
+		}
+		sum = (uint32_t)_mm_cvtsi128_si32(carry);
+#endif
+		for(; x < width; x++) {
+			sum += row[x];
+			row[x] = sum + (up ? up[x] : 0);
+		}
+	}
+
+	void ordered_to_floats(const uint32_t* row, float* out, unsigned int width) {
+		unsigned int x = 0;
+#ifdef HEIGHT_CODEC_SSE2
+		const __m128i ones = _mm_set1_epi32(-1);
+		const __m128i sign = _mm_set1_epi32((int)0x80000000u);
+		for(; x + 4 <= width; x += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(row + x));
+			__m128i flip = _mm_or_si128(_mm_xor_si128(_mm_srai_epi32(v, 31), ones), sign);
+			_mm_storeu_ps(out + x, _mm_castsi128_ps(_mm_xor_si128(v, flip)));
+		}
+#endif
+		for(; x < width; x++)
+			out[x] = ordered_to_float(row[x]);
+	}
+
+	// Out of line, so quantize()'s check and decoding run the same instructions
+	// whatever the compiler contracts into fused multiply-adds
+	HEIGHT_CODEC_NOINLINE void grid_to_floats(const uint32_t* row, float* out, unsigned int width, float base,
+		float step) {
+		unsigned int x = 0;
+#ifdef HEIGHT_CODEC_SSE2
+		const __m128 bases = _mm_set1_ps(base);
+		const __m128 steps = _mm_set1_ps(step);
+		for(; x + 4 <= width; x += 4) {
+			__m128 q = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(row + x)));
+			_mm_storeu_ps(out + x, _mm_add_ps(_mm_mul_ps(q, steps), bases));
+		}
+#endif
+		for(; x < width; x++)
+			out[x] = (float)(int32_t)row[x] * step + base;
+	}
+
+	// Snaps samples to a grid of step from base, if every one stays within max_error
+	bool quantize(const float* samples, unsigned int width, unsigned int height, float max_error,
+		std::vector<uint32_t> &values, float &base, float &step) {
+		const size_t count = (size_t)width * height;
+		float low = samples[0], high = samples[0];
+		for(size_t i = 0; i < count; i++) {
+			if(!std::isfinite(samples[i]))
+				return false;
+			low = std::min(low, samples[i]);
+			high = std::max(high, samples[i]);
+		}
+
+		// Rounding to the grid alone errs by up to half a step, leave room for the float math on top
+		base = low;
+		step = (max_error - (fabsf(low) + fabsf(high)) * 4.0f * FLT_EPSILON) * 2.0f;
+		if(!(step > 0.0f) || (double)(high - low) / step >= (double)(1 << 30))
+			return false;
+
+		values.resize(count);
+		for(size_t i = 0; i < count; i++)
+			values[i] = (uint32_t)(int32_t)floor(((double)samples[i] - base) / step + 0.5);
+
+		// Checked against what decoding will produce, rounding included, a row
+		// at a time like decode() does
+		std::vector<float> decoded(width);
+		for(unsigned int y = 0; y < height; y++) {
+			grid_to_floats(&values[(size_t)y * width], decoded.data(), width, base, step);
+			for(unsigned int x = 0; x < width; x++) {
+				if(!(fabsf(decoded[x] - samples[(size_t)y * width + x]) <= max_error))
+					return false;
+			}
+		}
+		return true;
+	}
+}
+
+void HeightCodec::encode(const float* samples, unsigned int width, unsigned int height, float max_error,
+	std::vector<unsigned char> &out) {
+	const size_t count = (size_t)width * height;
+	std::vector<uint32_t> values;
+	float base = 0.0f, step = 0.0f;
+
+	if(count > 0 && max_error > 0.0f && quantize(samples, width, height, max_error, values, base, step)) {
+		unsigned char header[QUANTIZED_HEADER] = { MODE_QUANTIZED };
+		memcpy(header + 4, &base, 4);
+		memcpy(header + 8, &step, 4);
+		out.insert(out.end(), header, header + QUANTIZED_HEADER);
+	} else {
+		values.resize(count);
+		for(size_t i = 0; i < count; i++)
+			values[i] = float_to_ordered(samples[i]);
+		unsigned char header[LOSSLESS_HEADER] = { MODE_LOSSLESS };
+		out.insert(out.end(), header, header + LOSSLESS_HEADER);
+	}
+
+	encode_rows(values.data(), width, height, out);
+}
+
+bool HeightCodec::decode(const unsigned char* data, size_t size, unsigned int width, unsigned int height, float* out) {
+	if(size < LOSSLESS_HEADER)
+		return false;
+	// Checked as a byte, casting a value outside the enum isn't defined
+	if(data[0] != MODE_LOSSLESS && data[0] != MODE_QUANTIZED)
+		return false;
+	Mode mode = (Mode)data[0];
+	size_t header = mode == MODE_QUANTIZED ? QUANTIZED_HEADER : LOSSLESS_HEADER;
+	if(size < header)
+		return false;
+
+	float base = 0.0f, step = 0.0f;
+	if(mode == MODE_QUANTIZED) {
+		memcpy(&base, data + 4, 4);
+		memcpy(&step, data + 8, 4);
+	}
+
+	// Two rows of integers: the one decoding and the one above it
+	std::vector<uint32_t> rows(2 * (size_t)width);
+	uint32_t* row = rows.data();
+	uint32_t* up = NULL;
+
+	BitReader reader(data + header, size - header);
+	for(unsigned int y = 0; y < height; y++) {
+		for(unsigned int begin = 0; begin < width; begin += HEIGHT_CODEC_BLOCK) {
+			unsigned int count = std::min((unsigned int)HEIGHT_CODEC_BLOCK, width - begin);
+			if(!reader.valid())
+				return false;
+			unsigned int k = reader.get(PARAMETER_BITS);
+			for(unsigned int i = 0; i < count; i++) {
+				uint32_t value;
+				if(!reader.get_rice(k, value))
+					return false;
+				row[begin + i] = unzigzag(value);
+			}
+		}
+
+		integrate_row(row, up, width);
+		if(mode == MODE_QUANTIZED)
+			grid_to_floats(row, out + (size_t)y * width, width, base, step);
+		else
+			ordered_to_floats(row, out + (size_t)y * width, width);
+
+		up = row;
+		row = row == rows.data() ? rows.data() + width : rows.data();
+	}
+	return true;
+}
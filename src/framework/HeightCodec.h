@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Residuals per Rice parameter. Smaller adapts faster, larger spends fewer bits on parameters
+#define HEIGHT_CODEC_BLOCK 32
+
+// Compression of heightfield tiles, lossless or within an error bound.
+//
+// Every sample is predicted from its neighbours as left + above - above left,
+// the plane through them, which leaves terrain little but the noise on top of
+// its slopes. The residuals are Rice coded in blocks of HEIGHT_CODEC_BLOCK,
+// each block with the parameter that suits it best, so flat plains and rough
+// mountains in one tile both code tightly.
+//
+// Lossless tiles predict the float bit patterns, mapped to integers in the
+// order of their values, so nothing about the samples is lost, NaNs
+// included. With an error bound the samples are first snapped to a grid of
+// twice that step, which shortens the residuals a lot more; tiles the grid
+// can't represent within the bound fall back to lossless.
+//
+// Unlike the median or Paeth predictors, the plane predictor is linear: a
+// row decodes as a running sum of its residuals added to the row above,
+// which is done four samples at a time with SSE2 where available. Decoding
+// outruns reading the uncompressed tiles from disk.
+class HeightCodec {
+	public:
+		// Appends the encoding of a width x height grid, stored row by row, to
+		// out. max_error = 0 is lossless
+		static void encode(const float* samples, unsigned int width, unsigned int height, float max_error,
+			std::vector<unsigned char> &out);
+
+		// Decodes a grid encoded with the same width and height into out. False
+		// when data is truncated or corrupt
+		static bool decode(const unsigned char* data, size_t size, unsigned int width, unsigned int height, float* out);
+};
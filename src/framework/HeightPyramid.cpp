@@ -0,0 +1,458 @@
+#include "HeightPyramid.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "HeightCodec.h"
+#include "JobSystem.h"
+
+namespace {
+	size_t sample_bytes(RawHeightFormat format) {
+		return format == RAW_HEIGHT_FLOAT32 ? 4 : 2;
+	}
+
+	// Raw files are read on little-endian machines, so big-endian data is swapped
+	float decode_sample(const char* data, const RawHeightSource &source) {
+		unsigned char bytes[4];
+		size_t size = sample_bytes(source.format);
+		memcpy(bytes, data, size);
+		if(source.big_endian)
+			std::reverse(bytes, bytes + size);
+
+		float value;
+		if(source.format == RAW_HEIGHT_UINT16) {
+			uint16_t sample;
+			memcpy(&sample, bytes, 2);
+			value = (float)sample;
+		} else if(source.format == RAW_HEIGHT_INT16) {
+			int16_t sample;
+			memcpy(&sample, bytes, 2);
+			value = (float)sample;
+		} else {
+			memcpy(&value, bytes, 4);
+		}
+		return value * source.scale + source.offset;
+	}
+}
+
+HeightPyramid::HeightPyramid() : cache_clock(0) {
+	memset(&header, 0, sizeof(Header));
+}
+
+bool HeightPyramid::build(const RawHeightSource &source, const char* path, JobSystem &jobs, size_t memory_budget) {
+	if(source.width == 0 || source.height == 0)
+		return false;
+
+	MappedFile input;
+	if(!input.open(source.path)) {
+		std::cout << "Failed to open height source " << source.path << std::endl;
+		return false;
+	}
+	if(input.get_size() < (uint64_t)source.width * source.height * sample_bytes(source.format)) {
+		std::cout << source.path << " is smaller than a " << source.width << "x" << source.height << " grid" << std::endl;
+		return false;
+	}
+
+	HeightPyramid pyramid;
+	uint64_t file_size;
+	plan_levels(pyramid.header, source.width, source.height, file_size);
+	// Built under a temporary name and only renamed to path once complete, so
+	// a failure never leaves a pyramid that opens but misses its bands
+	const std::string temporary = std::string(path) + ".tmp";
+	if(!pyramid.file.create(temporary.c_str(), file_size)) {
+		std::cout << "Failed to create height pyramid " << path << std::endl;
+		return false;
+	}
+
+	bool built;
+	{
+		MappedView view;
+		built = pyramid.file.map(0, sizeof(Header), view);
+		if(built)
+			memcpy(view.data(), &pyramid.header, sizeof(Header));
+	}
+
+	// Level 0 bands map a tile row of input and of output, the rest map two source
+	// tile rows and one output tile row, so the first level bounds the budget
+	const size_t tile_row_bytes = pyramid.get_tiles_x(0) * pyramid.tile_bytes();
+	size_t band_bytes = std::max(
+		(size_t)HEIGHT_PYRAMID_TILE_SIZE * source.width * sample_bytes(source.format) + tile_row_bytes,
+		2 * tile_row_bytes + tile_row_bytes / 2);
+	// The workers and the calling thread each work on one band at a time
+	unsigned int lanes = (unsigned int)std::max<size_t>(1, std::min<size_t>(jobs.get_worker_count() + 1, memory_budget / band_bytes));
+
+	for(unsigned int level = 0; level < pyramid.header.level_count && built; level++) {
+		built = run_bands(pyramid, level, &source, &input, jobs, lanes);
+		if(!built)
+			std::cout << "Failed to build level " << level << " of " << path << std::endl;
+	}
+
+	// Unmapped first, renaming over a file fails on Windows while it's open
+	pyramid.close();
+	if(built) {
+		std::remove(path);
+		built = std::rename(temporary.c_str(), path) == 0;
+		if(!built)
+			std::cout << "Failed to create height pyramid " << path << std::endl;
+	}
+	if(!built)
+		std::remove(temporary.c_str());
+	return built;
+}
+
+bool HeightPyramid::compress(const char* source_path, const char* path, JobSystem &jobs, float max_error) {
+	HeightPyramid source;
+	if(!source.open(source_path))
+		return false;
+	if(source.is_compressed()) {
+		std::cout << source_path << " is already compressed" << std::endl;
+		return false;
+	}
+
+	HeightPyramid pyramid;
+	pyramid.header = source.header;
+	uint64_t offset;
+	plan_index(pyramid.header, offset);
+
+	// Written under a temporary name and only renamed to path once complete,
+	// so a failure never leaves a partial pyramid behind
+	const std::string temporary = std::string(path) + ".tmp";
+	std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+	std::vector<TileEntry> entries((size_t)((offset - sizeof(Header)) / sizeof(TileEntry)));
+	out.write((const char*)&pyramid.header, sizeof(Header));
+	out.write((const char*)entries.data(), entries.size() * sizeof(TileEntry));
+
+	// Tiles are encoded a batch at a time, written in order as each batch is done
+	const unsigned int size = source.header.tile_size;
+	std::vector<std::vector<unsigned char>> encoded((jobs.get_worker_count() + 1) * 4);
+	size_t entry = 0;
+	for(unsigned int level = 0; level < source.header.level_count && out; level++) {
+		const unsigned int tiles_x = source.get_tiles_x(level);
+		const unsigned int tiles = tiles_x * source.get_tiles_y(level);
+		for(unsigned int first = 0; first < tiles && out; first += (unsigned int)encoded.size()) {
+			const unsigned int count = std::min((unsigned int)encoded.size(), tiles - first);
+			std::atomic<bool> failed(false);
+			jobs.parallel_for((int)count, 1, [&](int begin, int end) {
+				for(int i = begin; i < end; i++) {
+					MappedView view;
+					if(!source.map_tile(level, (first + i) % tiles_x, (first + i) / tiles_x, view)) {
+						failed = true;
+						continue;
+					}
+					encoded[i].clear();
+					HeightCodec::encode((const float*)view.data(), size, size, max_error, encoded[i]);
+				}
+			});
+			if(failed) {
+				std::cout << "Failed to read level " << level << " of " << source_path << std::endl;
+				out.close();
+				std::remove(temporary.c_str());
+				return false;
+			}
+
+			for(unsigned int i = 0; i < count; i++, entry++) {
+				out.write((const char*)encoded[i].data(), encoded[i].size());
+				entries[entry].offset = offset;
+				entries[entry].size = (uint32_t)encoded[i].size();
+				offset += encoded[i].size();
+			}
+		}
+	}
+
+	out.seekp(sizeof(Header));
+	out.write((const char*)entries.data(), entries.size() * sizeof(TileEntry));
+	out.close();
+
+	// The source is let go of first in case it's also the destination, and
+	// the destination removed because renaming over a file fails on Windows
+	source.close();
+	if(out)
+		std::remove(path);
+	if(!out || std::rename(temporary.c_str(), path) != 0) {
+		std::cout << "Failed to write compressed height pyramid " << path << std::endl;
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool HeightPyramid::open(const char* path) {
+	close();
+	if(!file.open(path))
+		return false;
+
+	MappedView view;
+	if(!file.map(0, sizeof(Header), view)) {
+		close();
+		return false;
+	}
+	memcpy(&header, view.data(), sizeof(Header));
+
+	// Compressed pyramids are only as large as their index, the tiles are checked as they are read
+	uint64_t expected_size;
+	Header planned;
+	bool known = (header.magic == MAGIC || header.magic == PACKED_MAGIC) && header.version == VERSION
+		&& header.tile_size == HEIGHT_PYRAMID_TILE_SIZE;
+	if(known) {
+		plan_levels(planned, header.levels[0].width, header.levels[0].height, expected_size);
+		if(header.magic == PACKED_MAGIC)
+			plan_index(planned, expected_size);
+	}
+	if(!known || memcmp(&planned, &header, sizeof(Header)) != 0 || file.get_size() < expected_size
+		|| (is_compressed() && !file.map(sizeof(Header), (size_t)(expected_size - sizeof(Header)), index))) {
+		std::cout << path << " is not a height pyramid" << std::endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+void HeightPyramid::close() {
+	index.release();
+	{
+		std::lock_guard<std::mutex> guard(cache_lock);
+		cache.clear();
+	}
+	file.close();
+	memset(&header, 0, sizeof(Header));
+}
+
+bool HeightPyramid::map_tile(unsigned int level, unsigned int tile_x, unsigned int tile_y, MappedView &view) const {
+	if(is_compressed() || level >= header.level_count || tile_x >= get_tiles_x(level) || tile_y >= get_tiles_y(level))
+		return false;
+	return file.map(tile_offset(level, tile_x, tile_y), tile_bytes(), view);
+}
+
+bool HeightPyramid::read(unsigned int level, int x, int y, unsigned int width, unsigned int height, float* out) const {
+	if(level >= header.level_count || width == 0 || height == 0)
+		return false;
+
+	const int size = (int)header.tile_size;
+	const int last_x = (int)get_width(level) - 1;
+	const int last_y = (int)get_height(level) - 1;
+
+	// Clamped coordinates never decrease, so every tile covers one run of rows and one of columns
+	std::vector<int> source_x(width);
+	for(unsigned int i = 0; i < width; i++)
+		source_x[i] = std::min(std::max(x + (int)i, 0), last_x);
+
+	MappedView view;
+	std::shared_ptr<const std::vector<float>> decoded;
+	unsigned int row = 0;
+	while(row < height) {
+		int tile_y = std::min(std::max(y + (int)row, 0), last_y) / size;
+		unsigned int row_end = row;
+		while(row_end < height && std::min(std::max(y + (int)row_end, 0), last_y) / size == tile_y)
+			row_end++;
+
+		unsigned int column = 0;
+		while(column < width) {
+			int tile_x = source_x[column] / size;
+			unsigned int column_end = column;
+			while(column_end < width && source_x[column_end] / size == tile_x)
+				column_end++;
+
+			const float* tile = load_tile(level, tile_x, tile_y, view, decoded);
+			if(!tile)
+				return false;
+			for(unsigned int j = row; j < row_end; j++) {
+				const float* line = tile + (std::min(std::max(y + (int)j, 0), last_y) - tile_y * size) * size;
+				float* dst = out + (size_t)j * width;
+				for(unsigned int i = column; i < column_end; i++)
+					dst[i] = line[source_x[i] - tile_x * size];
+			}
+			column = column_end;
+		}
+		row = row_end;
+	}
+	return true;
+}
+
+const float* HeightPyramid::load_tile(unsigned int level, unsigned int tile_x, unsigned int tile_y, MappedView &view,
+	std::shared_ptr<const std::vector<float>> &decoded) const {
+	if(!is_compressed())
+		return map_tile(level, tile_x, tile_y, view) ? (const float*)view.data() : NULL;
+	if(level >= header.level_count || tile_x >= get_tiles_x(level) || tile_y >= get_tiles_y(level))
+		return NULL;
+
+	const uint64_t key = tile_offset(level, tile_x, tile_y);
+	{
+		std::lock_guard<std::mutex> guard(cache_lock);
+		for(size_t i = 0; i < cache.size(); i++) {
+			if(cache[i].key == key) {
+				cache[i].used = ++cache_clock;
+				decoded = cache[i].samples;
+				return decoded->data();
+			}
+		}
+	}
+
+	// Decoded outside the lock, so other threads keep reading cached tiles meanwhile
+	TileEntry entry;
+	memcpy(&entry, index.data() + (key - sizeof(Header)), sizeof(TileEntry));
+	if(entry.offset + entry.size > file.get_size() || !file.map(entry.offset, entry.size, view))
+		return NULL;
+	std::shared_ptr<std::vector<float>> samples = std::make_shared<std::vector<float>>((size_t)header.tile_size * header.tile_size);
+	if(!HeightCodec::decode((const unsigned char*)view.data(), view.size(), header.tile_size, header.tile_size, samples->data()))
+		return NULL;
+	decoded = samples;
+
+	std::lock_guard<std::mutex> guard(cache_lock);
+	CachedTile tile;
+	tile.key = key;
+	tile.used = ++cache_clock;
+	tile.samples = samples;
+	if(cache.size() < HEIGHT_PYRAMID_TILE_CACHE) {
+		cache.push_back(tile);
+	} else {
+		size_t oldest = 0;
+		for(size_t i = 1; i < cache.size(); i++) {
+			if(cache[i].used < cache[oldest].used)
+				oldest = i;
+		}
+		cache[oldest] = tile;
+	}
+	return decoded->data();
+}
+
+uint64_t HeightPyramid::tile_offset(unsigned int level, unsigned int tile_x, unsigned int tile_y) const {
+	// Of the tile's samples, or of its index entry in compressed pyramids
+	size_t stride = is_compressed() ? sizeof(TileEntry) : tile_bytes();
+	return header.levels[level].offset + ((uint64_t)tile_y * get_tiles_x(level) + tile_x) * stride;
+}
+
+void HeightPyramid::plan_levels(Header &header, unsigned int width, unsigned int height, uint64_t &file_size) {
+	memset(&header, 0, sizeof(Header));
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.tile_size = HEIGHT_PYRAMID_TILE_SIZE;
+
+	const uint64_t size = HEIGHT_PYRAMID_TILE_SIZE;
+	file_size = sizeof(Header);
+	while(header.level_count < HEIGHT_PYRAMID_MAX_LEVELS) {
+		Level &level = header.levels[header.level_count++];
+		level.width = width;
+		level.height = height;
+		level.offset = file_size;
+		file_size += (width + size - 1) / size * ((height + size - 1) / size) * size * size * sizeof(float);
+
+		if(width <= size && height <= size)
+			break;
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	}
+}
+
+void HeightPyramid::plan_index(Header &header, uint64_t &index_end) {
+	const uint64_t size = header.tile_size;
+	header.magic = PACKED_MAGIC;
+	index_end = sizeof(Header);
+	for(unsigned int i = 0; i < header.level_count; i++) {
+		Level &level = header.levels[i];
+		level.offset = index_end;
+		index_end += (level.width + size - 1) / size * ((level.height + size - 1) / size) * sizeof(TileEntry);
+	}
+}
+
+bool HeightPyramid::convert_band(const MappedFile &input, const RawHeightSource &source, unsigned int tile_y) const {
+	const unsigned int size = header.tile_size;
+	const size_t stride = (size_t)source.width * sample_bytes(source.format);
+	const unsigned int first_row = tile_y * size;
+	const unsigned int rows = std::min(size, source.height - first_row);
+
+	MappedView in, out;
+	if(!input.map((uint64_t)first_row * stride, rows * stride, in)
+		|| !file.map(tile_offset(0, 0, tile_y), get_tiles_x(0) * tile_bytes(), out))
+		return false;
+
+	const size_t bytes = sample_bytes(source.format);
+	float* tiles = (float*)out.data();
+	std::vector<float> line(source.width);
+	for(unsigned int r = 0; r < size; r++) {
+		// Rows past the bottom of the grid repeat its last row
+		const char* src = in.data() + std::min(r, rows - 1) * stride;
+		for(unsigned int x = 0; x < source.width; x++)
+			line[x] = decode_sample(src + x * bytes, source);
+
+		for(unsigned int tile_x = 0; tile_x < get_tiles_x(0); tile_x++) {
+			float* dst = tiles + (size_t)tile_x * size * size + (size_t)r * size;
+			for(unsigned int c = 0; c < size; c++)
+				dst[c] = line[std::min(tile_x * size + c, source.width - 1)];
+		}
+	}
+
+	out.flush();
+	return true;
+}
+
+bool HeightPyramid::downsample_band(unsigned int level, unsigned int tile_y) const {
+	const unsigned int size = header.tile_size;
+	const unsigned int parent = level - 1;
+	const unsigned int parent_tiles_x = get_tiles_x(parent);
+	const unsigned int first_tile = 2 * tile_y;
+	const unsigned int tile_rows = std::min(2u, get_tiles_y(parent) - first_tile);
+	const unsigned int parent_last_x = get_width(parent) - 1;
+	const unsigned int parent_last_y = get_height(parent) - 1;
+
+	MappedView in, out;
+	if(!file.map(tile_offset(parent, 0, first_tile), (size_t)tile_rows * parent_tiles_x * tile_bytes(), in)
+		|| !file.map(tile_offset(level, 0, tile_y), get_tiles_x(level) * tile_bytes(), out))
+		return false;
+
+	const float* source = (const float*)in.data();
+	float* tiles = (float*)out.data();
+	// One spare column, since the last pair of an even width parent starts on its last sample
+	std::vector<float> rows[2];
+	rows[0].resize(parent_last_x + 2);
+	rows[1].resize(parent_last_x + 2);
+	for(unsigned int r = 0; r < size; r++) {
+		// Gather the two parent rows, clamped to the edges of the parent level
+		for(unsigned int k = 0; k < 2; k++) {
+			unsigned int y = std::min(std::min(tile_y * size + r, get_height(level) - 1) * 2 + k, parent_last_y);
+			const float* parent_row = source + (size_t)(y / size - first_tile) * parent_tiles_x * size * size
+				+ (size_t)(y % size) * size;
+			for(unsigned int x = 0; x < rows[k].size(); x++) {
+				unsigned int px = std::min(x, parent_last_x);
+				rows[k][x] = parent_row[(size_t)(px / size) * size * size + px % size];
+			}
+		}
+
+		for(unsigned int tile_x = 0; tile_x < get_tiles_x(level); tile_x++) {
+			float* dst = tiles + (size_t)tile_x * size * size + (size_t)r * size;
+			for(unsigned int c = 0; c < size; c++) {
+				unsigned int x = std::min(tile_x * size + c, get_width(level) - 1) * 2;
+				dst[c] = (rows[0][x] + rows[0][x + 1] + rows[1][x] + rows[1][x + 1]) * 0.25f;
+			}
+		}
+	}
+
+	out.flush();
+	return true;
+}
+
+bool HeightPyramid::run_bands(const HeightPyramid &pyramid, unsigned int level, const RawHeightSource* source,
+	const MappedFile* input, JobSystem &jobs, unsigned int lanes) {
+	const unsigned int bands = pyramid.get_tiles_y(level);
+	std::atomic<unsigned int> next(0);
+	std::atomic<bool> failed(false);
+
+	// Bands write disjoint tile rows, so lanes only share the counter. Each lane
+	// is one job, which keeps the mapped windows within the budget
+	auto work = [&]() {
+		unsigned int band;
+		while(!failed && (band = next++) < bands) {
+			bool built = level == 0 ? pyramid.convert_band(*input, *source, band) : pyramid.downsample_band(level, band);
+			if(!built)
+				failed = true;
+		}
+	};
+
+	jobs.parallel_for((int)std::min(lanes, bands), 1, [&](int, int) { work(); });
+
+	return !failed;
+}
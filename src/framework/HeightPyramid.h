@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "MappedFile.h"
+
+class JobSystem;
+
+// Width and height of a pyramid tile, in samples
+#define HEIGHT_PYRAMID_TILE_SIZE 256
+
+// Levels stop halving once they fit in a single tile, which a 2^32 sample edge never passes
+#define HEIGHT_PYRAMID_MAX_LEVELS 32
+
+// Default memory the importer may keep mapped at once, across all workers
+#define HEIGHT_IMPORT_MEMORY_BUDGET (512 * 1024 * 1024)
+
+// Decoded tiles of a compressed pyramid kept around for the next reads
+#define HEIGHT_PYRAMID_TILE_CACHE 32
+
+enum RawHeightFormat {
+	RAW_HEIGHT_UINT16,
+	RAW_HEIGHT_INT16,
+	RAW_HEIGHT_FLOAT32
+};
+
+// A headerless grid of elevation samples, stored row by row
+struct RawHeightSource {
+	const char* path;
+	unsigned int width;
+	unsigned int height;
+	RawHeightFormat format;
+	bool big_endian;
+	float scale; // Every sample is stored as raw * scale + offset
+	float offset;
+};
+
+// Tiled mip pyramid of a heightfield, stored as 32 bit floats in one file.
+//
+// Level 0 is the full grid, every level after it halves the previous one with
+// a 2x2 box filter, down to the first level that fits in one tile. Each level
+// is a row-major grid of HEIGHT_PYRAMID_TILE_SIZE^2 tiles, the samples past
+// the edge of the level repeating the last row and column.
+//
+// build() never holds more than the memory budget in mapped windows, so grids
+// far larger than memory are imported in one pass over the input. Readers map
+// only the tiles they touch.
+//
+// compress() turns a pyramid into one whose tiles are encoded with
+// HeightCodec, listed in an index after the header. read() works the same on
+// both, decoding the tiles of compressed ones and keeping the last few, which
+// costs less than reading their raw floats from disk.
+class HeightPyramid {
+	public:
+		HeightPyramid();
+
+		// Converts source into a pyramid at path on the threads of jobs, fewer if
+		// the budget can't hold one tile row for each at once
+		static bool build(const RawHeightSource &source, const char* path, JobSystem &jobs,
+			size_t memory_budget = HEIGHT_IMPORT_MEMORY_BUDGET);
+
+		// Encodes the pyramid at source_path into a compressed one at path, every
+		// sample within max_error of the original, or exactly for 0
+		static bool compress(const char* source_path, const char* path, JobSystem &jobs, float max_error = 0.0f);
+
+		bool open(const char* path);
+		void close();
+
+		// Maps one tile of a level, tile_size^2 floats row by row. Compressed
+		// pyramids have no such tiles to map
+		bool map_tile(unsigned int level, unsigned int tile_x, unsigned int tile_y, MappedView &view) const;
+
+		// Copies a width x height window of a level starting at (x, y) into out,
+		// clamping samples outside the level to its edges
+		bool read(unsigned int level, int x, int y, unsigned int width, unsigned int height, float* out) const;
+
+		inline bool is_open() const { return file.is_open(); }
+		inline bool is_compressed() const { return header.magic == PACKED_MAGIC; }
+		inline unsigned int get_level_count() const { return header.level_count; }
+		inline unsigned int get_tile_size() const { return header.tile_size; }
+		inline unsigned int get_width(unsigned int level = 0) const { return header.levels[level].width; }
+		inline unsigned int get_height(unsigned int level = 0) const { return header.levels[level].height; }
+		inline unsigned int get_tiles_x(unsigned int level) const { return tile_count(header.levels[level].width); }
+		inline unsigned int get_tiles_y(unsigned int level) const { return tile_count(header.levels[level].height); }
+
+	private:
+		static const uint32_t MAGIC = 0x52595048; // "HPYR"
+		static const uint32_t PACKED_MAGIC = 0x43595048; // "HPYC"
+		static const uint32_t VERSION = 1;
+
+		struct Level {
+			uint32_t width;
+			uint32_t height;
+			uint64_t offset; // Byte offset of the level's first tile
+		};
+
+		struct Header {
+			uint32_t magic;
+			uint32_t version;
+			uint32_t tile_size;
+			uint32_t level_count;
+			Level levels[HEIGHT_PYRAMID_MAX_LEVELS];
+		};
+
+		// Where a tile of a compressed pyramid is. The index follows the header,
+		// and each level's offset points at its first entry
+		struct TileEntry {
+			uint64_t offset;
+			uint32_t size;
+			uint32_t unused;
+		};
+
+		struct CachedTile {
+			uint64_t key;
+			unsigned long long used; // cache_clock when last read
+			std::shared_ptr<const std::vector<float>> samples;
+		};
+
+		MappedFile file;
+		Header header;
+		MappedView index;
+
+		mutable std::mutex cache_lock;
+		mutable std::vector<CachedTile> cache;
+		mutable unsigned long long cache_clock;
+
+		inline unsigned int tile_count(unsigned int samples) const {
+			return (samples + header.tile_size - 1) / header.tile_size;
+		}
+		inline size_t tile_bytes() const {
+			return (size_t)header.tile_size * header.tile_size * sizeof(float);
+		}
+		uint64_t tile_offset(unsigned int level, unsigned int tile_x, unsigned int tile_y) const;
+
+		const float* load_tile(unsigned int level, unsigned int tile_x, unsigned int tile_y, MappedView &view,
+			std::shared_ptr<const std::vector<float>> &decoded) const;
+
+		static void plan_levels(Header &header, unsigned int width, unsigned int height, uint64_t &file_size);
+		static void plan_index(Header &header, uint64_t &index_end);
+		bool convert_band(const MappedFile &input, const RawHeightSource &source, unsigned int tile_y) const;
+		bool downsample_band(unsigned int level, unsigned int tile_y) const;
+		static bool run_bands(const HeightPyramid &pyramid, unsigned int level, const RawHeightSource* source,
+			const MappedFile* input, JobSystem &jobs, unsigned int lanes);
+};
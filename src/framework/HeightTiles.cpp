@@ -0,0 +1,71 @@
+#include "HeightTiles.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+HeightTiles::HeightTiles() : width(0), height(0), tiles_across(0), tiles_down(0) {
+
+}
+
+HeightTiles::HeightTiles(int width, int height) : width(width), height(height),
+	tiles_across((width + HEIGHT_TILE_SIZE - 1) / HEIGHT_TILE_SIZE),
+	tiles_down((height + HEIGHT_TILE_SIZE - 1) / HEIGHT_TILE_SIZE) {
+	std::shared_ptr<HeightTile> zeros = std::make_shared<HeightTile>();
+	memset(zeros->heights, 0, sizeof(zeros->heights));
+	tiles.assign(tiles_across * tiles_down, zeros);
+}
+
+void HeightTiles::read(const TexelRect &rect, float* out) const {
+	int rect_width = rect.column1 - rect.column0;
+	for(int row = rect.row0; row < rect.row1; row++) {
+		float* line = out + (row - rect.row0) * rect_width;
+		int in_tile = (row & (HEIGHT_TILE_SIZE - 1)) << HEIGHT_TILE_SHIFT;
+		// A run of the row per tile it crosses
+		for(int column = rect.column0; column < rect.column1;) {
+			int end = std::min(rect.column1, (column | (HEIGHT_TILE_SIZE - 1)) + 1);
+			const HeightTile* tile = tiles[(row >> HEIGHT_TILE_SHIFT) * tiles_across + (column >> HEIGHT_TILE_SHIFT)].get();
+			memcpy(line + column - rect.column0, &tile->heights[in_tile + (column & (HEIGHT_TILE_SIZE - 1))],
+				(end - column) * sizeof(float));
+			column = end;
+		}
+	}
+}
+
+void HeightTiles::write(const TexelRect &rect, const float* in) {
+	int rect_width = rect.column1 - rect.column0;
+	for(int row = rect.row0; row < rect.row1; row++) {
+		const float* line = in + (row - rect.row0) * rect_width;
+		int in_tile = (row & (HEIGHT_TILE_SIZE - 1)) << HEIGHT_TILE_SHIFT;
+		for(int column = rect.column0; column < rect.column1;) {
+			int end = std::min(rect.column1, (column | (HEIGHT_TILE_SIZE - 1)) + 1);
+			float* heights = edit_tile((row >> HEIGHT_TILE_SHIFT) * tiles_across + (column >> HEIGHT_TILE_SHIFT));
+			memcpy(&heights[in_tile + (column & (HEIGHT_TILE_SIZE - 1))], line + column - rect.column0,
+				(end - column) * sizeof(float));
+			column = end;
+		}
+	}
+}
+
+float* HeightTiles::edit_tile(int index) {
+	// Only this map holds it when the count is 1, so nothing can start sharing
+	// it behind our back. A copy let go of on another thread at worst costs
+	// an extra copy here. use_count() is a relaxed load, the fence orders that
+	// thread's reads of the tile, done before it let go, ahead of our writes
+	std::shared_ptr<HeightTile> &tile = tiles[index];
+	if(tile.use_count() > 1)
+		tile = std::make_shared<HeightTile>(*tile);
+	else
+		std::atomic_thread_fence(std::memory_order_acquire);
+	return tile->heights;
+}
+
+TexelRect HeightTiles::get_tile_rect(int index) const {
+	int column0 = index % tiles_across * HEIGHT_TILE_SIZE;
+	int row0 = index / tiles_across * HEIGHT_TILE_SIZE;
+	TexelRect rect = {
+		column0, row0,
+		std::min(width, column0 + HEIGHT_TILE_SIZE), std::min(height, row0 + HEIGHT_TILE_SIZE)
+	};
+	return rect;
+}
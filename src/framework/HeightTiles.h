@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+// Side of the square tiles height maps are stored in, as a power of two.
+// 64 makes a tile 16 KB of floats
+#define HEIGHT_TILE_SHIFT 6
+#define HEIGHT_TILE_SIZE (1 << HEIGHT_TILE_SHIFT)
+
+// A rectangle of texels, column1 and row1 excluded
+struct TexelRect {
+	int column0, row0;
+	int column1, row1;
+
+	inline bool is_empty() const { return column0 >= column1 || row0 >= row1; }
+};
+
+struct HeightTile {
+	float heights[HEIGHT_TILE_SIZE * HEIGHT_TILE_SIZE]; // Rows of HEIGHT_TILE_SIZE
+};
+
+// A height map stored as square tiles that are shared until written.
+//
+// Copying a HeightTiles copies a pointer per tile rather than the heights,
+// so a copy is a snapshot that stays as it was however the original is
+// edited afterwards: writing to a tile anything else still shares first
+// gives the writer a tile of its own. What a snapshot keeps alive is only
+// the tiles written since, which lets undo history, or variants kept for
+// comparing, cost the area they changed rather than the whole map. A new
+// map starts out with every tile sharing one tile of zeros.
+//
+// Tiles on the right and bottom edges are padded out to the full size, the
+// padding is never read. Not thread safe, but a copy can be handed to
+// another thread: the tiles it shares aren't written while it holds them,
+// and writes after it lets go are ordered after its reads.
+class HeightTiles {
+	public:
+		HeightTiles();
+		HeightTiles(int width, int height);
+
+		inline float get(int column, int row) const {
+			return tiles[(row >> HEIGHT_TILE_SHIFT) * tiles_across + (column >> HEIGHT_TILE_SHIFT)]
+				->heights[((row & (HEIGHT_TILE_SIZE - 1)) << HEIGHT_TILE_SHIFT) + (column & (HEIGHT_TILE_SIZE - 1))];
+		}
+
+		// Copies the heights in rect out to rows of packed floats, and back
+		void read(const TexelRect &rect, float* out) const;
+		void write(const TexelRect &rect, const float* in);
+
+		// The heights of a tile to write to, rows of HEIGHT_TILE_SIZE. A shared
+		// tile is copied first, so the pointer is only good until the tile is
+		// shared again
+		float* edit_tile(int index);
+
+		// Shares a tile with the caller, who mustn't write to it
+		inline std::shared_ptr<HeightTile> get_tile(int index) const { return tiles[index]; }
+
+		// Puts tile in place of the one at index, which is handed back in tile
+		inline void swap_tile(int index, std::shared_ptr<HeightTile> &tile) { tiles[index].swap(tile); }
+
+		// The texels of a tile that are on the map
+		TexelRect get_tile_rect(int index) const;
+
+		inline int get_width() const { return width; }
+		inline int get_height() const { return height; }
+		inline int get_tiles_across() const { return tiles_across; }
+		inline int get_tiles_down() const { return tiles_down; }
+		inline int get_tile_count() const { return (int)tiles.size(); }
+
+	private:
+		int width, height;
+		int tiles_across, tiles_down;
+		std::vector<std::shared_ptr<HeightTile>> tiles; // Row by row
+};
@@ -0,0 +1,193 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+struct Job {
+	std::function<void()> work;
+	JobPriority priority;
+	std::atomic<int> blockers; // Unfinished dependencies, plus one until submit() is done with it
+	std::atomic<bool> finished;
+	std::mutex lock; // Guards dependents, and finished going true
+	std::vector<JobHandle> dependents;
+};
+
+namespace {
+	// Which pool the calling thread works for, if any, and its index there
+	thread_local const JobSystem* t_system = NULL;
+	thread_local int t_worker = -1;
+}
+
+JobSystem::JobSystem(unsigned int workers) : queued(0), next_victim(0), waiting(0), stopping(false) {
+	if(workers == 0) {
+		unsigned int cores = std::thread::hardware_concurrency();
+		workers = cores > 1 ? cores - 1 : 1;
+	}
+
+	for(unsigned int i = 0; i <= workers; i++)
+		this->workers.push_back(std::unique_ptr<Worker>(new Worker()));
+	for(unsigned int i = 0; i < workers; i++)
+		threads.push_back(std::thread(&JobSystem::worker, this, (int)i));
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> guard(sleep_lock);
+		stopping = true;
+	}
+	work_ready.notify_all();
+	for(size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+JobHandle JobSystem::submit(std::function<void()> work, JobPriority priority, const std::vector<JobHandle> &dependencies) {
+	JobHandle job = std::make_shared<Job>();
+	job->work = std::move(work);
+	job->priority = priority;
+	job->blockers = 1;
+	job->finished = false;
+
+	for(size_t i = 0; i < dependencies.size(); i++) {
+		Job &dependency = *dependencies[i];
+		std::lock_guard<std::mutex> guard(dependency.lock);
+		if(!dependency.finished) {
+			job->blockers++;
+			dependency.dependents.push_back(job);
+		}
+	}
+
+	// The last dependency to finish queues the job, unless they all already have
+	if(--job->blockers == 0)
+		enqueue(job);
+	return job;
+}
+
+void JobSystem::wait(const JobHandle &job) {
+	while(!job->finished) {
+		JobHandle next = take(current_worker());
+		if(next) {
+			run(next);
+			continue;
+		}
+
+		// Nothing to help with: whatever job waits on is running somewhere
+		std::unique_lock<std::mutex> guard(sleep_lock);
+		if(job->finished)
+			break;
+		waiting++;
+		job_done.wait(guard);
+		waiting--;
+	}
+}
+
+bool JobSystem::is_finished(const JobHandle &job) const {
+	return job->finished;
+}
+
+void JobSystem::parallel_for(int count, int batch, const std::function<void(int, int)> &work, JobPriority priority) {
+	if(count <= 0)
+		return;
+	batch = std::max(batch, 1);
+
+	// The calling thread takes the first range itself
+	std::vector<JobHandle> jobs;
+	for(int begin = batch; begin < count; begin += batch) {
+		int end = std::min(begin + batch, count);
+		jobs.push_back(submit([&work, begin, end]() { work(begin, end); }, priority));
+	}
+	work(0, std::min(batch, count));
+
+	for(size_t i = 0; i < jobs.size(); i++)
+		wait(jobs[i]);
+}
+
+int JobSystem::current_worker() const {
+	return t_system == this ? t_worker : -1;
+}
+
+void JobSystem::enqueue(const JobHandle &job) {
+	int self = current_worker();
+	Worker &target = *workers[self >= 0 ? self : workers.size() - 1];
+	{
+		std::lock_guard<std::mutex> guard(target.lock);
+		target.jobs[job->priority].push_back(job);
+	}
+	queued++;
+
+	// Taking the lock keeps a worker from missing this between its check and its wait
+	{
+		std::lock_guard<std::mutex> guard(sleep_lock);
+	}
+	work_ready.notify_one();
+}
+
+JobHandle JobSystem::take(int self) {
+	const int shared = (int)workers.size() - 1;
+	for(int priority = 0; priority < JOB_PRIORITY_COUNT; priority++) {
+		// Own jobs newest first, while they are still in cache
+		if(self >= 0) {
+			Worker &own = *workers[self];
+			std::lock_guard<std::mutex> guard(own.lock);
+			if(!own.jobs[priority].empty()) {
+				JobHandle job = own.jobs[priority].back();
+				own.jobs[priority].pop_back();
+				queued--;
+				return job;
+			}
+		}
+
+		// Then everyone else's oldest, starting from a different victim each time
+		unsigned int start = next_victim++;
+		for(int i = 0; i <= shared; i++) {
+			int victim = (int)((start + i) % (shared + 1));
+			if(victim == self)
+				continue;
+			Worker &other = *workers[victim];
+			std::lock_guard<std::mutex> guard(other.lock);
+			if(!other.jobs[priority].empty()) {
+				JobHandle job = other.jobs[priority].front();
+				other.jobs[priority].pop_front();
+				queued--;
+				return job;
+			}
+		}
+	}
+	return JobHandle();
+}
+
+void JobSystem::run(const JobHandle &job) {
+	job->work();
+	job->work = nullptr; // Releases whatever the job captured
+
+	std::vector<JobHandle> dependents;
+	{
+		std::lock_guard<std::mutex> guard(job->lock);
+		job->finished = true;
+		dependents.swap(job->dependents);
+	}
+	for(size_t i = 0; i < dependents.size(); i++) {
+		if(--dependents[i]->blockers == 0)
+			enqueue(dependents[i]);
+	}
+
+	std::lock_guard<std::mutex> guard(sleep_lock);
+	if(waiting > 0)
+		job_done.notify_all();
+}
+
+void JobSystem::worker(int index) {
+	t_system = this;
+	t_worker = index;
+
+	for(;;) {
+		JobHandle job = take(index);
+		if(job) {
+			run(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(sleep_lock);
+		work_ready.wait(guard, [this] { return stopping || queued > 0; });
+		if(stopping)
+			return;
+	}
+}
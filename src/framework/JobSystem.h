@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../utils/noiseutils.h"
+
+// Jobs of a higher priority are always taken before lower ones that are ready
+enum JobPriority {
+	JOB_PRIORITY_HIGH,
+	JOB_PRIORITY_NORMAL,
+	JOB_PRIORITY_LOW,
+	JOB_PRIORITY_COUNT
+};
+
+// Defined in JobSystem.cpp
+struct Job;
+typedef std::shared_ptr<Job> JobHandle;
+
+// One pool of worker threads shared by everything that runs in the background:
+// noise tile builds, normal and light map baking, meshing and image decoding.
+// Subsystems submit jobs here instead of starting threads of their own, so the
+// machine is never oversubscribed however many of them are busy.
+//
+// Every worker has its own deque per priority. Jobs submitted from a worker go
+// to the back of its deque and it takes them back from there, while idle
+// workers steal from the front of the others', so a job splitting itself up
+// keeps its pieces on the same core unless someone has nothing to do. Jobs
+// from other threads go to a shared deque that every worker takes from.
+//
+// A job may depend on others, and is only queued once all of them finished.
+// Waiting on a job runs other jobs in the meantime, so jobs can wait on the
+// jobs they submit without tying up a worker.
+class JobSystem {
+	public:
+		// workers = 0 uses one thread per core but one, the thread calling wait()
+		// being the last
+		JobSystem(unsigned int workers = 0);
+		~JobSystem();
+
+		// Runs work on some worker once every job in dependencies has finished.
+		// Safe from any thread, including from inside a job
+		JobHandle submit(std::function<void()> work, JobPriority priority = JOB_PRIORITY_NORMAL,
+			const std::vector<JobHandle> &dependencies = std::vector<JobHandle>());
+
+		// Returns once job has finished, running queued jobs meanwhile
+		void wait(const JobHandle &job);
+		bool is_finished(const JobHandle &job) const;
+
+		// Calls work(begin, end) over [0, count) in ranges of batch items, on the
+		// calling thread and the workers, and returns once all of them returned
+		void parallel_for(int count, int batch, const std::function<void(int, int)> &work,
+			JobPriority priority = JOB_PRIORITY_NORMAL);
+
+		inline unsigned int get_worker_count() const { return (unsigned int)threads.size(); }
+
+	private:
+		struct Worker {
+			std::mutex lock;
+			std::deque<JobHandle> jobs[JOB_PRIORITY_COUNT];
+		};
+
+		// One per thread, and a last one for jobs submitted from outside the pool
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::vector<std::thread> threads;
+		std::atomic<int> queued; // Jobs sitting in any deque
+		std::atomic<unsigned int> next_victim;
+
+		std::mutex sleep_lock;
+		std::condition_variable work_ready; // Signalled when a job is queued
+		std::condition_variable job_done; // Signalled when a job finishes, for wait()
+		int waiting; // Threads blocked in wait()
+		bool stopping;
+
+		int current_worker() const;
+		void enqueue(const JobHandle &job);
+		JobHandle take(int self);
+		void run(const JobHandle &job);
+		void worker(int index);
+};
+
+// Hands the tasks of libnoise builders and renderers to a JobSystem
+class JobTaskRunner : public noise::utils::TaskRunner {
+	public:
+		JobTaskRunner(JobSystem &jobs, JobPriority priority = JOB_PRIORITY_NORMAL) : jobs(jobs), priority(priority) {}
+
+		virtual void Run(int count, const std::function<void(int)> &task) {
+			jobs.parallel_for(count, 1, [&task](int begin, int end) {
+				for(int i = begin; i < end; i++)
+					task(i);
+			}, priority);
+		}
+
+	private:
+		JobSystem &jobs;
+		JobPriority priority;
+};
@@ -0,0 +1,217 @@
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	size_t query_granularity() {
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwAllocationGranularity;
+#else
+		return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	}
+}
+
+MappedView::MappedView() : base(NULL), delta(0), length(0) {
+
+}
+
+MappedView::~MappedView() {
+	release();
+}
+
+MappedView::MappedView(MappedView &&other) : base(other.base), delta(other.delta), length(other.length) {
+	other.base = NULL;
+	other.delta = 0;
+	other.length = 0;
+}
+
+MappedView &MappedView::operator=(MappedView &&other) {
+	if(this != &other) {
+		release();
+		base = other.base;
+		delta = other.delta;
+		length = other.length;
+		other.base = NULL;
+		other.delta = 0;
+		other.length = 0;
+	}
+	return *this;
+}
+
+void MappedView::flush() {
+	if(!base)
+		return;
+#ifdef _WIN32
+	FlushViewOfFile(base, delta + length);
+#else
+	msync(base, delta + length, MS_ASYNC);
+#endif
+}
+
+void MappedView::release() {
+	if(!base)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(base);
+#else
+	munmap(base, delta + length);
+#endif
+	base = NULL;
+	delta = 0;
+	length = 0;
+}
+
+#ifdef _WIN32
+MappedFile::MappedFile() : file(INVALID_HANDLE_VALUE), mapping(NULL), file_size(0), writable(false), opened(false) {
+
+}
+#else
+MappedFile::MappedFile() : file(-1), file_size(0), writable(false), opened(false) {
+
+}
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const char* path, bool writable) {
+	close();
+	this->writable = writable;
+
+#ifdef _WIN32
+	file = CreateFileA(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(file, &size)) {
+		close();
+		return false;
+	}
+	file_size = (uint64_t)size.QuadPart;
+#else
+	file = ::open(path, writable ? O_RDWR : O_RDONLY);
+	if(file < 0)
+		return false;
+
+	struct stat info;
+	if(fstat(file, &info) != 0) {
+		close();
+		return false;
+	}
+	file_size = (uint64_t)info.st_size;
+#endif
+
+	if(!open_mapping()) {
+		close();
+		return false;
+	}
+	opened = true;
+	return true;
+}
+
+bool MappedFile::create(const char* path, uint64_t size) {
+	close();
+	writable = true;
+
+#ifdef _WIN32
+	file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER end;
+	end.QuadPart = (LONGLONG)size;
+	if(!SetFilePointerEx(file, end, NULL, FILE_BEGIN) || !SetEndOfFile(file)) {
+		close();
+		return false;
+	}
+#else
+	file = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(file < 0)
+		return false;
+
+	if(ftruncate(file, (off_t)size) != 0) {
+		close();
+		return false;
+	}
+#endif
+	file_size = size;
+
+	if(!open_mapping()) {
+		close();
+		return false;
+	}
+	opened = true;
+	return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+	if(mapping)
+		CloseHandle(mapping);
+	if(file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if(file >= 0)
+		::close(file);
+	file = -1;
+#endif
+	file_size = 0;
+	opened = false;
+}
+
+bool MappedFile::map(uint64_t offset, size_t size, MappedView &view) const {
+	view.release();
+	if(!opened || size == 0 || offset + size > file_size)
+		return false;
+
+	// Mappings have to start on the granularity, so map from the boundary below
+	uint64_t aligned = offset / get_granularity() * get_granularity();
+	size_t delta = (size_t)(offset - aligned);
+
+#ifdef _WIN32
+	void* base = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+		(DWORD)(aligned >> 32), (DWORD)(aligned & 0xffffffff), delta + size);
+	if(!base)
+		return false;
+#else
+	void* base = mmap(NULL, delta + size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, (off_t)aligned);
+	if(base == MAP_FAILED)
+		return false;
+#endif
+
+	view.base = (char*)base;
+	view.delta = delta;
+	view.length = size;
+	return true;
+}
+
+size_t MappedFile::get_granularity() {
+	// Initialized once no matter which thread maps first
+	static const size_t granularity = query_granularity();
+	return granularity;
+}
+
+bool MappedFile::open_mapping() {
+#ifdef _WIN32
+	// Windows can't create a mapping of an empty file, and there is nothing to map anyway
+	if(file_size == 0)
+		return true;
+	mapping = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+	return mapping != NULL;
+#else
+	return true;
+#endif
+}
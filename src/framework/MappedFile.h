@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+// A window of a MappedFile. Unmaps itself when destroyed, so only the windows
+// currently in use take up address space, even in 32 bit builds.
+class MappedView {
+	public:
+		MappedView();
+		~MappedView();
+
+		MappedView(MappedView &&other);
+		MappedView &operator=(MappedView &&other);
+
+		// Starts writing dirty pages back without waiting for them, so written
+		// windows don't pile up in memory
+		void flush();
+		void release();
+
+		inline char* data() const { return base ? base + delta : NULL; }
+		inline size_t size() const { return length; }
+
+	private:
+		friend class MappedFile;
+
+		char* base; // Start of the mapping, rounded down to the allocation granularity
+		size_t delta; // Offset of the requested window inside the mapping
+		size_t length;
+
+		MappedView(const MappedView&);
+		MappedView &operator=(const MappedView&);
+};
+
+// A file accessed through memory-mapped windows instead of read/write calls.
+// Windows can be mapped from any number of threads at once.
+class MappedFile {
+	public:
+		MappedFile();
+		~MappedFile();
+
+		bool open(const char* path, bool writable = false);
+
+		// Creates or truncates path to size bytes, opened for writing
+		bool create(const char* path, uint64_t size);
+		void close();
+
+		// Maps size bytes starting at offset. offset needs no alignment
+		bool map(uint64_t offset, size_t size, MappedView &view) const;
+
+		inline bool is_open() const { return opened; }
+		inline uint64_t get_size() const { return file_size; }
+
+		// Alignment of the offsets the OS can map at
+		static size_t get_granularity();
+
+	private:
+#ifdef _WIN32
+		HANDLE file;
+		HANDLE mapping;
+#else
+		int file;
+#endif
+		uint64_t file_size;
+		bool writable;
+		bool opened;
+
+		bool open_mapping();
+
+		MappedFile(const MappedFile&);
+		MappedFile &operator=(const MappedFile&);
+};
@@ -0,0 +1,122 @@
+#include "MappedImage.h"
+
+#include <cstring>
+
+namespace {
+	// BMP fields are little-endian, read byte by byte so alignment doesn't matter
+	uint32_t read_u32(const char* bytes) {
+		const unsigned char* b = (const unsigned char*)bytes;
+		return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+	}
+
+	uint16_t read_u16(const char* bytes) {
+		const unsigned char* b = (const unsigned char*)bytes;
+		return (uint16_t)(b[0] | (b[1] << 8));
+	}
+
+	// File header, then the size field every info header starts with
+	const size_t BMP_FILE_HEADER = 14;
+	const size_t BMP_INFO_HEADER = 40; // BITMAPINFOHEADER, which the V4 and V5 headers extend
+	const uint32_t BMP_RGB = 0; // Uncompressed
+	const uint32_t BMP_BITFIELDS = 3; // Uncompressed with channel masks, only the default BGRA ones are mapped
+
+	// Smallest page size of the platforms we run on
+	const size_t PAGE_SIZE = 4096;
+}
+
+MappedImage::MappedImage() : width(0), height(0), components(0), stride(0), bgr(false), top_down(true) {
+
+}
+
+bool MappedImage::open_bmp(const char* path) {
+	close();
+	if(!file.open(path))
+		return false;
+
+	MappedView header;
+	if(file.get_size() < BMP_FILE_HEADER + BMP_INFO_HEADER || !file.map(0, BMP_FILE_HEADER + BMP_INFO_HEADER, header)) {
+		close();
+		return false;
+	}
+	const char* h = header.data();
+	const char* info = h + BMP_FILE_HEADER;
+	uint32_t info_size = read_u32(info);
+	int32_t signed_height = (int32_t)read_u32(info + 8);
+	uint16_t bits = read_u16(info + 14);
+	uint32_t compression = read_u32(info + 16);
+	uint32_t palette_size = read_u32(info + 32);
+	uint64_t data_offset = read_u32(h + 10);
+
+	if(h[0] != 'B' || h[1] != 'M' || info_size < BMP_INFO_HEADER || read_u16(info + 12) != 1
+		|| (compression != BMP_RGB && !(compression == BMP_BITFIELDS && bits == 32))) {
+		close();
+		return false;
+	}
+
+	width = read_u32(info + 4);
+	height = signed_height < 0 ? (unsigned int)-(int64_t)signed_height : (unsigned int)signed_height;
+	top_down = signed_height < 0;
+	bgr = true;
+
+	if(bits == 8) {
+		// Only grey palettes are the identity, anything else needs looking up
+		unsigned int entries = palette_size ? palette_size : 256;
+		MappedView palette;
+		uint64_t palette_offset = BMP_FILE_HEADER + info_size;
+		if(entries > 256 || palette_offset + entries * 4 > data_offset || !file.map(palette_offset, entries * 4, palette)) {
+			close();
+			return false;
+		}
+		const unsigned char* p = (const unsigned char*)palette.data();
+		for(unsigned int i = 0; i < entries; i++) {
+			if(p[i * 4] != i || p[i * 4 + 1] != i || p[i * 4 + 2] != i) {
+				close();
+				return false;
+			}
+		}
+		components = 1;
+	} else if(bits == 24 || bits == 32) {
+		if(compression == BMP_BITFIELDS) {
+			// The masks follow a plain info header, or sit inside the larger ones
+			MappedView masks;
+			if(!file.map(BMP_FILE_HEADER + BMP_INFO_HEADER, 12, masks) || read_u32(masks.data()) != 0x00FF0000
+				|| read_u32(masks.data() + 4) != 0x0000FF00 || read_u32(masks.data() + 8) != 0x000000FF) {
+				close();
+				return false;
+			}
+		}
+		components = bits / 8;
+	} else {
+		close();
+		return false;
+	}
+
+	// Rows are padded to 4 bytes
+	stride = ((size_t)width * components + 3) / 4 * 4;
+	return map_pixels(data_offset);
+}
+
+void MappedImage::close() {
+	view.release();
+	file.close();
+	width = height = components = 0;
+	stride = 0;
+}
+
+void MappedImage::touch() const {
+	const volatile char* data = view.data();
+	char sum = 0;
+	for(size_t i = 0; i < view.size(); i += PAGE_SIZE)
+		sum += data[i];
+	(void)sum;
+}
+
+bool MappedImage::map_pixels(uint64_t offset) {
+	uint64_t size = (uint64_t)stride * height;
+	if(width == 0 || height == 0 || components == 0 || offset + size > file.get_size()
+		|| size != (size_t)size || !file.map(offset, (size_t)size, view)) {
+		close();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "MappedFile.h"
+
+// An uncompressed image read straight out of a memory-mapped file.
+//
+// Nothing is decoded or copied: rows are views into the mapping, in the
+// file's channel order, and the GL upload is left to deal with it. BMPs
+// store blue first, which GL_BGR takes as is, and usually store their rows
+// bottom up, which only costs one upload call per row. Anything compressed,
+// paletted in colour or in another format is left to stb_image.
+class MappedImage {
+	public:
+		MappedImage();
+
+		// Maps an uncompressed 24 or 32 bit BMP, or an 8 bit one with a grey palette
+		bool open_bmp(const char* path);
+
+		void close();
+
+		// Row y counted from the top of the image
+		inline const unsigned char* get_row(unsigned int y) const {
+			return (const unsigned char*)view.data() + (ptrdiff_t)(top_down ? y : height - 1 - y) * stride;
+		}
+
+		// All rows as one block from the top, or NULL if they're stored bottom up
+		inline const unsigned char* get_pixels() const { return top_down ? (const unsigned char*)view.data() : NULL; }
+
+		// Reads a byte of every page, so uploading later doesn't wait on the disk.
+		// Safe off the GL thread
+		void touch() const;
+
+		inline bool is_open() const { return view.data() != NULL; }
+		inline unsigned int get_width() const { return width; }
+		inline unsigned int get_height() const { return height; }
+		inline unsigned int get_components() const { return components; }
+		inline size_t get_stride() const { return stride; }
+		inline bool is_bgr() const { return bgr; } // Blue stored first, as in BMPs
+		inline bool is_top_down() const { return top_down; }
+
+	private:
+		MappedFile file;
+		MappedView view; // The pixel rows only
+		unsigned int width, height;
+		unsigned int components;
+		size_t stride; // Bytes from one row to the next, padding included
+		bool bgr;
+		bool top_down;
+
+		bool map_pixels(uint64_t offset);
+
+		MappedImage(const MappedImage&);
+		MappedImage &operator=(const MappedImage&);
+};
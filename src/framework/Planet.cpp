@@ -0,0 +1,465 @@
+#include "Planet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstddef>
+#include <cstring>
+#include "../modules/lod.h"
+
+using namespace noise;
+
+// Noise values of the terrain graph stay well inside this multiple of height_scale
+#define PLANET_HEIGHT_MARGIN 2.0f
+
+// Depth of the skirts, as a fraction of the chunk's edge length
+#define PLANET_SKIRT_DEPTH 0.05f
+
+// Plans the simulation can hand over between two frames. Past that it keeps
+// the released chunks for a later plan, which only happens while a frame stalls
+#define PLANET_PLAN_QUEUE_SIZE 8
+
+namespace {
+	glm::vec3 sphere_point(utils::CubeFace face, double u, double v) {
+		double x, y, z;
+		utils::NoiseMapBuilderCubeSphere::GetSpherePoint(face, u, v, x, y, z);
+		return glm::vec3((float)x, (float)y, (float)z);
+	}
+}
+
+Planet::Planet(const module::Module &module, float radius, float height_scale, double noise_scale,
+	UploadRing &uploads, JobSystem &jobs) : radius(radius), height_scale(height_scale), noise_scale(noise_scale),
+	uploads(uploads), scheduler(jobs), chunk_count(0), drawn_count(0), prefetch_budget(0), built_count(0),
+	plans(PLANET_PLAN_QUEUE_SIZE), finished(scheduler.get_max_in_flight() * 2), unclaimed(0) {
+	scaled_module.SetSourceModule(0, module);
+	scaled_module.SetScale(noise_scale);
+
+	build_indices();
+
+	for(int face = 0; face < utils::CUBE_FACE_COUNT; face++)
+		roots[face] = create_chunk((utils::CubeFace)face, 0, -1.0, 1.0, -1.0, 1.0);
+}
+
+Planet::~Planet() {
+	// Cancels every build first, so the ones still queued return right away
+	for(int face = 0; face < utils::CUBE_FACE_COUNT; face++)
+		destroy_chunk(roots[face]);
+	scheduler.clear();
+
+	// Every buffer left is in a chunk released by now, handed over or not
+	std::shared_ptr<Plan> plan;
+	while(plans.pop(plan))
+		release(plan->released);
+	release(released);
+
+	glDeleteBuffers(1, &ibo);
+	glDeleteVertexArrays(1, &vao);
+}
+
+void Planet::plan(const glm::vec3 &camera_position, const glm::mat4 &view_projection, const Prefetcher* prefetcher) {
+	// Frustum planes as (normal, distance), inside when dot(normal, p) + distance >= 0
+	glm::vec4 planes[6];
+	for(int i = 0; i < 3; i++) {
+		glm::vec4 row(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+		glm::vec4 w(view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3]);
+		planes[i * 2] = w + row;
+		planes[i * 2 + 1] = w - row;
+	}
+
+	path.clear();
+	prefetch_budget = 0;
+	if(prefetcher) {
+		path = prefetcher->get_path();
+		prefetch_budget = prefetcher->get_budget(scheduler.get_throughput());
+	}
+
+	draw_list.clear();
+	for(int face = 0; face < utils::CUBE_FACE_COUNT; face++)
+		select(roots[face], camera_position, planes);
+	drawn_count = draw_list.size();
+
+	// Chunks merged away this tick are already cancelled, the rest are
+	// reordered. New builds only start while their results fit in finished
+	// next to the ones the GL thread hasn't taken yet
+	if(unclaimed.load() + scheduler.get_max_in_flight() <= finished.get_capacity())
+		scheduler.update(camera_position, view_projection);
+
+	publish();
+}
+
+void Planet::upload() {
+	// Every plan is taken for the chunks it released, only the newest is drawn
+	std::shared_ptr<Plan> plan;
+	while(plans.pop(plan)) {
+		release(plan->released);
+		shown = plan;
+	}
+
+	std::shared_ptr<ChunkJob> built;
+	while(finished.pop(built)) {
+		pending_uploads.push_back(std::move(built));
+		unclaimed--;
+	}
+
+	size_t kept = 0;
+	for(size_t i = 0; i < pending_uploads.size(); i++) {
+		std::shared_ptr<ChunkJob> job = pending_uploads[i];
+		if(job->cancelled)
+			continue;
+		if(!uploads.has_frame_budget()) {
+			// Out of time or bytes for this frame, the rest waits for the next one
+			pending_uploads[kept++] = job;
+			continue;
+		}
+
+		size_t size = job->vertices.size() * sizeof(PlanetVertex);
+		UploadAllocation allocation;
+		if(!uploads.allocate(size, sizeof(float), allocation)) {
+			// The ring is full, try again after the next flush
+			pending_uploads[kept++] = job;
+			continue;
+		}
+		memcpy(allocation.ptr, job->vertices.data(), size);
+
+		glGenBuffers(1, &job->vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, job->vbo);
+		glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		uploads.submit_buffer_copy(allocation, job->vbo, 0);
+
+		// The chunk keeps the job, but not the vertices now in the ring. Plans
+		// list it from the next tick on, after this frame's flush
+		job->vertices = std::vector<PlanetVertex>();
+		job->uploaded = true;
+		built_count++;
+	}
+	pending_uploads.resize(kept);
+}
+
+void Planet::draw() {
+	if(!shown)
+		return;
+
+	const std::vector<std::shared_ptr<ChunkJob>> &chunks = shown->draw_list;
+	glBindVertexArray(vao);
+	for(size_t i = 0; i < chunks.size(); i++) {
+		glBindBuffer(GL_ARRAY_BUFFER, chunks[i]->vbo);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PlanetVertex), (void*)offsetof(PlanetVertex, position));
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(PlanetVertex), (void*)offsetof(PlanetVertex, normal));
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(PlanetVertex), (void*)offsetof(PlanetVertex, tex_coords));
+		glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_SHORT, 0);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+Planet::Chunk* Planet::create_chunk(utils::CubeFace face, int level, double lower_u, double upper_u,
+	double lower_v, double upper_v) {
+	Chunk* chunk = new Chunk();
+	chunk->face = face;
+	chunk->level = level;
+	chunk->lower_u = lower_u;
+	chunk->upper_u = upper_u;
+	chunk->lower_v = lower_v;
+	chunk->upper_v = upper_v;
+	for(int i = 0; i < 4; i++)
+		chunk->children[i] = NULL;
+
+	double middle_u = (lower_u + upper_u) * 0.5;
+	double middle_v = (lower_v + upper_v) * 0.5;
+	chunk->direction = sphere_point(face, middle_u, middle_v);
+	chunk->center = chunk->direction * radius;
+
+	// Corners and edge midpoints bound the chunk's extent on the sphere
+	const double us[3] = { lower_u, middle_u, upper_u };
+	const double vs[3] = { lower_v, middle_v, upper_v };
+	glm::vec3 points[3][3];
+	float max_chord = 0.0f;
+	float min_cosine = 1.0f;
+	for(int j = 0; j < 3; j++) {
+		for(int i = 0; i < 3; i++) {
+			points[j][i] = sphere_point(face, us[i], vs[j]);
+			max_chord = std::max(max_chord, glm::length(points[j][i] - chunk->direction));
+			min_cosine = std::min(min_cosine, glm::dot(points[j][i], chunk->direction));
+		}
+	}
+	chunk->bound_radius = max_chord * radius + height_scale * PLANET_HEIGHT_MARGIN;
+	chunk->angular_radius = acosf(std::max(-1.0f, std::min(1.0f, min_cosine)));
+	chunk->edge_length = std::max(glm::length(points[0][2] - points[0][0]), glm::length(points[2][0] - points[0][0])) * radius;
+
+	std::shared_ptr<ChunkJob> job = std::make_shared<ChunkJob>();
+	job->face = face;
+	job->lower_u = lower_u;
+	job->upper_u = upper_u;
+	job->lower_v = lower_v;
+	job->upper_v = upper_v;
+	job->spacing = chunk->edge_length / radius * noise_scale / (PLANET_CHUNK_SIZE - 1);
+	job->skirt_depth = chunk->edge_length * PLANET_SKIRT_DEPTH;
+	job->cancelled = false;
+	job->vbo = 0;
+	job->uploaded = false;
+	chunk->job = job;
+
+	scheduler.request(chunk->center, chunk->bound_radius, job->cancelled, [this, job]() { run(job); });
+
+	chunk_count++;
+	return chunk;
+}
+
+void Planet::destroy_chunk(Chunk* chunk) {
+	destroy_children(chunk);
+
+	// The GL thread frees its buffer once it takes the next plan
+	chunk->job->cancelled = true;
+	released.push_back(chunk->job);
+
+	delete chunk;
+	chunk_count--;
+}
+
+void Planet::destroy_children(Chunk* chunk) {
+	for(int i = 0; i < 4; i++) {
+		if(chunk->children[i]) {
+			destroy_chunk(chunk->children[i]);
+			chunk->children[i] = NULL;
+		}
+	}
+}
+
+void Planet::split(Chunk* chunk) {
+	double middle_u = (chunk->lower_u + chunk->upper_u) * 0.5;
+	double middle_v = (chunk->lower_v + chunk->upper_v) * 0.5;
+	int level = chunk->level + 1;
+	chunk->children[0] = create_chunk(chunk->face, level, chunk->lower_u, middle_u, chunk->lower_v, middle_v);
+	chunk->children[1] = create_chunk(chunk->face, level, middle_u, chunk->upper_u, chunk->lower_v, middle_v);
+	chunk->children[2] = create_chunk(chunk->face, level, chunk->lower_u, middle_u, middle_v, chunk->upper_v);
+	chunk->children[3] = create_chunk(chunk->face, level, middle_u, chunk->upper_u, middle_v, chunk->upper_v);
+}
+
+void Planet::select(Chunk* chunk, const glm::vec3 &camera_position, const glm::vec4 (&planes)[6]) {
+	float distance = glm::length(camera_position - chunk->center) - chunk->bound_radius;
+	float ahead = distance_ahead(chunk);
+	float split_distance = PLANET_SPLIT_DISTANCE * chunk->edge_length;
+
+	// Merge far chunks even when they're culled, so looking away still frees
+	// them, but not the ones the camera is heading for
+	if(chunk->children[0] && std::min(distance, ahead) > split_distance * PLANET_MERGE_HYSTERESIS)
+		destroy_children(chunk);
+
+	if(!is_visible(chunk, camera_position, planes)) {
+		prefetch(chunk);
+		return;
+	}
+
+	if(!chunk->children[0] && chunk->level < PLANET_MAX_LEVEL && distance < split_distance)
+		split(chunk);
+
+	// Until every child can be drawn the parent covers their area
+	if(chunk->children[0] && children_uploaded(chunk)) {
+		for(int i = 0; i < 4; i++)
+			select(chunk->children[i], camera_position, planes);
+		return;
+	}
+	prefetch(chunk);
+
+	if(chunk->job->uploaded)
+		draw_list.push_back(chunk->job);
+}
+
+void Planet::prefetch(Chunk* chunk) {
+	if(path.empty())
+		return;
+
+	if(chunk->children[0]) {
+		for(int i = 0; i < 4; i++)
+			prefetch(chunk->children[i]);
+		return;
+	}
+
+	// Splitting queues four requests, so stop while the scheduler is behind
+	float split_distance = PLANET_SPLIT_DISTANCE * chunk->edge_length;
+	if(chunk->level < PLANET_MAX_LEVEL && distance_ahead(chunk) < split_distance
+		&& scheduler.get_outstanding_count() < prefetch_budget)
+		split(chunk);
+}
+
+bool Planet::is_visible(const Chunk* chunk, const glm::vec3 &camera_position, const glm::vec4 (&planes)[6]) const {
+	for(int i = 0; i < 6; i++) {
+		glm::vec3 normal(planes[i]);
+		if(glm::dot(normal, chunk->center) + planes[i].w < -chunk->bound_radius * glm::length(normal))
+			return false;
+	}
+
+	// Horizon culling: a sphere of the lowest possible surface radius hides
+	// everything more than acos(inner / camera) + acos(inner / outer) away
+	// from the point below the camera
+	float inner = radius - height_scale * PLANET_HEIGHT_MARGIN;
+	float outer = radius + height_scale * PLANET_HEIGHT_MARGIN;
+	float camera_distance = glm::length(camera_position);
+	if(inner <= 0.0f || camera_distance <= outer)
+		return true;
+
+	float horizon = acosf(inner / camera_distance) + acosf(inner / outer);
+	float cosine = glm::dot(camera_position / camera_distance, chunk->direction);
+	float angle = acosf(std::max(-1.0f, std::min(1.0f, cosine)));
+	return angle - chunk->angular_radius <= horizon;
+}
+
+float Planet::distance_ahead(const Chunk* chunk) const {
+	float distance = FLT_MAX;
+	for(size_t i = 0; i < path.size(); i++)
+		distance = std::min(distance, glm::length(path[i] - chunk->center) - chunk->bound_radius);
+	return distance;
+}
+
+bool Planet::children_uploaded(const Chunk* chunk) const {
+	for(int i = 0; i < 4; i++) {
+		if(!chunk->children[i]->job->uploaded)
+			return false;
+	}
+	return true;
+}
+
+void Planet::publish() {
+	std::shared_ptr<Plan> plan = std::make_shared<Plan>();
+	plan->draw_list.swap(draw_list);
+	plan->released.swap(released);
+
+	// Rather than wait on a stalled frame, keep the releases for the next plan
+	if(!plans.try_push(plan))
+		released.swap(plan->released);
+}
+
+void Planet::release(std::vector<std::shared_ptr<ChunkJob>> &jobs) {
+	for(size_t i = 0; i < jobs.size(); i++) {
+		if(jobs[i]->vbo) {
+			glDeleteBuffers(1, &jobs[i]->vbo);
+			jobs[i]->vbo = 0;
+		}
+	}
+	jobs.clear();
+}
+
+void Planet::build_indices() {
+	const int n = PLANET_CHUNK_SIZE;
+	std::vector<unsigned short> indices;
+
+	for(int j = 0; j < n - 1; j++) {
+		for(int i = 0; i < n - 1; i++) {
+			unsigned short a = j * n + i;
+			unsigned short b = a + 1;
+			unsigned short c = a + n;
+			unsigned short d = c + 1;
+			indices.push_back(a);
+			indices.push_back(b);
+			indices.push_back(c);
+			indices.push_back(b);
+			indices.push_back(d);
+			indices.push_back(c);
+		}
+	}
+
+	// Skirts follow the grid in the order build() writes them: bottom, top, left and right edge
+	for(int edge = 0; edge < 4; edge++) {
+		for(int k = 0; k < n - 1; k++) {
+			unsigned short grid[2], skirt[2];
+			for(int s = 0; s < 2; s++) {
+				int i = edge < 2 ? k + s : (edge == 2 ? 0 : n - 1);
+				int j = edge < 2 ? (edge == 0 ? 0 : n - 1) : k + s;
+				grid[s] = j * n + i;
+				skirt[s] = n * n + edge * n + k + s;
+			}
+			indices.push_back(grid[0]);
+			indices.push_back(skirt[0]);
+			indices.push_back(grid[1]);
+			indices.push_back(grid[1]);
+			indices.push_back(skirt[0]);
+			indices.push_back(skirt[1]);
+		}
+	}
+	index_count = indices.size();
+
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &ibo);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glBindVertexArray(0);
+}
+
+void Planet::run(const std::shared_ptr<ChunkJob> &job) {
+	if(job->cancelled)
+		return;
+	build(*job);
+	// Counted first, so plan() holds back new builds before the queue fills.
+	// Should it fill anyway, a chunk dropped meanwhile doesn't wait for room
+	unclaimed++;
+	if(!finished.push(job, job->cancelled))
+		unclaimed--;
+}
+
+void Planet::build(ChunkJob &job) const {
+	const int n = PLANET_CHUNK_SIZE;
+	const int bordered = n + 2;
+
+	// One extra sample on every side so the edge normals match the neighbours'.
+	// The bounds are dyadic fractions of the face, so the builder computes every
+	// sample position exactly and neighbouring chunks share their edge samples
+	double du = (job.upper_u - job.lower_u) / (n - 1);
+	double dv = (job.upper_v - job.lower_v) / (n - 1);
+	utils::NoiseMap heights;
+	utils::NoiseMapBuilderCubeSphere builder;
+	builder.SetSourceModule(scaled_module);
+	builder.SetDestNoiseMap(heights);
+	builder.SetDestSize(bordered, bordered);
+	builder.SetFace(job.face);
+	builder.SetBounds(job.lower_u - du, job.upper_u + du, job.lower_v - dv, job.upper_v + dv);
+	builder.SetCallback(TileScheduler::check_cancelled);
+	{
+		module::SampleSpacingScope spacing(job.spacing);
+		builder.Build();
+	}
+
+	std::vector<glm::vec3> directions(bordered * bordered);
+	std::vector<glm::vec3> positions(bordered * bordered);
+	for(int j = 0; j < bordered; j++) {
+		const float* row = heights.GetConstSlabPtr(j);
+		for(int i = 0; i < bordered; i++) {
+			glm::vec3 direction = sphere_point(job.face, job.lower_u + du * (i - 1), job.lower_v + dv * (j - 1));
+			directions[j * bordered + i] = direction;
+			positions[j * bordered + i] = direction * (radius + row[i] * height_scale);
+		}
+	}
+
+	job.vertices.resize(n * n + 4 * n);
+	for(int j = 0; j < n; j++) {
+		for(int i = 0; i < n; i++) {
+			int b = (j + 1) * bordered + (i + 1);
+			glm::vec3 tangent = positions[b + 1] - positions[b - 1];
+			glm::vec3 bitangent = positions[b + bordered] - positions[b - bordered];
+			glm::vec3 normal = glm::normalize(glm::cross(tangent, bitangent));
+
+			PlanetVertex &vertex = job.vertices[j * n + i];
+			memcpy(vertex.position, &positions[b].x, sizeof(vertex.position));
+			memcpy(vertex.normal, &normal.x, sizeof(vertex.normal));
+			vertex.tex_coords[0] = (float)((job.lower_u + du * i + 1.0) * 0.5) * PLANET_TEXTURE_REPEAT;
+			vertex.tex_coords[1] = (float)((job.lower_v + dv * j + 1.0) * 0.5) * PLANET_TEXTURE_REPEAT;
+		}
+	}
+
+	// Skirts: copies of the edge vertices pushed down towards the center
+	for(int edge = 0; edge < 4; edge++) {
+		for(int k = 0; k < n; k++) {
+			int i = edge < 2 ? k : (edge == 2 ? 0 : n - 1);
+			int j = edge < 2 ? (edge == 0 ? 0 : n - 1) : k;
+			PlanetVertex vertex = job.vertices[j * n + i];
+			glm::vec3 drop = directions[(j + 1) * bordered + (i + 1)] * job.skirt_depth;
+			for(int c = 0; c < 3; c++)
+				vertex.position[c] -= drop[c];
+			job.vertices[n * n + edge * n + k] = vertex;
+		}
+	}
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm.hpp>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <noise/noise.h>
+#include "HandoffQueue.h"
+#include "JobSystem.h"
+#include "Prefetcher.h"
+#include "TileScheduler.h"
+#include "UploadRing.h"
+#include "../utils/cubespherebuilder.h"
+
+// Vertices along each edge of a chunk
+#define PLANET_CHUNK_SIZE 33
+
+// Deepest level of the chunk quadtree below each cube face
+#define PLANET_MAX_LEVEL 10
+
+// A chunk splits once the camera is closer than this many chunk edge lengths
+#define PLANET_SPLIT_DISTANCE 2.0f
+
+// Split children are only merged back beyond this multiple of the split distance
+#define PLANET_MERGE_HYSTERESIS 1.25f
+
+// Times the grass texture repeats across one cube face
+#define PLANET_TEXTURE_REPEAT 80.0f
+
+struct PlanetVertex {
+	float position[3];
+	float normal[3];
+	float tex_coords[2];
+};
+
+// Planet rendered as a cube-sphere: each of the six cube faces is the root of
+// a quadtree of chunks, and every chunk is a PLANET_CHUNK_SIZE^2 grid built
+// from the 3D module graph with NoiseMapBuilderCubeSphere.
+//
+// Chunks are generated on the job system, nearest to the camera first, and
+// streamed to the GPU through the UploadRing. Every simulation tick plan()
+// walks the quadtrees from the camera: chunks outside the view frustum or
+// behind the horizon are culled, near chunks split into their four children
+// and far ones merge them again. A parent stays on screen until all four of
+// its children have been uploaded, so the surface never has holes while
+// detail streams in. Chunks of different levels meet with skirts hanging
+// below their edges to hide the cracks.
+//
+// The quadtrees belong to the simulation thread, so walking them never takes
+// time from a frame. Each plan goes to the GL thread through a HandoffQueue,
+// with the chunks to draw and the ones destroyed since the last plan, and the
+// GL thread only creates and frees buffers and queues uploads.
+//
+// Given a Prefetcher, chunks near the path ahead of the camera split as if the
+// camera were already there, visible or not, as long as the scheduler keeps
+// up, and are kept until the camera has passed them.
+class Planet {
+	public:
+		// Samples module on a sphere of radius noise_scale. The surface lies at
+		// radius + value * height_scale
+		Planet(const noise::module::Module &module, float radius, float height_scale, double noise_scale,
+			UploadRing &uploads, JobSystem &jobs);
+		~Planet();
+
+		// Simulation thread only: picks the chunks to draw, queues missing ones
+		// and hands the plan to the GL thread
+		void plan(const glm::vec3 &camera_position, const glm::mat4 &view_projection,
+			const Prefetcher* prefetcher = NULL);
+
+		// GL thread only, before UploadRing::flush(): takes the plans handed
+		// over, frees the buffers of destroyed chunks and uploads those the
+		// workers have finished
+		void upload();
+
+		// GL thread only: draws the chunks of the newest plan. Attributes are
+		// position, normal and texture coordinates at locations 0, 1 and 2
+		void draw();
+
+		inline size_t get_chunk_count() const { return chunk_count; }
+		inline size_t get_drawn_count() const { return drawn_count; }
+		inline size_t get_built_count() const { return built_count; }
+		inline size_t get_cancelled_count() const { return scheduler.get_cancelled_count(); }
+
+	private:
+		// Work handed to the job system, and the buffer it ends up in. The chunk
+		// owns it; destroying the chunk only sets cancelled, since a worker or
+		// the GL thread may still hold a reference
+		struct ChunkJob {
+			noise::utils::CubeFace face;
+			double lower_u, upper_u, lower_v, upper_v;
+			double spacing; // Distance between samples in module coordinates
+			float skirt_depth;
+			std::atomic<bool> cancelled;
+			std::vector<PlanetVertex> vertices;
+			unsigned int vbo; // GL thread only
+			std::atomic<bool> uploaded; // Set by the GL thread once vbo is queued
+		};
+
+		// What the GL thread needs from one plan()
+		struct Plan {
+			std::vector<std::shared_ptr<ChunkJob>> draw_list;
+			std::vector<std::shared_ptr<ChunkJob>> released; // Chunks destroyed since the last plan
+		};
+
+		struct Chunk {
+			noise::utils::CubeFace face;
+			int level;
+			double lower_u, upper_u, lower_v, upper_v;
+			glm::vec3 center; // Center of the bounding sphere
+			float bound_radius;
+			glm::vec3 direction; // Unit vector through the middle of the chunk
+			float angular_radius; // Largest angle between direction and a corner
+			float edge_length;
+			Chunk* children[4];
+			std::shared_ptr<ChunkJob> job;
+		};
+
+		noise::module::ScalePoint scaled_module;
+		float radius;
+		float height_scale;
+		double noise_scale;
+		UploadRing &uploads;
+		TileScheduler scheduler;
+
+		unsigned int vao;
+		unsigned int ibo;
+		unsigned int index_count;
+
+		// Simulation thread only
+		Chunk* roots[noise::utils::CUBE_FACE_COUNT];
+		size_t chunk_count;
+		size_t drawn_count;
+		std::vector<std::shared_ptr<ChunkJob>> draw_list; // Of the current plan()
+		std::vector<std::shared_ptr<ChunkJob>> released; // Not handed over yet, the queue was full
+		std::vector<glm::vec3> path; // Predicted camera path of the current plan()
+		size_t prefetch_budget; // Requests the scheduler may hold before prefetching stops
+
+		// GL thread only
+		std::shared_ptr<Plan> shown; // Newest plan taken, the one drawn
+		std::vector<std::shared_ptr<ChunkJob>> pending_uploads; // Built but not yet in the ring
+		size_t built_count;
+
+		HandoffQueue<std::shared_ptr<Plan>> plans;
+
+		// Built by a worker, not yet taken by the GL thread. Builds are only
+		// started while the ones in it and the ones running fit, so pushing to
+		// it never waits
+		HandoffQueue<std::shared_ptr<ChunkJob>> finished;
+		std::atomic<size_t> unclaimed; // Builds pushed, or about to be, and not popped yet
+
+		Chunk* create_chunk(noise::utils::CubeFace face, int level, double lower_u, double upper_u,
+			double lower_v, double upper_v);
+		void destroy_chunk(Chunk* chunk);
+		void destroy_children(Chunk* chunk);
+		void split(Chunk* chunk);
+
+		void select(Chunk* chunk, const glm::vec3 &camera_position, const glm::vec4 (&planes)[6]);
+		void prefetch(Chunk* chunk);
+		bool is_visible(const Chunk* chunk, const glm::vec3 &camera_position, const glm::vec4 (&planes)[6]) const;
+		float distance_ahead(const Chunk* chunk) const;
+		bool children_uploaded(const Chunk* chunk) const;
+		void publish();
+		void release(std::vector<std::shared_ptr<ChunkJob>> &jobs);
+
+		void build_indices();
+		void run(const std::shared_ptr<ChunkJob> &job);
+		void build(ChunkJob &job) const;
+};
@@ -0,0 +1,38 @@
+#include "Prefetcher.h"
+
+#include <algorithm>
+#include <cmath>
+
+// A frame moving the camera further than this is a jump, not flight
+#define PREFETCH_MAX_SPEED 100000.0f
+
+Prefetcher::Prefetcher() : last_position(0.0f), velocity(0.0f), started(false) {
+}
+
+void Prefetcher::update(const glm::vec3 &position, float delta) {
+	if(!started || delta <= 0.0f) {
+		last_position = position;
+		started = true;
+		return;
+	}
+
+	glm::vec3 measured = (position - last_position) / delta;
+	last_position = position;
+	if(glm::length(measured) > PREFETCH_MAX_SPEED) {
+		velocity = glm::vec3(0.0f);
+	} else {
+		// Exponential smoothing that doesn't depend on the frame rate
+		float blend = 1.0f - expf(-delta / PREFETCH_SMOOTHING);
+		velocity += (measured - velocity) * blend;
+	}
+
+	path.clear();
+	if(glm::length(velocity) < PREFETCH_MIN_SPEED)
+		return;
+	for(int step = 1; step <= PREFETCH_STEPS; step++)
+		path.push_back(position + velocity * (PREFETCH_SECONDS * step / PREFETCH_STEPS));
+}
+
+size_t Prefetcher::get_budget(float throughput) const {
+	return std::max((size_t)PREFETCH_MIN_TILES, (size_t)(throughput * PREFETCH_QUEUE_SECONDS));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm.hpp>
+#include <cstddef>
+#include <vector>
+
+// Seconds of flight the camera's path is extrapolated ahead
+#define PREFETCH_SECONDS 4.0f
+
+// Points the extrapolated path is sampled at, evenly spread in time
+#define PREFETCH_STEPS 8
+
+// Time constant of the velocity estimate, in seconds. Longer ignores short taps on the keys
+#define PREFETCH_SMOOTHING 0.3f
+
+// The camera is treated as standing still below this speed, in world units per second
+#define PREFETCH_MIN_SPEED 50.0f
+
+// Tiles a scheduler may hold, waiting or building, before speculative ones stop
+// being queued, in seconds of its measured throughput
+#define PREFETCH_QUEUE_SECONDS 1.0f
+
+// Tiles a scheduler may hold before any throughput has been measured
+#define PREFETCH_MIN_TILES 4
+
+// Predicts where the camera is heading, so streaming subsystems can build the
+// tiles along the way before the camera gets there.
+//
+// The velocity is measured from the camera's position every frame rather than
+// read from the keys, so replayed paths and any later way of moving the camera
+// are predicted the same way. The path ahead is a straight line along the
+// smoothed velocity, which at flight speeds is a good guess for several
+// seconds.
+//
+// Speculative work must never delay the tiles the camera needs now, so how
+// much of it a subsystem may queue follows the throughput its scheduler
+// measures: a fast machine prefetches the whole path, a slow one only its
+// start.
+class Prefetcher {
+	public:
+		Prefetcher();
+
+		// Once per frame with the camera's position and the frame time
+		void update(const glm::vec3 &position, float delta);
+
+		// Points the camera is expected to pass through, soonest first. Empty
+		// while the camera stands still
+		inline const std::vector<glm::vec3> &get_path() const { return path; }
+		inline const glm::vec3 &get_velocity() const { return velocity; }
+
+		// Tiles a scheduler building throughput tiles per second may hold,
+		// waiting or building, and still take speculative ones
+		size_t get_budget(float throughput) const;
+
+	private:
+		glm::vec3 last_position;
+		glm::vec3 velocity;
+		bool started;
+		std::vector<glm::vec3> path;
+};
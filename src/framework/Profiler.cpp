@@ -0,0 +1,242 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+Profiler::Profiler(size_t history) : history(history), recorded(0), frame_index(0), gpu_open(false) {
+	gpu_frames.resize(PROFILER_GPU_LATENCY);
+	for(size_t i = 0; i < gpu_frames.size(); i++) {
+		gpu_frames[i].frame = 0;
+		gpu_frames[i].used = 0;
+	}
+}
+
+Profiler::~Profiler() {
+	for(size_t i = 0; i < gpu_frames.size(); i++) {
+		for(size_t j = 0; j < gpu_frames[i].queries.size(); j++)
+			glDeleteQueries(1, &gpu_frames[i].queries[j].query);
+	}
+}
+
+void Profiler::begin_frame() {
+	frame_start = Clock::now();
+
+	FrameRecord &record = current();
+	record.index = frame_index;
+	record.frame_ms = 0.0;
+	std::fill(record.cpu_ms.begin(), record.cpu_ms.end(), 0.0);
+	std::fill(record.gpu_ms.begin(), record.gpu_ms.end(), -1.0);
+
+	// The queries in this slot were issued PROFILER_GPU_LATENCY frames ago, collect them before reuse
+	GpuFrame &gpu = gpu_frames[frame_index % gpu_frames.size()];
+	resolve_gpu(gpu);
+	gpu.frame = frame_index;
+	gpu.used = 0;
+}
+
+void Profiler::end_frame() {
+	// Close anything left open so a missing pop doesn't corrupt the next frame
+	while(!open_scopes.empty())
+		pop_cpu();
+	if(gpu_open)
+		end_gpu();
+
+	current().frame_ms = std::chrono::duration<double, std::milli>(Clock::now() - frame_start).count();
+
+	frame_index++;
+	if(recorded < history.size())
+		recorded++;
+}
+
+void Profiler::push_cpu(const char* name) {
+	OpenScope scope;
+	scope.scope = get_scope_id(name, cpu_ids, cpu_names);
+	scope.start = Clock::now();
+	open_scopes.push_back(scope);
+}
+
+void Profiler::pop_cpu() {
+	if(open_scopes.empty())
+		return;
+
+	OpenScope scope = open_scopes.back();
+	open_scopes.pop_back();
+
+	FrameRecord &record = current();
+	if(record.cpu_ms.size() <= (size_t)scope.scope)
+		record.cpu_ms.resize(cpu_names.size(), 0.0);
+	record.cpu_ms[scope.scope] += std::chrono::duration<double, std::milli>(Clock::now() - scope.start).count();
+}
+
+void Profiler::begin_gpu(const char* name) {
+	if(gpu_open)
+		end_gpu();
+
+	GpuFrame &gpu = gpu_frames[frame_index % gpu_frames.size()];
+	if(gpu.used == gpu.queries.size()) {
+		GpuQuery query;
+		glGenQueries(1, &query.query);
+		gpu.queries.push_back(query);
+	}
+
+	GpuQuery &query = gpu.queries[gpu.used++];
+	query.scope = get_scope_id(name, gpu_ids, gpu_names);
+	glBeginQuery(GL_TIME_ELAPSED, query.query);
+	gpu_open = true;
+}
+
+void Profiler::end_gpu() {
+	if(!gpu_open)
+		return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	gpu_open = false;
+}
+
+double Profiler::get_frame_percentile(double p) const {
+	std::vector<double> values;
+	values.reserve(recorded);
+	for(size_t i = 0; i < recorded; i++)
+		values.push_back(history[i].frame_ms);
+	return percentile(values, p);
+}
+
+double Profiler::get_cpu_percentile(const char* name, double p) const {
+	std::unordered_map<std::string, int>::const_iterator it = cpu_ids.find(name);
+	if(it == cpu_ids.end())
+		return 0.0;
+
+	std::vector<double> values = collect(it->second, false);
+	return percentile(values, p);
+}
+
+double Profiler::get_gpu_percentile(const char* name, double p) const {
+	std::unordered_map<std::string, int>::const_iterator it = gpu_ids.find(name);
+	if(it == gpu_ids.end())
+		return 0.0;
+
+	std::vector<double> values = collect(it->second, true);
+	return percentile(values, p);
+}
+
+void Profiler::report(std::ostream &out) const {
+	char line[256];
+	out << "Profile over " << recorded << " frames (ms)" << std::endl;
+	snprintf(line, sizeof(line), "  %-20s %8s %8s %8s", "", "p50", "p95", "p99");
+	out << line << std::endl;
+	snprintf(line, sizeof(line), "  %-20s %8.3f %8.3f %8.3f", "frame",
+		get_frame_percentile(50), get_frame_percentile(95), get_frame_percentile(99));
+	out << line << std::endl;
+
+	for(size_t i = 0; i < cpu_names.size(); i++) {
+		std::vector<double> values = collect((int)i, false);
+		snprintf(line, sizeof(line), "  cpu %-16s %8.3f %8.3f %8.3f", cpu_names[i].c_str(),
+			percentile(values, 50), percentile(values, 95), percentile(values, 99));
+		out << line << std::endl;
+	}
+
+	for(size_t i = 0; i < gpu_names.size(); i++) {
+		std::vector<double> values = collect((int)i, true);
+		snprintf(line, sizeof(line), "  gpu %-16s %8.3f %8.3f %8.3f", gpu_names[i].c_str(),
+			percentile(values, 50), percentile(values, 95), percentile(values, 99));
+		out << line << std::endl;
+	}
+}
+
+bool Profiler::dump_csv(const char* path) const {
+	FILE* file = fopen(path, "w");
+	if(!file)
+		return false;
+
+	fprintf(file, "frame,frame_ms");
+	for(size_t i = 0; i < cpu_names.size(); i++)
+		fprintf(file, ",cpu_%s_ms", cpu_names[i].c_str());
+	for(size_t i = 0; i < gpu_names.size(); i++)
+		fprintf(file, ",gpu_%s_ms", gpu_names[i].c_str());
+	fprintf(file, "\n");
+
+	// Once the ring has wrapped, the oldest frame sits at the next write position
+	size_t first = recorded < history.size() ? 0 : (size_t)(frame_index % history.size());
+	for(size_t n = 0; n < recorded; n++) {
+		const FrameRecord &record = history[(first + n) % history.size()];
+		fprintf(file, "%llu,%.4f", record.index, record.frame_ms);
+		for(size_t i = 0; i < cpu_names.size(); i++)
+			fprintf(file, ",%.4f", i < record.cpu_ms.size() ? record.cpu_ms[i] : 0.0);
+		for(size_t i = 0; i < gpu_names.size(); i++) {
+			if(i < record.gpu_ms.size() && record.gpu_ms[i] >= 0.0)
+				fprintf(file, ",%.4f", record.gpu_ms[i]);
+			else
+				fprintf(file, ",");
+		}
+		fprintf(file, "\n");
+	}
+
+	fclose(file);
+	return true;
+}
+
+int Profiler::get_scope_id(const char* name, std::unordered_map<std::string, int> &ids, std::vector<std::string> &names) {
+	std::unordered_map<std::string, int>::iterator it = ids.find(name);
+	if(it != ids.end())
+		return it->second;
+
+	int id = (int)names.size();
+	names.push_back(name);
+	ids[name] = id;
+	return id;
+}
+
+Profiler::FrameRecord &Profiler::current() {
+	return history[frame_index % history.size()];
+}
+
+Profiler::FrameRecord* Profiler::find_frame(unsigned long long index) {
+	FrameRecord &record = history[index % history.size()];
+	return record.index == index ? &record : NULL;
+}
+
+void Profiler::resolve_gpu(GpuFrame &frame) {
+	if(frame.used == 0)
+		return;
+
+	FrameRecord* record = find_frame(frame.frame);
+	for(size_t i = 0; i < frame.used; i++) {
+		// Several frames have passed, so this normally returns without waiting
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(frame.queries[i].query, GL_QUERY_RESULT, &elapsed);
+		if(!record)
+			continue;
+
+		int scope = frame.queries[i].scope;
+		if(record->gpu_ms.size() <= (size_t)scope)
+			record->gpu_ms.resize(gpu_names.size(), -1.0);
+		if(record->gpu_ms[scope] < 0.0)
+			record->gpu_ms[scope] = 0.0;
+		record->gpu_ms[scope] += elapsed / 1000000.0;
+	}
+	frame.used = 0;
+}
+
+double Profiler::percentile(std::vector<double> &values, double p) const {
+	if(values.empty())
+		return 0.0;
+
+	size_t rank = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+	if(rank >= values.size())
+		rank = values.size() - 1;
+	std::nth_element(values.begin(), values.begin() + rank, values.end());
+	return values[rank];
+}
+
+std::vector<double> Profiler::collect(int scope, bool gpu) const {
+	std::vector<double> values;
+	values.reserve(recorded);
+	for(size_t i = 0; i < recorded; i++) {
+		const std::vector<double> &samples = gpu ? history[i].gpu_ms : history[i].cpu_ms;
+		double value = (size_t)scope < samples.size() ? samples[scope] : (gpu ? -1.0 : 0.0);
+		// Unresolved GPU samples are skipped rather than counted as zero
+		if(!gpu || value >= 0.0)
+			values.push_back(value);
+	}
+	return values;
+}
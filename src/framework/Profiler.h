@@ -0,0 +1,121 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+
+// Number of frames kept in the history ring buffer
+#define PROFILER_HISTORY 2048
+
+// GPU queries are read back this many frames late so we never stall on them
+#define PROFILER_GPU_LATENCY 4
+
+// Frame profiler with nested CPU scopes and GL timer queries.
+// Every frame is stored in a ring buffer, so percentiles and the CSV dump
+// always cover the last PROFILER_HISTORY frames.
+class Profiler {
+	public:
+		Profiler(size_t history = PROFILER_HISTORY);
+		~Profiler();
+
+		void begin_frame();
+		void end_frame();
+
+		// Nested CPU timers. Scopes with the same name are summed within a frame
+		void push_cpu(const char* name);
+		void pop_cpu();
+
+		// GL_TIME_ELAPSED queries can't nest, so GPU scopes must not overlap
+		void begin_gpu(const char* name);
+		void end_gpu();
+
+		// Frame-time percentile over the recorded history, p in [0, 100]
+		double get_frame_percentile(double p) const;
+		double get_cpu_percentile(const char* name, double p) const;
+		double get_gpu_percentile(const char* name, double p) const;
+
+		inline size_t get_frame_count() const { return recorded; }
+
+		// Prints p50/p95/p99 of the frame and of every scope
+		void report(std::ostream &out) const;
+
+		// Writes one row per recorded frame, oldest first
+		bool dump_csv(const char* path) const;
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		struct FrameRecord {
+			unsigned long long index;
+			double frame_ms;
+			std::vector<double> cpu_ms; // Indexed by scope ID
+			std::vector<double> gpu_ms; // Indexed by scope ID, negative until the query is resolved
+		};
+
+		struct OpenScope {
+			int scope;
+			Clock::time_point start;
+		};
+
+		struct GpuQuery {
+			unsigned int query;
+			int scope;
+		};
+
+		// Queries issued during one frame, recycled PROFILER_GPU_LATENCY frames later
+		struct GpuFrame {
+			unsigned long long frame;
+			std::vector<GpuQuery> queries;
+			size_t used;
+		};
+
+		std::vector<FrameRecord> history;
+		size_t recorded;
+		unsigned long long frame_index;
+		Clock::time_point frame_start;
+
+		std::vector<std::string> cpu_names;
+		std::vector<std::string> gpu_names;
+		std::unordered_map<std::string, int> cpu_ids;
+		std::unordered_map<std::string, int> gpu_ids;
+
+		std::vector<OpenScope> open_scopes;
+		std::vector<GpuFrame> gpu_frames;
+		bool gpu_open;
+
+		int get_scope_id(const char* name, std::unordered_map<std::string, int> &ids, std::vector<std::string> &names);
+		FrameRecord &current();
+		FrameRecord* find_frame(unsigned long long index);
+		void resolve_gpu(GpuFrame &frame);
+		double percentile(std::vector<double> &values, double p) const;
+		std::vector<double> collect(int scope, bool gpu) const;
+};
+
+// Times the enclosing block on the CPU
+class ProfileScope {
+	public:
+		ProfileScope(Profiler &profiler, const char* name) : profiler(profiler) {
+			profiler.push_cpu(name);
+		}
+		~ProfileScope() {
+			profiler.pop_cpu();
+		}
+	private:
+		Profiler &profiler;
+};
+
+// Times the GL commands issued in the enclosing block
+class GpuProfileScope {
+	public:
+		GpuProfileScope(Profiler &profiler, const char* name) : profiler(profiler) {
+			profiler.begin_gpu(name);
+		}
+		~GpuProfileScope() {
+			profiler.end_gpu();
+		}
+	private:
+		Profiler &profiler;
+};
@@ -0,0 +1,684 @@
+#include "Scatter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include "Shader.h"
+
+using namespace noise;
+
+// Candidates tried around every point of a Poisson-disk pattern before it is retired
+#define SCATTER_PATTERN_ATTEMPTS 30
+
+// Plans the simulation can hand over between two frames. Past that it keeps
+// the dropped builds for a later plan, which only happens while a frame stalls
+#define SCATTER_PLAN_QUEUE_SIZE 8
+
+// Edits the GL thread can hand over between two ticks before it merges them
+#define SCATTER_EDIT_QUEUE_SIZE 4
+
+namespace {
+	uint32_t hash(uint32_t value) {
+		value ^= value >> 16;
+		value *= 0x7feb352d;
+		value ^= value >> 15;
+		value *= 0x846ca68b;
+		value ^= value >> 16;
+		return value;
+	}
+
+	uint32_t hash(int x, int z, int layer, int index) {
+		return hash((uint32_t)x * 73856093u ^ hash((uint32_t)z * 19349663u ^ hash((uint32_t)layer * 83492791u ^ (uint32_t)index)));
+	}
+
+	// Advances state and returns a number in [0, 1)
+	float next_random(uint32_t &state) {
+		state = hash(state + 0x9e3779b9u);
+		return (float)(state >> 8) * (1.0f / 16777216.0f);
+	}
+
+	float wrapped_distance(float a, float b) {
+		float d = fabsf(a - b);
+		return std::min(d, 1.0f - d);
+	}
+
+	// Bridson's Poisson-disk sampling on the unit torus, so the pattern tiles without seams
+	std::vector<glm::vec2> poisson_pattern(float radius, unsigned int seed) {
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		// Cells no wider than radius / sqrt(2) hold at most one point each
+		int grid_size = std::max(1, (int)ceilf(sqrtf(2.0f) / radius));
+		float cell_size = 1.0f / grid_size;
+		std::vector<int> grid(grid_size * grid_size, -1);
+		std::vector<glm::vec2> points;
+		std::vector<int> active;
+
+		auto cell_of = [&](const glm::vec2 &p) {
+			int cx = std::min((int)(p.x / cell_size), grid_size - 1);
+			int cz = std::min((int)(p.y / cell_size), grid_size - 1);
+			return cz * grid_size + cx;
+		};
+		auto add = [&](const glm::vec2 &p) {
+			grid[cell_of(p)] = (int)points.size();
+			active.push_back((int)points.size());
+			points.push_back(p);
+		};
+
+		add(glm::vec2(unit(random), unit(random)));
+		while(!active.empty()) {
+			int slot = std::uniform_int_distribution<int>(0, (int)active.size() - 1)(random);
+			glm::vec2 center = points[active[slot]];
+
+			bool placed = false;
+			for(int attempt = 0; attempt < SCATTER_PATTERN_ATTEMPTS && !placed; attempt++) {
+				float angle = unit(random) * 6.2831853f;
+				float distance = radius * (1.0f + unit(random));
+				glm::vec2 candidate = center + distance * glm::vec2(cosf(angle), sinf(angle));
+				candidate -= glm::floor(candidate);
+
+				int cx = std::min((int)(candidate.x / cell_size), grid_size - 1);
+				int cz = std::min((int)(candidate.y / cell_size), grid_size - 1);
+				bool clear = true;
+				for(int dz = -2; dz <= 2 && clear; dz++) {
+					for(int dx = -2; dx <= 2 && clear; dx++) {
+						int neighbour = grid[((cz + dz + grid_size) % grid_size) * grid_size + (cx + dx + grid_size) % grid_size];
+						if(neighbour < 0)
+							continue;
+						float ex = wrapped_distance(points[neighbour].x, candidate.x);
+						float ez = wrapped_distance(points[neighbour].y, candidate.y);
+						clear = ex * ex + ez * ez >= radius * radius;
+					}
+				}
+				if(clear) {
+					add(candidate);
+					placed = true;
+				}
+			}
+
+			if(!placed) {
+				active[slot] = active.back();
+				active.pop_back();
+			}
+		}
+		return points;
+	}
+
+	struct MeshBuilder {
+		std::vector<float> vertices; // Position, normal and color
+
+		void triangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, const glm::vec3 &color) {
+			glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+			const glm::vec3* corners[3] = { &a, &b, &c };
+			for(int i = 0; i < 3; i++) {
+				const float attributes[9] = { corners[i]->x, corners[i]->y, corners[i]->z,
+					normal.x, normal.y, normal.z, color.r, color.g, color.b };
+				vertices.insert(vertices.end(), attributes, attributes + 9);
+			}
+		}
+
+		// Cone or prism around the y axis, closed at the bottom
+		void ring(float bottom, float top, float bottom_radius, float top_radius, int sides, const glm::vec3 &color) {
+			for(int i = 0; i < sides; i++) {
+				float a0 = 6.2831853f * i / sides;
+				float a1 = 6.2831853f * (i + 1) / sides;
+				glm::vec3 b0(cosf(a0) * bottom_radius, bottom, sinf(a0) * bottom_radius);
+				glm::vec3 b1(cosf(a1) * bottom_radius, bottom, sinf(a1) * bottom_radius);
+				glm::vec3 t0(cosf(a0) * top_radius, top, sinf(a0) * top_radius);
+				glm::vec3 t1(cosf(a1) * top_radius, top, sinf(a1) * top_radius);
+				triangle(b0, t0, b1, color);
+				if(top_radius > 0.0f)
+					triangle(b1, t0, t1, color);
+				triangle(glm::vec3(0.0f, bottom, 0.0f), b0, b1, color);
+			}
+		}
+	};
+}
+
+Scatter::Scatter(const utils::NoiseMap &heights, float world_size, float height_scale, UploadRing &uploads,
+	JobSystem &jobs) : map_width(heights.GetWidth()), map_height(heights.GetHeight()), world_size(world_size),
+	height_scale(height_scale), uploads(uploads), scheduler(jobs), drawn_instance_count(0), instance_count(0),
+	plans(SCATTER_PLAN_QUEUE_SIZE), edits(SCATTER_EDIT_QUEUE_SIZE), finished(scheduler.get_max_in_flight() * 2),
+	unclaimed(0) {
+	ScatterLayer &trees = layers[SCATTER_TREES];
+	trees.spacing = 9.0f;
+	trees.min_height = 0.0f;
+	trees.max_height = 0.55f;
+	trees.min_slope = 0.0f;
+	trees.max_slope = 0.6f;
+	trees.density = 0.7f;
+	trees.min_scale = 10.0f;
+	trees.max_scale = 18.0f;
+	trees.draw_distance = 3000.0f;
+
+	ScatterLayer &rocks = layers[SCATTER_ROCKS];
+	rocks.spacing = 16.0f;
+	rocks.min_height = 0.05f;
+	rocks.max_height = 1.0f;
+	rocks.min_slope = 0.3f;
+	rocks.max_slope = 3.0f;
+	rocks.density = 0.5f;
+	rocks.min_scale = 2.0f;
+	rocks.max_scale = 6.0f;
+	rocks.draw_distance = 1500.0f;
+
+	for(int layer = 0; layer < SCATTER_LAYER_COUNT; layer++)
+		patterns[layer] = poisson_pattern(layers[layer].spacing / SCATTER_CHUNK_SIZE, 1234 + layer);
+
+	// The height map texture is the rendered noise map turned upside down, and
+	// clamped to the range its gradient covers
+	std::vector<float> texels(map_width * map_height);
+	for(int row = 0; row < map_height; row++) {
+		const float* source = heights.GetConstSlabPtr(map_height - 1 - row);
+		for(int column = 0; column < map_width; column++)
+			texels[row * map_width + column] = std::max(0.0f, std::min(1.0f, (source[column] + 1.0f) * 0.5f));
+	}
+	std::shared_ptr<HeightTiles> tiles = std::make_shared<HeightTiles>(map_width, map_height);
+	TexelRect all = { 0, 0, map_width, map_height };
+	tiles->write(all, texels.data());
+	this->heights = tiles;
+
+	// Known for every chunk up front, so the scheduler and the culling never wait on a build
+	chunks_across = (int)ceilf(world_size / SCATTER_CHUNK_SIZE);
+	ground.resize(chunks_across * chunks_across);
+	jobs.parallel_for(chunks_across * chunks_across, 1, [this, &texels](int begin, int end) {
+		for(int i = begin; i < end; i++) {
+			TexelRect rect = ground_texels(i % chunks_across, i / chunks_across);
+			ground[i] = measure_ground(&texels[rect.row0 * map_width + rect.column0], map_width, rect);
+		}
+	}, JOB_PRIORITY_HIGH);
+
+	build_meshes();
+}
+
+Scatter::~Scatter() {
+	// Cancels every build first, so the ones still queued return right away
+	for(auto it = chunks.begin(); it != chunks.end(); ++it)
+		destroy_chunk(it->second);
+	scheduler.clear();
+
+	// Every buffer left is in a build released by now, handed over or not
+	std::shared_ptr<Plan> plan;
+	while(plans.pop(plan))
+		release(plan->released);
+	release(released);
+
+	for(int layer = 0; layer < SCATTER_LAYER_COUNT; layer++) {
+		glDeleteBuffers(1, &meshes[layer].vbo);
+		glDeleteVertexArrays(1, &meshes[layer].vao);
+	}
+}
+
+void Scatter::plan(const glm::vec3 &camera_position, const glm::mat4 &view_projection, const Prefetcher* prefetcher) {
+	// Edits first, so chunks are built and culled on the newest ground
+	Edit edit;
+	while(edits.pop(edit))
+		apply_edit(edit);
+
+	float reach = 0.0f;
+	for(int layer = 0; layer < SCATTER_LAYER_COUNT; layer++)
+		reach = std::max(reach, layers[layer].draw_distance);
+
+	glm::vec2 camera(camera_position.x, camera_position.z);
+	auto distance_from = [](const glm::vec2 &point, int x, int z) {
+		glm::vec2 low(x * SCATTER_CHUNK_SIZE, z * SCATTER_CHUNK_SIZE);
+		glm::vec2 nearest = glm::clamp(point, low, low + SCATTER_CHUNK_SIZE);
+		return glm::length(point - nearest);
+	};
+
+	// Chunks are kept around the camera and around where it is heading
+	std::vector<glm::vec2> anchors(1, camera);
+	if(prefetcher) {
+		const std::vector<glm::vec3> &path = prefetcher->get_path();
+		for(size_t i = 0; i < path.size(); i++)
+			anchors.push_back(glm::vec2(path[i].x, path[i].z));
+	}
+
+	for(auto it = chunks.begin(); it != chunks.end();) {
+		Chunk* chunk = it->second;
+		chunk->distance = distance_from(camera, chunk->x, chunk->z);
+		bool kept = false;
+		for(size_t i = 0; i < anchors.size() && !kept; i++)
+			kept = distance_from(anchors[i], chunk->x, chunk->z) <= reach * SCATTER_RELEASE_MARGIN;
+		if(!kept) {
+			destroy_chunk(chunk);
+			it = chunks.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	// Queue the missing chunks in reach of the camera, then along its path while
+	// the prefetch budget lasts. The scheduler picks which to build first
+	size_t budget = prefetcher ? prefetcher->get_budget(scheduler.get_throughput()) : 0;
+	int last = (int)ceilf(world_size / SCATTER_CHUNK_SIZE) - 1;
+	for(size_t i = 0; i < anchors.size(); i++) {
+		const glm::vec2 &anchor = anchors[i];
+		int x0 = std::max(0, (int)floorf((anchor.x - reach) / SCATTER_CHUNK_SIZE));
+		int x1 = std::min(last, (int)floorf((anchor.x + reach) / SCATTER_CHUNK_SIZE));
+		int z0 = std::max(0, (int)floorf((anchor.y - reach) / SCATTER_CHUNK_SIZE));
+		int z1 = std::min(last, (int)floorf((anchor.y + reach) / SCATTER_CHUNK_SIZE));
+		for(int z = z0; z <= z1; z++) {
+			for(int x = x0; x <= x1; x++) {
+				if(i > 0 && scheduler.get_outstanding_count() >= budget)
+					break;
+				if(distance_from(anchor, x, z) <= reach && chunks.find(((long long)z << 32) | (unsigned int)x) == chunks.end())
+					create_chunk(x, z);
+			}
+		}
+	}
+
+	// New builds only start while their results fit in finished next to the
+	// ones the GL thread hasn't taken yet
+	if(unclaimed.load() + scheduler.get_max_in_flight() <= finished.get_capacity())
+		scheduler.update(camera_position, view_projection);
+
+	// Frustum planes as (normal, distance), inside when dot(normal, p) + distance >= 0
+	glm::vec4 planes[6];
+	for(int i = 0; i < 3; i++) {
+		glm::vec4 row(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+		glm::vec4 w(view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3]);
+		planes[i * 2] = w + row;
+		planes[i * 2 + 1] = w - row;
+	}
+
+	float overhang = 0.0f;
+	for(int layer = 0; layer < SCATTER_LAYER_COUNT; layer++)
+		overhang = std::max(overhang, meshes[layer].radius * layers[layer].max_scale);
+
+	draw_list.clear();
+	drawn_instance_count = 0;
+	for(auto it = chunks.begin(); it != chunks.end(); ++it) {
+		Chunk* chunk = it->second;
+
+		// An uploaded rebuild replaces what the chunk drew so far
+		if(chunk->job != chunk->shown && chunk->job->uploaded) {
+			if(chunk->shown)
+				released.push_back(chunk->shown);
+			chunk->shown = chunk->job;
+		}
+		if(!chunk->shown || chunk->distance > reach)
+			continue;
+
+		// Instances reach past the chunk's ground by up to their size
+		const glm::vec2 &range = ground[chunk->z * chunks_across + chunk->x];
+		glm::vec3 low(chunk->x * SCATTER_CHUNK_SIZE - overhang, range.x - overhang, chunk->z * SCATTER_CHUNK_SIZE - overhang);
+		glm::vec3 high = glm::vec3(low.x, range.y, low.z) + glm::vec3(SCATTER_CHUNK_SIZE + overhang * 2.0f, overhang, SCATTER_CHUNK_SIZE + overhang * 2.0f);
+		bool visible = true;
+		for(int i = 0; i < 6 && visible; i++) {
+			glm::vec3 corner(planes[i].x >= 0.0f ? high.x : low.x, planes[i].y >= 0.0f ? high.y : low.y, planes[i].z >= 0.0f ? high.z : low.z);
+			visible = glm::dot(glm::vec3(planes[i]), corner) + planes[i].w >= 0.0f;
+		}
+		if(!visible)
+			continue;
+
+		DrawnChunk drawn = { chunk->shown, chunk->distance };
+		draw_list.push_back(drawn);
+		for(int layer = 0; layer < SCATTER_LAYER_COUNT; layer++) {
+			if(chunk->distance <= layers[layer].draw_distance)
+				drawn_instance_count += chunk->shown->counts[layer];
+		}
+	}
+
+	publish();
+}
+
+void Scatter::upload() {
+	// An edit that didn't fit before goes first, the plans want the newest ground
+	if(unsent_edit.heights && edits.try_push(unsent_edit))
+		unsent_edit = Edit();
+
+	// Every plan is taken for the builds it released, only the newest is drawn
+	std::shared_ptr<Plan> plan;
+	while(plans.pop(plan)) {
+		release(plan->released);
+		shown = plan;
+	}
+
+	std::shared_ptr<ChunkJob> built;
+	while(finished.pop(built)) {
+		pending_uploads.push_back(std::move(built));
+		unclaimed--;
+	}
+
+	size_t kept = 0;
+	for(size_t i = 0; i < pending_uploads.size(); i++) {
+		std::shared_ptr<ChunkJob> job = pending_uploads[i];
+		if(job->cancelled)
+			continue;
+		if(!uploads.has_frame_budget()) {
+			// Out of time or bytes for this frame, the rest waits for the next one
+			pending_uploads[kept++] = job;
+			continue;
+		}
+
+		size_t size = 0;
+		for(int layer = 0; layer < SCATTER_LAYER_COUNT; layer++)
+			size += job->instances[layer].size() * sizeof(ScatterInstance);
+
+		if(size > 0) {
+			UploadAllocation allocation;
+			if(!uploads.allocate(size, sizeof(float), allocation)) {
+				// The ring is full, try again after the next flush
+				pending_uploads[kept++] = job;
+				continue;
+			}
+
+			size_t offset = 0;
+			for(int layer = 0; layer < SCATTER_LAYER_COUNT; layer++) {
+				size_t bytes = job->instances[layer].size() * sizeof(ScatterInstance);
+				if(bytes > 0)
+					memcpy((char*)allocation.ptr + offset, job->instances[layer].data(), bytes);
+				job->offsets[layer] = offset;
+				job->counts[layer] = (unsigned int)job->instances[layer].size();
+				instance_count += job->counts[layer];
+				offset += bytes;
+			}
+
+			glGenBuffers(1, &job->vbo);
+			glBindBuffer(GL_ARRAY_BUFFER, job->vbo);
+			glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			uploads.submit_buffer_copy(allocation, job->vbo, 0);
+		}
+
+		// The chunk keeps the job, but not the instances now in the ring. Plans
+		// list it from the next tick on, after this frame's flush
+		for(int layer = 0; layer < SCATTER_LAYER_COUNT; layer++)
+			job->instances[layer] = std::vector<ScatterInstance>();
+		job->uploaded = true;
+	}
+	pending_uploads.resize(kept);
+}
+
+void Scatter::draw(Shader &shader) {
+	if(!shown)
+		return;
+
+	const std::vector<DrawnChunk> &chunks = shown->draw_list;
+	shader.set_float("worldSize", world_size);
+
+	for(int layer = 0; layer < SCATTER_LAYER_COUNT; layer++) {
+		const ScatterLayer &rules = layers[layer];
+		shader.set_float("fadeStart", rules.draw_distance * 0.8f);
+		shader.set_float("fadeEnd", rules.draw_distance);
+
+		glBindVertexArray(meshes[layer].vao);
+		for(size_t i = 0; i < chunks.size(); i++) {
+			const ChunkJob* job = chunks[i].job.get();
+			if(job->counts[layer] == 0 || chunks[i].distance > rules.draw_distance)
+				continue;
+			glBindBuffer(GL_ARRAY_BUFFER, job->vbo);
+			glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(ScatterInstance), (void*)job->offsets[layer]);
+			glDrawArraysInstanced(GL_TRIANGLES, 0, meshes[layer].vertex_count, job->counts[layer]);
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+void Scatter::update_ground(const HeightTiles &heights, const TexelRect &changed) {
+	Edit edit;
+	edit.heights = std::make_shared<HeightTiles>(heights);
+	edit.changed = changed;
+
+	// One still waiting merges into this one, whose snapshot is newer
+	if(unsent_edit.heights) {
+		edit.changed.column0 = std::min(edit.changed.column0, unsent_edit.changed.column0);
+		edit.changed.row0 = std::min(edit.changed.row0, unsent_edit.changed.row0);
+		edit.changed.column1 = std::max(edit.changed.column1, unsent_edit.changed.column1);
+		edit.changed.row1 = std::max(edit.changed.row1, unsent_edit.changed.row1);
+	}
+	if(edits.try_push(edit))
+		unsent_edit = Edit();
+	else
+		unsent_edit = edit;
+}
+
+void Scatter::apply_edit(const Edit &edit) {
+	heights = edit.heights;
+	const TexelRect &changed = edit.changed;
+
+	std::vector<float> samples;
+	for(int z = 0; z < chunks_across; z++) {
+		for(int x = 0; x < chunks_across; x++) {
+			TexelRect rect = ground_texels(x, z);
+			if(rect.column1 <= changed.column0 || rect.column0 >= changed.column1
+				|| rect.row1 <= changed.row0 || rect.row0 >= changed.row1)
+				continue;
+			int width = rect.column1 - rect.column0;
+			samples.resize(width * (rect.row1 - rect.row0));
+			heights->read(rect, samples.data());
+			ground[z * chunks_across + x] = measure_ground(samples.data(), width, rect);
+
+			// Instances on the old ground would float or sink, or break the layer's rules
+			auto it = chunks.find(((long long)z << 32) | (unsigned int)x);
+			if(it != chunks.end())
+				request_build(it->second);
+		}
+	}
+}
+
+void Scatter::create_chunk(int x, int z) {
+	Chunk* chunk = new Chunk();
+	chunk->x = x;
+	chunk->z = z;
+	chunk->distance = 0.0f;
+	chunks[((long long)z << 32) | (unsigned int)x] = chunk;
+	request_build(chunk);
+}
+
+void Scatter::request_build(Chunk* chunk) {
+	// A build still running for the chunk samples older heights
+	if(chunk->job) {
+		chunk->job->cancelled = true;
+		if(chunk->job != chunk->shown)
+			released.push_back(chunk->job);
+	}
+
+	const int x = chunk->x, z = chunk->z;
+	std::shared_ptr<ChunkJob> job = std::make_shared<ChunkJob>();
+	job->x = x;
+	job->z = z;
+	job->cancelled = false;
+	job->heights = heights;
+	job->vbo = 0;
+	for(int layer = 0; layer < SCATTER_LAYER_COUNT; layer++) {
+		job->counts[layer] = 0;
+		job->offsets[layer] = 0;
+	}
+	job->uploaded = false;
+	chunk->job = job;
+
+	// The sphere around the ground under the chunk, the instances are small next to it
+	const glm::vec2 &range = ground[z * chunks_across + x];
+	glm::vec3 center((x + 0.5f) * SCATTER_CHUNK_SIZE, (range.x + range.y) * 0.5f, (z + 0.5f) * SCATTER_CHUNK_SIZE);
+	float radius = glm::length(glm::vec3(SCATTER_CHUNK_SIZE * 0.5f, (range.y - range.x) * 0.5f, SCATTER_CHUNK_SIZE * 0.5f));
+	scheduler.request(center, radius, job->cancelled, [this, job]() { run(job); });
+}
+
+void Scatter::destroy_chunk(Chunk* chunk) {
+	// The GL thread frees their buffers once it takes the next plan
+	chunk->job->cancelled = true;
+	released.push_back(chunk->job);
+	if(chunk->shown && chunk->shown != chunk->job)
+		released.push_back(chunk->shown);
+	delete chunk;
+}
+
+void Scatter::publish() {
+	std::shared_ptr<Plan> plan = std::make_shared<Plan>();
+	plan->draw_list.swap(draw_list);
+	plan->released.swap(released);
+
+	// Rather than wait on a stalled frame, keep the releases for the next plan
+	if(!plans.try_push(plan))
+		released.swap(plan->released);
+}
+
+void Scatter::release(std::vector<std::shared_ptr<ChunkJob>> &jobs) {
+	for(size_t i = 0; i < jobs.size(); i++) {
+		ChunkJob* job = jobs[i].get();
+		if(job->uploaded) {
+			for(int layer = 0; layer < SCATTER_LAYER_COUNT; layer++)
+				instance_count -= job->counts[layer];
+		}
+		if(job->vbo) {
+			glDeleteBuffers(1, &job->vbo);
+			job->vbo = 0;
+		}
+	}
+	jobs.clear();
+}
+
+float Scatter::sample_height(const HeightTiles &heights, float x, float z) const {
+	// Same as the GPU's linear filtering of the height map at x, z / world_size
+	float u = std::max(0.0f, std::min((float)map_width - 1.0f, x / world_size * map_width - 0.5f));
+	float v = std::max(0.0f, std::min((float)map_height - 1.0f, z / world_size * map_height - 0.5f));
+	int c0 = std::min((int)u, map_width - 2 < 0 ? 0 : map_width - 2);
+	int r0 = std::min((int)v, map_height - 2 < 0 ? 0 : map_height - 2);
+	int c1 = std::min(c0 + 1, map_width - 1);
+	int r1 = std::min(r0 + 1, map_height - 1);
+	float fu = u - c0;
+	float fv = v - r0;
+
+	float top = heights.get(c0, r0) * (1.0f - fu) + heights.get(c1, r0) * fu;
+	float bottom = heights.get(c0, r1) * (1.0f - fu) + heights.get(c1, r1) * fu;
+	return top * (1.0f - fv) + bottom * fv;
+}
+
+TexelRect Scatter::ground_texels(int x, int z) const {
+	// Every height map sample the chunk covers
+	const float x0 = x * SCATTER_CHUNK_SIZE;
+	const float z0 = z * SCATTER_CHUNK_SIZE;
+	TexelRect rect = {
+		std::max(0, (int)floorf(x0 / world_size * map_width - 0.5f)),
+		std::max(0, (int)floorf(z0 / world_size * map_height - 0.5f)),
+		std::min(map_width - 1, (int)ceilf((x0 + SCATTER_CHUNK_SIZE) / world_size * map_width - 0.5f)) + 1,
+		std::min(map_height - 1, (int)ceilf((z0 + SCATTER_CHUNK_SIZE) / world_size * map_height - 0.5f)) + 1
+	};
+	return rect;
+}
+
+glm::vec2 Scatter::measure_ground(const float* heights, int stride, const TexelRect &rect) const {
+	// heights starts at the rect's first texel, rows stride floats apart
+	float low = 1.0f, high = 0.0f;
+	for(int r = 0; r < rect.row1 - rect.row0; r++) {
+		for(int c = 0; c < rect.column1 - rect.column0; c++) {
+			low = std::min(low, heights[r * stride + c]);
+			high = std::max(high, heights[r * stride + c]);
+		}
+	}
+	return glm::vec2(std::min(low, high), high) * height_scale;
+}
+
+void Scatter::build_meshes() {
+	MeshBuilder builders[SCATTER_LAYER_COUNT];
+
+	// A trunk under two stacked cones, about 1.3 units tall
+	const glm::vec3 bark(0.35f, 0.25f, 0.15f);
+	const glm::vec3 leaves(0.16f, 0.36f, 0.13f);
+	builders[SCATTER_TREES].ring(-0.1f, 0.3f, 0.05f, 0.05f, 6, bark);
+	builders[SCATTER_TREES].ring(0.2f, 1.0f, 0.35f, 0.0f, 8, leaves);
+	builders[SCATTER_TREES].ring(0.55f, 1.3f, 0.25f, 0.0f, 8, leaves);
+	meshes[SCATTER_TREES].radius = 1.3f;
+
+	// A lopsided octahedron, sunk a little into the ground
+	const glm::vec3 stone(0.45f, 0.43f, 0.40f);
+	const glm::vec3 corners[6] = {
+		glm::vec3(1.0f, 0.1f, 0.1f), glm::vec3(-0.8f, 0.0f, -0.2f), glm::vec3(0.0f, 0.6f, 0.1f),
+		glm::vec3(0.1f, -0.3f, 0.0f), glm::vec3(-0.1f, 0.05f, 0.9f), glm::vec3(0.2f, 0.0f, -1.0f)
+	};
+	const int faces[8][3] = {
+		{ 0, 2, 4 }, { 4, 2, 1 }, { 1, 2, 5 }, { 5, 2, 0 },
+		{ 0, 4, 3 }, { 4, 1, 3 }, { 1, 5, 3 }, { 5, 0, 3 }
+	};
+	for(int i = 0; i < 8; i++)
+		builders[SCATTER_ROCKS].triangle(corners[faces[i][0]], corners[faces[i][1]], corners[faces[i][2]], stone);
+	meshes[SCATTER_ROCKS].radius = 1.0f;
+
+	for(int layer = 0; layer < SCATTER_LAYER_COUNT; layer++) {
+		Mesh &mesh = meshes[layer];
+		const std::vector<float> &vertices = builders[layer].vertices;
+		mesh.vertex_count = (int)(vertices.size() / 9);
+
+		glGenVertexArrays(1, &mesh.vao);
+		glGenBuffers(1, &mesh.vbo);
+		glBindVertexArray(mesh.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+		for(int i = 0; i < 3; i++) {
+			glEnableVertexAttribArray(i);
+			glVertexAttribPointer(i, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(i * 3 * sizeof(float)));
+		}
+
+		// Instance attributes come from each chunk's buffer at draw time
+		glEnableVertexAttribArray(3);
+		glVertexAttribDivisor(3, 1);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+}
+
+void Scatter::run(const std::shared_ptr<ChunkJob> &job) {
+	if(job->cancelled)
+		return;
+	build(*job);
+	// Counted first, so plan() holds back new builds before the queue fills.
+	// Should it fill anyway, a chunk dropped meanwhile doesn't wait for room
+	unclaimed++;
+	if(!finished.push(job, job->cancelled))
+		unclaimed--;
+}
+
+void Scatter::build(ChunkJob &job) const {
+	const float x0 = job.x * SCATTER_CHUNK_SIZE;
+	const float z0 = job.z * SCATTER_CHUNK_SIZE;
+
+	const HeightTiles &heights = *job.heights;
+	const float step = world_size / map_width;
+	for(int layer = 0; layer < SCATTER_LAYER_COUNT; layer++) {
+		const ScatterLayer &rules = layers[layer];
+		const std::vector<glm::vec2> &pattern = patterns[layer];
+		std::vector<ScatterInstance> &instances = job.instances[layer];
+
+		// Shifting the pattern by a whole-chunk hash keeps it blue noise inside the chunk
+		uint32_t chunk_state = hash(job.x, job.z, layer, -1);
+		glm::vec2 shift(next_random(chunk_state), next_random(chunk_state));
+
+		for(size_t i = 0; i < pattern.size(); i++) {
+			if(job.cancelled)
+				return;
+
+			glm::vec2 point = pattern[i] + shift;
+			point -= glm::floor(point);
+			float x = x0 + point.x * SCATTER_CHUNK_SIZE;
+			float z = z0 + point.y * SCATTER_CHUNK_SIZE;
+			if(x >= world_size || z >= world_size)
+				continue;
+
+			float height = sample_height(heights, x, z);
+			if(height < rules.min_height || height > rules.max_height)
+				continue;
+
+			float slope_x = (sample_height(heights, x + step, z) - sample_height(heights, x - step, z)) * height_scale / (2.0f * step);
+			float slope_z = (sample_height(heights, x, z + step) - sample_height(heights, x, z - step)) * height_scale / (2.0f * step);
+			float slope = sqrtf(slope_x * slope_x + slope_z * slope_z);
+			if(slope < rules.min_slope || slope > rules.max_slope)
+				continue;
+
+			uint32_t state = hash(job.x, job.z, layer, (int)i);
+			if(next_random(state) >= rules.density)
+				continue;
+
+			ScatterInstance instance;
+			instance.x = x;
+			instance.z = z;
+			instance.scale = rules.min_scale + (rules.max_scale - rules.min_scale) * next_random(state);
+			instance.rotation = next_random(state) * 6.2831853f;
+			instances.push_back(instance);
+		}
+	}
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm.hpp>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "HandoffQueue.h"
+#include "HeightTiles.h"
+#include "JobSystem.h"
+#include "Prefetcher.h"
+#include "TileScheduler.h"
+#include "UploadRing.h"
+#include "../utils/noiseutils.h"
+
+class Shader;
+
+// World units along each edge of a scatter chunk
+#define SCATTER_CHUNK_SIZE 500.0f
+
+// Chunks are only freed this far past the largest draw distance, so turning back doesn't rebuild them
+#define SCATTER_RELEASE_MARGIN 1.25f
+
+enum ScatterLayerType {
+	SCATTER_TREES,
+	SCATTER_ROCKS,
+	SCATTER_LAYER_COUNT
+};
+
+// Rules deciding where one kind of object is placed
+struct ScatterLayer {
+	float spacing; // Closest two instances of the layer get, in world units
+	float min_height, max_height; // Range of the height map, 0 to 1, the layer grows in
+	float min_slope, max_slope; // Rise over run of the ground
+	float density; // Fraction of the points passing the rules that are kept
+	float min_scale, max_scale;
+	float draw_distance; // Instances shrink away over the last fifth of this
+};
+
+// Per-instance attributes, read by scatter.vert at location 3
+struct ScatterInstance {
+	float x, z;
+	float scale;
+	float rotation;
+};
+
+// Scatters trees and rocks over the flat terrain.
+//
+// The terrain is split into SCATTER_CHUNK_SIZE chunks, and every chunk within
+// draw distance of the camera gets its instances from the job system, the ones
+// in view and nearest first, as well as ahead of it along the path predicted
+// by a Prefetcher. Each layer has one Poisson-disk pattern tiling a chunk,
+// shifted by a hash of the chunk's position, so instances are evenly spread
+// without visible repeats; each point of the pattern is kept only where the
+// height and slope of the height map match the layer's rules.
+//
+// Instances go to the GPU through the UploadRing, one buffer per chunk, and
+// every layer of a chunk is a single instanced draw: the number of draws
+// follows the number of chunks in view, never the number of instances. Chunks
+// outside the frustum or past a layer's draw distance are skipped, and the
+// vertex shader shrinks instances away as they near it.
+//
+// Which chunks exist, are built first and are drawn is decided on the
+// simulation thread by plan(), like the planet's quadtrees. Plans reach the
+// GL thread through a HandoffQueue, and edits of the ground the other way.
+class Scatter {
+	public:
+		// heights is the noise map the height map texture was rendered from,
+		// covering world_size units, with height_scale the world height of the
+		// top of the height map
+		Scatter(const noise::utils::NoiseMap &heights, float world_size, float height_scale,
+			UploadRing &uploads, JobSystem &jobs);
+		~Scatter();
+
+		// Simulation thread only: streams chunks around the camera, picks the
+		// ones to draw and hands the plan to the GL thread. With a prefetcher,
+		// chunks along its path are built ahead of time
+		void plan(const glm::vec3 &camera_position, const glm::mat4 &view_projection,
+			const Prefetcher* prefetcher = NULL);
+
+		// GL thread only, before UploadRing::flush(): takes the plans handed
+		// over, frees the buffers of dropped chunks and uploads those the
+		// workers have finished
+		void upload();
+
+		// GL thread only: draws the chunks of the newest plan with shader, which
+		// has to be the scatter shader
+		void draw(Shader &shader);
+
+		// GL thread only: the ground changed in a rectangle of texels. heights is
+		// the whole height map in texture order, 0 to 1, and is only copied as a
+		// snapshot for the next plan(), which rebuilds the chunks over the
+		// rectangle from it. They draw their old instances until the new ones
+		// are uploaded
+		void update_ground(const HeightTiles &heights, const TexelRect &changed);
+
+		inline const ScatterLayer &get_layer(int layer) const { return layers[layer]; }
+		inline size_t get_chunk_count() const { return chunks.size(); }
+		inline size_t get_instance_count() const { return instance_count; }
+		inline size_t get_drawn_instance_count() const { return drawn_instance_count; }
+		inline size_t get_cancelled_count() const { return scheduler.get_cancelled_count(); }
+
+	private:
+		// Work handed to the job system, and the buffer it ends up in. The chunk
+		// owns it; dropping it only sets cancelled, since a worker or the GL
+		// thread may still hold a reference
+		struct ChunkJob {
+			int x, z;
+			std::atomic<bool> cancelled;
+			std::shared_ptr<const HeightTiles> heights; // As of the request, edits after it don't reach the build
+			std::vector<ScatterInstance> instances[SCATTER_LAYER_COUNT];
+			unsigned int vbo; // GL thread only
+			unsigned int counts[SCATTER_LAYER_COUNT]; // Written by the GL thread before uploaded
+			size_t offsets[SCATTER_LAYER_COUNT]; // Byte offset of each layer in vbo
+			std::atomic<bool> uploaded; // Set by the GL thread once vbo is queued
+		};
+
+		struct Chunk {
+			int x, z;
+			std::shared_ptr<ChunkJob> job; // The newest build
+			std::shared_ptr<ChunkJob> shown; // The newest build uploaded, drawn until job replaces it
+			float distance; // From the camera along the ground, as of the last plan()
+		};
+
+		struct DrawnChunk {
+			std::shared_ptr<ChunkJob> job;
+			float distance;
+		};
+
+		// What the GL thread needs from one plan()
+		struct Plan {
+			std::vector<DrawnChunk> draw_list;
+			std::vector<std::shared_ptr<ChunkJob>> released; // Builds dropped since the last plan
+		};
+
+		struct Edit {
+			std::shared_ptr<const HeightTiles> heights; // NULL for none
+			TexelRect changed;
+		};
+
+		struct Mesh {
+			unsigned int vao;
+			unsigned int vbo;
+			int vertex_count;
+			float radius; // Bounding radius at scale 1
+		};
+
+		ScatterLayer layers[SCATTER_LAYER_COUNT];
+		std::vector<glm::vec2> patterns[SCATTER_LAYER_COUNT]; // Points in the unit square, tiling it
+		Mesh meshes[SCATTER_LAYER_COUNT];
+
+		int map_width, map_height;
+		int chunks_across;
+		float world_size;
+		float height_scale;
+		UploadRing &uploads;
+		TileScheduler scheduler;
+
+		// Simulation thread only. The height map is in texture order, 0 to 1, so
+		// instances follow the rendered surface: a snapshot, replaced on every
+		// edit, that builds share
+		std::shared_ptr<const HeightTiles> heights;
+		std::vector<glm::vec2> ground; // Lowest and highest ground under every chunk, in world units
+		std::unordered_map<long long, Chunk*> chunks;
+		std::vector<DrawnChunk> draw_list; // Of the current plan()
+		std::vector<std::shared_ptr<ChunkJob>> released; // Not handed over yet, the queue was full
+		size_t drawn_instance_count;
+
+		// GL thread only
+		std::shared_ptr<Plan> shown; // Newest plan taken, the one drawn
+		std::vector<std::shared_ptr<ChunkJob>> pending_uploads; // Built but not yet in the ring
+		Edit unsent_edit; // Not handed over yet, the queue was full
+		size_t instance_count;
+
+		HandoffQueue<std::shared_ptr<Plan>> plans;
+		HandoffQueue<Edit> edits;
+
+		// Built by a worker, not yet taken by the GL thread. Builds are only
+		// started while the ones in it and the ones running fit, so pushing to
+		// it never waits
+		HandoffQueue<std::shared_ptr<ChunkJob>> finished;
+		std::atomic<size_t> unclaimed; // Builds pushed, or about to be, and not popped yet
+
+		void apply_edit(const Edit &edit);
+		void create_chunk(int x, int z);
+		void request_build(Chunk* chunk);
+		void destroy_chunk(Chunk* chunk);
+		void publish();
+		void release(std::vector<std::shared_ptr<ChunkJob>> &jobs);
+
+		float sample_height(const HeightTiles &heights, float x, float z) const;
+		TexelRect ground_texels(int x, int z) const;
+		glm::vec2 measure_ground(const float* heights, int stride, const TexelRect &rect) const;
+		void build_meshes();
+		void run(const std::shared_ptr<ChunkJob> &job);
+		void build(ChunkJob &job) const;
+};
@@ -10,8 +10,10 @@
 #include <gtc/matrix_transform.hpp>
 #include <gtc/type_ptr.hpp>
 #include <vector>
+#include <unordered_map>
 
 #include "texture.h"
+#include "ShaderCache.h"
 
 class Shader {
 	public:
@@ -25,116 +27,36 @@ class Shader {
 		// Constructor reads and builds the shader
 		Shader(const char* vertex_path, const char* fragment_path) {
 			// Retrieve the vertex/fragment source code from filePath
-			std::string vertex_code;
-			std::string fragment_code;
-			std::ifstream v_shader_file;
-			std::ifstream f_shader_file;
+			std::vector<ShaderSource> sources;
+			sources.push_back(ShaderSource(GL_VERTEX_SHADER, read_shader_file(vertex_path)));
+			sources.push_back(ShaderSource(GL_FRAGMENT_SHADER, read_shader_file(fragment_path)));
 
-			// Ensure ifstream objects can throw exceptions
-			v_shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-			f_shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-
-			try {
-				// Open files
-				v_shader_file.open(vertex_path);
-				f_shader_file.open(fragment_path);
-				std::stringstream v_shader_stream, f_shader_stream;
-
-				// Read file's buffer contents into streams
-				v_shader_stream << v_shader_file.rdbuf();
-				f_shader_stream << f_shader_file.rdbuf();
-
-				// Close file handlers
-				v_shader_file.close();
-				f_shader_file.close();
-
-				// Convert stream into string
-				vertex_code = v_shader_stream.str();
-				fragment_code = f_shader_stream.str();
-			} 
-			catch(std::ifstream::failure e) {
-				std::cout << "error: shader file not successfully read" << std::endl;
-			}
-
-			// Compile the shaders
-
-			const char* v_shader_code = vertex_code.c_str();
-			const char* f_shader_code = fragment_code.c_str();
-
-			unsigned int vertex, fragment;
-
-			// Set up vertex shader
-			vertex = glCreateShader(GL_VERTEX_SHADER);
-			glShaderSource(vertex, 1, &v_shader_code, NULL);
-			glCompileShader(vertex);
-			check_compile_errors(vertex, "VERTEX");
-
-			// Set up fragment shader
-			fragment = glCreateShader(GL_FRAGMENT_SHADER);
-			glShaderSource(fragment, 1, &f_shader_code, NULL);
-			glCompileShader(fragment);
-			check_compile_errors(fragment, "FRAGMENT");
-
-			// Link both shader objects into a shader program that we can use for rendering
-			// Shader program object is the final linked version of multiple shaders combined
-			id = glCreateProgram(); // Create the ID
-			glAttachShader(id, vertex); // Attach the vertex shader
-			glAttachShader(id, fragment); // Attach the fragment shader
-			glLinkProgram(id); // Link the shaders altogether
-			check_compile_errors(id, "PROGRAM");
-
-			// Delete the shaders we created, the useful part is already in the shader program
-			glDeleteShader(vertex);
-			glDeleteShader(fragment);
+			build_program(sources);
 
 			std::cout << "Shader " << id << " created successfully from " << vertex_path << " and " << fragment_path << std::endl;
 		}
 
 		Shader(const char* vertex_path, const char* tess_control_path, const char* tess_eval_path, const char* geomPath, const char* fragPath) {
-			unsigned int vertex, tess_control, tess_eval, geometry, fragment;
-			vertex = compile_shader(GL_VERTEX_SHADER, vertex_path);
-			tess_control = compile_shader(GL_TESS_CONTROL_SHADER, tess_control_path);
-			tess_eval = compile_shader(GL_TESS_EVALUATION_SHADER, tess_eval_path);
-			geometry = compile_shader(GL_GEOMETRY_SHADER, geomPath);
-			fragment = compile_shader(GL_FRAGMENT_SHADER, fragPath);
-
-			id = glCreateProgram();
-			glAttachShader(id, vertex);
-			glAttachShader(id, tess_control);
-			glAttachShader(id, tess_eval);
-			glAttachShader(id, geometry);
-			glAttachShader(id, fragment);
-			glLinkProgram(id);
-			check_compile_errors(id, "PROGRAM");
+			std::vector<ShaderSource> sources;
+			sources.push_back(ShaderSource(GL_VERTEX_SHADER, read_shader_file(vertex_path)));
+			sources.push_back(ShaderSource(GL_TESS_CONTROL_SHADER, read_shader_file(tess_control_path)));
+			sources.push_back(ShaderSource(GL_TESS_EVALUATION_SHADER, read_shader_file(tess_eval_path)));
+			sources.push_back(ShaderSource(GL_GEOMETRY_SHADER, read_shader_file(geomPath)));
+			sources.push_back(ShaderSource(GL_FRAGMENT_SHADER, read_shader_file(fragPath)));
 
-			glDeleteShader(vertex);
-			glDeleteShader(tess_control);
-			glDeleteShader(tess_eval);
-			glDeleteShader(geometry);
-			glDeleteShader(fragment);
+			build_program(sources);
 
 			std::cout << "Tessellation Shader Created" << std::endl;
 		}
 
 		Shader(const char* vertex_path, const char* tess_control_path, const char* tess_eval_path, const char* fragPath) {
-			unsigned int vertex, tess_control, tess_eval, fragment;
-			vertex = compile_shader(GL_VERTEX_SHADER, vertex_path);
-			tess_control = compile_shader(GL_TESS_CONTROL_SHADER, tess_control_path);
-			tess_eval = compile_shader(GL_TESS_EVALUATION_SHADER, tess_eval_path);
-			fragment = compile_shader(GL_FRAGMENT_SHADER, fragPath);
-
-			id = glCreateProgram();
-			glAttachShader(id, vertex);
-			glAttachShader(id, tess_control);
-			glAttachShader(id, tess_eval);
-			glAttachShader(id, fragment);
-			glLinkProgram(id);
-			check_compile_errors(id, "PROGRAM");
+			std::vector<ShaderSource> sources;
+			sources.push_back(ShaderSource(GL_VERTEX_SHADER, read_shader_file(vertex_path)));
+			sources.push_back(ShaderSource(GL_TESS_CONTROL_SHADER, read_shader_file(tess_control_path)));
+			sources.push_back(ShaderSource(GL_TESS_EVALUATION_SHADER, read_shader_file(tess_eval_path)));
+			sources.push_back(ShaderSource(GL_FRAGMENT_SHADER, read_shader_file(fragPath)));
 
-			glDeleteShader(vertex);
-			glDeleteShader(tess_control);
-			glDeleteShader(tess_eval);
-			glDeleteShader(fragment);
+			build_program(sources);
 
 			std::cout << "Tessellation Shader Created" << std::endl;
 		}
@@ -144,53 +66,98 @@ class Shader {
 			glUseProgram(id);
 		}
 
+		// Returns the location resolved at link time, or -1 if the program has no such uniform
+		int get_uniform_location(const std::string &name) const {
+			std::unordered_map<std::string, int>::const_iterator it = uniform_locations.find(name);
+			return it != uniform_locations.end() ? it->second : -1;
+		}
+
+		// Points the named uniform block at a buffer binding point (see UniformBuffer)
+		void bind_uniform_block(const std::string &name, unsigned int binding) {
+			unsigned int index = glGetUniformBlockIndex(id, name.c_str());
+			if(index != GL_INVALID_INDEX)
+				glUniformBlockBinding(id, index, binding);
+		}
+
 		// Utility uniform functions
 		void set_bool(const std::string &name, bool value) const {
-			glUniform1i(glGetUniformLocation(id, name.c_str()), (int)value);
+			glUniform1i(get_uniform_location(name), (int)value);
 		}
 		void set_int(const std::string &name, int value) const {
-			glUniform1i(glGetUniformLocation(id, name.c_str()), value);
+			glUniform1i(get_uniform_location(name), value);
 		}
 
 		void set_float(const std::string &name, float value) const {
-			glUniform1f(glGetUniformLocation(id, name.c_str()), value);
+			glUniform1f(get_uniform_location(name), value);
 		}
 
 		void set_vec2(const std::string &name, glm::vec2 vec) const {
-			glUniform2f(glGetUniformLocation(id, name.c_str()), vec.x, vec.y);
+			glUniform2f(get_uniform_location(name), vec.x, vec.y);
 		}
 
 		void set_vec2(const std::string &name, float x, float y) const {
-			glUniform2f(glGetUniformLocation(id, name.c_str()), x, y);
+			glUniform2f(get_uniform_location(name), x, y);
 		}
 
 		void set_vec3(const std::string &name, glm::vec3 vec) {
-			glUniform3fv(glGetUniformLocation(id, name.c_str()), 1, glm::value_ptr(vec));
+			glUniform3fv(get_uniform_location(name), 1, glm::value_ptr(vec));
 		}
 
 		void set_vec3(const std::string &name, float x, float y, float z) const {
-			glUniform3f(glGetUniformLocation(id, name.c_str()), x, y, z);
+			glUniform3f(get_uniform_location(name), x, y, z);
 		}
 
 		void set_vec4(const std::string &name, glm::vec4 vec) {
-			glUniform4fv(glGetUniformLocation(id, name.c_str()), 1, glm::value_ptr(vec));
+			glUniform4fv(get_uniform_location(name), 1, glm::value_ptr(vec));
 		}
 
 		void set_mat3(const std::string &name, glm::mat4 mat) const {
-			glUniformMatrix3fv(glGetUniformLocation(id, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+			glUniformMatrix3fv(get_uniform_location(name), 1, GL_FALSE, glm::value_ptr(mat));
 		}
 
 		void set_mat4(const std::string &name, glm::mat4 mat) const {
-			glUniformMatrix4fv(glGetUniformLocation(id, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+			glUniformMatrix4fv(get_uniform_location(name), 1, GL_FALSE, glm::value_ptr(mat));
 		}
 
 		// Basically just setSampler
 		void set_texture(const std::string &name, unsigned int textureLocation) {
-			glUniform1i(glGetUniformLocation(id, name.c_str()), textureLocation);
+			glUniform1i(get_uniform_location(name), textureLocation);
 		}
 
 	private:
-		unsigned int compile_shader(GLenum type, const char* path) {
+		// Uniform name -> location, filled once after linking so set_* never hits the driver's string lookup
+		std::unordered_map<std::string, int> uniform_locations;
+
+		void cache_uniform_locations() {
+			uniform_locations.clear();
+
+			int count = 0;
+			int max_length = 0;
+			glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+			glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+			std::vector<char> name(max_length + 1);
+			for(int i = 0; i < count; i++) {
+				int length = 0, size = 0;
+				GLenum type;
+				glGetActiveUniform(id, i, (GLsizei)name.size(), &length, &size, &type, name.data());
+
+				std::string uniform_name(name.data(), length);
+				int location = glGetUniformLocation(id, uniform_name.c_str());
+				if(location < 0)
+					continue; // Lives in a uniform block
+
+				uniform_locations[uniform_name] = location;
+
+				// Arrays are reported as "name[0]", but are usually set by their base name
+				size_t bracket = uniform_name.find('[');
+				if(bracket != std::string::npos)
+					uniform_locations[uniform_name.substr(0, bracket)] = location;
+			}
+		}
+
+		// Reads a whole shader source file into a string
+		std::string read_shader_file(const char* path) {
 			std::string code;
 			std::ifstream shader_file;
 
@@ -213,6 +180,46 @@ class Shader {
 				std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ at path " << path << std::endl;
 			}
 
+			return code;
+		}
+
+		// Loads the linked program from the binary cache, or compiles and links the stages and caches the result
+		void build_program(const std::vector<ShaderSource> &sources) {
+			std::string key = ShaderCache::make_key(sources);
+
+			id = glCreateProgram();
+			if(ShaderCache::load(id, key)) {
+				cache_uniform_locations();
+				return;
+			}
+
+			// The driver rejected the cached binary (or there was none), start from a clean program
+			glDeleteProgram(id);
+			id = glCreateProgram();
+
+			std::vector<unsigned int> shaders;
+			for(size_t i = 0; i < sources.size(); i++) {
+				unsigned int shader = compile_shader(sources[i].type, sources[i].code);
+				glAttachShader(id, shader);
+				shaders.push_back(shader);
+			}
+
+			// Link all shader objects into a shader program that we can use for rendering
+			ShaderCache::prepare(id);
+			glLinkProgram(id);
+			check_compile_errors(id, "PROGRAM");
+			cache_uniform_locations();
+
+			// Delete the shaders we created, the useful part is already in the shader program
+			for(size_t i = 0; i < shaders.size(); i++) {
+				glDetachShader(id, shaders[i]);
+				glDeleteShader(shaders[i]);
+			}
+
+			ShaderCache::store(id, key);
+		}
+
+		unsigned int compile_shader(GLenum type, const std::string &code) {
 			// Compile the shader
 			const char* shaderCode = code.c_str();
 
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Directory the linked program binaries are written to
+#define SHADER_CACHE_DIR "shader_cache"
+
+// One stage of a shader program, already read from disk
+struct ShaderSource {
+	GLenum type;
+	std::string code;
+
+	ShaderSource(GLenum type, const std::string &code) : type(type), code(code) {
+
+	}
+};
+
+// Stores linked program binaries on disk so later launches can skip compiling.
+// Entries are keyed by a hash of every stage's source plus the driver identity,
+// so editing a shader or updating the driver simply misses the cache.
+class ShaderCache {
+	public:
+		// Whether the context can retrieve and reload program binaries at all
+		static bool supported() {
+			if(!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+				return false;
+
+			int formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			return formats > 0;
+		}
+
+		// Builds the cache key for a set of stages on the current driver
+		static std::string make_key(const std::vector<ShaderSource> &sources) {
+			uint64_t hash = 14695981039346656037ULL; // FNV-1a offset basis
+			for(size_t i = 0; i < sources.size(); i++) {
+				hash = fnv1a(hash, &sources[i].type, sizeof(GLenum));
+				hash = fnv1a(hash, sources[i].code.data(), sources[i].code.size());
+			}
+
+			const GLubyte* driver[] = { glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION) };
+			for(int i = 0; i < 3; i++) {
+				if(driver[i])
+					hash = fnv1a(hash, driver[i], strlen((const char*)driver[i]) + 1);
+			}
+
+			char key[17];
+			snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+			return key;
+		}
+
+		// Must be called before linking so the driver keeps the binary around
+		static void prepare(unsigned int program) {
+			if(supported())
+				glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+
+		// Loads a cached binary into the program. Returns false on a miss or when the driver rejects it
+		static bool load(unsigned int program, const std::string &key) {
+			if(!supported())
+				return false;
+
+			FILE* file = fopen(get_path(key).c_str(), "rb");
+			if(!file)
+				return false;
+
+			Header header;
+			std::vector<char> binary;
+			bool ok = fread(&header, sizeof(Header), 1, file) == 1 && header.magic == MAGIC;
+			if(ok) {
+				// A corrupt or cut off cache can claim any length, it has to fit in the file
+				long start = ftell(file);
+				ok = start >= 0 && fseek(file, 0, SEEK_END) == 0;
+				long end = ok ? ftell(file) : -1;
+				ok = ok && end >= start && header.length <= (unsigned long)(end - start)
+					&& fseek(file, start, SEEK_SET) == 0;
+			}
+			if(ok) {
+				binary.resize(header.length);
+				ok = header.length > 0 && fread(binary.data(), 1, binary.size(), file) == binary.size();
+			}
+			fclose(file);
+
+			if(!ok)
+				return false;
+
+			glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+
+			int success = 0;
+			glGetProgramiv(program, GL_LINK_STATUS, &success);
+			return success != 0;
+		}
+
+		// Writes the linked program's binary to the cache. Failures only cost the next launch a compile
+		static void store(unsigned int program, const std::string &key) {
+			if(!supported())
+				return;
+
+			int success = 0, length = 0;
+			glGetProgramiv(program, GL_LINK_STATUS, &success);
+			glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+			if(!success || length <= 0)
+				return;
+
+			std::vector<char> binary(length);
+			Header header;
+			header.magic = MAGIC;
+			glGetProgramBinary(program, length, NULL, &header.format, binary.data());
+			header.length = (uint32_t)length;
+
+#ifdef _WIN32
+			_mkdir(SHADER_CACHE_DIR);
+#else
+			mkdir(SHADER_CACHE_DIR, 0755);
+#endif
+			FILE* file = fopen(get_path(key).c_str(), "wb");
+			if(!file)
+				return;
+
+			fwrite(&header, sizeof(Header), 1, file);
+			fwrite(binary.data(), 1, binary.size(), file);
+			fclose(file);
+		}
+
+	private:
+		static const uint32_t MAGIC = 0x42504c47; // "GLPB"
+
+		struct Header {
+			uint32_t magic;
+			GLenum format;
+			uint32_t length;
+		};
+
+		static uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+			const unsigned char* bytes = (const unsigned char*)data;
+			for(size_t i = 0; i < size; i++) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ULL; // FNV-1a prime
+			}
+			return hash;
+		}
+
+		static std::string get_path(const std::string &key) {
+			return std::string(SHADER_CACHE_DIR) + "/" + key + ".bin";
+		}
+};
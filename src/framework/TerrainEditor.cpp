@@ -0,0 +1,359 @@
+#include "TerrainEditor.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace noise;
+
+namespace {
+	// Bisection steps narrowing down where a ray crosses the ground
+	const int RAY_REFINE_STEPS = 8;
+
+	// Half width of the smoothing kernel, as a fraction of the brush radius
+	const float SMOOTH_REACH = 0.1f;
+
+	const TexelRect EMPTY_RECT = { 0, 0, 0, 0 };
+
+	// Weight of a brush at a distance from its center, given as a fraction of
+	// the radius squared. Smooth at the center and at the edge
+	float falloff(float distance_squared) {
+		float t = 1.0f - distance_squared;
+		return t > 0.0f ? t * t : 0.0f;
+	}
+
+	TexelRect merge(const TexelRect &a, const TexelRect &b) {
+		if(a.is_empty())
+			return b;
+		if(b.is_empty())
+			return a;
+		TexelRect rect = {
+			std::min(a.column0, b.column0), std::min(a.row0, b.row0),
+			std::max(a.column1, b.column1), std::max(a.row1, b.row1)
+		};
+		return rect;
+	}
+
+	// rect and the texels up to margin around it, as far as the map goes
+	TexelRect grow(const TexelRect &rect, int width, int height, int margin = 1) {
+		TexelRect grown = {
+			std::max(0, rect.column0 - margin), std::max(0, rect.row0 - margin),
+			std::min(width, rect.column1 + margin), std::min(height, rect.row1 + margin)
+		};
+		return grown;
+	}
+}
+
+TerrainEditor::TerrainEditor(const utils::NoiseMap &heights, float world_size, float height_scale,
+	unsigned int height_texture, unsigned int normal_texture, UploadRing &uploads) : map_width(heights.GetWidth()),
+	map_height(heights.GetHeight()), world_size(world_size), height_scale(height_scale), height_texture(height_texture),
+	normal_texture(normal_texture), uploads(uploads), strokes(TERRAIN_EDITOR_QUEUE_SIZE), dirty(EMPTY_RECT),
+	pending(EMPTY_RECT), stroke_count(0), history_position(0), step_open(false), step_serial(0),
+	history_moves(0) {
+	// The height texture is the rendered noise map turned upside down, and
+	// clamped to the range its gradient covers
+	std::vector<float> texels(map_width * map_height);
+	for(int row = 0; row < map_height; row++) {
+		const float* source = heights.GetConstSlabPtr(map_height - 1 - row);
+		for(int column = 0; column < map_width; column++)
+			texels[row * map_width + column] = std::max(0.0f, std::min(1.0f, (source[column] + 1.0f) * 0.5f));
+	}
+	TexelRect all = { 0, 0, map_width, map_height };
+	this->heights = HeightTiles(map_width, map_height);
+	this->heights.write(all, texels.data());
+	saved_in.assign(this->heights.get_tile_count(), 0);
+
+	// The one full upload. Only the base levels are read from here on. The
+	// textures are already bound to their units for drawing, so whatever the
+	// active unit held is put back afterwards
+	GLint bound = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+	glBindTexture(GL_TEXTURE_2D, height_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, map_width, map_height, 0, GL_RED, GL_FLOAT, texels.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, normal_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, (GLuint)bound);
+}
+
+bool TerrainEditor::submit(const BrushStroke &stroke) {
+	BrushStroke queued = stroke;
+	return strokes.try_push(queued);
+}
+
+void TerrainEditor::undo() {
+	history_moves--;
+}
+
+void TerrainEditor::redo() {
+	history_moves++;
+}
+
+bool TerrainEditor::update() {
+	TexelRect edited = move_history(history_moves.exchange(0));
+	BrushStroke stroke;
+	while(strokes.pop(stroke)) {
+		// Aimed as of the heights the stroke lands on, so strokes queued together build on each other
+		glm::vec3 center;
+		if(stroke.starts_step)
+			step_open = false;
+		if(!raycast(stroke.origin, stroke.direction, center))
+			continue;
+		edited = merge(edited, apply(stroke, center));
+		stroke_count++;
+	}
+
+	// A rectangle the ring had no room for goes out with the next one
+	TexelRect unsent = merge(pending, edited);
+	pending = unsent.is_empty() || upload(unsent) ? EMPTY_RECT : unsent;
+
+	if(edited.is_empty())
+		return false;
+	dirty = edited;
+	return true;
+}
+
+bool TerrainEditor::raycast(const glm::vec3 &origin, const glm::vec3 &direction, glm::vec3 &hit) const {
+	if(glm::length(direction) <= 0.0f)
+		return false;
+	glm::vec3 ray = glm::normalize(direction);
+
+	// Clip the ray to the box the terrain fills
+	const glm::vec3 low(0.0f, 0.0f, 0.0f);
+	const glm::vec3 high(world_size, height_scale, world_size);
+	float enter = 0.0f, leave = FLT_MAX;
+	for(int i = 0; i < 3; i++) {
+		if(fabsf(ray[i]) < 1e-6f) {
+			if(origin[i] < low[i] || origin[i] > high[i])
+				return false;
+			continue;
+		}
+		float t0 = (low[i] - origin[i]) / ray[i];
+		float t1 = (high[i] - origin[i]) / ray[i];
+		enter = std::max(enter, std::min(t0, t1));
+		leave = std::min(leave, std::max(t0, t1));
+	}
+	if(enter > leave)
+		return false;
+
+	// Step a texel at a time until the ray is under the ground, then narrow it down
+	const float step = world_size / std::max(map_width, map_height);
+	auto below = [&](float t) {
+		glm::vec3 point = origin + ray * t;
+		return point.y <= sample_height(point.x, point.z);
+	};
+	float previous = enter;
+	for(float t = enter;; t = std::min(t + step, leave)) {
+		if(below(t)) {
+			float above = previous;
+			for(int i = 0; i < RAY_REFINE_STEPS && t > above; i++) {
+				float middle = (above + t) * 0.5f;
+				if(below(middle))
+					t = middle;
+				else
+					above = middle;
+			}
+			hit = origin + ray * t;
+			return true;
+		}
+		if(t >= leave)
+			return false;
+		previous = t;
+	}
+}
+
+void TerrainEditor::open_step() {
+	// Whatever was undone can't be redone on top of a new step
+	history.resize(history_position);
+	if(history.size() >= TERRAIN_EDITOR_UNDO_STEPS)
+		history.pop_front();
+	history.push_back(std::vector<SavedTile>());
+	history_position = history.size();
+	step_serial++;
+	step_open = true;
+}
+
+TexelRect TerrainEditor::move_history(int moves) {
+	TexelRect changed = EMPTY_RECT;
+	for(; moves != 0; moves += moves < 0 ? 1 : -1) {
+		if(moves < 0 ? history_position == 0 : history_position == history.size())
+			break;
+		if(moves < 0)
+			history_position--;
+
+		// The swap leaves the step holding what it replaced, ready to go back
+		std::vector<SavedTile> &step = history[history_position];
+		for(size_t i = 0; i < step.size(); i++) {
+			heights.swap_tile(step[i].index, step[i].tile);
+			changed = merge(changed, heights.get_tile_rect(step[i].index));
+		}
+
+		if(moves > 0)
+			history_position++;
+	}
+	// Strokes after this start afresh rather than add to a step that moved
+	if(!changed.is_empty())
+		step_open = false;
+	return changed;
+}
+
+float TerrainEditor::sample_height(float x, float z) const {
+	// Same as the GPU's linear filtering of the height texture at x, z / world_size
+	float u = std::max(0.0f, std::min((float)map_width - 1.0f, x / world_size * map_width - 0.5f));
+	float v = std::max(0.0f, std::min((float)map_height - 1.0f, z / world_size * map_height - 0.5f));
+	int c0 = std::min((int)u, map_width - 2 < 0 ? 0 : map_width - 2);
+	int r0 = std::min((int)v, map_height - 2 < 0 ? 0 : map_height - 2);
+	int c1 = std::min(c0 + 1, map_width - 1);
+	int r1 = std::min(r0 + 1, map_height - 1);
+	float fu = u - c0;
+	float fv = v - r0;
+
+	float top = heights.get(c0, r0) * (1.0f - fu) + heights.get(c1, r0) * fu;
+	float bottom = heights.get(c0, r1) * (1.0f - fu) + heights.get(c1, r1) * fu;
+	return (top * (1.0f - fv) + bottom * fv) * height_scale;
+}
+
+TexelRect TerrainEditor::apply(const BrushStroke &stroke, const glm::vec3 &center) {
+	// Texel centers are half a texel in from the corners of their cells
+	const float spacing_x = world_size / map_width;
+	const float spacing_z = world_size / map_height;
+	TexelRect rect;
+	rect.column0 = std::max(0, (int)ceilf((center.x - stroke.radius) / spacing_x - 0.5f));
+	rect.column1 = std::min(map_width, (int)floorf((center.x + stroke.radius) / spacing_x - 0.5f) + 1);
+	rect.row0 = std::max(0, (int)ceilf((center.z - stroke.radius) / spacing_z - 0.5f));
+	rect.row1 = std::min(map_height, (int)floorf((center.z + stroke.radius) / spacing_z - 0.5f) + 1);
+	if(rect.is_empty() || stroke.radius <= 0.0f)
+		return EMPTY_RECT;
+
+	// Smoothing averages the neighbours as they were before the stroke, over a
+	// kernel that grows with the brush. Summing them up first makes every
+	// average four lookups, however wide the kernel
+	int reach = std::max(1, (int)(stroke.radius * SMOOTH_REACH / std::min(spacing_x, spacing_z)));
+	TexelRect source = grow(rect, map_width, map_height, reach);
+	int sums_width = source.column1 - source.column0 + 1;
+	if(stroke.type == BRUSH_SMOOTH) {
+		sums.assign(sums_width * (source.row1 - source.row0 + 1), 0.0);
+		for(int row = source.row0; row < source.row1; row++) {
+			double* line = &sums[(row - source.row0 + 1) * sums_width];
+			const double* above = line - sums_width;
+			double sum = 0.0;
+			for(int column = source.column0; column < source.column1; column++) {
+				sum += heights.get(column, row);
+				line[column - source.column0 + 1] = above[column - source.column0 + 1] + sum;
+			}
+		}
+	}
+
+	if(!step_open)
+		open_step();
+
+	// A tile at a time, keeping each for undo the first time the step writes it
+	const float target = sample_height(center.x, center.z) / height_scale;
+	const float inverse_radius_squared = 1.0f / (stroke.radius * stroke.radius);
+	int tiles_across = heights.get_tiles_across();
+	for(int tile_z = rect.row0 >> HEIGHT_TILE_SHIFT; tile_z <= (rect.row1 - 1) >> HEIGHT_TILE_SHIFT; tile_z++) {
+		for(int tile_x = rect.column0 >> HEIGHT_TILE_SHIFT; tile_x <= (rect.column1 - 1) >> HEIGHT_TILE_SHIFT; tile_x++) {
+			int index = tile_z * tiles_across + tile_x;
+			if(saved_in[index] != step_serial) {
+				SavedTile saved = { index, heights.get_tile(index) };
+				history.back().push_back(saved);
+				saved_in[index] = step_serial;
+			}
+			float* tile = heights.edit_tile(index);
+
+			TexelRect part = heights.get_tile_rect(index);
+			part.column0 = std::max(part.column0, rect.column0);
+			part.row0 = std::max(part.row0, rect.row0);
+			part.column1 = std::min(part.column1, rect.column1);
+			part.row1 = std::min(part.row1, rect.row1);
+			for(int row = part.row0; row < part.row1; row++) {
+				float dz = (row + 0.5f) * spacing_z - center.z;
+				for(int column = part.column0; column < part.column1; column++) {
+					float dx = (column + 0.5f) * spacing_x - center.x;
+					float weight = falloff((dx * dx + dz * dz) * inverse_radius_squared);
+					if(weight <= 0.0f)
+						continue;
+
+					float &height = tile[((row & (HEIGHT_TILE_SIZE - 1)) << HEIGHT_TILE_SHIFT) + (column & (HEIGHT_TILE_SIZE - 1))];
+					switch(stroke.type) {
+						case BRUSH_RAISE:
+							height += stroke.strength * weight / height_scale;
+							break;
+						case BRUSH_LOWER:
+							height -= stroke.strength * weight / height_scale;
+							break;
+						case BRUSH_SMOOTH: {
+							int r0 = std::max(row - reach, source.row0) - source.row0;
+							int r1 = std::min(row + reach + 1, source.row1) - source.row0;
+							int c0 = std::max(column - reach, source.column0) - source.column0;
+							int c1 = std::min(column + reach + 1, source.column1) - source.column0;
+							double sum = sums[r1 * sums_width + c1] - sums[r0 * sums_width + c1] - sums[r1 * sums_width + c0]
+								+ sums[r0 * sums_width + c0];
+							float average = (float)(sum / ((r1 - r0) * (c1 - c0)));
+							height += (average - height) * std::min(1.0f, stroke.strength * weight);
+							break;
+						}
+						case BRUSH_FLATTEN:
+							height += (target - height) * std::min(1.0f, stroke.strength * weight);
+							break;
+						default:
+							break;
+					}
+					height = std::max(0.0f, std::min(1.0f, height));
+				}
+			}
+		}
+	}
+	return rect;
+}
+
+bool TerrainEditor::upload(const TexelRect &rect) {
+	// The normals on the edge of the rectangle lean on the heights inside it
+	TexelRect normals = grow(rect, map_width, map_height);
+	int width = rect.column1 - rect.column0, height = rect.row1 - rect.row0;
+	int normals_width = normals.column1 - normals.column0, normals_height = normals.row1 - normals.row0;
+
+	// Both or neither, heights without their normals would light the edit wrong
+	UploadAllocation height_allocation, normal_allocation;
+	if(!uploads.allocate(width * height * sizeof(float), sizeof(float), height_allocation))
+		return false;
+	if(!uploads.allocate(normals_width * normals_height * 4, 4, normal_allocation)) {
+		uploads.cancel(height_allocation);
+		return false;
+	}
+
+	heights.read(rect, (float*)height_allocation.ptr);
+	encode_normals(normals, (unsigned char*)normal_allocation.ptr);
+
+	// Edits can't wait for a frame with budget left, but they count against it
+	uploads.submit_texture_copy(height_allocation, height_texture, 0, rect.column0, rect.row0, width, height,
+		GL_RED, GL_FLOAT);
+	uploads.submit_texture_copy(normal_allocation, normal_texture, 0, normals.column0, normals.row0,
+		normals_width, normals_height, GL_RGBA, GL_UNSIGNED_BYTE);
+	return true;
+}
+
+void TerrainEditor::encode_normals(const TexelRect &rect, unsigned char* out) const {
+	// Same encoding as the baked normal map: the normal's x in red, up in blue
+	// and z in green, each mapped from -1 to 1 onto 0 to 255. Texture rows run
+	// along world z, against the noise map the bake came from, so green holds
+	// the slope along z rather than the normal's z
+	const float spacing_x = world_size / map_width;
+	const float spacing_z = world_size / map_height;
+	for(int row = rect.row0; row < rect.row1; row++) {
+		int r0 = std::max(row - 1, 0), r1 = std::min(row + 1, map_height - 1);
+		for(int column = rect.column0; column < rect.column1; column++) {
+			int c0 = std::max(column - 1, 0), c1 = std::min(column + 1, map_width - 1);
+			float slope_x = c1 > c0 ? (heights.get(c1, row) - heights.get(c0, row)) * height_scale
+				/ ((c1 - c0) * spacing_x) : 0.0f;
+			float slope_z = r1 > r0 ? (heights.get(column, r1) - heights.get(column, r0)) * height_scale
+				/ ((r1 - r0) * spacing_z) : 0.0f;
+
+			float length = sqrtf(slope_x * slope_x + slope_z * slope_z + 1.0f);
+			float normal[3] = { -slope_x / length, slope_z / length, 1.0f / length };
+			for(int i = 0; i < 3; i++)
+				*out++ = (unsigned char)((unsigned int)floorf((normal[i] + 1.0f) * 127.5f) & 0xff);
+			*out++ = 0;
+		}
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm.hpp>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include "HandoffQueue.h"
+#include "HeightTiles.h"
+#include "UploadRing.h"
+#include "../utils/noiseutils.h"
+
+// Strokes waiting for the GL thread. Any more are dropped until it catches up
+#define TERRAIN_EDITOR_QUEUE_SIZE 256
+
+// Steps kept for undo, the oldest are forgotten past it. Each keeps the
+// tiles it changed as they were, so a step costs the area it touched
+#define TERRAIN_EDITOR_UNDO_STEPS 500
+
+enum BrushType {
+	BRUSH_RAISE,
+	BRUSH_LOWER,
+	BRUSH_SMOOTH,
+	BRUSH_FLATTEN,
+	BRUSH_TYPE_COUNT
+};
+
+// One application of a brush, aimed along a ray from the camera
+struct BrushStroke {
+	BrushType type;
+	glm::vec3 origin;
+	glm::vec3 direction;
+	float radius; // World units, the brush fades out towards it
+	float strength; // World units raised or lowered at the center, or the fraction smoothed or flattened
+	bool starts_step; // First stroke of a drag, which is undone as one step
+};
+
+// Sculpts the flat terrain while it is rendered.
+//
+// The editor keeps the height map on the CPU as HeightTiles, in texture
+// order and in the 0 to 1 range of the height texture, and takes the height
+// and normal textures over from the application: the heights are uploaded
+// once as floats, so sculpting isn't stuck on 8 bit steps, and both textures
+// drop their mipmaps, which edits would leave stale and the vertex shaders
+// never read.
+//
+// Strokes can be queued from any thread. update() applies the queued ones to
+// the CPU heights, recomputes the normals of the rectangle they touched plus
+// the texel around it, and writes only that rectangle of both textures
+// through the UploadRing, so a stroke costs the same on a 4k map as on a
+// small one. Whatever else follows the ground, like the bounds of the
+// scatter chunks, can be refreshed from get_dirty_rect() afterwards. The
+// baked light map is left as it was.
+//
+// Before a step writes to a tile for the first time it keeps the tile as it
+// was, and the copy on write leaves that one alone. Undoing a step swaps the
+// kept tiles back in, and keeps the ones they replace for redoing it.
+class TerrainEditor {
+	public:
+		// heights is the noise map the height texture was rendered from,
+		// covering world_size units, with height_scale the world height of the
+		// top of the height map. GL thread only
+		TerrainEditor(const noise::utils::NoiseMap &heights, float world_size, float height_scale,
+			unsigned int height_texture, unsigned int normal_texture, UploadRing &uploads);
+
+		// Queues a stroke for the next update(). Safe from any thread, false if
+		// the queue is full
+		bool submit(const BrushStroke &stroke);
+
+		// Queue undoing the last step or redoing the last one undone for the
+		// next update(). Safe from any thread
+		void undo();
+		void redo();
+
+		// GL thread only, before UploadRing::flush(): applies the queued strokes
+		// and queues the uploads of what they changed. False if nothing changed
+		bool update();
+
+		// Where the ray first meets the ground, in world units
+		bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, glm::vec3 &hit) const;
+
+		// Ground height at world x, z, as the GPU filters the height texture
+		float sample_height(float x, float z) const;
+
+		// Texels changed by the last update() that did anything
+		inline const TexelRect &get_dirty_rect() const { return dirty; }
+		// Copying them makes a snapshot, which costs a pointer per tile
+		inline const HeightTiles &get_heights() const { return heights; }
+		inline int get_map_width() const { return map_width; }
+		inline int get_map_height() const { return map_height; }
+		inline size_t get_stroke_count() const { return stroke_count; }
+		inline size_t get_undo_count() const { return history_position; }
+		inline size_t get_redo_count() const { return history.size() - history_position; }
+
+	private:
+		// A tile as it was before, or after, the step that changed it
+		struct SavedTile {
+			int index;
+			std::shared_ptr<HeightTile> tile;
+		};
+
+		// Height map in texture order, 0 to 1
+		HeightTiles heights;
+		int map_width, map_height;
+		float world_size;
+		float height_scale;
+		unsigned int height_texture;
+		unsigned int normal_texture;
+		UploadRing &uploads;
+
+		HandoffQueue<BrushStroke> strokes;
+		TexelRect dirty; // Of the last update() that changed anything
+		TexelRect pending; // Changed, but not yet uploaded for lack of ring space
+		std::vector<double> sums; // Summed area table of the heights before a smoothing stroke
+		size_t stroke_count;
+
+		// Steps before history_position can be undone, the ones from it redone.
+		// A step holds the tiles it changed as they were before, or after once
+		// it's undone
+		std::deque<std::vector<SavedTile>> history;
+		size_t history_position;
+		bool step_open; // Strokes go into the last step until a drag starts or the history moves
+		std::vector<size_t> saved_in; // Per tile, the serial of the last step that kept it
+		size_t step_serial;
+		std::atomic<int> history_moves; // Queued redos less undos
+
+		void open_step();
+		TexelRect move_history(int moves);
+
+		TexelRect apply(const BrushStroke &stroke, const glm::vec3 &center);
+		bool upload(const TexelRect &rect);
+		void encode_normals(const TexelRect &rect, unsigned char* out) const;
+};
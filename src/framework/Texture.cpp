@@ -1,7 +1,7 @@
 #include "texture.h"
 
 Texture::Texture(std::string file_name) : file_path(file_name) {
-	this->texture_ID = load();
+	this->texture_ID = load(decode(file_name));
 
 	// Set default texture coordinates
 	tex_coords[0] = 0; tex_coords[1] = 0; // bottom left
@@ -14,7 +14,7 @@ Texture::Texture(std::string file_name) : file_path(file_name) {
 }
 
 Texture::Texture(std::string file_name, std::vector<float> tc) : file_path(file_name) {
-	this->texture_ID = load();
+	this->texture_ID = load(decode(file_name));
 
 	// Set default texture coordinates
 	tex_coords[0] = tc[0]; tex_coords[1] = tc[1]; // bottom left
@@ -23,6 +23,39 @@ Texture::Texture(std::string file_name, std::vector<float> tc) : file_path(file_
 	tex_coords[6] = tc[6]; tex_coords[7] = tc[7]; // bottom right
 }
 
+Texture::Texture(std::string file_name, TextureImage image) : file_path(file_name) {
+	this->texture_ID = load(image);
+
+	// Set default texture coordinates
+	tex_coords[0] = 0; tex_coords[1] = 0; // bottom left
+	tex_coords[2] = 0; tex_coords[3] = 1; // top left
+	tex_coords[4] = 1; tex_coords[5] = 1; // top right
+	tex_coords[6] = 1; tex_coords[7] = 0; // bottom right
+
+	this->x = 0;
+	this->y = 0;
+}
+
+TextureImage Texture::decode(const std::string &file_name) {
+	TextureImage image;
+	image.data = NULL;
+	image.mapped = new MappedImage();
+
+	// Uncompressed BMPs go to GL straight from the file rather than through a decoded copy
+	if(image.mapped->open_bmp(file_name.c_str())) {
+		image.mapped->touch();
+		image.width = image.mapped->get_width();
+		image.height = image.mapped->get_height();
+		image.components = image.mapped->get_components();
+		return image;
+	}
+	delete image.mapped;
+	image.mapped = NULL;
+
+	image.data = stbi_load(file_name.c_str(), &image.width, &image.height, &image.components, 0);
+	return image;
+}
+
 void Texture::bind() {
 	glBindTexture(GL_TEXTURE_2D, texture_ID);
 }
@@ -31,13 +64,13 @@ void Texture::unbind() {
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-unsigned int Texture::load() {
+unsigned int Texture::load(TextureImage image) {
 	unsigned int id;
 	glGenTextures(1, &id);
 
-	int width, height, num_components;
-	unsigned char *data = stbi_load(file_path.c_str(), &width, &height, &num_components, 0);
-	if(data) {
+	int width = image.width, height = image.height, num_components = image.components;
+	unsigned char *data = image.data;
+	if(data || image.mapped) {
 		GLenum format;
 		if(num_components == 1)
 			format = GL_RED;
@@ -47,7 +80,12 @@ unsigned int Texture::load() {
 			format = GL_RGBA;
 
 		glBindTexture(GL_TEXTURE_2D, id);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+		if(image.mapped) {
+			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, NULL);
+			upload(*image.mapped);
+		} else {
+			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+		}
 		glGenerateMipmap(GL_TEXTURE_2D); 
 
 		// Set the class variables to the respective size of the image retrieved form stbi lib
@@ -59,7 +97,10 @@ unsigned int Texture::load() {
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-		stbi_image_free(data);
+		if(image.mapped)
+			delete image.mapped;
+		else
+			stbi_image_free(data);
 	} else {
 		std::cout << "Texture failed to load at path: " << file_path << std::endl;
 	}
@@ -67,6 +108,27 @@ unsigned int Texture::load() {
 	return id;
 }
 
+void Texture::upload(const MappedImage &image) {
+	const unsigned int width = image.get_width(), height = image.get_height(), components = image.get_components();
+	GLenum format = components == 1 ? GL_RED : (components == 3 ? GL_RGB : GL_RGBA);
+	if(image.is_bgr() && components > 1)
+		format = components == 3 ? GL_BGR : GL_BGRA;
+
+	// Rows start at the top, like stb_image's, so textures keep their orientation
+	const size_t tight = (size_t)width * components;
+	const size_t stride = image.get_stride();
+	if(image.is_top_down() && (stride == tight || stride == (tight + 3) / 4 * 4)) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, stride == tight ? 1 : 4);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, image.get_pixels());
+	} else {
+		// Bottom up files go a row at a time rather than through a flipped copy
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for(unsigned int y = 0; y < height; y++)
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, 1, format, GL_UNSIGNED_BYTE, image.get_row(y));
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
 GLvoid* Texture::get_image_data() {
 	int width, height, num_components;
 	unsigned char *data = stbi_load(file_path.c_str(), &width, &height, &num_components, 0);
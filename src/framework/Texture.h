@@ -8,6 +8,15 @@
 #include <GL/glew.h>
 #include <iostream>
 #include "../utils/stb_image.h"
+#include "MappedImage.h"
+
+// Pixels ready to upload. Decoding is safe off the GL thread
+struct TextureImage {
+	unsigned char* data; // Decoded by stb_image, NULL if the file couldn't be read or was mapped
+	int width, height;
+	int components;
+	MappedImage* mapped; // Uncompressed files are mapped instead of decoded, NULL otherwise
+};
 
 class Texture {
 	public:
@@ -20,6 +29,10 @@ class Texture {
 	public:
 		Texture(std::string file_name);
 		Texture(std::string file_name, std::vector<float> tc);
+		// Uploads an image from decode() and frees or unmaps it
+		Texture(std::string file_name, TextureImage image);
+
+		static TextureImage decode(const std::string &file_name);
 
 		void bind();
 		void unbind();
@@ -32,5 +45,6 @@ class Texture {
 
 		GLvoid* get_image_data();
 	private:
-		unsigned int load();
+		unsigned int load(TextureImage image);
+		static void upload(const MappedImage &image);
 };
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	// Flag of the tile work running on this thread, NULL outside of one
+	thread_local const std::atomic<bool>* t_cancelled = NULL;
+}
+
+TileScheduler::TileScheduler(JobSystem &jobs, unsigned int max_in_flight) : jobs(jobs),
+	max_in_flight(max_in_flight > 0 ? max_in_flight : jobs.get_worker_count() + 2), cancelled_count(0),
+	completed_count(0), throughput(0.0f), measured_count(0), measured_at(std::chrono::steady_clock::now()) {
+}
+
+TileScheduler::~TileScheduler() {
+	clear();
+}
+
+void TileScheduler::request(const glm::vec3 &center, float radius, const std::atomic<bool> &cancelled, std::function<void()> work) {
+	Request request;
+	request.center = center;
+	request.radius = radius;
+	request.cancelled = &cancelled;
+	request.work = std::move(work);
+	request.score = 0.0f;
+	pending.push_back(std::move(request));
+}
+
+void TileScheduler::update(const glm::vec3 &camera_position, const glm::mat4 &view_projection) {
+	// Only time spent building counts, so an idle scheduler keeps its last rate
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	float elapsed = std::chrono::duration<float>(now - measured_at).count();
+	if(in_flight.empty()) {
+		measured_count = completed_count;
+		measured_at = now;
+	} else if(elapsed > 0.0f) {
+		size_t completed = completed_count;
+		float rate = (completed - measured_count) / elapsed;
+		throughput += (rate - throughput) * (1.0f - expf(-elapsed / TILE_THROUGHPUT_SMOOTHING));
+		measured_count = completed;
+		measured_at = now;
+	}
+
+	in_flight.erase(std::remove_if(in_flight.begin(), in_flight.end(), [this](const JobHandle &handle) {
+		return jobs.is_finished(handle);
+	}), in_flight.end());
+
+	size_t before = pending.size();
+	pending.erase(std::remove_if(pending.begin(), pending.end(), [](const Request &request) {
+		return request.cancelled->load();
+	}), pending.end());
+	cancelled_count += before - pending.size();
+
+	if(pending.empty() || in_flight.size() >= max_in_flight)
+		return;
+
+	// Frustum planes as (normal, distance), inside when dot(normal, p) + distance >= 0
+	glm::vec4 planes[6];
+	for(int i = 0; i < 3; i++) {
+		glm::vec4 row(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+		glm::vec4 w(view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3]);
+		planes[i * 2] = w + row;
+		planes[i * 2 + 1] = w - row;
+	}
+
+	for(size_t i = 0; i < pending.size(); i++) {
+		Request &request = pending[i];
+		request.score = std::max(glm::length(request.center - camera_position) - request.radius, 0.0f);
+		for(int p = 0; p < 6; p++) {
+			if(glm::dot(glm::vec3(planes[p]), request.center) + planes[p].w < -request.radius * glm::length(glm::vec3(planes[p]))) {
+				request.score = request.score * TILE_OUT_OF_VIEW_WEIGHT + request.radius;
+				break;
+			}
+		}
+	}
+
+	// Only the requests about to start need to be in order
+	size_t starting = std::min(pending.size(), (size_t)(max_in_flight - in_flight.size()));
+	std::partial_sort(pending.begin(), pending.begin() + starting, pending.end(), [](const Request &a, const Request &b) {
+		return a.score < b.score;
+	});
+
+	for(size_t i = 0; i < starting; i++) {
+		std::shared_ptr<Request> request = std::make_shared<Request>(std::move(pending[i]));
+		in_flight.push_back(jobs.submit([this, request]() { run(*request); }));
+	}
+	pending.erase(pending.begin(), pending.begin() + starting);
+}
+
+void TileScheduler::clear() {
+	cancelled_count += pending.size();
+	pending.clear();
+	for(size_t i = 0; i < in_flight.size(); i++)
+		jobs.wait(in_flight[i]);
+	in_flight.clear();
+}
+
+bool TileScheduler::is_cancelled() {
+	return t_cancelled && t_cancelled->load();
+}
+
+void TileScheduler::check_cancelled(int) {
+	if(is_cancelled())
+		throw TileCancelled();
+}
+
+void TileScheduler::run(const Request &request) {
+	if(request.cancelled->load()) {
+		cancelled_count++;
+		return;
+	}
+
+	// Waiting inside work can run another tile on this thread, so restore the outer flag
+	const std::atomic<bool>* outer = t_cancelled;
+	t_cancelled = request.cancelled;
+	try {
+		request.work();
+		completed_count++;
+	} catch(const TileCancelled &) {
+		cancelled_count++;
+	}
+	t_cancelled = outer;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm.hpp>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "JobSystem.h"
+
+// Tiles outside the view frustum rank as if this many times further away
+#define TILE_OUT_OF_VIEW_WEIGHT 4.0f
+
+// Time constant of the throughput estimate, in seconds
+#define TILE_THROUGHPUT_SMOOTHING 1.0f
+
+// Thrown by TileScheduler::check_cancelled() to abandon a cancelled tile
+struct TileCancelled {};
+
+// Orders the tile builds of a streaming subsystem by what the camera needs
+// first, and stops building tiles nobody needs anymore.
+//
+// Requests wait here instead of in the job system, which only ever holds a
+// few more of them than it has workers. Every update() ranks the waiting
+// requests by the distance from the camera to their bounding sphere, pushing
+// the ones outside the view frustum back, and hands the best ones over, so
+// turning or flying fast reorders everything that hasn't started yet.
+//
+// A request is cancelled by setting the flag it was made with. Waiting ones
+// are dropped at the next update(); running ones notice through
+// is_cancelled(), or by passing check_cancelled() as the NoiseMapCallback of
+// the builders they run, which stops a build at the next row.
+class TileScheduler {
+	public:
+		// max_in_flight = 0 keeps one more request in the job system than it has
+		// threads, the calling thread included
+		TileScheduler(JobSystem &jobs, unsigned int max_in_flight = 0);
+		~TileScheduler();
+
+		// Queues work for a tile bounded by the sphere at center. work runs once,
+		// unless cancelled becomes true first; cancelled must outlive work
+		void request(const glm::vec3 &center, float radius, const std::atomic<bool> &cancelled, std::function<void()> work);
+
+		// Ranks the waiting requests from the camera and starts the best ones
+		void update(const glm::vec3 &camera_position, const glm::mat4 &view_projection);
+
+		// Drops every waiting request and returns once the running ones finished
+		void clear();
+
+		inline size_t get_pending_count() const { return pending.size(); }
+		inline size_t get_in_flight_count() const { return in_flight.size(); }
+		inline unsigned int get_max_in_flight() const { return max_in_flight; }
+		inline size_t get_cancelled_count() const { return cancelled_count; }
+		inline size_t get_completed_count() const { return completed_count; }
+
+		// Requests not finished yet, waiting or building
+		inline size_t get_outstanding_count() const { return pending.size() + in_flight.size(); }
+
+		// Tiles finished per second, measured across update() calls
+		inline float get_throughput() const { return throughput; }
+
+		// Whether the tile work running on the calling thread has been cancelled
+		static bool is_cancelled();
+
+		// NoiseMapCallback throwing TileCancelled once the calling thread's tile is
+		// cancelled. The scheduler catches it around the work
+		static void check_cancelled(int row);
+
+	private:
+		struct Request {
+			glm::vec3 center;
+			float radius;
+			const std::atomic<bool>* cancelled;
+			std::function<void()> work;
+			float score; // Lower starts first
+		};
+
+		JobSystem &jobs;
+		unsigned int max_in_flight;
+		std::vector<Request> pending;
+		std::vector<JobHandle> in_flight;
+		std::atomic<size_t> cancelled_count; // Requests dropped or abandoned since construction
+		std::atomic<size_t> completed_count;
+
+		float throughput;
+		size_t measured_count; // completed_count when throughput was last measured
+		std::chrono::steady_clock::time_point measured_at;
+
+		void run(const Request &request);
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+// Binding point the FrameData block is attached to in every shader
+#define FRAME_DATA_BINDING 0
+
+// Per-frame camera and light constants, laid out to match the std140
+// "FrameData" block in the shaders. vec3s are padded to vec4 because std140
+// aligns them to 16 bytes anyway.
+struct FrameData {
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::vec4 camera_position; // w unused
+	glm::vec4 light_position; // w unused
+	glm::vec4 light_color; // w unused
+};
+
+static_assert(sizeof(FrameData) == 176, "FrameData must match the std140 block layout");
+
+// Uniform buffer object that is attached to a fixed binding point
+class UniformBuffer {
+	public:
+		unsigned int id;
+		unsigned int binding;
+		size_t size;
+
+		UniformBuffer(size_t size, unsigned int binding) : binding(binding), size(size) {
+			glGenBuffers(1, &id);
+			glBindBuffer(GL_UNIFORM_BUFFER, id);
+			glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+			glBindBufferBase(GL_UNIFORM_BUFFER, binding, id);
+		}
+
+		~UniformBuffer() {
+			glDeleteBuffers(1, &id);
+		}
+
+		// Replaces the whole buffer contents, one call per frame
+		template<typename T>
+		void update(const T &data) {
+			glBindBuffer(GL_UNIFORM_BUFFER, id);
+			glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T) < size ? sizeof(T) : size, &data);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		}
+};
@@ -0,0 +1,240 @@
+#include "UploadRing.h"
+
+#include <iostream>
+#include <cstring>
+
+UploadRing::UploadRing(size_t capacity) : capacity(capacity), persistent(false), buffer(0), memory(NULL),
+	head(0), used(0), first_block(1), next_serial(1), frame_budget_bytes(UPLOAD_FRAME_BYTES),
+	frame_budget_milliseconds(UPLOAD_FRAME_MILLISECONDS), frame_bytes(0), frame_start(std::chrono::steady_clock::now()) {
+	persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+
+	if(persistent) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glBufferStorage(GL_COPY_READ_BUFFER, capacity, NULL, flags);
+		memory = (char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, capacity, flags);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+		if(!memory) {
+			std::cout << "Persistent mapping failed, uploads fall back to client memory" << std::endl;
+			glDeleteBuffers(1, &buffer);
+			buffer = 0;
+			persistent = false;
+		}
+	}
+
+	if(!persistent)
+		memory = new char[capacity];
+}
+
+UploadRing::~UploadRing() {
+	for(size_t i = 0; i < fences.size(); i++)
+		glDeleteSync(fences[i].sync);
+
+	if(persistent) {
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+	} else {
+		delete[] memory;
+	}
+}
+
+bool UploadRing::allocate(size_t size, size_t alignment, UploadAllocation &out) {
+	if(size == 0 || size > capacity)
+		return false;
+	if(alignment == 0)
+		alignment = 1;
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	size_t offset = (head + alignment - 1) / alignment * alignment;
+	if(offset + size > capacity)
+		offset = 0; // Not enough room before the end, skip the remainder and wrap
+
+	// Free space is the contiguous run starting at head, so padding counts against it too
+	size_t padding = offset >= head ? offset - head : capacity - head;
+	size_t reserved = padding + size;
+	if(used + reserved > capacity)
+		return false;
+
+	Block block;
+	block.reserved = reserved;
+	block.fence_serial = 0;
+	block.cancelled = false;
+	blocks.push_back(block);
+
+	out.block = first_block + blocks.size() - 1;
+	out.offset = offset;
+	out.size = size;
+	out.ptr = memory + offset;
+
+	head = (offset + size) % capacity;
+	used += reserved;
+	return true;
+}
+
+void UploadRing::submit_buffer_copy(const UploadAllocation &allocation, unsigned int buffer, size_t dst_offset) {
+	Command command;
+	command.type = COPY_BUFFER;
+	command.allocation = allocation;
+	command.target = buffer;
+	command.dst_offset = dst_offset;
+	frame_bytes += allocation.size;
+
+	std::lock_guard<std::mutex> guard(lock);
+	commands.push_back(command);
+}
+
+void UploadRing::submit_texture_copy(const UploadAllocation &allocation, unsigned int texture, int level,
+	int x, int y, int width, int height, GLenum format, GLenum type) {
+	Command command;
+	command.type = COPY_TEXTURE;
+	command.allocation = allocation;
+	command.target = texture;
+	command.level = level;
+	command.x = x;
+	command.y = y;
+	command.width = width;
+	command.height = height;
+	command.format = format;
+	command.pixel_type = type;
+	frame_bytes += allocation.size;
+
+	std::lock_guard<std::mutex> guard(lock);
+	commands.push_back(command);
+}
+
+void UploadRing::cancel(const UploadAllocation &allocation) {
+	std::lock_guard<std::mutex> guard(lock);
+	blocks[(size_t)(allocation.block - first_block)].cancelled = true;
+}
+
+size_t UploadRing::get_used() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return used;
+}
+
+void UploadRing::flush() {
+	std::vector<Command> pending;
+	unsigned long long serial = 0;
+
+	// Only hold the lock long enough to take the queued commands
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		pending.swap(commands);
+		if(!pending.empty()) {
+			serial = next_serial++;
+			for(size_t i = 0; i < pending.size(); i++)
+				blocks[(size_t)(pending[i].allocation.block - first_block)].fence_serial = serial;
+		}
+	}
+
+	unsigned long long completed = 0;
+	if(!pending.empty()) {
+		// Texture copies bind their target on the active unit, which may be
+		// holding a texture for drawing, so it gets it back afterwards
+		GLint bound_texture = 0;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound_texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		if(persistent)
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+
+		for(size_t i = 0; i < pending.size(); i++)
+			execute(pending[i]);
+		glBindTexture(GL_TEXTURE_2D, (GLuint)bound_texture);
+
+		if(persistent) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+			Fence fence;
+			fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			fence.serial = serial;
+			fences.push_back(fence);
+		} else {
+			// Client memory copies are consumed by the time the calls return
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			completed = serial;
+		}
+	}
+
+	// Poll, never wait: anything still in flight is picked up on a later frame
+	while(!fences.empty()) {
+		GLenum status = glClientWaitSync(fences.front().sync, 0, 0);
+		if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+
+		completed = fences.front().serial;
+		glDeleteSync(fences.front().sync);
+		fences.pop_front();
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	reclaim(completed);
+}
+
+void UploadRing::begin_frame() {
+	frame_bytes = 0;
+	frame_start = std::chrono::steady_clock::now();
+}
+
+void UploadRing::set_frame_budget(size_t bytes, float milliseconds) {
+	frame_budget_bytes = bytes;
+	frame_budget_milliseconds = milliseconds;
+}
+
+bool UploadRing::has_frame_budget() const {
+	if(frame_bytes == 0)
+		return true;
+	if(frame_bytes >= frame_budget_bytes)
+		return false;
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - frame_start;
+	return elapsed.count() < frame_budget_milliseconds;
+}
+
+void UploadRing::reclaim(unsigned long long completed_serial) {
+	while(!blocks.empty()) {
+		const Block &block = blocks.front();
+		bool retired = block.cancelled || (block.fence_serial != 0 && block.fence_serial <= completed_serial);
+		if(!retired)
+			break;
+
+		used -= block.reserved;
+		blocks.pop_front();
+		first_block++;
+	}
+
+	// Nothing outstanding, so restart at the beginning to avoid needless wrapping
+	if(blocks.empty())
+		head = 0;
+}
+
+void UploadRing::execute(const Command &command) {
+	const UploadAllocation &allocation = command.allocation;
+
+	switch(command.type) {
+		case COPY_BUFFER:
+			if(persistent) {
+				glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, command.target);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.offset, command.dst_offset, allocation.size);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+				glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			} else {
+				glBindBuffer(GL_COPY_WRITE_BUFFER, command.target);
+				glBufferSubData(GL_COPY_WRITE_BUFFER, command.dst_offset, allocation.size, allocation.ptr);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			}
+			break;
+		case COPY_TEXTURE:
+			// With the ring bound as the unpack buffer the pointer argument is an offset into it
+			glBindTexture(GL_TEXTURE_2D, command.target);
+			glTexSubImage2D(GL_TEXTURE_2D, command.level, command.x, command.y, command.width, command.height,
+				command.format, command.pixel_type, persistent ? (const void*)allocation.offset : allocation.ptr);
+			break;
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <mutex>
+
+// Default size of the streaming ring, in bytes
+#define UPLOAD_RING_SIZE (64 * 1024 * 1024)
+
+// Bytes queued per frame before streaming subsystems defer the rest to the next one
+#define UPLOAD_FRAME_BYTES (8 * 1024 * 1024)
+
+// Milliseconds per frame streaming subsystems may spend queueing uploads
+#define UPLOAD_FRAME_MILLISECONDS 2.0f
+
+// A piece of the ring handed to a producer. ptr stays valid until the copy
+// that consumes it has been submitted and the GPU has finished with it.
+struct UploadAllocation {
+	unsigned long long block; // Sequence number of the reservation
+	size_t offset; // Byte offset inside the ring buffer
+	size_t size;
+	void* ptr;
+};
+
+// Streaming upload path built on a persistently mapped ring buffer.
+//
+// Any thread may allocate() space, write into it and submit a copy into a
+// GL buffer or texture. Only the GL thread calls flush(), which issues the
+// queued copies, fences them and recycles ring space whose fences have
+// signalled. Nothing in here waits on the GPU: when the ring is full,
+// allocate() fails and the producer tries again after the next flush.
+//
+// Without GL 4.4 / ARB_buffer_storage the ring lives in client memory and
+// flush() uploads it with glBufferSubData/glTexSubImage2D instead.
+//
+// Streaming subsystems keep their frame time steady by checking
+// has_frame_budget() before each upload they could put off: a frame is
+// allowed so many bytes and so much time from begin_frame() on, and whatever
+// doesn't fit waits for the next one. Every submitted copy counts against the
+// bytes, including the ones that can't wait.
+class UploadRing {
+	public:
+		UploadRing(size_t capacity = UPLOAD_RING_SIZE);
+		~UploadRing();
+
+		// Reserves size bytes aligned to alignment. Safe from any thread
+		bool allocate(size_t size, size_t alignment, UploadAllocation &out);
+
+		// Queues a copy of the allocation into buffer at dst_offset. Safe from any thread
+		void submit_buffer_copy(const UploadAllocation &allocation, unsigned int buffer, size_t dst_offset);
+
+		// Queues a glTexSubImage2D from the allocation. Rows must be tightly packed
+		void submit_texture_copy(const UploadAllocation &allocation, unsigned int texture, int level,
+			int x, int y, int width, int height, GLenum format, GLenum type);
+
+		// Returns an allocation that will never be submitted
+		void cancel(const UploadAllocation &allocation);
+
+		// GL thread only: issues queued copies and reclaims finished ring space
+		void flush();
+
+		// GL thread only, before the frame's first upload: restarts the budget
+		void begin_frame();
+		void set_frame_budget(size_t bytes, float milliseconds);
+
+		// GL thread only: whether another upload fits in this frame. The first
+		// one always does, however large, so nothing starves
+		bool has_frame_budget() const;
+		inline size_t get_frame_bytes() const { return frame_bytes; }
+
+		inline bool is_persistent() const { return persistent; }
+		inline size_t get_capacity() const { return capacity; }
+		size_t get_used() const;
+
+	private:
+		enum CommandType {
+			COPY_BUFFER,
+			COPY_TEXTURE
+		};
+
+		struct Command {
+			CommandType type;
+			UploadAllocation allocation;
+			unsigned int target;
+			size_t dst_offset;
+			int level, x, y, width, height;
+			GLenum format, pixel_type;
+		};
+
+		// One reservation, kept in allocation order so space is always reclaimed front to back
+		struct Block {
+			size_t reserved; // Size plus any padding skipped at the end of the ring
+			unsigned long long fence_serial; // Fence covering the copy, 0 until flush() issues it
+			bool cancelled;
+		};
+
+		struct Fence {
+			GLsync sync;
+			unsigned long long serial;
+		};
+
+		size_t capacity;
+		bool persistent;
+		unsigned int buffer;
+		char* memory;
+
+		mutable std::mutex lock;
+		size_t head;
+		size_t used;
+		unsigned long long first_block; // Sequence number of blocks.front()
+		unsigned long long next_serial;
+		std::deque<Block> blocks;
+		std::vector<Command> commands;
+		std::deque<Fence> fences;
+
+		size_t frame_budget_bytes;
+		float frame_budget_milliseconds;
+		std::atomic<size_t> frame_bytes; // Submitted since begin_frame()
+		std::chrono::steady_clock::time_point frame_start;
+
+		void reclaim(unsigned long long completed_serial);
+		void execute(const Command &command);
+};
@@ -10,13 +10,34 @@
 #include "utils/stb_image.h"
 #include "framework/Camera.h"
 #include "framework/Shader.h"
+#include "framework/UniformBuffer.h"
+#include "framework/Profiler.h"
+#include "framework/CameraPath.h"
+#include "framework/Framebuffer.h"
+#include "framework/UploadRing.h"
+#include "framework/Planet.h"
+#include "framework/HeightPyramid.h"
+#include "framework/Clipmap.h"
+#include "framework/JobSystem.h"
+#include "framework/Scatter.h"
+#include "framework/TerrainEditor.h"
+#include "framework/Prefetcher.h"
+#include "framework/FrameSnapshot.h"
 #include "framework/Texture.h"
 #include "framework/Light.h"
 #include "framework/HeightMap.h"
 #include "framework/PerlinHeightsGenerator.h"
 #include <noise/noise.h>
 #include "utils/noiseutils.h"
-#include "utils/ImageLoader.h"
+#include "utils/tilebuilder.h"
+#include "utils/horizonrenderer.h"
+#include "modules/fastvoronoi.h"
+#include "modules/fusedturbulence.h"
+#include "modules/lodfractal.h"
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
 
 using namespace noise;
 //constants
@@ -26,7 +47,57 @@ using namespace noise;
 #define FACTOR 0.45 // Increase to make flatter
 #define AMPLITUDE 300 / FACTOR
 
-void create_height_map(float noiseWidth, float noiseHeight, float vertWidth, float vertHeight);
+#define PLANET_RADIUS 5000.0f
+
+// Simulation ticks per second, however fast frames are rendered
+#define SIMULATION_TICK_RATE 120
+
+// Ticks run at most to catch up after a stall, the rest are dropped
+#define SIMULATION_MAX_CATCH_UP 8
+
+// World distance between samples of an imported height pyramid
+#define CLIPMAP_SPACING 5.0f
+
+// Sculpting brushes: radius in world units, world units raised or lowered per
+// second at the center, and fraction smoothed or flattened per second
+#define BRUSH_RADIUS 200.0f
+#define BRUSH_HEIGHT_RATE 150.0f
+#define BRUSH_BLEND_RATE 4.0f
+
+// The terrain's module graph, shared by the flat height map and the planet
+struct TerrainModules {
+	// Produces 3D ridged multifractal noise, similar to mountains
+	module::LodRidgedMulti base_mountain_terrain;
+	module::FastVoronoi plateau_terrain;
+
+#if 1
+	// Generates "Billowy" noise suitable for clouds and rocks
+	module::LodBillow base_flat_terrain;
+#endif
+
+#if 0
+	module::Spheres base_flat_terrain;
+#endif
+
+#if 0
+	// Produces polygon-like formations
+	module::FastVoronoi base_flat_terrain;
+#endif
+
+	// Applies a scaling factor to the output value from the source module
+	module::ScaleBias flat_terrain;
+
+	module::LodPerlin terrain_type;
+	module::Select terrain_selector;
+
+	// pseudo-random displacement of the input value
+	module::FusedTurbulence final_terrain;
+
+	TerrainModules();
+};
+
+void create_height_map(float noiseWidth, float noiseHeight, float vertWidth, float vertHeight, float bumpHeight,
+	float horizonBumpHeight, glm::vec2 lightDirection, utils::NoiseMap &height_map, JobSystem &jobs);
 
 float get_height(int x, int z);
 glm::vec3 calculate_normal(int x, int z, int upperBounds);
@@ -39,8 +110,11 @@ unsigned char* read_BMP(char* filename);
 
 Camera camera(glm::vec3(20.0f, 100.0f, 3.0));
 
-float delta = 0.0f; // Time between current frame and last frame
-float last_frame = 0.0f; // Time of last frame
+float delta = 0.0f; // Length of the current simulation tick
+
+// Window size, applied by the render thread with the next snapshot
+int viewport_width = SCREEN_WIDTH;
+int viewport_height = SCREEN_HEIGHT;
 
 float mouse_last_X = 0.0f;
 float mouse_last_Y = 0.0f;
@@ -48,6 +122,35 @@ bool first_mouse = true; // If the mouse has not entered the window yet
 
 bool wire_frame = false;
 
+// Sculpts the flat terrain, NULL for the planet and the clipmap
+TerrainEditor* editor = NULL;
+BrushType brush = BRUSH_RAISE;
+// Held as of the last input tick, so holding them down acts once
+bool brush_held = false;
+bool undo_held = false;
+bool redo_held = false;
+
+// Command line options for recording and replaying camera paths
+struct Options {
+	const char* record_path; // --record <file>: save the fly-through on exit
+	const char* replay_path; // --replay <file>: play a recorded path and exit
+	float timestep; // --timestep <seconds>: fixed step used for replay
+	bool headless; // --headless: hidden window (OSMesa if available) rendering offscreen
+	bool planet; // --planet: render a streamed cube-sphere planet instead of the flat terrain
+	RawHeightSource import_source; // --import <raw> <width>x<height> <u16|s16|f32>[be] <pyramid>: build a height pyramid and exit
+	const char* import_path;
+	const char* clipmap_path; // --clipmap <pyramid>: fly over an imported pyramid with a geometry clipmap
+	const char* compress_source; // --compress <pyramid> <output> <max error>: compress a pyramid and exit, 0 keeping it exact
+	const char* compress_path;
+	float compress_error;
+};
+
+Options options = { NULL, NULL, 1.0f / 60.0f, false, false, { NULL, 0, 0, RAW_HEIGHT_UINT16, false, 1.0f, 0.0f }, NULL, NULL,
+	NULL, NULL, 0.0f };
+
+void parse_options(int argc, char** argv);
+bool parse_import(char** argv);
+
 module::Perlin perlin_module;
 
 utils::NoiseMap height_map;
@@ -55,15 +158,61 @@ utils::NoiseMapBuilderPlane height_map_builder;
 float heights[50][50];
 
 unsigned char* data;
-Image* image;
 
-int main() {
+int main(int argc, char** argv) {
+	parse_options(argc, argv);
+
+	CameraPath camera_path;
+	if(options.replay_path && !camera_path.load(options.replay_path)) {
+		std::cout << "Failed to load camera path " << options.replay_path << std::endl;
+		return -1;
+	}
+
+	// Every subsystem working in the background shares these threads
+	JobSystem *jobs = new JobSystem();
+
+	if(options.import_path) {
+		// Imports never open a window, the pyramid is all they produce
+		const RawHeightSource &source = options.import_source;
+		bool imported = HeightPyramid::build(source, options.import_path, *jobs);
+		delete jobs;
+		if(!imported)
+			return -1;
+		std::cout << "Imported " << source.width << "x" << source.height << " samples into " << options.import_path << std::endl;
+		return 0;
+	}
+
+	if(options.compress_source) {
+		bool compressed = HeightPyramid::compress(options.compress_source, options.compress_path, *jobs, options.compress_error);
+		delete jobs;
+		if(!compressed)
+			return -1;
+
+		MappedFile source, output;
+		if(source.open(options.compress_source) && output.open(options.compress_path))
+			std::cout << "Compressed " << options.compress_source << " from " << source.get_size() / (1024 * 1024) << " MB to "
+				<< output.get_size() / (1024 * 1024) << " MB in " << options.compress_path << std::endl;
+		return 0;
+	}
+
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-	GLFWwindow* window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Terrain-Generation", NULL, NULL);
+	GLFWwindow* window = NULL;
+	if(options.headless) {
+		// Prefer a surfaceless software context so benchmarks run without a display
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+		window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Terrain-Generation", NULL, NULL);
+		if(window == NULL) {
+			std::cout << "OSMesa context unavailable, falling back to a hidden window" << std::endl;
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+		}
+	}
+	if(window == NULL)
+		window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Terrain-Generation", NULL, NULL);
 	if(window == NULL) {
 		std::cout << "Failed to create GLFW window" << std::endl;
 		glfwTerminate();
@@ -78,6 +227,10 @@ int main() {
 
 	glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
 
+	// Replays measure the renderer, not the display's refresh rate
+	if(options.replay_path)
+		glfwSwapInterval(0);
+
 	// Tell GLFW that this is the function we want ran when the window changes size
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
@@ -95,13 +248,32 @@ int main() {
 
 	glEnable(GL_DEPTH_TEST);
 
+	const float SIZE = 10000;
+
+	Light *light = new Light(glm::vec3(20000, 20000, 20000), glm::vec3(1, 1, 1));
+
 	// Create the height map before loading in the texture
-	create_height_map(512.0, 512.0, 2, 2);
+	// The map stores (value + 1) / 2 scaled by AMPLITUDE, over 2 noise units per SIZE world units,
+	// so this bump height makes the normal map hold world space normals
+	// The light map measures heights in samples, SIZE / 512 world units apart. Map rows run against world z
+	glm::vec2 light_direction(light->position.x - SIZE * 0.5f, -(light->position.z - SIZE * 0.5f));
+	// The noise map is kept to place the scattered trees and rocks on
+	utils::NoiseMap terrain_heights;
+	create_height_map(512.0, 512.0, 2, 2, (AMPLITUDE) * 0.5f * 2 / SIZE, (AMPLITUDE) * 0.5f * 512 / SIZE, light_direction, terrain_heights, *jobs);
 
 	Shader *terrain_shader = new Shader("src/shaders/terrain.vert", "src/shaders/terrain.frag");
-	Texture *texture = new Texture("res/grass.png");
-	Texture *height_map = new Texture("res/heightmap.bmp");
-	Light *light = new Light(glm::vec3(20000, 20000, 20000), glm::vec3(1, 1, 1));
+
+	// Decode the images side by side, only the uploads need the GL thread
+	const char* texture_paths[4] = { "res/grass.png", "res/heightmap.bmp", "res/normalmap.bmp", "res/lightmap.bmp" };
+	TextureImage texture_images[4];
+	jobs->parallel_for(4, 1, [&](int begin, int end) {
+		for(int i = begin; i < end; i++)
+			texture_images[i] = Texture::decode(texture_paths[i]);
+	}, JOB_PRIORITY_HIGH);
+	Texture *texture = new Texture(texture_paths[0], texture_images[0]);
+	Texture *height_map = new Texture(texture_paths[1], texture_images[1]);
+	Texture *terrain_normals = new Texture(texture_paths[2], texture_images[2]);
+	Texture *light_map = new Texture(texture_paths[3], texture_images[3]);
 
 	/********************************/
 	//  LOAD TERRAIN MESH/VERTICES
@@ -109,7 +281,6 @@ int main() {
 
 	const float MAX_PIXEL_COLOR = 256 * 256 * 256;
 
-	const float SIZE = 10000;
 	const float VERTEX_COUNT = 2000; // Default 2000
 
 	// Map of [VERTEX_COUNT, VERTEX_COUNT]
@@ -117,34 +288,39 @@ int main() {
 	std::vector<float> texture_coords(VERTEX_COUNT * VERTEX_COUNT * 2);
 	std::vector<unsigned int> indices(6 * (VERTEX_COUNT - 1) * (VERTEX_COUNT - 1));
 
-	int vertex_pointer = 0;
-	for(float i = 0; i < VERTEX_COUNT; i++) { // z
-		for(float j = 0; j < VERTEX_COUNT; j++) { // x
-			vertices[vertex_pointer * 3] = (float)j / ((float)VERTEX_COUNT - 1) * SIZE;
-			vertices[vertex_pointer * 3 + 1] = 0;
-			vertices[vertex_pointer * 3 + 2] = (float)i / ((float)VERTEX_COUNT - 1) * SIZE;
-
-			texture_coords[vertex_pointer * 2] = (float)j / ((float)VERTEX_COUNT - 1);
-			texture_coords[vertex_pointer * 2 + 1] = (float)i / ((float)VERTEX_COUNT - 1);
-			vertex_pointer++;
+	// Rows are independent, so they are filled in parallel
+	jobs->parallel_for(VERTEX_COUNT, 64, [&](int begin, int end) {
+		for(int i = begin; i < end; i++) { // z
+			int vertex_pointer = i * VERTEX_COUNT;
+			for(int j = 0; j < VERTEX_COUNT; j++) { // x
+				vertices[vertex_pointer * 3] = (float)j / ((float)VERTEX_COUNT - 1) * SIZE;
+				vertices[vertex_pointer * 3 + 1] = 0;
+				vertices[vertex_pointer * 3 + 2] = (float)i / ((float)VERTEX_COUNT - 1) * SIZE;
+
+				texture_coords[vertex_pointer * 2] = (float)j / ((float)VERTEX_COUNT - 1);
+				texture_coords[vertex_pointer * 2 + 1] = (float)i / ((float)VERTEX_COUNT - 1);
+				vertex_pointer++;
+			}
 		}
-	}
-
-	int pointer = 0;
-	for(int gz = 0; gz < VERTEX_COUNT - 1; gz++) {
-		for(int gx = 0; gx < VERTEX_COUNT - 1; gx++) {
-			int top_left = (gz * VERTEX_COUNT) + gx;
-			int top_right = top_left + 1;
-			int bottom_left = ((gz + 1) * VERTEX_COUNT) + gx;
-			int bottom_right = bottom_left + 1;
-			indices[pointer++] = top_left;
-			indices[pointer++] = bottom_left;
-			indices[pointer++] = top_right;
-			indices[pointer++] = top_right;
-			indices[pointer++] = bottom_left;
-			indices[pointer++] = bottom_right;
+	});
+
+	jobs->parallel_for(VERTEX_COUNT - 1, 64, [&](int begin, int end) {
+		for(int gz = begin; gz < end; gz++) {
+			int pointer = gz * (VERTEX_COUNT - 1) * 6;
+			for(int gx = 0; gx < VERTEX_COUNT - 1; gx++) {
+				int top_left = (gz * VERTEX_COUNT) + gx;
+				int top_right = top_left + 1;
+				int bottom_left = ((gz + 1) * VERTEX_COUNT) + gx;
+				int bottom_right = bottom_left + 1;
+				indices[pointer++] = top_left;
+				indices[pointer++] = bottom_left;
+				indices[pointer++] = top_right;
+				indices[pointer++] = top_right;
+				indices[pointer++] = bottom_left;
+				indices[pointer++] = bottom_right;
+			}
 		}
-	}
+	});
 
 	unsigned int vao, pVBO, nVBO, tcVBO, ibo;
 	glGenVertexArrays(1, &vao);
@@ -180,131 +356,503 @@ int main() {
 	terrain_shader->use();
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, height_map->get_ID());
-	terrain_shader->set_texture("height_map", 1);
+	terrain_shader->set_texture("heightMap", 1);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, terrain_normals->get_ID());
+	terrain_shader->set_texture("terrainNormals", 2);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, light_map->get_ID());
+	terrain_shader->set_texture("lightMap", 3);
+	terrain_shader->set_bool("bakedLighting", true);
+	terrain_shader->set_vec2("lightMapScale", 1.0f / SIZE, 1.0f / SIZE);
 
 	terrain_shader->set_float("AMPLITUDE", AMPLITUDE);
 
-	glm::mat4 projection;
-	
-	// Render loop
+	// Per-frame camera/light constants go through one uniform buffer update
+	UniformBuffer *frame_uniforms = new UniformBuffer(sizeof(FrameData), FRAME_DATA_BINDING);
+	terrain_shader->bind_uniform_block("FrameData", FRAME_DATA_BINDING);
+	FrameData frame_data;
+	frame_data.light_position = glm::vec4(light->position, 1.0f);
+	frame_data.light_color = glm::vec4(light->color, 1.0f);
+
+	// These never change between frames
+	glm::mat4 model = glm::translate(glm::mat4(), glm::vec3(0, 0, 0));
+	terrain_shader->set_mat4("model", model);
+	terrain_shader->set_float("shineDamper", 1);
+	terrain_shader->set_float("reflectivity", 0);
+	terrain_shader->set_int("tex", 0);
+
+	Profiler *profiler = new Profiler();
+
+	// Streaming uploads from worker threads are issued from here once per frame
+	UploadRing *uploads = new UploadRing();
+
+	// The planet samples the same graph at the flat terrain's scale of 2 noise units per SIZE
+	TerrainModules *planet_terrain = NULL;
+	Planet *planet = NULL;
+	Shader *planet_shader = NULL;
+	if(options.planet) {
+		planet_terrain = new TerrainModules();
+		planet = new Planet(planet_terrain->final_terrain, PLANET_RADIUS, (AMPLITUDE) * 0.5f, PLANET_RADIUS * 2 / SIZE, *uploads, *jobs);
+
+		planet_shader = new Shader("src/shaders/planet.vert", "src/shaders/terrain.frag");
+		planet_shader->use();
+		planet_shader->bind_uniform_block("FrameData", FRAME_DATA_BINDING);
+		planet_shader->set_float("shineDamper", 1);
+		planet_shader->set_float("reflectivity", 0);
+		planet_shader->set_int("tex", 0);
+
+		camera.position = glm::vec3(0.0f, 0.0f, PLANET_RADIUS * 3);
+	}
+
+	HeightPyramid *pyramid = NULL;
+	Clipmap *clipmap = NULL;
+	Shader *clipmap_shader = NULL;
+	if(options.clipmap_path && !options.planet) {
+		pyramid = new HeightPyramid();
+		if(pyramid->open(options.clipmap_path)) {
+			clipmap = new Clipmap(*pyramid, CLIPMAP_SPACING, AMPLITUDE, *uploads, *jobs);
+
+			clipmap_shader = new Shader("src/shaders/clipmap.vert", "src/shaders/terrain.frag");
+			clipmap_shader->use();
+			clipmap_shader->bind_uniform_block("FrameData", FRAME_DATA_BINDING);
+			clipmap_shader->set_float("shineDamper", 1);
+			clipmap_shader->set_float("reflectivity", 0);
+			clipmap_shader->set_int("tex", 0);
+			// Same texture density as the flat terrain
+			clipmap_shader->set_float("textureScale", 80.0f / SIZE);
+		} else {
+			std::cout << "Failed to open height pyramid " << options.clipmap_path << std::endl;
+		}
+	}
+
+	// Trees and rocks only grow on the flat terrain, whose height map they sample
+	Scatter *scatter = NULL;
+	Shader *scatter_shader = NULL;
+	if(!planet && !clipmap) {
+		scatter = new Scatter(terrain_heights, SIZE, AMPLITUDE, *uploads, *jobs);
+
+		scatter_shader = new Shader("src/shaders/scatter.vert", "src/shaders/scatter.frag");
+		scatter_shader->use();
+		scatter_shader->bind_uniform_block("FrameData", FRAME_DATA_BINDING);
+		scatter_shader->set_texture("heightMap", 1);
+		scatter_shader->set_float("AMPLITUDE", AMPLITUDE);
+
+		editor = new TerrainEditor(terrain_heights, SIZE, AMPLITUDE, height_map->get_ID(), terrain_normals->get_ID(), *uploads);
+	}
+
+	// A hidden window has no usable default framebuffer
+	Framebuffer *offscreen = options.headless ? new Framebuffer(SCREEN_WIDTH, SCREEN_HEIGHT) : NULL;
+
+	int replay_step = 0;
+	int replay_steps = camera_path.get_step_count(options.timestep);
+	float record_start = glfwGetTime();
+	Prefetcher prefetcher;
+	unsigned long long tick = 0;
+
+	// Replays render every step exactly once, interactive runs render the newest tick there is
+	FrameExchange frames(options.replay_path != NULL);
+	auto publish_tick = [&](float step) {
+		FrameSnapshot &snapshot = frames.get_back();
+		snapshot.tick = ++tick;
+		snapshot.delta = step;
+		snapshot.camera_position = camera.position;
+		snapshot.view = camera.get_view_matrix();
+		snapshot.projection = glm::perspective(glm::radians(camera.zoom), SCREEN_WIDTH / SCREEN_HEIGHT, 0.1f, 100000.0f);
+		snapshot.view_projection = snapshot.projection * snapshot.view;
+		snapshot.viewport_width = viewport_width;
+		snapshot.viewport_height = viewport_height;
+		snapshot.wire_frame = wire_frame;
+
+		// What to stream and draw is decided here, the render thread only
+		// uploads and draws the plans handed to it
+		if(planet)
+			planet->plan(snapshot.camera_position, snapshot.view_projection, &prefetcher);
+		if(scatter)
+			scatter->plan(snapshot.camera_position, snapshot.view_projection, &prefetcher);
+		frames.publish();
+	};
+
+	// The render thread needs a snapshot to start from, replays wait for their first step instead,
+	// and it needs the context to itself
+	if(!options.replay_path)
+		publish_tick(0.0f);
+	glfwMakeContextCurrent(NULL);
+
+	// Render loop: uploads and draws whatever the simulation last published, so
+	// waiting on the swap never holds up input, the camera or streaming
+	std::thread render_thread([&]() {
+		glfwMakeContextCurrent(window);
+		int drawn_width = SCREEN_WIDTH, drawn_height = SCREEN_HEIGHT;
+		bool drawn_wire_frame = false;
+
+		while(const FrameSnapshot* frame = frames.acquire()) {
+			profiler->begin_frame();
+
+			if(frame->viewport_width != drawn_width || frame->viewport_height != drawn_height) {
+				drawn_width = frame->viewport_width;
+				drawn_height = frame->viewport_height;
+				glViewport(0, 0, drawn_width, drawn_height);
+			}
+			if(frame->wire_frame != drawn_wire_frame) {
+				drawn_wire_frame = frame->wire_frame;
+				glPolygonMode(GL_FRONT_AND_BACK, drawn_wire_frame ? GL_LINE : GL_FILL);
+			}
+
+			// Streaming uploads below share one budget per frame
+			uploads->begin_frame();
+
+			if(planet) {
+				// Queues the planet's chunk uploads, so it has to run before the flush
+				ProfileScope scope(*profiler, "planet");
+				planet->upload();
+			}
+
+			if(clipmap) {
+				// Queues the samples read for the rings, so it has to run before the flush
+				ProfileScope scope(*profiler, "clipmap");
+				clipmap->update(frame->camera_position);
+			}
+
+			if(editor) {
+				// Queues the edited texels, so it has to run before the flush, and hands
+				// the new ground to the scatter, whose next plan rebuilds the chunks on it
+				ProfileScope scope(*profiler, "editor");
+				if(editor->update() && scatter)
+					scatter->update_ground(editor->get_heights(), editor->get_dirty_rect());
+			}
+
+			if(scatter) {
+				// Queues the instances of new chunks, so it has to run before the flush
+				ProfileScope scope(*profiler, "scatter");
+				scatter->upload();
+			}
+
+			{
+				ProfileScope scope(*profiler, "uploads");
+				uploads->flush();
+			}
+
+			if(offscreen)
+				offscreen->bind();
+
+			// Rendering here
+			glClearColor(0.4f, 0.4f, 0.4f, 1.0f); // State-Setting function
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // State-using function
+
+			{
+				ProfileScope scope(*profiler, "uniforms");
+				frame_data.projection = frame->projection;
+				frame_data.view = frame->view;
+				frame_data.camera_position = glm::vec4(frame->camera_position, 1.0f);
+				frame_uniforms->update(frame_data);
+			}
+
+			{
+				ProfileScope scope(*profiler, "draw");
+				GpuProfileScope gpu_scope(*profiler, "terrain");
+
+				// Set up Shader
+				if(planet)
+					planet_shader->use();
+				else if(clipmap)
+					clipmap_shader->use();
+				else
+					terrain_shader->use();
+
+				// Bind the mountain/grass texture
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, texture->get_ID());
+
+				// Draw the vertices/indices (send them to the graphics card to be processed)
+				if(planet) {
+					planet->draw();
+				} else if(clipmap) {
+					clipmap->draw(*clipmap_shader);
+				} else {
+					glBindVertexArray(vao);
+					glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+				}
+			}
+
+			if(scatter) {
+				ProfileScope scope(*profiler, "draw scatter");
+				GpuProfileScope gpu_scope(*profiler, "scatter");
+				scatter_shader->use();
+				scatter->draw(*scatter_shader);
+			}
+
+			{
+				ProfileScope scope(*profiler, "swap");
+				// Swaps the color buffer that has been used to draw in during this iteration and show it as output to the screen
+				// Offscreen frames are never presented, so wait for the GPU instead to keep frame times honest
+				if(offscreen)
+					glFinish();
+				else
+					glfwSwapBuffers(window);
+			}
+
+			profiler->end_frame();
+		}
+
+		glfwMakeContextCurrent(NULL);
+	});
+
+	// Simulation loop: input, camera, path prediction and what to stream at a
+	// fixed tick on the main thread, which GLFW requires for events anyway
+	const float timestep = 1.0f / SIMULATION_TICK_RATE;
+	double next_tick = glfwGetTime();
 	while(!glfwWindowShouldClose(window)) {
-		// Per frame time logic
-		float current_frame = glfwGetTime();
-		delta = current_frame - last_frame;
-		last_frame = current_frame;
-
-		// Check for inputs, etc
-		process_input_camera(window);
-
-		// Rendering here
-		glClearColor(0.4f, 0.4f, 0.4f, 1.0f); // State-Setting function
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // State-using function
-
-		glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), SCREEN_WIDTH / SCREEN_HEIGHT, 0.1f, 100000.0f);
-		glm::mat4 view = camera.get_view_matrix();
-		glm::mat4 model = glm::translate(glm::mat4(), glm::vec3(0, 0, 0));
-
-		// Set up Shader
-		terrain_shader->use();
-		terrain_shader->set_mat4("projection", projection);
-		terrain_shader->set_mat4("view", view);
-		terrain_shader->set_mat4("model", model);
-		terrain_shader->set_vec3("lightPosition", light->position);
-		terrain_shader->set_vec3("lightColor", light->color);
-		terrain_shader->set_float("shineDamper", 1);
-		terrain_shader->set_float("reflectivity", 0);
-
-		// Bind the mountain/grass texture
-		terrain_shader->set_int("tex", 0);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture->get_ID());
-
-		// Draw the vertices/indices (send them to the graphics card to be processed)
-		glBindVertexArray(vao);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-
-		// Checks if any events are triggered(like keyboard input or mouse movement events), 
-		// updates window states, calls corresponding functions
-		glfwPollEvents();
-
-		// Swaps the color buffer that has been used to draw in during this iteration and show it as output to the screen
-		glfwSwapBuffers(window);
+		if(options.replay_path) {
+			// Replays advance by a fixed step, and publishing waits for the last one to be rendered
+			if(replay_step >= replay_steps)
+				break;
+			glfwPollEvents();
+			if(glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+				glfwSetWindowShouldClose(window, true);
+
+			camera_path.apply(camera, replay_step++, options.timestep);
+			prefetcher.update(camera.position, options.timestep);
+			publish_tick(options.timestep);
+			continue;
+		}
+
+		// Catch up on the ticks due, but after a stall drop the backlog instead of lurching
+		int ticks = 0;
+		for(double now = glfwGetTime(); now >= next_tick && ticks < SIMULATION_MAX_CATCH_UP; ticks++) {
+			delta = timestep;
+			process_input_camera(window);
+			if(options.record_path)
+				camera_path.record(camera, (float)next_tick - record_start);
+			prefetcher.update(camera.position, timestep);
+			next_tick += timestep;
+		}
+		if(ticks == SIMULATION_MAX_CATCH_UP)
+			next_tick = glfwGetTime();
+		if(ticks > 0)
+			publish_tick(timestep * ticks);
+
+		// Checks if any events are triggered(like keyboard input or mouse movement events),
+		// updates window states, calls corresponding functions. Sleeps until the next tick otherwise
+		glfwWaitEventsTimeout(std::max(0.0, next_tick - glfwGetTime()));
+	}
+
+	frames.close();
+	render_thread.join();
+	glfwMakeContextCurrent(window);
+
+	if(options.record_path) {
+		if(camera_path.save(options.record_path))
+			std::cout << "Recorded " << camera_path.get_key_count() << " camera keys to " << options.record_path << std::endl;
+		else
+			std::cout << "Failed to write camera path " << options.record_path << std::endl;
+	}
+
+	profiler->report(std::cout);
+	if(planet)
+		std::cout << "Planet: " << planet->get_built_count() << " chunks built, " << planet->get_chunk_count() << " resident, "
+			<< planet->get_cancelled_count() << " cancelled" << std::endl;
+	if(clipmap)
+		std::cout << "Clipmap: " << clipmap->get_uploaded_bytes() / (1024 * 1024) << " MB of heights uploaded, "
+			<< clipmap->get_failed_reads() << " failed reads" << std::endl;
+	if(scatter)
+		std::cout << "Scatter: " << scatter->get_instance_count() << " instances in " << scatter->get_chunk_count() << " chunks, "
+			<< scatter->get_drawn_instance_count() << " drawn in the last frame, " << scatter->get_cancelled_count() << " chunks cancelled" << std::endl;
+	if(editor && editor->get_stroke_count() > 0)
+		std::cout << "Editor: " << editor->get_stroke_count() << " brush strokes applied, " << editor->get_undo_count()
+			<< " steps to undo" << std::endl;
+	if(options.replay_path) {
+		// Keep the statistics of each run next to the path that produced them
+		std::string csv = std::string(options.replay_path) + ".profile.csv";
+		profiler->dump_csv(csv.c_str());
+	} else {
+		profiler->dump_csv("profile.csv");
 	}
+	// Stops the planet's workers before the graph they sample goes away
+	delete planet;
+	delete planet_terrain;
+	delete planet_shader;
+	delete clipmap;
+	delete clipmap_shader;
+	delete pyramid;
+	delete scatter;
+	delete scatter_shader;
+	delete editor;
+	delete uploads;
+	delete jobs;
+	delete profiler;
+	delete offscreen;
 
 	glfwTerminate();
 	return 0;
 }
 
-void create_height_map(float noiseWidth, float noiseHeight, float vertWidth, float vertHeight) {
-	// Produces 3D ridged multifractal noise, similar to mountains
-	module::RidgedMulti base_mountain_terrain;
-	module::Voronoi plateau_terrain;
-
+TerrainModules::TerrainModules() {
 #if 1
-	// Generates "Billowy" noise suitable for clouds and rocks
-	module::Billow base_flat_terrain;
 	base_flat_terrain.SetFrequency(2.0);
 #endif
 
 #if 0
-	module::Spheres base_flat_terrain;
 	base_flat_terrain.SetFrequency(2.0);
 
 #endif
 
 #if 0
-	// Produces polygon-like formations
-	module::Voronoi base_flat_terrain;
 	base_flat_terrain.SetFrequency(2.0);
 	base_flat_terrain.SetDisplacement(0.25);
 #endif
 
-	// Applies a scaling factor to the output value from the source module
 	// Scales the flat terrain, adds noise to it
-	module::ScaleBias flat_terrain;
 	flat_terrain.SetSourceModule(0, base_flat_terrain);
 	flat_terrain.SetScale(1.000); // Default is 1
 	flat_terrain.SetBias(-0.75); // Default is 0
-	
-	module::Perlin terrain_type;
 
-	module::Select terrain_selector;
 	terrain_selector.SetSourceModule(0, flat_terrain);
 	terrain_selector.SetSourceModule(1, base_mountain_terrain);
 	terrain_selector.SetControlModule(terrain_type);
 	terrain_selector.SetBounds(0.0, 500); //1000
 	terrain_selector.SetEdgeFalloff(0.125); // .125
 
-	// pseudo-random displacement of the input value
-	module::Turbulence final_terrain;
 	final_terrain.SetSourceModule(0, terrain_selector);
 	final_terrain.SetFrequency(2.0); // How rapidly the displacement changes
 	final_terrain.SetPower(0.125); // The scaling factor that is applied to the displacement amount
+}
+
+void create_height_map(float noiseWidth, float noiseHeight, float vertWidth, float vertHeight, float bumpHeight,
+	float horizonBumpHeight, glm::vec2 lightDirection, utils::NoiseMap &height_map, JobSystem &jobs) {
+	TerrainModules terrain;
+	JobTaskRunner runner(jobs, JOB_PRIORITY_HIGH);
 
-	// Output the noise map
-	utils::NoiseMap height_map;
-	utils::NoiseMapBuilderPlane height_map_builder;
-	height_map_builder.SetSourceModule(final_terrain);
+	// Output the noise map, and the normals of the surface from the noise gradient
+	utils::Image normal_map;
+	utils::NoiseMapBuilderPlaneTiled height_map_builder;
+	height_map_builder.SetSourceModule(terrain.final_terrain);
 	height_map_builder.SetDestNoiseMap(height_map);
+	height_map_builder.SetDestNormalMap(normal_map);
+	height_map_builder.SetBumpHeight(bumpHeight);
 	height_map_builder.SetDestSize(noiseWidth, noiseHeight);
 	height_map_builder.SetBounds(0, vertWidth, 0, vertHeight);
-	height_map_builder.Build();
-
-	utils::RendererImage renderer;
-	utils::Image image;
-	renderer.SetSourceNoiseMap(height_map);
-	renderer.SetDestImage(image);
-	renderer.Render();
-
-	utils::WriterBMP writer;
-	writer.SetSourceImage(image);
-	writer.SetDestFilename("res/heightmap.bmp");
-	writer.WriteDestFile();
+	height_map_builder.SetTaskRunner(&runner);
+	{
+		// Octaves finer than the distance between samples can't show up in the map
+		module::SampleSpacingScope spacing(std::max(vertWidth / noiseWidth, vertHeight / noiseHeight));
+		height_map_builder.Build();
+	}
+	std::cout << "Height map: " << height_map_builder.GetSimplifiedTileCount() << " tiles skipped a Select branch" << std::endl;
+
+	// The three images only read the finished maps, so they are written side by side. They are
+	// stored top down so the textures upload from the mapped files in one call
+	JobHandle height_image = jobs.submit([&]() {
+		utils::RendererImage renderer;
+		utils::Image image;
+		renderer.SetSourceNoiseMap(height_map);
+		renderer.SetDestImage(image);
+		renderer.Render();
+
+		utils::WriterBMP writer;
+		writer.SetSourceImage(image);
+		writer.SetDestFilename("res/heightmap.bmp");
+		writer.SetTopDown(true);
+		writer.SetTaskRunner(&runner);
+		writer.WriteDestFile();
+	}, JOB_PRIORITY_HIGH);
+
+	JobHandle normal_image = jobs.submit([&]() {
+		utils::WriterBMP writer;
+		writer.SetSourceImage(normal_map);
+		writer.SetDestFilename("res/normalmap.bmp");
+		writer.SetTopDown(true);
+		writer.SetTaskRunner(&runner);
+		writer.WriteDestFile();
+	}, JOB_PRIORITY_HIGH);
+
+	// Bake the shadow horizon towards the light and the ambient occlusion
+	JobHandle light_image = jobs.submit([&]() {
+		utils::RendererHorizon horizon_renderer;
+		utils::Image light_map;
+		horizon_renderer.SetSourceNoiseMap(height_map);
+		horizon_renderer.SetDestImage(light_map);
+		horizon_renderer.SetBumpHeight(horizonBumpHeight);
+		horizon_renderer.SetLightDirection(lightDirection.x, lightDirection.y);
+		horizon_renderer.SetTaskRunner(&runner);
+		horizon_renderer.Render();
+
+		utils::WriterBMP writer;
+		writer.SetSourceImage(light_map);
+		writer.SetDestFilename("res/lightmap.bmp");
+		writer.SetTopDown(true);
+		writer.SetTaskRunner(&runner);
+		writer.WriteDestFile();
+	}, JOB_PRIORITY_HIGH);
+
+	jobs.wait(height_image);
+	jobs.wait(normal_image);
+	jobs.wait(light_image);
+}
+
+void parse_options(int argc, char** argv) {
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			options.record_path = argv[++i];
+		else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			options.replay_path = argv[++i];
+		else if(strcmp(argv[i], "--timestep") == 0 && i + 1 < argc)
+			options.timestep = (float)atof(argv[++i]);
+		else if(strcmp(argv[i], "--headless") == 0)
+			options.headless = true;
+		else if(strcmp(argv[i], "--planet") == 0)
+			options.planet = true;
+		else if(strcmp(argv[i], "--clipmap") == 0 && i + 1 < argc)
+			options.clipmap_path = argv[++i];
+		else if(strcmp(argv[i], "--import") == 0 && i + 4 < argc && parse_import(argv + i + 1))
+			i += 4;
+		else if(strcmp(argv[i], "--compress") == 0 && i + 3 < argc) {
+			options.compress_source = argv[++i];
+			options.compress_path = argv[++i];
+			options.compress_error = std::max(0.0f, (float)atof(argv[++i]));
+		}
+		else
+			std::cout << "Ignoring unknown option " << argv[i] << std::endl;
+	}
+
+	if(options.timestep <= 0.0f)
+		options.timestep = 1.0f / 60.0f;
+	if(options.headless && !options.replay_path)
+		std::cout << "--headless without --replay has no input, the camera will not move" << std::endl;
+}
+
+bool parse_import(char** argv) {
+	RawHeightSource &source = options.import_source;
+	if(sscanf(argv[1], "%ux%u", &source.width, &source.height) != 2 || source.width == 0 || source.height == 0)
+		return false;
+
+	// Integer samples are normalized like the generated height map, floats are kept as they are
+	const char* format = argv[2];
+	if(strncmp(format, "u16", 3) == 0) {
+		source.format = RAW_HEIGHT_UINT16;
+		source.scale = 1.0f / 65535.0f;
+	} else if(strncmp(format, "s16", 3) == 0) {
+		source.format = RAW_HEIGHT_INT16;
+		source.scale = 1.0f / 32767.0f;
+	} else if(strncmp(format, "f32", 3) == 0) {
+		source.format = RAW_HEIGHT_FLOAT32;
+		source.scale = 1.0f;
+	} else {
+		return false;
+	}
+	source.big_endian = strcmp(format + 3, "be") == 0;
+	if(!source.big_endian && format[3] != '\0')
+		return false;
+
+	source.path = argv[0];
+	options.import_path = argv[3];
+	return true;
 }
 
 // MARK: 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-	glViewport(0, 0, width, height);
+	viewport_width = width;
+	viewport_height = height;
 }
 
 void process_input_camera(GLFWwindow* window) {
@@ -331,13 +879,50 @@ void process_input_camera(GLFWwindow* window) {
 		glfwSetWindowShouldClose(window, true);
 	}
 
+	// The render thread owns the context, so it switches the polygon mode
 	if(glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS)
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		wire_frame = true;
 	if(glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS)
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		wire_frame = false;
+
+	// 1 to 4 pick raise, lower, smooth or flatten, and the left mouse button
+	// applies the brush where the camera looks. Ctrl+Z undoes a drag and
+	// Ctrl+Y redoes it
+	if(editor) {
+		for(int i = 0; i < BRUSH_TYPE_COUNT; i++) {
+			if(glfwGetKey(window, GLFW_KEY_1 + i) == GLFW_PRESS)
+				brush = (BrushType)i;
+		}
+
+		bool control = glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS;
+		bool undo = control && glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS;
+		bool redo = control && glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS;
+		if(undo && !undo_held)
+			editor->undo();
+		if(redo && !redo_held)
+			editor->redo();
+		undo_held = undo;
+		redo_held = redo;
+
+		bool held = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+		if(held) {
+			BrushStroke stroke;
+			stroke.type = brush;
+			stroke.origin = camera.position;
+			stroke.direction = camera.front;
+			stroke.radius = BRUSH_RADIUS;
+			stroke.strength = (brush == BRUSH_RAISE || brush == BRUSH_LOWER ? BRUSH_HEIGHT_RATE : BRUSH_BLEND_RATE) * delta;
+			stroke.starts_step = !brush_held;
+			editor->submit(stroke);
+		}
+		brush_held = held;
+	}
 }
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
+	if(options.replay_path)
+		return;
+
 	if(first_mouse) {
 		mouse_last_X = xpos;
 		mouse_last_Y = ypos;
@@ -354,6 +939,9 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+	if(options.replay_path)
+		return;
+
 	camera.process_mouse_scroll(yoffset);
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,748 @@
+// bounds.cpp
+//
+
+#include "bounds.h"
+#include "fastvoronoi.h"
+#include "fusedturbulence.h"
+#include "latticenoise.h"
+#include "lodfractal.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <noise/mathconsts.h>
+
+using namespace noise::module;
+
+namespace
+{
+
+  // Largest magnitude gradient noise can reach anywhere.  The noise is a
+  // convex combination of 2.12 * dot(gradient, p - corner) over the cell
+  // corners, and the interpolation weights keep the weighted mean squared
+  // corner distance at or below 0.25 per axis, so |noise| <= 2.12 * sqrt(3/4).
+  const double GRADIENT_NOISE_LIMIT = 2.12 * 0.86602540378443865;
+
+  // Widening applied to computed bounds to absorb the rounding differences
+  // between the bounds and GetValue().
+  const double BOUNDS_PAD = 1.0e-9;
+
+  // Regions covering more lattice cells than this fall back to the global
+  // gradient noise bound for that octave.
+  const int MAX_BOUND_CELLS = 64;
+
+  // Boxes wider than this, in lattice units, are split into up to
+  // MAX_BOUND_SPLITS pieces per axis before being bounded.
+  const double MAX_BOUND_SPLIT_WIDTH = 0.125;
+  const int MAX_BOUND_SPLITS = 4;
+
+  // Beyond this magnitude MakeInt32Range() wraps the input, and the cells
+  // touched by a region are no longer contiguous.
+  const double MAX_BOUND_COORD = 1073741824.0;
+
+  Interval MakeInterval (double lower, double upper)
+  {
+    Interval interval;
+    interval.lower = lower;
+    interval.upper = upper;
+    return interval;
+  }
+
+  Interval Unbounded ()
+  {
+    return MakeInterval (-HUGE_VAL, HUGE_VAL);
+  }
+
+  // Replaces NaN (e.g. infinity times zero) with the unbounded interval.
+  Interval Checked (const Interval& a)
+  {
+    if (!(a.lower <= a.upper)) {
+      return Unbounded ();
+    }
+    return a;
+  }
+
+  Interval Pad (const Interval& a)
+  {
+    return MakeInterval (
+      a.lower - BOUNDS_PAD * (1.0 + fabs (a.lower)),
+      a.upper + BOUNDS_PAD * (1.0 + fabs (a.upper)));
+  }
+
+  Interval IntervalHull (const Interval& a, const Interval& b)
+  {
+    return MakeInterval (std::min (a.lower, b.lower),
+      std::max (a.upper, b.upper));
+  }
+
+  Interval IntervalAdd (const Interval& a, const Interval& b)
+  {
+    return Checked (MakeInterval (a.lower + b.lower, a.upper + b.upper));
+  }
+
+  Interval IntervalScale (const Interval& a, double scale)
+  {
+    if (scale == 0.0) {
+      return MakeInterval (0.0, 0.0);
+    }
+    double p = a.lower * scale;
+    double q = a.upper * scale;
+    return Checked (MakeInterval (std::min (p, q), std::max (p, q)));
+  }
+
+  Interval IntervalMultiply (const Interval& a, const Interval& b)
+  {
+    double p0 = a.lower * b.lower;
+    double p1 = a.lower * b.upper;
+    double p2 = a.upper * b.lower;
+    double p3 = a.upper * b.upper;
+    return Checked (MakeInterval (
+      std::min (std::min (p0, p1), std::min (p2, p3)),
+      std::max (std::max (p0, p1), std::max (p2, p3))));
+  }
+
+  Interval IntervalAbs (const Interval& a)
+  {
+    if (a.lower >= 0.0) {
+      return a;
+    }
+    if (a.upper <= 0.0) {
+      return MakeInterval (-a.upper, -a.lower);
+    }
+    return MakeInterval (0.0, std::max (-a.lower, a.upper));
+  }
+
+  Interval IntervalSquare (const Interval& a)
+  {
+    Interval b = IntervalAbs (a);
+    return MakeInterval (b.lower * b.lower, b.upper * b.upper);
+  }
+
+  Region ScaleRegion (const Region& region, double scale)
+  {
+    Region scaled;
+    scaled.lowerX = std::min (region.lowerX * scale, region.upperX * scale);
+    scaled.upperX = std::max (region.lowerX * scale, region.upperX * scale);
+    scaled.lowerY = std::min (region.lowerY * scale, region.upperY * scale);
+    scaled.upperY = std::max (region.lowerY * scale, region.upperY * scale);
+    scaled.lowerZ = std::min (region.lowerZ * scale, region.upperZ * scale);
+    scaled.upperZ = std::max (region.lowerZ * scale, region.upperZ * scale);
+    return scaled;
+  }
+
+  // Adds the range of gradient * (p - corner) for p in [lower, upper].
+  void AccumulateLinear (double gradient, double lower, double upper,
+    double& low, double& high)
+  {
+    double p = gradient * lower;
+    double q = gradient * upper;
+    low  += std::min (p, q);
+    high += std::max (p, q);
+  }
+
+  // Bounds of LinearInterp (n0, n1, a).
+  Interval LerpBounds (const Interval& n0, const Interval& n1,
+    const Interval& a)
+  {
+    Interval oneMinusA = MakeInterval (1.0 - a.upper, 1.0 - a.lower);
+    return IntervalAdd (IntervalMultiply (oneMinusA, n0),
+      IntervalMultiply (a, n1));
+  }
+
+  // Bounds of the interpolation weight for lattice offsets in [lower, upper].
+  // Every fade curve is increasing on [0, 1].
+  Interval FadeBounds (double lower, double upper,
+    noise::NoiseQuality noiseQuality)
+  {
+    return MakeInterval (noise::lattice::FadeCurve (lower, noiseQuality),
+      noise::lattice::FadeCurve (upper, noiseQuality));
+  }
+
+  // Bounds of noise::GradientCoherentNoise3D() over a box inside the cell
+  // at (ix, iy, iz), given relative to the cell.  The corner functions are
+  // linear, so their ranges over the box are exact; the interpolation is
+  // then carried out on intervals.
+  Interval CellBounds (int ix, int iy, int iz, int seed,
+    noise::NoiseQuality noiseQuality, double bx0, double bx1, double by0,
+    double by1, double bz0, double bz1)
+  {
+    unsigned int hash = noise::lattice::LatticeHash (ix, iy, iz, seed);
+    Interval n[8];
+    Interval hull = MakeInterval (HUGE_VAL, -HUGE_VAL);
+    for (int corner = 0; corner < 8; corner++) {
+      int dx = corner & 1;
+      int dy = (corner >> 1) & 1;
+      int dz = corner >> 2;
+      const double* gradient = noise::lattice::GradientFromHash (hash
+        + dx * noise::lattice::X_NOISE_GEN
+        + dy * noise::lattice::Y_NOISE_GEN
+        + dz * noise::lattice::Z_NOISE_GEN);
+
+      double low = 0.0;
+      double high = 0.0;
+      AccumulateLinear (gradient[0], bx0 - dx, bx1 - dx, low, high);
+      AccumulateLinear (gradient[1], by0 - dy, by1 - dy, low, high);
+      AccumulateLinear (gradient[2], bz0 - dz, bz1 - dz, low, high);
+      n[corner] = MakeInterval (low * 2.12, high * 2.12);
+      hull = IntervalHull (hull, n[corner]);
+    }
+
+    // Same interpolation order as noise::GradientCoherentNoise3D().
+    Interval xs = FadeBounds (bx0, bx1, noiseQuality);
+    Interval ys = FadeBounds (by0, by1, noiseQuality);
+    Interval zs = FadeBounds (bz0, bz1, noiseQuality);
+    Interval iy0 = LerpBounds (LerpBounds (n[0], n[1], xs),
+      LerpBounds (n[2], n[3], xs), ys);
+    Interval iy1 = LerpBounds (LerpBounds (n[4], n[5], xs),
+      LerpBounds (n[6], n[7], xs), ys);
+    Interval cell = LerpBounds (iy0, iy1, zs);
+
+    // The noise is also a convex combination of the corner functions, and
+    // never exceeds the global limit.
+    cell.lower = std::max (cell.lower,
+      std::max (hull.lower, -GRADIENT_NOISE_LIMIT));
+    cell.upper = std::min (cell.upper,
+      std::min (hull.upper, GRADIENT_NOISE_LIMIT));
+    return cell;
+  }
+
+  // Number of pieces to split [lower, upper] into along one axis.  Interval
+  // arithmetic loses precision as the box grows, so wide boxes are split.
+  int GetSplitCount (double lower, double upper)
+  {
+    int count = (int)ceil ((upper - lower) / MAX_BOUND_SPLIT_WIDTH);
+    return std::max (1, std::min (count, MAX_BOUND_SPLITS));
+  }
+
+  // Bounds of noise::GradientCoherentNoise3D() over a region given in
+  // lattice coordinates: the union of the bounds of every cell the region
+  // touches.
+  Interval GradientNoiseBounds (const Region& region, int seed,
+    noise::NoiseQuality noiseQuality)
+  {
+    Interval global = MakeInterval (-GRADIENT_NOISE_LIMIT,
+      GRADIENT_NOISE_LIMIT);
+
+    if (fabs (region.lowerX) >= MAX_BOUND_COORD
+      || fabs (region.upperX) >= MAX_BOUND_COORD
+      || fabs (region.lowerY) >= MAX_BOUND_COORD
+      || fabs (region.upperY) >= MAX_BOUND_COORD
+      || fabs (region.lowerZ) >= MAX_BOUND_COORD
+      || fabs (region.upperZ) >= MAX_BOUND_COORD) {
+      return Pad (global);
+    }
+
+    int x0 = noise::lattice::LatticeFloor (region.lowerX);
+    int x1 = noise::lattice::LatticeFloor (region.upperX);
+    int y0 = noise::lattice::LatticeFloor (region.lowerY);
+    int y1 = noise::lattice::LatticeFloor (region.upperY);
+    int z0 = noise::lattice::LatticeFloor (region.lowerZ);
+    int z1 = noise::lattice::LatticeFloor (region.upperZ);
+
+    long long cellCount = (long long)(x1 - x0 + 1) * (y1 - y0 + 1)
+      * (z1 - z0 + 1);
+    if (cellCount > MAX_BOUND_CELLS) {
+      return Pad (global);
+    }
+
+    Interval result = MakeInterval (HUGE_VAL, -HUGE_VAL);
+    for (int iz = z0; iz <= z1; iz++) {
+      for (int iy = y0; iy <= y1; iy++) {
+        for (int ix = x0; ix <= x1; ix++) {
+
+          // Part of the region inside this cell, relative to the cell.
+          double bx0 = std::max (region.lowerX, (double)ix) - ix;
+          double bx1 = std::min (region.upperX, (double)ix + 1.0) - ix;
+          double by0 = std::max (region.lowerY, (double)iy) - iy;
+          double by1 = std::min (region.upperY, (double)iy + 1.0) - iy;
+          double bz0 = std::max (region.lowerZ, (double)iz) - iz;
+          double bz1 = std::min (region.upperZ, (double)iz + 1.0) - iz;
+
+          int xSplits = GetSplitCount (bx0, bx1);
+          int ySplits = GetSplitCount (by0, by1);
+          int zSplits = GetSplitCount (bz0, bz1);
+          for (int k = 0; k < zSplits; k++) {
+            for (int j = 0; j < ySplits; j++) {
+              for (int i = 0; i < xSplits; i++) {
+                result = IntervalHull (result, CellBounds (ix, iy, iz, seed,
+                  noiseQuality,
+                  bx0 + (bx1 - bx0) * i / xSplits,
+                  (i + 1 == xSplits)? bx1: bx0 + (bx1 - bx0) * (i + 1) / xSplits,
+                  by0 + (by1 - by0) * j / ySplits,
+                  (j + 1 == ySplits)? by1: by0 + (by1 - by0) * (j + 1) / ySplits,
+                  bz0 + (bz1 - bz0) * k / zSplits,
+                  (k + 1 == zSplits)? bz1: bz0 + (bz1 - bz0) * (k + 1) / zSplits));
+              }
+            }
+          }
+        }
+      }
+    }
+
+    return Pad (result);
+  }
+
+  // Octaves evaluated by a fractal module, matching its GetValue().
+  void GetOctaves (const Module& sourceModule, double frequency,
+    double lacunarity, int octaveCount, int& evaluated, double& fade)
+  {
+    bool isLod = dynamic_cast<const LodPerlin*> (&sourceModule) != NULL
+      || dynamic_cast<const LodBillow*> (&sourceModule) != NULL
+      || dynamic_cast<const LodRidgedMulti*> (&sourceModule) != NULL;
+    fade = 0.0;
+    evaluated = octaveCount;
+    if (isLod) {
+      evaluated = GetLodOctaveCount (frequency, lacunarity, octaveCount, fade);
+    }
+  }
+
+  enum FractalType
+  {
+    FRACTAL_PERLIN,
+    FRACTAL_BILLOW
+  };
+
+  // Bounds of Perlin-style fractals: a persistence-weighted sum of octaves.
+  // evaluated and fade are the octave count and fade from GetOctaves().
+  Interval FractalBounds (FractalType type, const Region& region,
+    double frequency, double lacunarity, double persistence, int evaluated,
+    double fade, int seed, noise::NoiseQuality noiseQuality)
+  {
+    int lastOctave = (fade > 0.0)? evaluated: evaluated - 1;
+
+    Region octaveRegion = ScaleRegion (region, frequency);
+    Interval value = MakeInterval (0.0, 0.0);
+    double curPersistence = 1.0;
+    for (int curOctave = 0; curOctave <= lastOctave; curOctave++) {
+      Interval signal = GradientNoiseBounds (octaveRegion,
+        (seed + curOctave) & 0xffffffff, noiseQuality);
+      if (type == FRACTAL_BILLOW) {
+        signal = IntervalAdd (IntervalScale (IntervalAbs (signal), 2.0),
+          MakeInterval (-1.0, -1.0));
+      }
+      if (curOctave == evaluated) {
+        signal = IntervalScale (signal, fade);
+      }
+      value = IntervalAdd (value, IntervalScale (signal, curPersistence));
+
+      octaveRegion = ScaleRegion (octaveRegion, lacunarity);
+      curPersistence *= persistence;
+    }
+
+    if (type == FRACTAL_BILLOW) {
+      value = IntervalAdd (value, MakeInterval (0.5, 0.5));
+    }
+    return Pad (value);
+  }
+
+  Interval RidgedMultiBounds (const RidgedMulti& ridged, const Region& region)
+  {
+    int evaluated;
+    double fade;
+    GetOctaves (ridged, ridged.GetFrequency (), ridged.GetLacunarity (),
+      ridged.GetOctaveCount (), evaluated, fade);
+    int lastOctave = (fade > 0.0)? evaluated: evaluated - 1;
+
+    // RidgedMulti keeps its spectral weights private; they are recomputed
+    // here the same way CalcSpectralWeights() does.
+    double spectralFrequency = 1.0;
+
+    Region octaveRegion = ScaleRegion (region, ridged.GetFrequency ());
+    Interval value = MakeInterval (0.0, 0.0);
+    for (int curOctave = 0; curOctave <= lastOctave; curOctave++) {
+      Interval noise = GradientNoiseBounds (octaveRegion,
+        (ridged.GetSeed () + curOctave) & 0x7fffffff,
+        ridged.GetNoiseQuality ());
+
+      // signal = (1 - |noise|)^2 * weight, where the weight is 1.0 for the
+      // first octave and anywhere in [0, 1] after that.
+      Interval signal = IntervalSquare (IntervalAdd (MakeInterval (1.0, 1.0),
+        IntervalScale (IntervalAbs (noise), -1.0)));
+      if (curOctave > 0) {
+        signal.lower = 0.0;
+      }
+      if (curOctave == evaluated) {
+        signal = IntervalScale (signal, fade);
+      }
+      value = IntervalAdd (value,
+        IntervalScale (signal, pow (spectralFrequency, -1.0)));
+
+      octaveRegion = ScaleRegion (octaveRegion, ridged.GetLacunarity ());
+      spectralFrequency *= ridged.GetLacunarity ();
+    }
+
+    return Pad (IntervalAdd (IntervalScale (value, 1.25),
+      MakeInterval (-1.0, -1.0)));
+  }
+
+  // Region of input values a Turbulence-style module passes to its source
+  // module for input values inside region.  Each displacement channel is
+  // Perlin noise with the default lacunarity, persistence and quality,
+  // sampled at an offset position.
+  Region TurbulenceRegion (const Region& region, double frequency,
+    double power, int roughness, int seed)
+  {
+    double lower[3] = { region.lowerX, region.lowerY, region.lowerZ };
+    double upper[3] = { region.upperX, region.upperY, region.upperZ };
+    for (int c = 0; c < 3; c++) {
+      Region channel;
+      channel.lowerX = region.lowerX + TURBULENCE_OFFSET[c][0];
+      channel.upperX = region.upperX + TURBULENCE_OFFSET[c][0];
+      channel.lowerY = region.lowerY + TURBULENCE_OFFSET[c][1];
+      channel.upperY = region.upperY + TURBULENCE_OFFSET[c][1];
+      channel.lowerZ = region.lowerZ + TURBULENCE_OFFSET[c][2];
+      channel.upperZ = region.upperZ + TURBULENCE_OFFSET[c][2];
+
+      Interval displacement = IntervalScale (FractalBounds (FRACTAL_PERLIN,
+        channel, frequency, DEFAULT_PERLIN_LACUNARITY,
+        DEFAULT_PERLIN_PERSISTENCE, roughness, 0.0, seed + c,
+        DEFAULT_PERLIN_QUALITY), power);
+      Interval reached = Pad (IntervalAdd (MakeInterval (lower[c], upper[c]),
+        displacement));
+      lower[c] = reached.lower;
+      upper[c] = reached.upper;
+    }
+
+    Region reached;
+    reached.lowerX = lower[0];
+    reached.upperX = upper[0];
+    reached.lowerY = lower[1];
+    reached.upperY = upper[1];
+    reached.lowerZ = lower[2];
+    reached.upperZ = upper[2];
+    return reached;
+  }
+
+  Interval VoronoiBounds (bool isDistanceEnabled, double displacement)
+  {
+    // The seed point of the cell containing the input value is at most two
+    // units away along each axis, so the nearest seed point is no further
+    // than 2 * sqrt(3).
+    Interval value = MakeInterval (0.0, 0.0);
+    if (isDistanceEnabled) {
+      value = MakeInterval (-1.0, 2.0 * noise::SQRT_3 * noise::SQRT_3 - 1.0);
+    }
+    double cellValue = fabs (displacement);
+    return Pad (IntervalAdd (value, MakeInterval (-cellValue, cellValue)));
+  }
+
+  // Which source module a Select outputs everywhere in a region: 0 or 1, or
+  // -1 if that depends on the position.  Mirrors Select::GetValue().
+  int GetSelectedSource (const Select& select, const Region& region)
+  {
+    Interval control = GetBounds (select.GetControlModule (), region);
+    double lowerBound = select.GetLowerBound ();
+    double upperBound = select.GetUpperBound ();
+    double edgeFalloff = select.GetEdgeFalloff ();
+
+    if (edgeFalloff > 0.0) {
+      if (control.upper < lowerBound - edgeFalloff
+        || control.lower >= upperBound + edgeFalloff) {
+        return 0;
+      }
+      if (control.lower >= lowerBound + edgeFalloff
+        && control.upper < upperBound - edgeFalloff) {
+        return 1;
+      }
+    } else {
+      if (control.upper < lowerBound || control.lower > upperBound) {
+        return 0;
+      }
+      if (control.lower >= lowerBound && control.upper <= upperBound) {
+        return 1;
+      }
+    }
+    return -1;
+  }
+
+  // Simplifies the first count source modules of a module.  Returns true if
+  // any of them changed.
+  bool SimplifySources (const Module& sourceModule, int count,
+    const Region& region, ModuleArena& arena, const Module** pSources)
+  {
+    bool changed = false;
+    for (int i = 0; i < count; i++) {
+      const Module& original = sourceModule.GetSourceModule (i);
+      pSources[i] = &Simplify (original, region, arena);
+      changed = changed || (pSources[i] != &original);
+    }
+    return changed;
+  }
+
+}
+
+Interval noise::module::GetBounds (const Module& sourceModule,
+  const Region& region)
+{
+  if (const Const* pConst = dynamic_cast<const Const*> (&sourceModule)) {
+    double value = pConst->GetConstValue ();
+    return MakeInterval (value, value);
+  }
+
+  if (const Perlin* pPerlin = dynamic_cast<const Perlin*> (&sourceModule)) {
+    int evaluated;
+    double fade;
+    GetOctaves (*pPerlin, pPerlin->GetFrequency (), pPerlin->GetLacunarity (),
+      pPerlin->GetOctaveCount (), evaluated, fade);
+    return FractalBounds (FRACTAL_PERLIN, region, pPerlin->GetFrequency (),
+      pPerlin->GetLacunarity (), pPerlin->GetPersistence (), evaluated, fade,
+      pPerlin->GetSeed (), pPerlin->GetNoiseQuality ());
+  }
+
+  if (const Billow* pBillow = dynamic_cast<const Billow*> (&sourceModule)) {
+    int evaluated;
+    double fade;
+    GetOctaves (*pBillow, pBillow->GetFrequency (), pBillow->GetLacunarity (),
+      pBillow->GetOctaveCount (), evaluated, fade);
+    return FractalBounds (FRACTAL_BILLOW, region, pBillow->GetFrequency (),
+      pBillow->GetLacunarity (), pBillow->GetPersistence (), evaluated, fade,
+      pBillow->GetSeed (), pBillow->GetNoiseQuality ());
+  }
+
+  if (const RidgedMulti* pRidged
+    = dynamic_cast<const RidgedMulti*> (&sourceModule)) {
+    return RidgedMultiBounds (*pRidged, region);
+  }
+
+  if (const Voronoi* pVoronoi
+    = dynamic_cast<const Voronoi*> (&sourceModule)) {
+    return VoronoiBounds (pVoronoi->IsDistanceEnabled (),
+      pVoronoi->GetDisplacement ());
+  }
+
+  if (const FastVoronoi* pVoronoi
+    = dynamic_cast<const FastVoronoi*> (&sourceModule)) {
+    return VoronoiBounds (pVoronoi->IsDistanceEnabled (),
+      pVoronoi->GetDisplacement ());
+  }
+
+  if (const ScaleBias* pScaleBias
+    = dynamic_cast<const ScaleBias*> (&sourceModule)) {
+    Interval source = GetBounds (pScaleBias->GetSourceModule (0), region);
+    return Pad (IntervalAdd (IntervalScale (source, pScaleBias->GetScale ()),
+      MakeInterval (pScaleBias->GetBias (), pScaleBias->GetBias ())));
+  }
+
+  if (const Select* pSelect = dynamic_cast<const Select*> (&sourceModule)) {
+    int selected = GetSelectedSource (*pSelect, region);
+    if (selected >= 0) {
+      return GetBounds (pSelect->GetSourceModule (selected), region);
+    }
+    // In the falloff band the output is a blend of the two sources.
+    return IntervalHull (GetBounds (pSelect->GetSourceModule (0), region),
+      GetBounds (pSelect->GetSourceModule (1), region));
+  }
+
+  if (const Blend* pBlend = dynamic_cast<const Blend*> (&sourceModule)) {
+    Interval v0 = GetBounds (pBlend->GetSourceModule (0), region);
+    Interval v1 = GetBounds (pBlend->GetSourceModule (1), region);
+    Interval alpha = IntervalScale (IntervalAdd (GetBounds (pBlend->GetControlModule (),
+      region), MakeInterval (1.0, 1.0)), 0.5);
+
+    // LinearInterp() is linear in each argument, so its extremes are at
+    // the corners of the argument box.
+    Interval result = MakeInterval (HUGE_VAL, -HUGE_VAL);
+    const double as[2] = { alpha.lower, alpha.upper };
+    const double n0s[2] = { v0.lower, v0.upper };
+    const double n1s[2] = { v1.lower, v1.upper };
+    for (int i = 0; i < 8; i++) {
+      double a = as[i & 1];
+      double value = ((1.0 - a) * n0s[(i >> 1) & 1]) + (a * n1s[i >> 2]);
+      result = IntervalHull (result, MakeInterval (value, value));
+    }
+    return Pad (Checked (result));
+  }
+
+  if (const Turbulence* pTurbulence
+    = dynamic_cast<const Turbulence*> (&sourceModule)) {
+    return GetBounds (pTurbulence->GetSourceModule (0), TurbulenceRegion (
+      region, pTurbulence->GetFrequency (), pTurbulence->GetPower (),
+      pTurbulence->GetRoughnessCount (), pTurbulence->GetSeed ()));
+  }
+
+  if (const FusedTurbulence* pTurbulence
+    = dynamic_cast<const FusedTurbulence*> (&sourceModule)) {
+    return GetBounds (pTurbulence->GetSourceModule (0), TurbulenceRegion (
+      region, pTurbulence->GetFrequency (), pTurbulence->GetPower (),
+      pTurbulence->GetRoughnessCount (), pTurbulence->GetSeed ()));
+  }
+
+  if (dynamic_cast<const Add*> (&sourceModule) != NULL) {
+    return Pad (IntervalAdd (GetBounds (sourceModule.GetSourceModule (0), region),
+      GetBounds (sourceModule.GetSourceModule (1), region)));
+  }
+
+  if (dynamic_cast<const Multiply*> (&sourceModule) != NULL) {
+    return Pad (IntervalMultiply (GetBounds (sourceModule.GetSourceModule (0), region),
+      GetBounds (sourceModule.GetSourceModule (1), region)));
+  }
+
+  if (dynamic_cast<const Max*> (&sourceModule) != NULL) {
+    Interval a = GetBounds (sourceModule.GetSourceModule (0), region);
+    Interval b = GetBounds (sourceModule.GetSourceModule (1), region);
+    return MakeInterval (std::max (a.lower, b.lower),
+      std::max (a.upper, b.upper));
+  }
+
+  if (dynamic_cast<const Min*> (&sourceModule) != NULL) {
+    Interval a = GetBounds (sourceModule.GetSourceModule (0), region);
+    Interval b = GetBounds (sourceModule.GetSourceModule (1), region);
+    return MakeInterval (std::min (a.lower, b.lower),
+      std::min (a.upper, b.upper));
+  }
+
+  if (dynamic_cast<const Abs*> (&sourceModule) != NULL) {
+    return IntervalAbs (GetBounds (sourceModule.GetSourceModule (0), region));
+  }
+
+  if (dynamic_cast<const Invert*> (&sourceModule) != NULL) {
+    return IntervalScale (GetBounds (sourceModule.GetSourceModule (0), region), -1.0);
+  }
+
+  if (const Clamp* pClamp = dynamic_cast<const Clamp*> (&sourceModule)) {
+    Interval source = GetBounds (pClamp->GetSourceModule (0), region);
+    double lowerBound = pClamp->GetLowerBound ();
+    double upperBound = pClamp->GetUpperBound ();
+    return MakeInterval (
+      std::min (std::max (source.lower, lowerBound), upperBound),
+      std::min (std::max (source.upper, lowerBound), upperBound));
+  }
+
+  return Unbounded ();
+}
+
+ModuleArena::ModuleArena ()
+{
+}
+
+ModuleArena::~ModuleArena ()
+{
+  for (size_t i = 0; i < m_modules.size (); i++) {
+    delete m_modules[i];
+  }
+}
+
+const Module& noise::module::Simplify (const Module& sourceModule,
+  const Region& region, ModuleArena& arena)
+{
+  const Module* pSources[3];
+
+  if (const Select* pSelect = dynamic_cast<const Select*> (&sourceModule)) {
+    int selected = GetSelectedSource (*pSelect, region);
+    if (selected >= 0) {
+      return Simplify (pSelect->GetSourceModule (selected), region, arena);
+    }
+    if (!SimplifySources (sourceModule, 3, region, arena, pSources)) {
+      return sourceModule;
+    }
+    Select& select = arena.Create<Select> ();
+    select.SetSourceModule (0, *pSources[0]);
+    select.SetSourceModule (1, *pSources[1]);
+    select.SetControlModule (*pSources[2]);
+    select.SetBounds (pSelect->GetLowerBound (), pSelect->GetUpperBound ());
+    select.SetEdgeFalloff (pSelect->GetEdgeFalloff ());
+    return select;
+  }
+
+  if (const ScaleBias* pScaleBias
+    = dynamic_cast<const ScaleBias*> (&sourceModule)) {
+    if (!SimplifySources (sourceModule, 1, region, arena, pSources)) {
+      return sourceModule;
+    }
+    ScaleBias& scaleBias = arena.Create<ScaleBias> ();
+    scaleBias.SetSourceModule (0, *pSources[0]);
+    scaleBias.SetScale (pScaleBias->GetScale ());
+    scaleBias.SetBias (pScaleBias->GetBias ());
+    return scaleBias;
+  }
+
+  if (const Turbulence* pTurbulence
+    = dynamic_cast<const Turbulence*> (&sourceModule)) {
+    Region reached = TurbulenceRegion (region, pTurbulence->GetFrequency (),
+      pTurbulence->GetPower (), pTurbulence->GetRoughnessCount (),
+      pTurbulence->GetSeed ());
+    if (!SimplifySources (sourceModule, 1, reached, arena, pSources)) {
+      return sourceModule;
+    }
+    Turbulence& turbulence = arena.Create<Turbulence> ();
+    turbulence.SetSourceModule (0, *pSources[0]);
+    turbulence.SetFrequency (pTurbulence->GetFrequency ());
+    turbulence.SetPower (pTurbulence->GetPower ());
+    turbulence.SetRoughness (pTurbulence->GetRoughnessCount ());
+    turbulence.SetSeed (pTurbulence->GetSeed ());
+    return turbulence;
+  }
+
+  if (const FusedTurbulence* pTurbulence
+    = dynamic_cast<const FusedTurbulence*> (&sourceModule)) {
+    Region reached = TurbulenceRegion (region, pTurbulence->GetFrequency (),
+      pTurbulence->GetPower (), pTurbulence->GetRoughnessCount (),
+      pTurbulence->GetSeed ());
+    if (!SimplifySources (sourceModule, 1, reached, arena, pSources)) {
+      return sourceModule;
+    }
+    FusedTurbulence& turbulence = arena.Create<FusedTurbulence> ();
+    turbulence.SetSourceModule (0, *pSources[0]);
+    turbulence.SetFrequency (pTurbulence->GetFrequency ());
+    turbulence.SetPower (pTurbulence->GetPower ());
+    turbulence.SetRoughness (pTurbulence->GetRoughnessCount ());
+    turbulence.SetSeed (pTurbulence->GetSeed ());
+    return turbulence;
+  }
+
+  if (dynamic_cast<const Blend*> (&sourceModule) != NULL) {
+    if (!SimplifySources (sourceModule, 3, region, arena, pSources)) {
+      return sourceModule;
+    }
+    Blend& blend = arena.Create<Blend> ();
+    blend.SetSourceModule (0, *pSources[0]);
+    blend.SetSourceModule (1, *pSources[1]);
+    blend.SetControlModule (*pSources[2]);
+    return blend;
+  }
+
+  // Parameterless modules only need their sources replaced.
+  Module* pCopy = NULL;
+  int sourceCount = 0;
+  if (dynamic_cast<const Add*> (&sourceModule) != NULL) {
+    if (SimplifySources (sourceModule, 2, region, arena, pSources)) {
+      pCopy = &arena.Create<Add> ();
+      sourceCount = 2;
+    }
+  } else if (dynamic_cast<const Multiply*> (&sourceModule) != NULL) {
+    if (SimplifySources (sourceModule, 2, region, arena, pSources)) {
+      pCopy = &arena.Create<Multiply> ();
+      sourceCount = 2;
+    }
+  } else if (dynamic_cast<const Max*> (&sourceModule) != NULL) {
+    if (SimplifySources (sourceModule, 2, region, arena, pSources)) {
+      pCopy = &arena.Create<Max> ();
+      sourceCount = 2;
+    }
+  } else if (dynamic_cast<const Min*> (&sourceModule) != NULL) {
+    if (SimplifySources (sourceModule, 2, region, arena, pSources)) {
+      pCopy = &arena.Create<Min> ();
+      sourceCount = 2;
+    }
+  } else if (dynamic_cast<const Abs*> (&sourceModule) != NULL) {
+    if (SimplifySources (sourceModule, 1, region, arena, pSources)) {
+      pCopy = &arena.Create<Abs> ();
+      sourceCount = 1;
+    }
+  } else if (dynamic_cast<const Invert*> (&sourceModule) != NULL) {
+    if (SimplifySources (sourceModule, 1, region, arena, pSources)) {
+      pCopy = &arena.Create<Invert> ();
+      sourceCount = 1;
+    }
+  }
+
+  if (pCopy != NULL) {
+    for (int i = 0; i < sourceCount; i++) {
+      pCopy->SetSourceModule (i, *pSources[i]);
+    }
+    return *pCopy;
+  }
+
+  // Generators, and modules this file doesn't know, are used as they are.
+  return sourceModule;
+}
@@ -0,0 +1,105 @@
+// bounds.h
+//
+// Conservative output bounds of noise modules over a region, and tile-wise
+// simplification of module graphs based on them.
+//
+// libnoise modules have no notion of bounds, so GetBounds() recognizes the
+// module classes used by this project (and their fused/LOD replacements)
+// by type.  Any other module is treated as unbounded, which is always
+// correct but never lets a Select be resolved.
+//
+
+#ifndef NOISE_MODULE_BOUNDS_H
+#define NOISE_MODULE_BOUNDS_H
+
+#include <vector>
+
+#include <noise/noise.h>
+
+namespace noise
+{
+
+  namespace module
+  {
+
+    /// @addtogroup libnoise
+    /// @{
+
+    /// A closed range of output values.
+    struct Interval
+    {
+      double lower;
+      double upper;
+    };
+
+    /// An axis-aligned box of input values.  A flat box (e.g. lowerY ==
+    /// upperY for a plane) is allowed.
+    struct Region
+    {
+      double lowerX, upperX;
+      double lowerY, upperY;
+      double lowerZ, upperZ;
+    };
+
+    /// Returns an interval that contains every value @a sourceModule can
+    /// output for input values inside @a region.
+    ///
+    /// Gradient noise is bounded per lattice cell using the linear corner
+    /// functions that the noise interpolates between, so the bounds get
+    /// tighter as the region gets smaller.  Fractal modules honour the
+    /// calling thread's sample spacing (see SampleSpacingScope) the same way
+    /// their GetValue() does.
+    Interval GetBounds (const Module& sourceModule, const Region& region);
+
+    /// Owns the modules created by Simplify().
+    ///
+    /// Simplified graphs point into the arena, so it must outlive every use
+    /// of the module Simplify() returned.
+    class ModuleArena
+    {
+
+      public:
+
+        /// Constructor.
+        ModuleArena ();
+
+        /// Destructor.  Destroys every module created in the arena.
+        ~ModuleArena ();
+
+        /// Creates a default-constructed module owned by the arena.
+        template <class T> T& Create ()
+        {
+          T* pModule = new T;
+          m_modules.push_back (pModule);
+          return *pModule;
+        }
+
+      private:
+
+        ModuleArena (const ModuleArena&);
+        ModuleArena& operator= (const ModuleArena&);
+
+        /// Modules owned by the arena.
+        std::vector<Module*> m_modules;
+
+    };
+
+    /// Returns a module that outputs the same values as @a sourceModule
+    /// everywhere inside @a region, with every Select whose control value
+    /// provably stays on one side of its bounds replaced by the source
+    /// module it selects.
+    ///
+    /// Modules above a resolved Select are re-created in @a arena with the
+    /// same parameters; the original graph is never modified, so several
+    /// threads can simplify it for different regions at once.  If nothing
+    /// can be resolved, @a sourceModule itself is returned.
+    const Module& Simplify (const Module& sourceModule, const Region& region,
+      ModuleArena& arena);
+
+    // @}
+
+  }
+
+}
+
+#endif
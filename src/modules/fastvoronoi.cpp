@@ -0,0 +1,229 @@
+// fastvoronoi.cpp
+//
+
+#include "fastvoronoi.h"
+#include "latticenoise.h"
+
+#include <noise/mathconsts.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+using namespace noise::module;
+
+namespace
+{
+
+  // Seed points are cached in a toroidal block of cells: a cell maps to the
+  // slot given by the low bits of its coordinates, so the block slides with
+  // the samples and the 5x5x5 neighbourhood of a sample never collides with
+  // itself.
+  const int CACHE_BITS = 3;
+  const int CACHE_MASK = (1 << CACHE_BITS) - 1;
+  const int CACHE_CELLS = 1 << (CACHE_BITS * 3);
+
+  // Number of modules whose seed points a thread keeps at the same time.
+  const int CACHE_BLOCKS = 4;
+
+  // Offsets of the cells sharing a face with the cell of the input value.
+  const int FACE_NEIGHBOUR[6][3] = {
+    { 1, 0, 0 }, { -1, 0, 0 },
+    { 0, 1, 0 }, { 0, -1, 0 },
+    { 0, 0, 1 }, { 0, 0, -1 }
+  };
+
+  struct FeatureBlock
+  {
+    unsigned long long owner; // Cache key of the module, 0 when unused
+    bool filled[CACHE_CELLS];
+    int cell[CACHE_CELLS][3];
+    double point[CACHE_CELLS][3];
+  };
+
+  struct FeatureCache
+  {
+    FeatureBlock block[CACHE_BLOCKS];
+    int nextVictim;
+  };
+
+  thread_local FeatureCache t_featureCache;
+
+  std::atomic<unsigned long long> g_nextCacheKey (1);
+
+  // Returns the calling thread's block for the given module, evicting the
+  // oldest block if the module has none yet.
+  FeatureBlock& GetFeatureBlock (unsigned long long owner)
+  {
+    FeatureCache& cache = t_featureCache;
+    for (int i = 0; i < CACHE_BLOCKS; i++) {
+      if (cache.block[i].owner == owner) {
+        return cache.block[i];
+      }
+    }
+
+    FeatureBlock& victim = cache.block[cache.nextVictim];
+    cache.nextVictim = (cache.nextVictim + 1) % CACHE_BLOCKS;
+    victim.owner = owner;
+    memset (victim.filled, 0, sizeof (victim.filled));
+    return victim;
+  }
+
+  // Returns the seed point of a cell, computing it the same way as
+  // noise::module::Voronoi if it is not cached.
+  const double* GetFeaturePoint (FeatureBlock& block, int xCur, int yCur,
+    int zCur, int seed)
+  {
+    int index = (xCur & CACHE_MASK)
+      | ((yCur & CACHE_MASK) << CACHE_BITS)
+      | ((zCur & CACHE_MASK) << (CACHE_BITS * 2));
+
+    int* cell = block.cell[index];
+    double* point = block.point[index];
+    if (!block.filled[index]
+      || cell[0] != xCur || cell[1] != yCur || cell[2] != zCur) {
+      point[0] = xCur + noise::lattice::ValueNoise3D (xCur, yCur, zCur, seed    );
+      point[1] = yCur + noise::lattice::ValueNoise3D (xCur, yCur, zCur, seed + 1);
+      point[2] = zCur + noise::lattice::ValueNoise3D (xCur, yCur, zCur, seed + 2);
+      cell[0] = xCur;
+      cell[1] = yCur;
+      cell[2] = zCur;
+      block.filled[index] = true;
+    }
+    return point;
+  }
+
+  // Lower bound on the squared distance, along one axis, from a to the seed
+  // point of the cell at cur.  ValueNoise3D() returns values in (-1, 1], so
+  // the seed point lies in [cur - 1, cur + 1].  The bound never exceeds the
+  // distance term Voronoi computes, rounding included, because every step
+  // is a monotonic operation on a value that is at least as close to a.
+  double AxisBound (double a, int cur)
+  {
+    double low = (double)cur - 1.0;
+    double high = (double)cur + 1.0;
+    double d = 0.0;
+    if (a < low) {
+      d = low - a;
+    } else if (a > high) {
+      d = a - high;
+    }
+    return d * d;
+  }
+
+  double SquaredDistance (const double* point, double x, double y, double z)
+  {
+    double xDist = point[0] - x;
+    double yDist = point[1] - y;
+    double zDist = point[2] - z;
+    return xDist * xDist + yDist * yDist + zDist * zDist;
+  }
+
+}
+
+FastVoronoi::FastVoronoi ():
+  Module (GetSourceModuleCount ()),
+  m_displacement   (DEFAULT_VORONOI_DISPLACEMENT),
+  m_enableDistance (false),
+  m_frequency      (DEFAULT_VORONOI_FREQUENCY),
+  m_seed           (DEFAULT_VORONOI_SEED),
+  m_cacheKey       (g_nextCacheKey++)
+{
+}
+
+void FastVoronoi::SetSeed (int seed)
+{
+  if (seed != m_seed) {
+    m_seed = seed;
+    m_cacheKey = g_nextCacheKey++;
+  }
+}
+
+double FastVoronoi::GetValue (double x, double y, double z) const
+{
+  x *= m_frequency;
+  y *= m_frequency;
+  z *= m_frequency;
+
+  int xInt = lattice::LatticeFloor (x);
+  int yInt = lattice::LatticeFloor (y);
+  int zInt = lattice::LatticeFloor (z);
+
+  FeatureBlock& block = GetFeatureBlock (m_cacheKey);
+
+  double xBound[5], yBound[5], zBound[5];
+  for (int i = 0; i < 5; i++) {
+    xBound[i] = AxisBound (x, xInt - 2 + i);
+    yBound[i] = AxisBound (y, yInt - 2 + i);
+    zBound[i] = AxisBound (z, zInt - 2 + i);
+  }
+
+  // The cell containing the input value and its six face neighbours are
+  // part of the search, so the nearest of their seed points is an upper
+  // bound on the result.  The bound only limits which cells are tested; the
+  // candidate is still chosen in Voronoi's order.
+  double limit = SquaredDistance (
+    GetFeaturePoint (block, xInt, yInt, zInt, m_seed), x, y, z);
+  for (int n = 0; n < 6; n++) {
+    const double* point = GetFeaturePoint (block,
+      xInt + FACE_NEIGHBOUR[n][0], yInt + FACE_NEIGHBOUR[n][1],
+      zInt + FACE_NEIGHBOUR[n][2], m_seed);
+    double dist = SquaredDistance (point, x, y, z);
+    if (dist < limit) {
+      limit = dist;
+    }
+  }
+
+  double minDist = 2147483647.0;
+  double xCandidate = 0;
+  double yCandidate = 0;
+  double zCandidate = 0;
+
+  for (int k = 0; k < 5; k++) {
+    if (zBound[k] > limit) {
+      continue;
+    }
+    for (int j = 0; j < 5; j++) {
+      if (yBound[j] + zBound[k] > limit) {
+        continue;
+      }
+      for (int i = 0; i < 5; i++) {
+        if (xBound[i] + yBound[j] + zBound[k] > limit) {
+          continue;
+        }
+
+        const double* point = GetFeaturePoint (block, xInt - 2 + i,
+          yInt - 2 + j, zInt - 2 + k, m_seed);
+        double dist = SquaredDistance (point, x, y, z);
+
+        if (dist < minDist) {
+          minDist = dist;
+          xCandidate = point[0];
+          yCandidate = point[1];
+          zCandidate = point[2];
+          if (minDist < limit) {
+            limit = minDist;
+          }
+        }
+      }
+    }
+  }
+
+  double value;
+  if (m_enableDistance) {
+    // Determine the distance to the nearest seed point.
+    double xDist = xCandidate - x;
+    double yDist = yCandidate - y;
+    double zDist = zCandidate - z;
+    value = (sqrt (xDist * xDist + yDist * yDist + zDist * zDist)
+      ) * SQRT_3 - 1.0;
+  } else {
+    value = 0.0;
+  }
+
+  // Return the calculated distance with the displacement value applied.
+  return value + (m_displacement * (double)(lattice::ValueNoise3D (
+    (int)(floor (xCandidate)),
+    (int)(floor (yCandidate)),
+    (int)(floor (zCandidate)), 0)));
+}
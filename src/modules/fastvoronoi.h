@@ -0,0 +1,142 @@
+// fastvoronoi.h
+//
+
+#ifndef NOISE_MODULE_FASTVORONOI_H
+#define NOISE_MODULE_FASTVORONOI_H
+
+#include <noise/noise.h>
+
+namespace noise
+{
+
+  namespace module
+  {
+
+    /// @addtogroup libnoise
+    /// @{
+
+    /// @addtogroup modules
+    /// @{
+
+    /// @addtogroup generatormodules
+    /// @{
+
+    /// Drop-in replacement for noise::module::Voronoi that returns identical
+    /// values with far fewer seed point evaluations.
+    ///
+    /// noise::module::Voronoi hashes the seed point of all 125 cells around
+    /// the input value for every sample.  This module makes two changes:
+    ///
+    /// - Seed points are cached per thread in a small block of cells that
+    ///   slides along with the samples, so neighbouring samples of a tile
+    ///   reuse each other's seed points instead of hashing them again.
+    /// - A seed point always lies within one unit of its cell's corner, so
+    ///   each cell has a lower bound on its distance to the input value.
+    ///   Cells whose bound exceeds the nearest distance found so far are
+    ///   skipped without touching their seed point.
+    ///
+    /// Cells are still visited in Voronoi's order with the same strict
+    /// comparison, so ties resolve to the same seed point and the output
+    /// matches noise::module::Voronoi exactly.
+    ///
+    /// This noise module requires no source modules.
+    class FastVoronoi: public Module
+    {
+
+      public:
+
+        /// Constructor.
+        ///
+        /// The default displacement, frequency and seed are the same as
+        /// those of noise::module::Voronoi.
+        FastVoronoi ();
+
+        /// Enables or disables applying the distance from the nearest seed
+        /// point to the output value.
+        void EnableDistance (bool enable = true)
+        {
+          m_enableDistance = enable;
+        }
+
+        /// Returns the displacement value of the Voronoi cells.
+        double GetDisplacement () const
+        {
+          return m_displacement;
+        }
+
+        /// Returns the frequency of the seed points.
+        double GetFrequency () const
+        {
+          return m_frequency;
+        }
+
+        virtual int GetSourceModuleCount () const
+        {
+          return 0;
+        }
+
+        /// Returns the seed value used by the Voronoi cells.
+        int GetSeed () const
+        {
+          return m_seed;
+        }
+
+        /// Determines if the distance from the nearest seed point is applied
+        /// to the output value.
+        bool IsDistanceEnabled () const
+        {
+          return m_enableDistance;
+        }
+
+        virtual double GetValue (double x, double y, double z) const;
+
+        /// Sets the displacement value of the Voronoi cells.
+        void SetDisplacement (double displacement)
+        {
+          m_displacement = displacement;
+        }
+
+        /// Sets the frequency of the seed points.
+        void SetFrequency (double frequency)
+        {
+          m_frequency = frequency;
+        }
+
+        /// Sets the seed value used by the Voronoi cells.
+        ///
+        /// Changing the seed invalidates the cached seed points.
+        void SetSeed (int seed);
+
+      protected:
+
+        /// Scale of the random displacement to apply to each Voronoi cell.
+        double m_displacement;
+
+        /// Determines if the distance from the nearest seed point is applied
+        /// to the output value.
+        bool m_enableDistance;
+
+        /// Frequency of the seed points.
+        double m_frequency;
+
+        /// Seed value used by the coherent-noise function to determine the
+        /// positions of the seed points.
+        int m_seed;
+
+        /// Identifies this module's seed points in the per-thread cache.  A
+        /// new key is taken whenever the seed points change.
+        unsigned long long m_cacheKey;
+
+    };
+
+    /// @}
+
+    /// @}
+
+    /// @}
+
+  }
+
+}
+
+#endif
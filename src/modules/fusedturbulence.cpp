@@ -0,0 +1,118 @@
+// fusedturbulence.cpp
+//
+
+#include "fusedturbulence.h"
+#include "latticenoise.h"
+
+using namespace noise::module;
+
+namespace
+{
+
+  // Number of displacement channels (x, y and z) evaluated together.
+  const int CHANNEL_COUNT = 3;
+
+  const double (&CHANNEL_OFFSET)[CHANNEL_COUNT][3] = TURBULENCE_OFFSET;
+
+}
+
+FusedTurbulence::FusedTurbulence ():
+  Module (GetSourceModuleCount ()),
+  m_frequency   (DEFAULT_TURBULENCE_FREQUENCY),
+  m_octaveCount (DEFAULT_TURBULENCE_ROUGHNESS),
+  m_power       (DEFAULT_TURBULENCE_POWER),
+  m_seed        (DEFAULT_TURBULENCE_SEED)
+{
+}
+
+void FusedTurbulence::GetDisplacedPosition (double x, double y, double z,
+  double& xDistort, double& yDistort, double& zDistort) const
+{
+  // The internal Perlin modules of Turbulence always use the default
+  // lacunarity, persistence and quality.
+  const double lacunarity = DEFAULT_PERLIN_LACUNARITY;
+  const double persistence = DEFAULT_PERLIN_PERSISTENCE;
+
+  double px[CHANNEL_COUNT], py[CHANNEL_COUNT], pz[CHANNEL_COUNT];
+  double value[CHANNEL_COUNT];
+  for (int c = 0; c < CHANNEL_COUNT; c++) {
+    px[c] = (x + CHANNEL_OFFSET[c][0]) * m_frequency;
+    py[c] = (y + CHANNEL_OFFSET[c][1]) * m_frequency;
+    pz[c] = (z + CHANNEL_OFFSET[c][2]) * m_frequency;
+    value[c] = 0.0;
+  }
+
+  double curPersistence = 1.0;
+  for (int curOctave = 0; curOctave < m_octaveCount; curOctave++) {
+    double nx[CHANNEL_COUNT], ny[CHANNEL_COUNT], nz[CHANNEL_COUNT];
+    double xs[CHANNEL_COUNT], ys[CHANNEL_COUNT], zs[CHANNEL_COUNT];
+    int x0[CHANNEL_COUNT], y0[CHANNEL_COUNT], z0[CHANNEL_COUNT];
+    unsigned int hash[CHANNEL_COUNT];
+
+    // Lattice cell, fade curves and base corner hash of every channel.
+    for (int c = 0; c < CHANNEL_COUNT; c++) {
+      nx[c] = MakeInt32Range (px[c]);
+      ny[c] = MakeInt32Range (py[c]);
+      nz[c] = MakeInt32Range (pz[c]);
+      x0[c] = lattice::LatticeFloor (nx[c]);
+      y0[c] = lattice::LatticeFloor (ny[c]);
+      z0[c] = lattice::LatticeFloor (nz[c]);
+      xs[c] = SCurve3 (nx[c] - (double)x0[c]);
+      ys[c] = SCurve3 (ny[c] - (double)y0[c]);
+      zs[c] = SCurve3 (nz[c] - (double)z0[c]);
+      hash[c] = lattice::LatticeHash (x0[c], y0[c], z0[c],
+        (m_seed + c + curOctave) & 0xffffffff);
+    }
+
+    // Gradient noise at the eight cell corners, corner-major so each
+    // inner loop does the same work for all channels.
+    double n[8][CHANNEL_COUNT];
+    for (int corner = 0; corner < 8; corner++) {
+      int dx = corner & 1;
+      int dy = (corner >> 1) & 1;
+      int dz = corner >> 2;
+      unsigned int step = dx * lattice::X_NOISE_GEN
+        + dy * lattice::Y_NOISE_GEN + dz * lattice::Z_NOISE_GEN;
+      for (int c = 0; c < CHANNEL_COUNT; c++) {
+        n[corner][c] = lattice::GradientNoise3D (nx[c], ny[c], nz[c],
+          x0[c] + dx, y0[c] + dy, z0[c] + dz, hash[c] + step);
+      }
+    }
+
+    // Same interpolation order as noise::GradientCoherentNoise3D().
+    for (int c = 0; c < CHANNEL_COUNT; c++) {
+      double ix0, ix1, iy0, iy1;
+      ix0 = LinearInterp (n[0][c], n[1][c], xs[c]);
+      ix1 = LinearInterp (n[2][c], n[3][c], xs[c]);
+      iy0 = LinearInterp (ix0, ix1, ys[c]);
+      ix0 = LinearInterp (n[4][c], n[5][c], xs[c]);
+      ix1 = LinearInterp (n[6][c], n[7][c], xs[c]);
+      iy1 = LinearInterp (ix0, ix1, ys[c]);
+      double signal = LinearInterp (iy0, iy1, zs[c]);
+
+      value[c] += signal * curPersistence;
+
+      px[c] *= lacunarity;
+      py[c] *= lacunarity;
+      pz[c] *= lacunarity;
+    }
+
+    curPersistence *= persistence;
+  }
+
+  xDistort = x + (value[0] * m_power);
+  yDistort = y + (value[1] * m_power);
+  zDistort = z + (value[2] * m_power);
+}
+
+double FusedTurbulence::GetValue (double x, double y, double z) const
+{
+  assert (m_pSourceModule[0] != NULL);
+
+  double xDistort, yDistort, zDistort;
+  GetDisplacedPosition (x, y, z, xDistort, yDistort, zDistort);
+
+  // Retrieve the output value at the offsetted input value instead of the
+  // original input value.
+  return m_pSourceModule[0]->GetValue (xDistort, yDistort, zDistort);
+}
@@ -0,0 +1,166 @@
+// fusedturbulence.h
+//
+
+#ifndef NOISE_MODULE_FUSEDTURBULENCE_H
+#define NOISE_MODULE_FUSEDTURBULENCE_H
+
+#include <noise/noise.h>
+
+namespace noise
+{
+
+  namespace module
+  {
+
+    /// @addtogroup libnoise
+    /// @{
+
+    /// @addtogroup modules
+    /// @{
+
+    /// @addtogroup transformermodules
+    /// @{
+
+    /// Offsets that noise::module::Turbulence adds to the input value
+    /// before sampling its x, y and z displacement noise.
+    const double TURBULENCE_OFFSET[3][3] = {
+      { 12414.0 / 65536.0, 65124.0 / 65536.0, 31337.0 / 65536.0 },
+      { 26519.0 / 65536.0, 18128.0 / 65536.0, 60493.0 / 65536.0 },
+      { 53820.0 / 65536.0, 11213.0 / 65536.0, 44845.0 / 65536.0 }
+    };
+
+    /// Drop-in replacement for noise::module::Turbulence that evaluates the
+    /// three displacement noises together.
+    ///
+    /// noise::module::Turbulence owns three independent Perlin modules and
+    /// calls each of them, octave by octave, for every sample.  This module
+    /// produces identical output but runs the three noises through a single
+    /// octave loop.  The frequency scaling, lattice flooring, fade curves
+    /// and corner hashing of the three channels are laid out side by side so
+    /// the compiler can vectorize them, and each channel hashes one cell
+    /// corner and reaches the other seven by addition.
+    ///
+    /// The three channels sample the displacement noise at different offset
+    /// positions (this is what decorrelates them), so they generally fall in
+    /// different lattice cells; the shared work is the loop structure and
+    /// arithmetic, not the cells themselves.
+    ///
+    /// The frequency, power, roughness and seed behave exactly as in
+    /// noise::module::Turbulence, including the seed + 1 / seed + 2 used
+    /// for the y and z channels.
+    ///
+    /// This noise module requires one source module.
+    class FusedTurbulence: public Module
+    {
+
+      public:
+
+        /// Constructor.
+        ///
+        /// The default frequency, power, roughness and seed are the same as
+        /// those of noise::module::Turbulence.
+        FusedTurbulence ();
+
+        /// Returns the frequency of the displacement noise.
+        double GetFrequency () const
+        {
+          return m_frequency;
+        }
+
+        /// Returns the power of the turbulence.
+        double GetPower () const
+        {
+          return m_power;
+        }
+
+        /// Returns the roughness of the turbulence, the number of octaves
+        /// of the displacement noise.
+        int GetRoughnessCount () const
+        {
+          return m_octaveCount;
+        }
+
+        /// Returns the seed of the x displacement noise.  The y and z
+        /// channels use @a seed + 1 and @a seed + 2.
+        int GetSeed () const
+        {
+          return m_seed;
+        }
+
+        virtual int GetSourceModuleCount () const
+        {
+          return 1;
+        }
+
+        virtual double GetValue (double x, double y, double z) const;
+
+        /// Calculates the displaced input position without evaluating the
+        /// source module.
+        ///
+        /// @param x The @a x coordinate of the input value.
+        /// @param y The @a y coordinate of the input value.
+        /// @param z The @a z coordinate of the input value.
+        /// @param xDistort Receives the displaced @a x coordinate.
+        /// @param yDistort Receives the displaced @a y coordinate.
+        /// @param zDistort Receives the displaced @a z coordinate.
+        void GetDisplacedPosition (double x, double y, double z,
+          double& xDistort, double& yDistort, double& zDistort) const;
+
+        /// Sets the frequency of the displacement noise.
+        void SetFrequency (double frequency)
+        {
+          m_frequency = frequency;
+        }
+
+        /// Sets the power of the turbulence.
+        void SetPower (double power)
+        {
+          m_power = power;
+        }
+
+        /// Sets the roughness of the turbulence.
+        ///
+        /// @pre The roughness is between 1 and noise::module::PERLIN_MAX_OCTAVE.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        void SetRoughness (int roughness)
+        {
+          if (roughness < 1 || roughness > PERLIN_MAX_OCTAVE) {
+            throw noise::ExceptionInvalidParam ();
+          }
+          m_octaveCount = roughness;
+        }
+
+        /// Sets the seed of the x displacement noise.
+        void SetSeed (int seed)
+        {
+          m_seed = seed;
+        }
+
+      protected:
+
+        /// Frequency of the displacement noise.
+        double m_frequency;
+
+        /// Number of octaves of the displacement noise.
+        int m_octaveCount;
+
+        /// The power (scale) of the displacement.
+        double m_power;
+
+        /// Seed of the x displacement noise.
+        int m_seed;
+
+    };
+
+    /// @}
+
+    /// @}
+
+    /// @}
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,484 @@
+// gradient.cpp
+//
+// The fractal loops below follow libnoise's perlin.cpp, billow.cpp and
+// ridgedmulti.cpp (and lodfractal.cpp for the LOD variants) operation for
+// operation, so the values they return are the same as GetValue().  The
+// derivatives are carried along with respect to the module's input
+// coordinates.
+//
+
+#include "gradient.h"
+#include "latticenoise.h"
+#include "lodfractal.h"
+#include "fastvoronoi.h"
+#include "fusedturbulence.h"
+
+#include <noise/mathconsts.h>
+
+#include <cmath>
+
+using namespace noise::module;
+
+namespace
+{
+
+  enum FractalType
+  {
+    FRACTAL_PERLIN,
+    FRACTAL_BILLOW,
+    FRACTAL_RIDGED
+  };
+
+  ValueGradient MakeValueGradient (double value, double dx, double dy,
+    double dz)
+  {
+    ValueGradient result;
+    result.value = value;
+    result.dx = dx;
+    result.dy = dy;
+    result.dz = dz;
+    return result;
+  }
+
+  // a * aScale + b * bScale, applied to the value and gradient alike.
+  ValueGradient Combine (const ValueGradient& a, double aScale,
+    const ValueGradient& b, double bScale)
+  {
+    return MakeValueGradient (a.value * aScale + b.value * bScale,
+      a.dx * aScale + b.dx * bScale,
+      a.dy * aScale + b.dy * bScale,
+      a.dz * aScale + b.dz * bScale);
+  }
+
+  // LinearInterp (a, b, alpha) where alpha itself depends on the input.
+  ValueGradient Interp (const ValueGradient& a, const ValueGradient& b,
+    const ValueGradient& alpha)
+  {
+    double difference = b.value - a.value;
+    ValueGradient result = Combine (a, 1.0 - alpha.value, b, alpha.value);
+    result.value = noise::LinearInterp (a.value, b.value, alpha.value);
+    result.dx += alpha.dx * difference;
+    result.dy += alpha.dy * difference;
+    result.dz += alpha.dz * difference;
+    return result;
+  }
+
+  ValueGradient Negate (const ValueGradient& a)
+  {
+    return MakeValueGradient (-a.value, -a.dx, -a.dy, -a.dz);
+  }
+
+  ValueGradient FractalGradient (FractalType type, bool isLod,
+    double frequency, double lacunarity, double persistence, int octaveCount,
+    int baseSeed, noise::NoiseQuality noiseQuality, double x, double y,
+    double z)
+  {
+    double fade = 0.0;
+    if (isLod) {
+      octaveCount = GetLodOctaveCount (frequency, lacunarity, octaveCount,
+        fade);
+    }
+    int lastOctave = (fade > 0.0)? octaveCount: octaveCount - 1;
+
+    x *= frequency;
+    y *= frequency;
+    z *= frequency;
+
+    // Derivative of the octave's coordinates with respect to the input.
+    double scale = frequency;
+
+    double value = 0.0;
+    double dx = 0.0, dy = 0.0, dz = 0.0;
+    double curPersistence = 1.0;
+
+    // State of RidgedMulti: the weight from the previous octave and its
+    // gradient, and the frequency used to compute the spectral weights.
+    const double offset = 1.0;
+    const double gain = 2.0;
+    double weight = 1.0;
+    double wdx = 0.0, wdy = 0.0, wdz = 0.0;
+    double spectralFrequency = 1.0;
+
+    for (int curOctave = 0; curOctave <= lastOctave; curOctave++) {
+      double nx = noise::MakeInt32Range (x);
+      double ny = noise::MakeInt32Range (y);
+      double nz = noise::MakeInt32Range (z);
+
+      int seed = (type == FRACTAL_RIDGED)
+        ? (baseSeed + curOctave) & 0x7fffffff
+        : (baseSeed + curOctave) & 0xffffffff;
+      double sdx, sdy, sdz;
+      double signal = noise::lattice::GradientCoherentNoise3D (nx, ny, nz,
+        seed, noiseQuality, sdx, sdy, sdz);
+      sdx *= scale;
+      sdy *= scale;
+      sdz *= scale;
+
+      double octaveWeight;
+      if (type == FRACTAL_RIDGED) {
+        double sign = (signal < 0.0)? 1.0: -1.0;
+        signal = fabs (signal);
+        signal = offset - signal;
+        sdx *= sign;
+        sdy *= sign;
+        sdz *= sign;
+
+        sdx *= 2.0 * signal;
+        sdy *= 2.0 * signal;
+        sdz *= 2.0 * signal;
+        signal *= signal;
+
+        sdx = sdx * weight + signal * wdx;
+        sdy = sdy * weight + signal * wdy;
+        sdz = sdz * weight + signal * wdz;
+        signal *= weight;
+
+        weight = signal * gain;
+        wdx = sdx * gain;
+        wdy = sdy * gain;
+        wdz = sdz * gain;
+        if (weight > 1.0) {
+          weight = 1.0;
+          wdx = wdy = wdz = 0.0;
+        }
+        if (weight < 0.0) {
+          weight = 0.0;
+          wdx = wdy = wdz = 0.0;
+        }
+
+        octaveWeight = pow (spectralFrequency, -1.0);
+        spectralFrequency *= lacunarity;
+      } else {
+        if (type == FRACTAL_BILLOW) {
+          double sign = (signal < 0.0)? -2.0: 2.0;
+          signal = 2.0 * fabs (signal) - 1.0;
+          sdx *= sign;
+          sdy *= sign;
+          sdz *= sign;
+        }
+        octaveWeight = curPersistence;
+        curPersistence *= persistence;
+      }
+
+      if (curOctave == octaveCount) {
+        signal *= fade;
+        sdx *= fade;
+        sdy *= fade;
+        sdz *= fade;
+      }
+      value += signal * octaveWeight;
+      dx += sdx * octaveWeight;
+      dy += sdy * octaveWeight;
+      dz += sdz * octaveWeight;
+
+      x *= lacunarity;
+      y *= lacunarity;
+      z *= lacunarity;
+      scale *= lacunarity;
+    }
+
+    if (type == FRACTAL_BILLOW) {
+      value += 0.5;
+    } else if (type == FRACTAL_RIDGED) {
+      return MakeValueGradient ((value * 1.25) - 1.0, dx * 1.25, dy * 1.25,
+        dz * 1.25);
+    }
+    return MakeValueGradient (value, dx, dy, dz);
+  }
+
+  // Gradient of the distance term of Voronoi noise.  The nearest seed point
+  // is found with the same search as libnoise's voronoi.cpp; FastVoronoi
+  // picks the same point.
+  void VoronoiGradient (double frequency, int seed, double x, double y,
+    double z, double& dx, double& dy, double& dz)
+  {
+    x *= frequency;
+    y *= frequency;
+    z *= frequency;
+
+    int xInt = noise::lattice::LatticeFloor (x);
+    int yInt = noise::lattice::LatticeFloor (y);
+    int zInt = noise::lattice::LatticeFloor (z);
+
+    double minDist = 2147483647.0;
+    double xCandidate = 0, yCandidate = 0, zCandidate = 0;
+    for (int zCur = zInt - 2; zCur <= zInt + 2; zCur++) {
+      for (int yCur = yInt - 2; yCur <= yInt + 2; yCur++) {
+        for (int xCur = xInt - 2; xCur <= xInt + 2; xCur++) {
+          double xPos = xCur + noise::lattice::ValueNoise3D (xCur, yCur, zCur,
+            seed);
+          double yPos = yCur + noise::lattice::ValueNoise3D (xCur, yCur, zCur,
+            seed + 1);
+          double zPos = zCur + noise::lattice::ValueNoise3D (xCur, yCur, zCur,
+            seed + 2);
+          double xDist = xPos - x;
+          double yDist = yPos - y;
+          double zDist = zPos - z;
+          double dist = xDist * xDist + yDist * yDist + zDist * zDist;
+          if (dist < minDist) {
+            minDist = dist;
+            xCandidate = xPos;
+            yCandidate = yPos;
+            zCandidate = zPos;
+          }
+        }
+      }
+    }
+
+    double distance = sqrt (minDist);
+    if (distance <= 0.0) {
+      dx = dy = dz = 0.0;
+      return;
+    }
+    double scale = noise::SQRT_3 * frequency / distance;
+    dx = (x - xCandidate) * scale;
+    dy = (y - yCandidate) * scale;
+    dz = (z - zCandidate) * scale;
+  }
+
+  // The libnoise Turbulence displaces the input by three Perlin modules with
+  // the default lacunarity and persistence; FusedTurbulence matches it.
+  ValueGradient TurbulenceGradient (const Module& sourceModule,
+    double frequency, double power, int roughness, int seed, double x,
+    double y, double z)
+  {
+    const double input[3] = { x, y, z };
+    double displaced[3];
+    ValueGradient channel[3];
+    for (int c = 0; c < 3; c++) {
+      channel[c] = FractalGradient (FRACTAL_PERLIN, false, frequency,
+        noise::module::DEFAULT_PERLIN_LACUNARITY,
+        noise::module::DEFAULT_PERLIN_PERSISTENCE, roughness, seed + c,
+        noise::QUALITY_STD, x + TURBULENCE_OFFSET[c][0],
+        y + TURBULENCE_OFFSET[c][1], z + TURBULENCE_OFFSET[c][2]);
+      displaced[c] = input[c] + (channel[c].value * power);
+    }
+
+    ValueGradient source = GetValueGradient (sourceModule, displaced[0],
+      displaced[1], displaced[2]);
+
+    // Chain rule: the gradient is J^T * source gradient, where
+    // J = I + power * (gradients of the displacement channels).
+    const double g[3] = { source.dx, source.dy, source.dz };
+    ValueGradient result = source;
+    for (int c = 0; c < 3; c++) {
+      result.dx += g[c] * power * channel[c].dx;
+      result.dy += g[c] * power * channel[c].dy;
+      result.dz += g[c] * power * channel[c].dz;
+    }
+    return result;
+  }
+
+  ValueGradient SelectGradient (const Select& select, double x, double y,
+    double z)
+  {
+    const Module& source0 = select.GetSourceModule (0);
+    const Module& source1 = select.GetSourceModule (1);
+    ValueGradient control = GetValueGradient (select.GetControlModule (), x,
+      y, z);
+    double controlValue = control.value;
+    double lowerBound = select.GetLowerBound ();
+    double upperBound = select.GetUpperBound ();
+    double edgeFalloff = select.GetEdgeFalloff ();
+
+    if (edgeFalloff <= 0.0) {
+      if (controlValue < lowerBound || controlValue > upperBound) {
+        return GetValueGradient (source0, x, y, z);
+      }
+      return GetValueGradient (source1, x, y, z);
+    }
+
+    bool inLowerBand;
+    if (controlValue < (lowerBound - edgeFalloff)) {
+      return GetValueGradient (source0, x, y, z);
+    } else if (controlValue < (lowerBound + edgeFalloff)) {
+      inLowerBand = true;
+    } else if (controlValue < (upperBound - edgeFalloff)) {
+      return GetValueGradient (source1, x, y, z);
+    } else if (controlValue < (upperBound + edgeFalloff)) {
+      inLowerBand = false;
+    } else {
+      return GetValueGradient (source0, x, y, z);
+    }
+
+    // Smooth transition between the two sources.
+    double bound = inLowerBand? lowerBound: upperBound;
+    double lowerCurve = (bound - edgeFalloff);
+    double upperCurve = (bound + edgeFalloff);
+    double a = (controlValue - lowerCurve) / (upperCurve - lowerCurve);
+    double alphaScale = noise::lattice::FadeCurveDerivative (a,
+      noise::QUALITY_STD) / (upperCurve - lowerCurve);
+    ValueGradient alpha = MakeValueGradient (noise::SCurve3 (a),
+      control.dx * alphaScale, control.dy * alphaScale,
+      control.dz * alphaScale);
+
+    ValueGradient v0 = GetValueGradient (source0, x, y, z);
+    ValueGradient v1 = GetValueGradient (source1, x, y, z);
+    return inLowerBand? Interp (v0, v1, alpha): Interp (v1, v0, alpha);
+  }
+
+  ValueGradient NumericalGradient (const Module& sourceModule, double x,
+    double y, double z)
+  {
+    const double h = GRADIENT_FALLBACK_STEP;
+    double scale = 0.5 / h;
+    return MakeValueGradient (sourceModule.GetValue (x, y, z),
+      (sourceModule.GetValue (x + h, y, z)
+        - sourceModule.GetValue (x - h, y, z)) * scale,
+      (sourceModule.GetValue (x, y + h, z)
+        - sourceModule.GetValue (x, y - h, z)) * scale,
+      (sourceModule.GetValue (x, y, z + h)
+        - sourceModule.GetValue (x, y, z - h)) * scale);
+  }
+
+}
+
+ValueGradient noise::module::GetValueGradient (const Module& sourceModule,
+  double x, double y, double z)
+{
+  if (const Const* pConst = dynamic_cast<const Const*> (&sourceModule)) {
+    return MakeValueGradient (pConst->GetConstValue (), 0.0, 0.0, 0.0);
+  }
+
+  if (const Perlin* pPerlin = dynamic_cast<const Perlin*> (&sourceModule)) {
+    return FractalGradient (FRACTAL_PERLIN,
+      dynamic_cast<const LodPerlin*> (pPerlin) != NULL,
+      pPerlin->GetFrequency (), pPerlin->GetLacunarity (),
+      pPerlin->GetPersistence (), pPerlin->GetOctaveCount (),
+      pPerlin->GetSeed (), pPerlin->GetNoiseQuality (), x, y, z);
+  }
+
+  if (const Billow* pBillow = dynamic_cast<const Billow*> (&sourceModule)) {
+    return FractalGradient (FRACTAL_BILLOW,
+      dynamic_cast<const LodBillow*> (pBillow) != NULL,
+      pBillow->GetFrequency (), pBillow->GetLacunarity (),
+      pBillow->GetPersistence (), pBillow->GetOctaveCount (),
+      pBillow->GetSeed (), pBillow->GetNoiseQuality (), x, y, z);
+  }
+
+  if (const RidgedMulti* pRidged
+    = dynamic_cast<const RidgedMulti*> (&sourceModule)) {
+    return FractalGradient (FRACTAL_RIDGED,
+      dynamic_cast<const LodRidgedMulti*> (pRidged) != NULL,
+      pRidged->GetFrequency (), pRidged->GetLacunarity (), 1.0,
+      pRidged->GetOctaveCount (), pRidged->GetSeed (),
+      pRidged->GetNoiseQuality (), x, y, z);
+  }
+
+  if (const Voronoi* pVoronoi
+    = dynamic_cast<const Voronoi*> (&sourceModule)) {
+    ValueGradient result = MakeValueGradient (pVoronoi->GetValue (x, y, z),
+      0.0, 0.0, 0.0);
+    if (pVoronoi->IsDistanceEnabled ()) {
+      VoronoiGradient (pVoronoi->GetFrequency (), pVoronoi->GetSeed (), x, y,
+        z, result.dx, result.dy, result.dz);
+    }
+    return result;
+  }
+
+  if (const FastVoronoi* pVoronoi
+    = dynamic_cast<const FastVoronoi*> (&sourceModule)) {
+    ValueGradient result = MakeValueGradient (pVoronoi->GetValue (x, y, z),
+      0.0, 0.0, 0.0);
+    if (pVoronoi->IsDistanceEnabled ()) {
+      VoronoiGradient (pVoronoi->GetFrequency (), pVoronoi->GetSeed (), x, y,
+        z, result.dx, result.dy, result.dz);
+    }
+    return result;
+  }
+
+  if (const ScaleBias* pScaleBias
+    = dynamic_cast<const ScaleBias*> (&sourceModule)) {
+    ValueGradient source = GetValueGradient (pScaleBias->GetSourceModule (0),
+      x, y, z);
+    double scale = pScaleBias->GetScale ();
+    return MakeValueGradient (source.value * scale + pScaleBias->GetBias (),
+      source.dx * scale, source.dy * scale, source.dz * scale);
+  }
+
+  if (const Select* pSelect = dynamic_cast<const Select*> (&sourceModule)) {
+    return SelectGradient (*pSelect, x, y, z);
+  }
+
+  if (const Blend* pBlend = dynamic_cast<const Blend*> (&sourceModule)) {
+    ValueGradient v0 = GetValueGradient (pBlend->GetSourceModule (0), x, y, z);
+    ValueGradient v1 = GetValueGradient (pBlend->GetSourceModule (1), x, y, z);
+    ValueGradient control = GetValueGradient (pBlend->GetControlModule (), x,
+      y, z);
+    ValueGradient alpha = MakeValueGradient ((control.value + 1.0) / 2.0,
+      control.dx * 0.5, control.dy * 0.5, control.dz * 0.5);
+    return Interp (v0, v1, alpha);
+  }
+
+  if (const Turbulence* pTurbulence
+    = dynamic_cast<const Turbulence*> (&sourceModule)) {
+    return TurbulenceGradient (pTurbulence->GetSourceModule (0),
+      pTurbulence->GetFrequency (), pTurbulence->GetPower (),
+      pTurbulence->GetRoughnessCount (), pTurbulence->GetSeed (), x, y, z);
+  }
+
+  if (const FusedTurbulence* pTurbulence
+    = dynamic_cast<const FusedTurbulence*> (&sourceModule)) {
+    return TurbulenceGradient (pTurbulence->GetSourceModule (0),
+      pTurbulence->GetFrequency (), pTurbulence->GetPower (),
+      pTurbulence->GetRoughnessCount (), pTurbulence->GetSeed (), x, y, z);
+  }
+
+  if (dynamic_cast<const Add*> (&sourceModule) != NULL) {
+    ValueGradient v0 = GetValueGradient (sourceModule.GetSourceModule (0), x,
+      y, z);
+    ValueGradient v1 = GetValueGradient (sourceModule.GetSourceModule (1), x,
+      y, z);
+    return Combine (v0, 1.0, v1, 1.0);
+  }
+
+  if (dynamic_cast<const Multiply*> (&sourceModule) != NULL) {
+    ValueGradient v0 = GetValueGradient (sourceModule.GetSourceModule (0), x,
+      y, z);
+    ValueGradient v1 = GetValueGradient (sourceModule.GetSourceModule (1), x,
+      y, z);
+    ValueGradient result = Combine (v0, v1.value, v1, v0.value);
+    result.value = v0.value * v1.value;
+    return result;
+  }
+
+  if (dynamic_cast<const Max*> (&sourceModule) != NULL) {
+    ValueGradient v0 = GetValueGradient (sourceModule.GetSourceModule (0), x,
+      y, z);
+    ValueGradient v1 = GetValueGradient (sourceModule.GetSourceModule (1), x,
+      y, z);
+    return (v0.value > v1.value)? v0: v1;
+  }
+
+  if (dynamic_cast<const Min*> (&sourceModule) != NULL) {
+    ValueGradient v0 = GetValueGradient (sourceModule.GetSourceModule (0), x,
+      y, z);
+    ValueGradient v1 = GetValueGradient (sourceModule.GetSourceModule (1), x,
+      y, z);
+    return (v0.value < v1.value)? v0: v1;
+  }
+
+  if (dynamic_cast<const Abs*> (&sourceModule) != NULL) {
+    ValueGradient source = GetValueGradient (sourceModule.GetSourceModule (0),
+      x, y, z);
+    return (source.value < 0.0)? Negate (source): source;
+  }
+
+  if (dynamic_cast<const Invert*> (&sourceModule) != NULL) {
+    return Negate (GetValueGradient (sourceModule.GetSourceModule (0), x, y,
+      z));
+  }
+
+  if (const Clamp* pClamp = dynamic_cast<const Clamp*> (&sourceModule)) {
+    ValueGradient source = GetValueGradient (pClamp->GetSourceModule (0), x,
+      y, z);
+    if (source.value < pClamp->GetLowerBound ()) {
+      return MakeValueGradient (pClamp->GetLowerBound (), 0.0, 0.0, 0.0);
+    } else if (source.value > pClamp->GetUpperBound ()) {
+      return MakeValueGradient (pClamp->GetUpperBound (), 0.0, 0.0, 0.0);
+    }
+    return source;
+  }
+
+  return NumericalGradient (sourceModule, x, y, z);
+}
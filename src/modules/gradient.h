@@ -0,0 +1,58 @@
+// gradient.h
+//
+// Evaluation of noise modules together with their analytic gradient.
+//
+// libnoise modules only return values, so GetValueGradient() recognizes the
+// module classes used by this project by type, the same way GetBounds() in
+// bounds.h does.  Any other module falls back to central differences.
+//
+
+#ifndef NOISE_MODULE_GRADIENT_H
+#define NOISE_MODULE_GRADIENT_H
+
+#include <noise/noise.h>
+
+namespace noise
+{
+
+  namespace module
+  {
+
+    /// @addtogroup libnoise
+    /// @{
+
+    /// Step used for the central differences of modules without an
+    /// analytic gradient.
+    const double GRADIENT_FALLBACK_STEP = 1.0 / 4096.0;
+
+    /// The output value of a module and its partial derivatives.
+    struct ValueGradient
+    {
+      double value;
+      double dx;
+      double dy;
+      double dz;
+    };
+
+    /// Returns the output value of @a sourceModule at ( @a x, @a y, @a z )
+    /// together with its gradient there.
+    ///
+    /// The value is identical to sourceModule.GetValue (x, y, z).  The
+    /// gradient is exact for Const, Perlin, Billow, RidgedMulti (and their
+    /// LOD variants, at the calling thread's sample spacing), Voronoi,
+    /// FastVoronoi, ScaleBias, Add, Multiply, Max, Min, Abs, Invert, Clamp,
+    /// Select, Blend, Turbulence and FusedTurbulence.
+    /// Where a module is not differentiable (the crease of Billow and
+    /// RidgedMulti, Voronoi cell borders, lattice cell borders with
+    /// QUALITY_FAST) one of the one-sided derivatives is returned.  Any other module is differentiated numerically with a
+    /// step of GRADIENT_FALLBACK_STEP.
+    ValueGradient GetValueGradient (const Module& sourceModule, double x,
+      double y, double z);
+
+    // @}
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,21 @@
+// latticenoise.cpp
+//
+
+#include "latticenoise.h"
+
+// vectortable.h defines noise::g_randomVectors outright.  libnoise already
+// defines that symbol, so wrap our copy in a private namespace to keep the
+// two from colliding at link time when libnoise is linked statically.
+namespace noise
+{
+  namespace lattice
+  {
+    namespace table
+    {
+      #include <noise/vectortable.h>
+    }
+  }
+}
+
+const double* const noise::lattice::g_gradientTable
+  = noise::lattice::table::noise::g_randomVectors;
@@ -0,0 +1,237 @@
+// latticenoise.h
+//
+// Inline versions of the lattice-noise functions from libnoise's
+// noisegen.cpp.  They return exactly the same values as
+// noise::GradientCoherentNoise3D() and noise::ValueNoise3D(), but because
+// they are visible to the compiler the modules in this directory can fuse,
+// inline and vectorize them instead of calling into the library per sample.
+//
+
+#ifndef NOISE_LATTICENOISE_H
+#define NOISE_LATTICENOISE_H
+
+#include <noise/noise.h>
+#include <noise/interp.h>
+
+namespace noise
+{
+
+  namespace lattice
+  {
+
+    /// @addtogroup libnoise
+    /// @{
+
+    // Constants used by the hashing functions.  They must match
+    // noisegen.cpp or the output will differ from libnoise.
+    const unsigned int X_NOISE_GEN = 1619;
+    const unsigned int Y_NOISE_GEN = 31337;
+    const unsigned int Z_NOISE_GEN = 6971;
+    const unsigned int SEED_NOISE_GEN = 1013;
+    const unsigned int SHIFT_NOISE_GEN = 8;
+
+    /// libnoise's table of 256 normalized gradient vectors, laid out as
+    /// (x, y, z, 0) rows.
+    extern const double* const g_gradientTable;
+
+    /// Returns the lower lattice coordinate of @a a.
+    ///
+    /// This is not floor(): like libnoise, a value of exactly 0.0 (or any
+    /// other non-positive integer) maps to the cell below it.
+    inline int LatticeFloor (double a)
+    {
+      return (a > 0.0? (int)a: (int)a - 1);
+    }
+
+    /// Applies the interpolation curve selected by @a noiseQuality.
+    inline double FadeCurve (double a, NoiseQuality noiseQuality)
+    {
+      switch (noiseQuality) {
+        case QUALITY_FAST:
+          return a;
+        case QUALITY_STD:
+          return SCurve3 (a);
+        case QUALITY_BEST:
+          return SCurve5 (a);
+      }
+      return a;
+    }
+
+    /// Returns the hash of a lattice point.
+    ///
+    /// The hash is linear in each coordinate, so callers can compute it for
+    /// one corner of a cell and reach the other corners by adding
+    /// X_NOISE_GEN, Y_NOISE_GEN and Z_NOISE_GEN.  Unsigned arithmetic gives
+    /// the same low bits as libnoise's (overflowing) signed arithmetic.
+    inline unsigned int LatticeHash (int ix, int iy, int iz, int seed)
+    {
+      return X_NOISE_GEN * (unsigned int)ix
+        + Y_NOISE_GEN    * (unsigned int)iy
+        + Z_NOISE_GEN    * (unsigned int)iz
+        + SEED_NOISE_GEN * (unsigned int)seed;
+    }
+
+    /// Returns a pointer to the gradient vector selected by a lattice hash.
+    inline const double* GradientFromHash (unsigned int hash)
+    {
+      unsigned int vectorIndex = (hash ^ (hash >> SHIFT_NOISE_GEN)) & 0xff;
+      return g_gradientTable + (vectorIndex << 2);
+    }
+
+    /// Same as noise::GradientNoise3D(), given a precomputed lattice hash.
+    inline double GradientNoise3D (double fx, double fy, double fz, int ix,
+      int iy, int iz, unsigned int hash)
+    {
+      const double* gradient = GradientFromHash (hash);
+      double xvPoint = (fx - (double)ix);
+      double yvPoint = (fy - (double)iy);
+      double zvPoint = (fz - (double)iz);
+      return ((gradient[0] * xvPoint)
+        + (gradient[1] * yvPoint)
+        + (gradient[2] * zvPoint)) * 2.12;
+    }
+
+    /// Same as noise::GradientCoherentNoise3D().
+    inline double GradientCoherentNoise3D (double x, double y, double z,
+      int seed, NoiseQuality noiseQuality)
+    {
+      int x0 = LatticeFloor (x);
+      int x1 = x0 + 1;
+      int y0 = LatticeFloor (y);
+      int y1 = y0 + 1;
+      int z0 = LatticeFloor (z);
+      int z1 = z0 + 1;
+
+      double xs = FadeCurve (x - (double)x0, noiseQuality);
+      double ys = FadeCurve (y - (double)y0, noiseQuality);
+      double zs = FadeCurve (z - (double)z0, noiseQuality);
+
+      // Hash the (x0, y0, z0) corner once and step to the others.
+      unsigned int h000 = LatticeHash (x0, y0, z0, seed);
+      unsigned int h010 = h000 + Y_NOISE_GEN;
+      unsigned int h001 = h000 + Z_NOISE_GEN;
+      unsigned int h011 = h010 + Z_NOISE_GEN;
+
+      double n0, n1, ix0, ix1, iy0, iy1;
+      n0  = GradientNoise3D (x, y, z, x0, y0, z0, h000);
+      n1  = GradientNoise3D (x, y, z, x1, y0, z0, h000 + X_NOISE_GEN);
+      ix0 = LinearInterp (n0, n1, xs);
+      n0  = GradientNoise3D (x, y, z, x0, y1, z0, h010);
+      n1  = GradientNoise3D (x, y, z, x1, y1, z0, h010 + X_NOISE_GEN);
+      ix1 = LinearInterp (n0, n1, xs);
+      iy0 = LinearInterp (ix0, ix1, ys);
+      n0  = GradientNoise3D (x, y, z, x0, y0, z1, h001);
+      n1  = GradientNoise3D (x, y, z, x1, y0, z1, h001 + X_NOISE_GEN);
+      ix0 = LinearInterp (n0, n1, xs);
+      n0  = GradientNoise3D (x, y, z, x0, y1, z1, h011);
+      n1  = GradientNoise3D (x, y, z, x1, y1, z1, h011 + X_NOISE_GEN);
+      ix1 = LinearInterp (n0, n1, xs);
+      iy1 = LinearInterp (ix0, ix1, ys);
+
+      return LinearInterp (iy0, iy1, zs);
+    }
+
+    /// Returns the derivative of the interpolation curve selected by
+    /// @a noiseQuality.
+    inline double FadeCurveDerivative (double a, NoiseQuality noiseQuality)
+    {
+      switch (noiseQuality) {
+        case QUALITY_FAST:
+          return 1.0;
+        case QUALITY_STD:
+          return 6.0 * a * (1.0 - a);
+        case QUALITY_BEST:
+          return 30.0 * a * a * (a * (a - 2.0) + 1.0);
+      }
+      return 1.0;
+    }
+
+    /// Same as GradientCoherentNoise3D(), also returning the partial
+    /// derivatives of the noise with respect to @a x, @a y and @a z.
+    ///
+    /// The returned value is computed with exactly the same operations as
+    /// GradientCoherentNoise3D(), so the two always agree.
+    inline double GradientCoherentNoise3D (double x, double y, double z,
+      int seed, NoiseQuality noiseQuality, double& dx, double& dy,
+      double& dz)
+    {
+      int x0 = LatticeFloor (x);
+      int y0 = LatticeFloor (y);
+      int z0 = LatticeFloor (z);
+
+      double xs = FadeCurve (x - (double)x0, noiseQuality);
+      double ys = FadeCurve (y - (double)y0, noiseQuality);
+      double zs = FadeCurve (z - (double)z0, noiseQuality);
+      double dxs = FadeCurveDerivative (x - (double)x0, noiseQuality);
+      double dys = FadeCurveDerivative (y - (double)y0, noiseQuality);
+      double dzs = FadeCurveDerivative (z - (double)z0, noiseQuality);
+
+      // Corner values and their (constant) gradients, 2.12 * gradient.
+      unsigned int hash = LatticeHash (x0, y0, z0, seed);
+      double n[8], gx[8], gy[8], gz[8];
+      for (int corner = 0; corner < 8; corner++) {
+        int cx = corner & 1;
+        int cy = (corner >> 1) & 1;
+        int cz = corner >> 2;
+        unsigned int cornerHash = hash + cx * X_NOISE_GEN + cy * Y_NOISE_GEN
+          + cz * Z_NOISE_GEN;
+        n[corner] = GradientNoise3D (x, y, z, x0 + cx, y0 + cy, z0 + cz,
+          cornerHash);
+        const double* gradient = GradientFromHash (cornerHash);
+        gx[corner] = gradient[0] * 2.12;
+        gy[corner] = gradient[1] * 2.12;
+        gz[corner] = gradient[2] * 2.12;
+      }
+
+      // Interpolate along x.  d/dp lerp (a, b, t) =
+      //   (1 - t) * a' + t * b' + t' * (b - a)
+      double ix[4], ixdx[4], ixdy[4], ixdz[4];
+      for (int i = 0; i < 4; i++) {
+        int a = i * 2;
+        int b = a + 1;
+        ix[i] = LinearInterp (n[a], n[b], xs);
+        ixdx[i] = LinearInterp (gx[a], gx[b], xs) + dxs * (n[b] - n[a]);
+        ixdy[i] = LinearInterp (gy[a], gy[b], xs);
+        ixdz[i] = LinearInterp (gz[a], gz[b], xs);
+      }
+
+      // Interpolate along y.
+      double iy[2], iydx[2], iydy[2], iydz[2];
+      for (int i = 0; i < 2; i++) {
+        int a = i * 2;
+        int b = a + 1;
+        iy[i] = LinearInterp (ix[a], ix[b], ys);
+        iydx[i] = LinearInterp (ixdx[a], ixdx[b], ys);
+        iydy[i] = LinearInterp (ixdy[a], ixdy[b], ys) + dys * (ix[b] - ix[a]);
+        iydz[i] = LinearInterp (ixdz[a], ixdz[b], ys);
+      }
+
+      // Interpolate along z.
+      dx = LinearInterp (iydx[0], iydx[1], zs);
+      dy = LinearInterp (iydy[0], iydy[1], zs);
+      dz = LinearInterp (iydz[0], iydz[1], zs) + dzs * (iy[1] - iy[0]);
+      return LinearInterp (iy[0], iy[1], zs);
+    }
+
+    /// Same as noise::IntValueNoise3D().
+    inline int IntValueNoise3D (int x, int y, int z, int seed)
+    {
+      unsigned int n = LatticeHash (x, y, z, seed) & 0x7fffffff;
+      n = (n >> 13) ^ n;
+      return (int)((n * (n * n * 60493 + 19990303) + 1376312589)
+        & 0x7fffffff);
+    }
+
+    /// Same as noise::ValueNoise3D().
+    inline double ValueNoise3D (int x, int y, int z, int seed)
+    {
+      return 1.0 - ((double)IntValueNoise3D (x, y, z, seed) / 1073741824.0);
+    }
+
+    // @}
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,59 @@
+// lod.cpp
+//
+
+#include "lod.h"
+
+#include <cmath>
+
+using namespace noise::module;
+
+namespace
+{
+
+  thread_local double t_sampleSpacing = 0.0;
+
+}
+
+double noise::module::GetSampleSpacing ()
+{
+  return t_sampleSpacing;
+}
+
+SampleSpacingScope::SampleSpacingScope (double spacing):
+  m_previousSpacing (t_sampleSpacing)
+{
+  t_sampleSpacing = spacing;
+}
+
+SampleSpacingScope::~SampleSpacingScope ()
+{
+  t_sampleSpacing = m_previousSpacing;
+}
+
+int noise::module::GetLodOctaveCount (double frequency, double lacunarity,
+  int octaveCount, double& fade)
+{
+  fade = 0.0;
+
+  double spacing = t_sampleSpacing;
+  if (spacing <= 0.0 || frequency <= 0.0 || lacunarity <= 1.0) {
+    return octaveCount;
+  }
+
+  // Octave n has a frequency of frequency * lacunarity^n and is resolved
+  // while that is no more than 0.5 / spacing.  This is the (fractional)
+  // number of such octaves.
+  double octaves = 1.0 + log (0.5 / (spacing * frequency)) / log (lacunarity);
+
+  if (octaves >= (double)octaveCount) {
+    return octaveCount;
+  }
+  if (octaves < 1.0) {
+    // Always keep the first octave, even if it is aliased.
+    return 1;
+  }
+
+  int wholeOctaves = (int)octaves;
+  fade = octaves - (double)wholeOctaves;
+  return wholeOctaves;
+}
@@ -0,0 +1,82 @@
+// lod.h
+//
+// Sample spacing for level-of-detail noise generation.  A noise map builder
+// knows how far apart its samples are; the fractal modules in lodfractal.h
+// use that spacing to skip octaves too fine to show up in the result.
+//
+
+#ifndef NOISE_MODULE_LOD_H
+#define NOISE_MODULE_LOD_H
+
+namespace noise
+{
+
+  namespace module
+  {
+
+    /// @addtogroup libnoise
+    /// @{
+
+    /// Returns the sample spacing set on the calling thread, or 0.0 if
+    /// modules should generate full detail.
+    double GetSampleSpacing ();
+
+    /// Sets the sample spacing of the calling thread for the lifetime of
+    /// the object, restoring the previous spacing when it goes out of scope.
+    ///
+    /// The spacing is the distance between adjacent samples in the input
+    /// coordinates of the outermost module, e.g. the width of the bounding
+    /// rectangle divided by the width of the noise map.  A spacing of 0.0
+    /// requests full detail.
+    ///
+    /// The spacing is per thread, so each thread building noise maps sets
+    /// its own.
+    class SampleSpacingScope
+    {
+
+      public:
+
+        /// Constructor.
+        ///
+        /// @param spacing The distance between adjacent samples.
+        explicit SampleSpacingScope (double spacing);
+
+        /// Destructor.
+        ~SampleSpacingScope ();
+
+      private:
+
+        SampleSpacingScope (const SampleSpacingScope&);
+        SampleSpacingScope& operator= (const SampleSpacingScope&);
+
+        /// Spacing to restore on destruction.
+        double m_previousSpacing;
+
+    };
+
+    /// Returns the number of octaves of a fractal that are resolved at the
+    /// calling thread's sample spacing.
+    ///
+    /// @param frequency Frequency of the first octave.
+    /// @param lacunarity Frequency multiplier between successive octaves.
+    /// @param octaveCount Total number of octaves of the fractal.
+    /// @param fade Receives the weight, from 0.0 to 1.0, of the octave
+    /// following the returned count.
+    ///
+    /// @returns The number of octaves to evaluate at full weight.
+    ///
+    /// An octave is resolved while its frequency is at most the Nyquist
+    /// frequency, half the sampling rate.  The octave straddling that limit
+    /// is faded in gradually as the spacing shrinks, so moving between
+    /// detail levels never pops.  Without a sample spacing this returns
+    /// @a octaveCount with a fade of 0.0.
+    int GetLodOctaveCount (double frequency, double lacunarity,
+      int octaveCount, double& fade);
+
+    // @}
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,175 @@
+// lodfractal.cpp
+//
+// The loops below are those of libnoise's perlin.cpp, billow.cpp and
+// ridgedmulti.cpp, with the octave count taken from GetLodOctaveCount() and
+// the contribution of the faded octave scaled by its weight.
+//
+
+#include "lodfractal.h"
+#include "latticenoise.h"
+
+#include <cmath>
+
+using namespace noise::module;
+
+double LodPerlin::GetValue (double x, double y, double z) const
+{
+  double fade;
+  int octaveCount = GetLodOctaveCount (m_frequency, m_lacunarity,
+    m_octaveCount, fade);
+  int lastOctave = (fade > 0.0)? octaveCount: octaveCount - 1;
+
+  double value = 0.0;
+  double signal = 0.0;
+  double curPersistence = 1.0;
+  double nx, ny, nz;
+  int seed;
+
+  x *= m_frequency;
+  y *= m_frequency;
+  z *= m_frequency;
+
+  for (int curOctave = 0; curOctave <= lastOctave; curOctave++) {
+
+    // Make sure that these floating-point values have the same range as a 32-
+    // bit integer so that we can pass them to the coherent-noise functions.
+    nx = MakeInt32Range (x);
+    ny = MakeInt32Range (y);
+    nz = MakeInt32Range (z);
+
+    // Get the coherent-noise value from the input value and add it to the
+    // final result.
+    seed = (m_seed + curOctave) & 0xffffffff;
+    signal = lattice::GradientCoherentNoise3D (nx, ny, nz, seed,
+      m_noiseQuality);
+    if (curOctave == octaveCount) {
+      signal *= fade;
+    }
+    value += signal * curPersistence;
+
+    // Prepare the next octave.
+    x *= m_lacunarity;
+    y *= m_lacunarity;
+    z *= m_lacunarity;
+    curPersistence *= m_persistence;
+  }
+
+  return value;
+}
+
+double LodBillow::GetValue (double x, double y, double z) const
+{
+  double fade;
+  int octaveCount = GetLodOctaveCount (m_frequency, m_lacunarity,
+    m_octaveCount, fade);
+  int lastOctave = (fade > 0.0)? octaveCount: octaveCount - 1;
+
+  double value = 0.0;
+  double signal = 0.0;
+  double curPersistence = 1.0;
+  double nx, ny, nz;
+  int seed;
+
+  x *= m_frequency;
+  y *= m_frequency;
+  z *= m_frequency;
+
+  for (int curOctave = 0; curOctave <= lastOctave; curOctave++) {
+
+    // Make sure that these floating-point values have the same range as a 32-
+    // bit integer so that we can pass them to the coherent-noise functions.
+    nx = MakeInt32Range (x);
+    ny = MakeInt32Range (y);
+    nz = MakeInt32Range (z);
+
+    // Get the coherent-noise value from the input value and add it to the
+    // final result.
+    seed = (m_seed + curOctave) & 0xffffffff;
+    signal = lattice::GradientCoherentNoise3D (nx, ny, nz, seed,
+      m_noiseQuality);
+    signal = 2.0 * fabs (signal) - 1.0;
+    if (curOctave == octaveCount) {
+      signal *= fade;
+    }
+    value += signal * curPersistence;
+
+    // Prepare the next octave.
+    x *= m_lacunarity;
+    y *= m_lacunarity;
+    z *= m_lacunarity;
+    curPersistence *= m_persistence;
+  }
+  value += 0.5;
+
+  return value;
+}
+
+double LodRidgedMulti::GetValue (double x, double y, double z) const
+{
+  double fade;
+  int octaveCount = GetLodOctaveCount (m_frequency, m_lacunarity,
+    m_octaveCount, fade);
+  int lastOctave = (fade > 0.0)? octaveCount: octaveCount - 1;
+
+  x *= m_frequency;
+  y *= m_frequency;
+  z *= m_frequency;
+
+  double signal = 0.0;
+  double value  = 0.0;
+  double weight = 1.0;
+
+  // These parameters should be user-defined; they may be exposed in a
+  // future version of libnoise.
+  double offset = 1.0;
+  double gain = 2.0;
+
+  for (int curOctave = 0; curOctave <= lastOctave; curOctave++) {
+
+    // Make sure that these floating-point values have the same range as a 32-
+    // bit integer so that we can pass them to the coherent-noise functions.
+    double nx, ny, nz;
+    nx = MakeInt32Range (x);
+    ny = MakeInt32Range (y);
+    nz = MakeInt32Range (z);
+
+    // Get the coherent-noise value.
+    int seed = (m_seed + curOctave) & 0x7fffffff;
+    signal = lattice::GradientCoherentNoise3D (nx, ny, nz, seed,
+      m_noiseQuality);
+
+    // Make the ridges.
+    signal = fabs (signal);
+    signal = offset - signal;
+
+    // Square the signal to increase the sharpness of the ridges.
+    signal *= signal;
+
+    // The weighting from the previous octave is applied to the signal.
+    // Larger values have higher weights, producing sharp points along the
+    // ridges.
+    signal *= weight;
+
+    // Weight successive contributions by the previous signal.
+    weight = signal * gain;
+    if (weight > 1.0) {
+      weight = 1.0;
+    }
+    if (weight < 0.0) {
+      weight = 0.0;
+    }
+
+    // Add the signal to the output value.
+    if (curOctave == octaveCount) {
+      signal *= fade;
+    }
+    value += (signal * m_pSpectralWeights[curOctave]);
+
+    // Go to the next octave.
+    x *= m_lacunarity;
+    y *= m_lacunarity;
+    z *= m_lacunarity;
+  }
+
+  return (value * 1.25) - 1.0;
+}
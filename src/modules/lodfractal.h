@@ -0,0 +1,81 @@
+// lodfractal.h
+//
+
+#ifndef NOISE_MODULE_LODFRACTAL_H
+#define NOISE_MODULE_LODFRACTAL_H
+
+#include <noise/noise.h>
+#include "lod.h"
+
+namespace noise
+{
+
+  namespace module
+  {
+
+    /// @addtogroup libnoise
+    /// @{
+
+    /// @addtogroup modules
+    /// @{
+
+    /// @addtogroup generatormodules
+    /// @{
+
+    /// Perlin noise that skips octaves finer than the sample spacing.
+    ///
+    /// Configured and used exactly like noise::module::Perlin.  When the
+    /// calling thread has a sample spacing set (see SampleSpacingScope),
+    /// only the octaves returned by GetLodOctaveCount() are evaluated and
+    /// the last one is faded.  Without a spacing the output is identical to
+    /// noise::module::Perlin.
+    class LodPerlin: public Perlin
+    {
+
+      public:
+
+        virtual double GetValue (double x, double y, double z) const;
+
+    };
+
+    /// Billowy noise that skips octaves finer than the sample spacing.
+    ///
+    /// Configured and used exactly like noise::module::Billow.  Without a
+    /// sample spacing the output is identical to noise::module::Billow.
+    class LodBillow: public Billow
+    {
+
+      public:
+
+        virtual double GetValue (double x, double y, double z) const;
+
+    };
+
+    /// Ridged-multifractal noise that skips octaves finer than the sample
+    /// spacing.
+    ///
+    /// Configured and used exactly like noise::module::RidgedMulti.  Each
+    /// ridged octave is weighted by the previous one, so only the trailing
+    /// octaves can be dropped; the skipped octaves are the finest and
+    /// lightest.  Without a sample spacing the output is identical to
+    /// noise::module::RidgedMulti.
+    class LodRidgedMulti: public RidgedMulti
+    {
+
+      public:
+
+        virtual double GetValue (double x, double y, double z) const;
+
+    };
+
+    /// @}
+
+    /// @}
+
+    /// @}
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+#version 330 core
+
+// Grid point within the level, 0 .. GRID_SIZE - 1 along each axis
+layout(location = 0) in vec2 position;
+
+out DATA {
+	vec3 position;
+	vec3 surfaceNormal;
+	vec3 toLightVector;
+	vec3 toCameraVector;
+	vec2 texCoords;
+} vs_out;
+
+// Per-frame constants, updated once per frame from FrameData in UniformBuffer.h
+layout(std140) uniform FrameData {
+	mat4 projection;
+	mat4 view;
+	vec4 cameraPosition;
+	vec4 lightPosition;
+	vec4 lightColor;
+} frame;
+
+// Must match CLIPMAP_GRID_SIZE, CLIPMAP_TEXTURE_SIZE and CLIPMAP_MORPH_WIDTH in Clipmap.h
+const int GRID_SIZE = 255;
+const int TEXTURE_SIZE = 256;
+const float MORPH_WIDTH = 0.1;
+
+uniform sampler2D fineHeights;
+uniform sampler2D coarseHeights;
+
+uniform vec2 levelOrigin;
+uniform float levelSpacing;
+uniform bool morph;
+uniform float heightScale;
+uniform float textureScale = 1.0;
+
+// Heights are stored toroidally, grid point p lives in texel p mod TEXTURE_SIZE
+float fineHeight(ivec2 p) {
+	return texelFetch(fineHeights, p & (TEXTURE_SIZE - 1), 0).r;
+}
+
+float coarseHeight(ivec2 p) {
+	return texelFetch(coarseHeights, p & (TEXTURE_SIZE - 1), 0).r;
+}
+
+void main() {
+	ivec2 local = ivec2(position);
+	ivec2 origin = ivec2(levelOrigin);
+	ivec2 grid = origin + local;
+	float height = fineHeight(grid);
+
+	// Towards the outer edge, blend into the coarser level, which samples the
+	// odd grid points halfway along its edges
+	float halfSize = float(GRID_SIZE - 1) * 0.5;
+	vec2 fromCenter = abs(position - halfSize);
+	float alpha = clamp((max(fromCenter.x, fromCenter.y) - halfSize * (1.0 - MORPH_WIDTH)) / (halfSize * MORPH_WIDTH), 0.0, 1.0);
+	if(morph && alpha > 0.0) {
+		ivec2 low = grid >> 1;
+		ivec2 high = (grid + 1) >> 1;
+		float coarse = (coarseHeight(low) + coarseHeight(ivec2(high.x, low.y))
+			+ coarseHeight(ivec2(low.x, high.y)) + coarseHeight(high)) * 0.25;
+		height = mix(height, coarse, alpha);
+	}
+
+	// Central differences, one sided at the edge of the level
+	ivec2 left = origin + clamp(local - ivec2(1, 0), ivec2(0), ivec2(GRID_SIZE - 1));
+	ivec2 right = origin + clamp(local + ivec2(1, 0), ivec2(0), ivec2(GRID_SIZE - 1));
+	ivec2 down = origin + clamp(local - ivec2(0, 1), ivec2(0), ivec2(GRID_SIZE - 1));
+	ivec2 up = origin + clamp(local + ivec2(0, 1), ivec2(0), ivec2(GRID_SIZE - 1));
+	float slopeX = (fineHeight(right) - fineHeight(left)) * heightScale / (float(right.x - left.x) * levelSpacing);
+	float slopeZ = (fineHeight(up) - fineHeight(down)) * heightScale / (float(up.y - down.y) * levelSpacing);
+
+	vec3 worldPosition = vec3(vec2(grid).x * levelSpacing, height * heightScale, vec2(grid).y * levelSpacing);
+
+	gl_Position = frame.projection * frame.view * vec4(worldPosition, 1.0);
+
+	vs_out.position = worldPosition;
+	vs_out.texCoords = worldPosition.xz * textureScale;
+	vs_out.surfaceNormal = normalize(vec3(-slopeX, 1.0, -slopeZ));
+	vs_out.toLightVector = frame.lightPosition.xyz - worldPosition;
+	vs_out.toCameraVector = frame.cameraPosition.xyz - worldPosition;
+}
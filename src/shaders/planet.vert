@@ -0,0 +1,38 @@
+#version 330 core
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoords;
+
+out DATA {
+	vec3 position;
+	vec3 surfaceNormal;
+	vec3 toLightVector;
+	vec3 toCameraVector;
+	vec2 texCoords;
+} vs_out;
+
+// Per-frame constants, updated once per frame from FrameData in UniformBuffer.h
+layout(std140) uniform FrameData {
+	mat4 projection;
+	mat4 view;
+	vec4 cameraPosition;
+	vec4 lightPosition;
+	vec4 lightColor;
+} frame;
+
+uniform mat4 model = mat4(1.0);
+
+// Planet chunks are displaced and lit on the CPU, so this only transforms them
+// and feeds the same lighting inputs as terrain.vert
+void main() {
+	vec4 worldPosition = model * vec4(position, 1.0);
+
+	gl_Position = frame.projection * frame.view * worldPosition;
+
+	vs_out.position = position;
+	vs_out.texCoords = texCoords;
+	vs_out.surfaceNormal = normal;
+	vs_out.toLightVector = frame.lightPosition.xyz - worldPosition.xyz;
+	vs_out.toCameraVector = frame.cameraPosition.xyz - worldPosition.xyz;
+}
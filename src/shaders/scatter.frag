@@ -0,0 +1,24 @@
+#version 330 core
+
+out vec4 fragColor;
+
+in DATA {
+	vec3 normal;
+	vec3 color;
+	vec3 toLightVector;
+} fs_in;
+
+layout(std140) uniform FrameData {
+	mat4 projection;
+	mat4 view;
+	vec4 cameraPosition;
+	vec4 lightPosition;
+	vec4 lightColor;
+} frame;
+
+void main() {
+	float nDotl = dot(normalize(fs_in.normal), normalize(fs_in.toLightVector));
+	float brightness = max(nDotl, 0.25);
+
+	fragColor = vec4(fs_in.color * brightness * frame.lightColor.rgb, 1.0);
+}
@@ -0,0 +1,52 @@
+#version 330 core
+
+// Mesh of the layer, scaled to 1
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec3 color;
+
+// ScatterInstance in Scatter.h: world x, z, scale and rotation about y
+layout(location = 3) in vec4 instance;
+
+out DATA {
+	vec3 normal;
+	vec3 color;
+	vec3 toLightVector;
+} vs_out;
+
+// Per-frame constants, updated once per frame from FrameData in UniformBuffer.h
+layout(std140) uniform FrameData {
+	mat4 projection;
+	mat4 view;
+	vec4 cameraPosition;
+	vec4 lightPosition;
+	vec4 lightColor;
+} frame;
+
+uniform sampler2D heightMap;
+uniform float AMPLITUDE;
+uniform float worldSize;
+
+// Instances shrink to nothing between these distances from the camera
+uniform float fadeStart;
+uniform float fadeEnd;
+
+void main() {
+	vec2 base = instance.xy;
+	float ground = texture(heightMap, base / worldSize).r * AMPLITUDE;
+
+	float distance = length(frame.cameraPosition.xz - base);
+	float scale = instance.z * (1.0 - smoothstep(fadeStart, fadeEnd, distance));
+
+	float s = sin(instance.w);
+	float c = cos(instance.w);
+	mat3 rotation = mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+
+	vec3 worldPosition = vec3(base.x, ground, base.y) + rotation * position * scale;
+
+	gl_Position = frame.projection * frame.view * vec4(worldPosition, 1.0);
+
+	vs_out.normal = rotation * normal;
+	vs_out.color = color;
+	vs_out.toLightVector = frame.lightPosition.xyz - worldPosition;
+}
@@ -12,13 +12,26 @@ in DATA {
 	vec2 texCoords;
 } fs_in;
 
+layout(std140) uniform FrameData {
+	mat4 projection;
+	mat4 view;
+	vec4 cameraPosition;
+	vec4 lightPosition;
+	vec4 lightColor;
+} frame;
+
 uniform sampler2D tex;
 uniform sampler2D normalMap;
 uniform sampler2D heightMap;
-uniform vec3 lightColor;
 uniform float shineDamper = 1;
 uniform float reflectivity = 0.0;
 
+// Baked by RendererHorizon: the sine of the horizon towards the light in red,
+// ambient occlusion in green. Only the flat terrain has one
+uniform sampler2D lightMap;
+uniform bool bakedLighting = false;
+uniform vec2 lightMapScale; // World xz to light map coordinates
+
 void main() {
 	// normalize into vector space
 	/*
@@ -39,8 +52,19 @@ void main() {
 	vec3 unitNormal = vec3(r, g, b);
 	vec3 unitLightVector = normalize(fs_in.toLightVector);
 
+	// Shadowed once the light sinks below the baked horizon, softened over a few degrees
+	float shadow = 1.0;
+	float occlusion = 1.0;
+	if(bakedLighting) {
+		vec2 baked = texture(lightMap, fs_in.position.xz * lightMapScale).rg;
+		float horizon = baked.r * 2.0 - 1.0;
+		shadow = smoothstep(horizon - 0.03, horizon + 0.03, unitLightVector.y);
+		occlusion = baked.g;
+	}
+
 	float nDotl = dot(unitNormal, unitLightVector);
-	float brightness = max(nDotl, 0.2);
+	float brightness = max(nDotl * shadow, 0.2) * occlusion;
+	vec3 lightColor = frame.lightColor.rgb;
 	vec3 diffuse = brightness * lightColor;
 	
 	vec3 unitVectorToCamera = normalize(fs_in.toCameraVector);
@@ -50,7 +74,7 @@ void main() {
 	float specularFactor = dot(reflectedLightDirection, unitVectorToCamera);
 	specularFactor = max(specularFactor, 0.0);
 	float dampedFactor = pow(specularFactor, shineDamper);
-	vec3 finalSpecular = dampedFactor * reflectivity * lightColor;
+	vec3 finalSpecular = dampedFactor * reflectivity * shadow * lightColor;
 
 	//fragColor = vec4(brightness) * vec4(lightColor, 1.0) * texture(tex, fs_in.texCoords);
 	fragColor = vec4(diffuse, 1.0) * texture(tex, fs_in.texCoords) + vec4(finalSpecular, 1.0);
@@ -14,12 +14,19 @@ out DATA {
 	vec2 texCoords;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view = mat4(1.0);
+// Per-frame constants, updated once per frame from FrameData in UniformBuffer.h
+layout(std140) uniform FrameData {
+	mat4 projection;
+	mat4 view;
+	vec4 cameraPosition;
+	vec4 lightPosition;
+	vec4 lightColor;
+} frame;
+
 uniform mat4 model = mat4(1.0);
-uniform vec3 lightPosition;
 
 uniform sampler2D heightMap;
+uniform sampler2D terrainNormals;
 
 uniform float AMPLITUDE;
 
@@ -31,7 +38,7 @@ void main() {
 
 	vec4 worldPosition = model * vec4(position.x, height, position.z, 1.0);
 
-	gl_Position = projection * view * worldPosition;
+	gl_Position = frame.projection * frame.view * worldPosition;
 
 	vs_out.position = vec3(position.x, height, position.z);
 
@@ -40,20 +47,16 @@ void main() {
 
 	vs_out.surfaceNormal = getNormal();
 	//vs_out.toLightVector = lightPosition - position;
-	vs_out.toLightVector = lightPosition - worldPosition.xyz;
-	vs_out.toCameraVector = (inverse(view) * vec4(0.0, 0.0, 0.0, 1.0)).xyz - worldPosition.xyz;
+	vs_out.toLightVector = frame.lightPosition.xyz - worldPosition.xyz;
+	vs_out.toCameraVector = frame.cameraPosition.xyz - worldPosition.xyz;
 }
 
 vec3 getNormal() {
-	const vec2 size = vec2(2.0, 0.0); // what does this do?
-	const ivec3 offset = ivec3(-1, 0, 1);
-
-	float s01 = textureOffset(heightMap, texCoords, offset.xy).x;
-	float s21 = textureOffset(heightMap, texCoords, offset.zy).x;
-    float s10 = textureOffset(heightMap, texCoords, offset.yx).x;
-    float s12 = textureOffset(heightMap, texCoords, offset.yz).x;
-	vec3 va = normalize(vec3(size.xy, s21 - s01));
-	vec3 vb = normalize(vec3(size.yx, s12 - s10));
-
-	return cross(va, vb);
-}
\ No newline at end of file
+	// Exact normals from the noise gradient, baked with the height map.
+	// x and z are in red and green, up is in blue. The images keep the noise
+	// map's first row at the bottom and are uploaded top row first, so the
+	// map's z axis runs against the texture's.
+	vec3 n = texture(terrainNormals, texCoords).rgb * 2.0 - 1.0;
+
+	return normalize(vec3(n.r, n.b, -n.g));
+}
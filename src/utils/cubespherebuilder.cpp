@@ -0,0 +1,95 @@
+// cubespherebuilder.cpp
+//
+
+#include <cmath>
+
+#include "cubespherebuilder.h"
+
+using namespace noise;
+using namespace noise::utils;
+
+namespace
+{
+
+  // Center, u axis and v axis of each face.  u x v points out of the cube,
+  // so every face is seen counterclockwise from outside.
+  const double FACE_BASIS[CUBE_FACE_COUNT][3][3] = {
+    { {  1.0,  0.0,  0.0 }, {  0.0,  0.0, -1.0 }, {  0.0,  1.0,  0.0 } },
+    { { -1.0,  0.0,  0.0 }, {  0.0,  0.0,  1.0 }, {  0.0,  1.0,  0.0 } },
+    { {  0.0,  1.0,  0.0 }, {  1.0,  0.0,  0.0 }, {  0.0,  0.0, -1.0 } },
+    { {  0.0, -1.0,  0.0 }, {  1.0,  0.0,  0.0 }, {  0.0,  0.0,  1.0 } },
+    { {  0.0,  0.0,  1.0 }, {  1.0,  0.0,  0.0 }, {  0.0,  1.0,  0.0 } },
+    { {  0.0,  0.0, -1.0 }, { -1.0,  0.0,  0.0 }, {  0.0,  1.0,  0.0 } }
+  };
+
+}
+
+NoiseMapBuilderCubeSphere::NoiseMapBuilderCubeSphere ():
+  m_face (CUBE_FACE_POS_X),
+  m_lowerUBound (-1.0),
+  m_lowerVBound (-1.0),
+  m_upperUBound ( 1.0),
+  m_upperVBound ( 1.0)
+{
+}
+
+void NoiseMapBuilderCubeSphere::Build ()
+{
+  if ( m_upperUBound <= m_lowerUBound
+    || m_upperVBound <= m_lowerVBound
+    || m_destWidth < 2
+    || m_destHeight < 2
+    || m_pSourceModule == NULL
+    || m_pDestNoiseMap == NULL) {
+    throw noise::ExceptionInvalidParam ();
+  }
+
+  // Resize the destination noise map so that it can store the new output
+  // values from the source model.
+  m_pDestNoiseMap->SetSize (m_destWidth, m_destHeight);
+
+  double uExtent = m_upperUBound - m_lowerUBound;
+  double vExtent = m_upperVBound - m_lowerVBound;
+
+  // Fill every point in the noise map with the output values from the
+  // module.  The positions are computed from the point index rather than
+  // accumulated, so both edges land exactly on the bounds.
+  for (int y = 0; y < m_destHeight; y++) {
+    float* pDest = m_pDestNoiseMap->GetSlabPtr (y);
+    double curV = m_lowerVBound + vExtent * (double)y
+      / (double)(m_destHeight - 1);
+    for (int x = 0; x < m_destWidth; x++) {
+      double curU = m_lowerUBound + uExtent * (double)x
+        / (double)(m_destWidth - 1);
+      double px, py, pz;
+      GetSpherePoint (m_face, curU, curV, px, py, pz);
+      *pDest++ = (float)m_pSourceModule->GetValue (px, py, pz);
+    }
+    if (m_pCallback != NULL) {
+      m_pCallback (y);
+    }
+  }
+}
+
+void NoiseMapBuilderCubeSphere::GetSpherePoint (CubeFace face, double u,
+  double v, double& x, double& y, double& z)
+{
+  const double (&basis)[3][3] = FACE_BASIS[face];
+  double cx = basis[0][0] + u * basis[1][0] + v * basis[2][0];
+  double cy = basis[0][1] + u * basis[1][1] + v * basis[2][1];
+  double cz = basis[0][2] + u * basis[1][2] + v * basis[2][2];
+
+  double x2 = cx * cx;
+  double y2 = cy * cy;
+  double z2 = cz * cz;
+  x = cx * sqrt (1.0 - y2 / 2.0 - z2 / 2.0 + y2 * z2 / 3.0);
+  y = cy * sqrt (1.0 - z2 / 2.0 - x2 / 2.0 + z2 * x2 / 3.0);
+  z = cz * sqrt (1.0 - x2 / 2.0 - y2 / 2.0 + x2 * y2 / 3.0);
+
+  // Inside the face this is already (almost exactly) unit length; past its
+  // edges it is not.
+  double length = sqrt (x * x + y * y + z * z);
+  x /= length;
+  y /= length;
+  z /= length;
+}
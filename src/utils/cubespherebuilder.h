@@ -0,0 +1,160 @@
+// cubespherebuilder.h
+//
+
+#ifndef CUBESPHEREBUILDER_H
+#define CUBESPHEREBUILDER_H
+
+#include "noiseutils.h"
+
+namespace noise
+{
+
+  namespace utils
+  {
+
+    /// Faces of the cube projected onto the sphere by
+    /// NoiseMapBuilderCubeSphere.
+    enum CubeFace
+    {
+      CUBE_FACE_POS_X = 0,
+      CUBE_FACE_NEG_X = 1,
+      CUBE_FACE_POS_Y = 2,
+      CUBE_FACE_NEG_Y = 3,
+      CUBE_FACE_POS_Z = 4,
+      CUBE_FACE_NEG_Z = 5
+    };
+
+    /// Number of faces of the cube.
+    const int CUBE_FACE_COUNT = 6;
+
+    /// Builds a noise map from a patch of one face of a cube-sphere.
+    ///
+    /// NoiseMapBuilderSphere samples the sphere on a latitude/longitude
+    /// grid, which packs the samples ever closer together towards the poles
+    /// and needs trigonometry for every sample.  This builder instead maps
+    /// each face of a cube onto the sphere, so the six faces tile the whole
+    /// sphere with samples of roughly uniform density, and each sample only
+    /// costs a few multiplications and two square roots.
+    ///
+    /// A face is addressed by ( @a u, @a v ) coordinates, both ranging from
+    /// -1.0 to +1.0.  The sphere model has a radius of 1.0 unit and its
+    /// center is at the origin, as with NoiseMapBuilderSphere.
+    ///
+    /// Unlike the other builders, the bounds are inclusive: point (0, 0) of
+    /// the noise map lies on the lower bounds and point (width - 1,
+    /// height - 1) on the upper bounds, so patches that share an edge also
+    /// share the samples along it.
+    class NoiseMapBuilderCubeSphere: public NoiseMapBuilder
+    {
+
+      public:
+
+        /// Constructor.
+        NoiseMapBuilderCubeSphere ();
+
+        virtual void Build ();
+
+        /// Returns the face of the cube the noise map is built from.
+        CubeFace GetFace () const
+        {
+          return m_face;
+        }
+
+        /// Returns the lower @a u boundary of the noise map.
+        double GetLowerUBound () const
+        {
+          return m_lowerUBound;
+        }
+
+        /// Returns the lower @a v boundary of the noise map.
+        double GetLowerVBound () const
+        {
+          return m_lowerVBound;
+        }
+
+        /// Returns the upper @a u boundary of the noise map.
+        double GetUpperUBound () const
+        {
+          return m_upperUBound;
+        }
+
+        /// Returns the upper @a v boundary of the noise map.
+        double GetUpperVBound () const
+        {
+          return m_upperVBound;
+        }
+
+        /// Calculates the point on the unit sphere for a position on a face
+        /// of the cube.
+        ///
+        /// @param face The face of the cube.
+        /// @param u The @a u coordinate on the face.
+        /// @param v The @a v coordinate on the face.
+        /// @param x Receives the @a x coordinate of the point.
+        /// @param y Receives the @a y coordinate of the point.
+        /// @param z Receives the @a z coordinate of the point.
+        ///
+        /// The cube is mapped onto the sphere with the area-preserving
+        /// approximation p * sqrt (1 - q^2 / 2 - r^2 / 2 + q^2 r^2 / 3),
+        /// which spreads the samples more evenly than normalizing the cube
+        /// position.  ( @a u, @a v ) may lie outside -1.0 .. +1.0, which
+        /// continues the face past its edges; the result is always
+        /// normalized onto the sphere.
+        static void GetSpherePoint (CubeFace face, double u, double v,
+          double& x, double& y, double& z);
+
+        /// Sets the coordinate boundaries of the noise map.
+        ///
+        /// @param lowerUBound The lower @a u boundary of the noise map.
+        /// @param upperUBound The upper @a u boundary of the noise map.
+        /// @param lowerVBound The lower @a v boundary of the noise map.
+        /// @param upperVBound The upper @a v boundary of the noise map.
+        ///
+        /// @pre The lower @a u boundary is less than the upper @a u boundary.
+        /// @pre The lower @a v boundary is less than the upper @a v boundary.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        void SetBounds (double lowerUBound, double upperUBound,
+          double lowerVBound, double upperVBound)
+        {
+          if (lowerUBound >= upperUBound
+            || lowerVBound >= upperVBound) {
+            throw noise::ExceptionInvalidParam ();
+          }
+
+          m_lowerUBound = lowerUBound;
+          m_upperUBound = upperUBound;
+          m_lowerVBound = lowerVBound;
+          m_upperVBound = upperVBound;
+        }
+
+        /// Sets the face of the cube the noise map is built from.
+        void SetFace (CubeFace face)
+        {
+          m_face = face;
+        }
+
+      private:
+
+        /// Face of the cube the noise map is built from.
+        CubeFace m_face;
+
+        /// Lower @a u boundary of the noise map.
+        double m_lowerUBound;
+
+        /// Lower @a v boundary of the noise map.
+        double m_lowerVBound;
+
+        /// Upper @a u boundary of the noise map.
+        double m_upperUBound;
+
+        /// Upper @a v boundary of the noise map.
+        double m_upperVBound;
+
+    };
+
+  }
+
+}
+
+#endif
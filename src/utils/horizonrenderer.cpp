@@ -0,0 +1,202 @@
+// horizonrenderer.cpp
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include <noise/mathconsts.h>
+
+#include "horizonrenderer.h"
+
+using namespace noise;
+using namespace noise::utils;
+
+// Slope stored for points with nothing ahead of them.
+const float NO_HORIZON = -1.0e30f;
+
+// Number of lines a thread claims at a time.
+const int SWEEP_LINE_BATCH = 16;
+
+RendererHorizon::RendererHorizon ():
+  m_bumpHeight (1.0),
+  m_directionCount (DEFAULT_HORIZON_DIRECTION_COUNT),
+  m_lightX (1.0),
+  m_lightY (0.0),
+  m_pDestImage (NULL),
+  m_pSourceNoiseMap (NULL),
+  m_pTaskRunner (NULL),
+  m_threadCount (0)
+{
+}
+
+void RendererHorizon::Render ()
+{
+  if ( m_pSourceNoiseMap == NULL
+    || m_pDestImage == NULL
+    || m_pSourceNoiseMap->GetWidth  () <= 0
+    || m_pSourceNoiseMap->GetHeight () <= 0) {
+    throw noise::ExceptionInvalidParam ();
+  }
+
+  int width  = m_pSourceNoiseMap->GetWidth  ();
+  int height = m_pSourceNoiseMap->GetHeight ();
+  size_t count = (size_t)width * height;
+
+  std::vector<float> lightSlopes (count);
+  Sweep (m_lightX, m_lightY, &lightSlopes[0]);
+
+  // With a horizon at elevation a in every direction, the cosine weighted
+  // part of the sky left open is cos^2 (a) = 1 / (1 + tan^2 (a)).
+  std::vector<float> slopes (count);
+  std::vector<float> openness (count, 0.0f);
+  for (int i = 0; i < m_directionCount; i++) {
+    double angle = 2.0 * noise::PI * (double)i / (double)m_directionCount;
+    Sweep (cos (angle), sin (angle), &slopes[0]);
+    for (size_t j = 0; j < count; j++) {
+      float slope = std::max (slopes[j], 0.0f);
+      openness[j] += 1.0f / (1.0f + slope * slope);
+    }
+  }
+
+  m_pDestImage->SetSize (width, height);
+  for (int y = 0; y < height; y++) {
+    Color* pDest = m_pDestImage->GetSlabPtr (y);
+    for (int x = 0; x < width; x++) {
+      size_t index = (size_t)y * width + x;
+      double slope = (double)lightSlopes[index];
+      double horizon = slope / sqrt (1.0 + slope * slope);
+      double open = openness[index] / (double)m_directionCount;
+      *pDest++ = Color (
+        (noise::uint8)floor ((horizon + 1.0) * 127.5 + 0.5),
+        (noise::uint8)floor (open * 255.0 + 0.5),
+        0, 255);
+    }
+  }
+}
+
+void RendererHorizon::SetLightDirection (double x, double y)
+{
+  double length = sqrt (x * x + y * y);
+  if (length <= 0.0) {
+    throw noise::ExceptionInvalidParam ();
+  }
+  m_lightX = x / length;
+  m_lightY = y / length;
+}
+
+void RendererHorizon::Sweep (double x, double y, float* slopes) const
+{
+  int width  = m_pSourceNoiseMap->GetWidth  ();
+  int height = m_pSourceNoiseMap->GetHeight ();
+
+  // Lines step one point at a time along the major axis of the direction
+  // and by rounded fractions along the other, so every point of the map
+  // lies on exactly one line.
+  bool alongX = fabs (x) >= fabs (y);
+  int majorCount = alongX ? width : height;
+  int minorCount = alongX ? height : width;
+  double major = alongX ? x : y;
+  double minor = alongX ? y : x;
+
+  std::vector<int> offsets (majorCount);
+  for (int i = 0; i < majorCount; i++) {
+    offsets[i] = (int)floor ((double)i * minor / major + 0.5);
+  }
+  int lowOffset  = std::min (offsets[0], offsets[majorCount - 1]);
+  int highOffset = std::max (offsets[0], offsets[majorCount - 1]);
+  int firstLine = -highOffset;
+  int lineCount = minorCount - lowOffset + highOffset;
+
+  // Points further along the direction are swept first, so the hull holds
+  // everything ahead of the current point.
+  int firstStep = major > 0.0 ? majorCount - 1 : 0;
+  int stepDelta = major > 0.0 ? -1 : 1;
+
+  auto sweepBatch = [&] (int batch, std::vector<double>& hullDistance,
+    std::vector<double>& hullElevation) {
+    int batchEnd = std::min (batch + SWEEP_LINE_BATCH, lineCount);
+    for (int line = batch; line < batchEnd; line++) {
+      hullDistance.clear ();
+      hullElevation.clear ();
+      for (int i = firstStep; i >= 0 && i < majorCount; i += stepDelta) {
+        int m = firstLine + line + offsets[i];
+        if (m < 0 || m >= minorCount) {
+          continue;
+        }
+        int px = alongX ? i : m;
+        int py = alongX ? m : i;
+        double distance  = (double)i / major;
+        double elevation = m_pSourceNoiseMap->GetValue (px, py)
+          * m_bumpHeight;
+
+        // Drop hull points below the line from here to the point behind
+        // them; what remains on top is the tangent from this point.
+        size_t size = hullDistance.size ();
+        while (size >= 2) {
+          double topSlope = (hullElevation[size - 1] - elevation)
+            / (hullDistance[size - 1] - distance);
+          double nextSlope = (hullElevation[size - 2] - elevation)
+            / (hullDistance[size - 2] - distance);
+          if (topSlope > nextSlope) {
+            break;
+          }
+          size--;
+        }
+        hullDistance.resize (size);
+        hullElevation.resize (size);
+
+        float* pSlope = &slopes[(size_t)py * width + px];
+        if (size == 0) {
+          *pSlope = NO_HORIZON;
+        } else {
+          *pSlope = (float)((hullElevation[size - 1] - elevation)
+            / (hullDistance[size - 1] - distance));
+        }
+        hullDistance.push_back (distance);
+        hullElevation.push_back (elevation);
+      }
+    }
+  };
+
+  int batchCount = (lineCount + SWEEP_LINE_BATCH - 1) / SWEEP_LINE_BATCH;
+  if (m_pTaskRunner != NULL) {
+    m_pTaskRunner->Run (batchCount, [&] (int batch) {
+      std::vector<double> hullDistance;
+      std::vector<double> hullElevation;
+      sweepBatch (batch * SWEEP_LINE_BATCH, hullDistance, hullElevation);
+    });
+    return;
+  }
+
+  std::atomic<int> nextLine (0);
+  auto sweepLines = [&] () {
+    // Hull points as (distance along the direction, elevation).
+    std::vector<double> hullDistance;
+    std::vector<double> hullElevation;
+    hullDistance.reserve (majorCount);
+    hullElevation.reserve (majorCount);
+
+    int batch;
+    while ((batch = nextLine.fetch_add (SWEEP_LINE_BATCH)) < lineCount) {
+      sweepBatch (batch, hullDistance, hullElevation);
+    }
+  };
+
+  int threadCount = m_threadCount;
+  if (threadCount <= 0) {
+    threadCount = std::max ((int)std::thread::hardware_concurrency (), 1);
+  }
+  threadCount = std::min (threadCount, batchCount);
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < threadCount; i++) {
+    threads.push_back (std::thread (sweepLines));
+  }
+  sweepLines ();
+  for (size_t i = 0; i < threads.size (); i++) {
+    threads[i].join ();
+  }
+}
@@ -0,0 +1,211 @@
+// horizonrenderer.h
+//
+
+#ifndef HORIZONRENDERER_H
+#define HORIZONRENDERER_H
+
+#include "noiseutils.h"
+
+namespace noise
+{
+
+  namespace utils
+  {
+
+    /// Default number of directions RendererHorizon gathers ambient
+    /// occlusion from.
+    const int DEFAULT_HORIZON_DIRECTION_COUNT = 16;
+
+    /// Renders a light map holding the shadow horizon and the ambient
+    /// occlusion of a noise map.
+    ///
+    /// The noise map is treated as a heightfield.  For every point, the
+    /// red channel receives the sine of the elevation angle of the horizon
+    /// seen from that point towards the light, mapped from -1.0 .. +1.0 to
+    /// 0 .. 255; the point is in shadow while the light is lower than this.
+    /// The green channel receives the ambient occlusion: the fraction of the
+    /// sky, weighted by the cosine to the vertical, left open by the
+    /// horizons in a number of evenly spread directions, from 0 (fully
+    /// occluded) to 255 (open).  The blue channel is left at zero.
+    ///
+    /// Horizons are not found by casting a ray from every point.  The
+    /// points of the noise map are swept line by line in each direction,
+    /// keeping the upper convex hull of the points already swept; the
+    /// horizon of each new point is its tangent to that hull.  Each point
+    /// is pushed onto and popped from the hull at most once, so a direction
+    /// costs time proportional to the number of points whatever the length
+    /// of the lines.  The lines of a direction are independent, so they are
+    /// spread over several threads, or handed to a task runner if one is
+    /// set.
+    class RendererHorizon
+    {
+
+      public:
+
+        /// Constructor.
+        RendererHorizon ();
+
+        /// Returns the bump height.
+        ///
+        /// @returns The bump height.
+        ///
+        /// As with RendererNormalMap, the bump height is the ratio of
+        /// spatial resolution to elevation resolution: a noise value of
+        /// 1.0 lies @a bumpHeight times the distance between two
+        /// neighbouring points above a value of 0.0.
+        double GetBumpHeight () const
+        {
+          return m_bumpHeight;
+        }
+
+        /// Returns the number of directions the ambient occlusion is
+        /// gathered from.
+        int GetDirectionCount () const
+        {
+          return m_directionCount;
+        }
+
+        /// Returns the task runner the lines are swept on, or NULL to start
+        /// threads for them.
+        TaskRunner* GetTaskRunner () const
+        {
+          return m_pTaskRunner;
+        }
+
+        /// Returns the number of threads the rendering is spread over, or
+        /// 0 to use one per core.
+        int GetThreadCount () const
+        {
+          return m_threadCount;
+        }
+
+        /// Renders the destination image using the contents of the source
+        /// noise map.
+        ///
+        /// @pre SetSourceNoiseMap() has been previously called.
+        /// @pre SetDestImage() has been previously called.
+        ///
+        /// @post The original contents of the destination image is
+        /// destroyed.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        void Render ();
+
+        /// Sets the bump height.
+        ///
+        /// @param bumpHeight The bump height.
+        ///
+        /// See GetBumpHeight().
+        void SetBumpHeight (double bumpHeight)
+        {
+          m_bumpHeight = bumpHeight;
+        }
+
+        /// Sets the destination image.
+        ///
+        /// @param destImage The destination image.
+        ///
+        /// The destination image will contain the light map after a
+        /// successful call to the Render() method.
+        ///
+        /// The destination image must exist throughout the lifetime of this
+        /// object unless another image replaces that image.
+        void SetDestImage (Image& destImage)
+        {
+          m_pDestImage = &destImage;
+        }
+
+        /// Sets the number of directions the ambient occlusion is gathered
+        /// from.
+        ///
+        /// @pre The direction count is positive.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        void SetDirectionCount (int directionCount)
+        {
+          if (directionCount <= 0) {
+            throw noise::ExceptionInvalidParam ();
+          }
+          m_directionCount = directionCount;
+        }
+
+        /// Sets the horizontal direction towards the light.
+        ///
+        /// @param x The @a x component of the direction, along the rows of
+        /// the noise map.
+        /// @param y The @a y component of the direction, across the rows of
+        /// the noise map.
+        ///
+        /// @pre The direction is not zero.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        void SetLightDirection (double x, double y);
+
+        /// Sets the source noise map.
+        ///
+        /// @param sourceNoiseMap The source noise map.
+        ///
+        /// The source noise map must exist throughout the lifetime of this
+        /// object unless another noise map replaces that noise map.
+        void SetSourceNoiseMap (const NoiseMap& sourceNoiseMap)
+        {
+          m_pSourceNoiseMap = &sourceNoiseMap;
+        }
+
+        /// Sets the task runner the lines are swept on.
+        ///
+        /// @param pTaskRunner The task runner, or NULL to start threads for
+        /// the lines.
+        ///
+        /// With a task runner set, the thread count is ignored.
+        void SetTaskRunner (TaskRunner* pTaskRunner)
+        {
+          m_pTaskRunner = pTaskRunner;
+        }
+
+        /// Sets the number of threads the rendering is spread over.
+        ///
+        /// @param threadCount The number of threads, or 0 to use one per
+        /// core.
+        void SetThreadCount (int threadCount)
+        {
+          m_threadCount = threadCount;
+        }
+
+      private:
+
+        /// Sweeps every line of the noise map in one direction, storing the
+        /// slope of the horizon of every point in @a slopes.
+        void Sweep (double x, double y, float* slopes) const;
+
+        /// Bump height.
+        double m_bumpHeight;
+
+        /// Number of directions the ambient occlusion is gathered from.
+        int m_directionCount;
+
+        /// @a x component of the unit direction towards the light.
+        double m_lightX;
+
+        /// @a y component of the unit direction towards the light.
+        double m_lightY;
+
+        /// A pointer to the destination image.
+        Image* m_pDestImage;
+
+        /// A pointer to the source noise map.
+        const NoiseMap* m_pSourceNoiseMap;
+
+        /// Task runner the lines are swept on, or NULL.
+        TaskRunner* m_pTaskRunner;
+
+        /// Number of threads, or 0 to use one per core.
+        int m_threadCount;
+
+    };
+
+  }
+
+}
+
+#endif
@@ -21,7 +21,17 @@
 // off every 'zig'.)
 //
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <new>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NOISEUTILS_SSE2
+#include <emmintrin.h>
+#endif
 
 #include <noise/interp.h>
 #include <noise/mathconsts.h>
@@ -35,6 +45,15 @@ using namespace noise::module;
 // Bitmap header size.
 const int BMP_HEADER_SIZE = 54;
 
+// Number of bytes the writers convert before writing them in one call.
+const size_t WRITER_BAND_SIZE = 4 << 20;
+
+// Number of lines a task converts at a time.
+const int WRITER_LINE_BATCH = 16;
+
+// Number of lines in a band the QOI writer encodes on its own.
+const int QOI_BAND_HEIGHT = 64;
+
 // Direction of the light source, in compass degrees (0 = north, 90 = east,
 // 180 = south, 270 = east)
 const double DEFAULT_LIGHT_AZIMUTH = 45.0;
@@ -108,6 +127,240 @@ namespace noise
       return bytes;
     }
 
+    // Unpacks a 32-bit integer value into four bytes in big endian format.
+    inline noise::uint8* UnpackBig32 (noise::uint8* bytes,
+      noise::uint32 integer)
+    {
+      bytes[0] = (noise::uint8)((integer & 0xff000000) >> 24);
+      bytes[1] = (noise::uint8)((integer & 0x00ff0000) >> 16);
+      bytes[2] = (noise::uint8)((integer & 0x0000ff00) >> 8 );
+      bytes[3] = (noise::uint8)((integer & 0x000000ff)      );
+      return bytes;
+    }
+
+    // Packs the blue, green, and red channels of count colors into three
+    // bytes each, in the order Windows bitmaps store them.
+    inline void PackBGR (const Color* pSource, noise::uint8* pDest,
+      int count)
+    {
+      int x = 0;
+    #ifdef NOISEUTILS_SSE2
+      // A color is stored as alpha, blue, green, red, so shifting the alpha
+      // channel out of each one leaves the other three in order.  The four
+      // colors are then joined in pairs, and the pairs joined.
+      const __m128i evenColor = _mm_set_epi32 (0, -1, 0, -1);
+      const __m128i lowPair   = _mm_set_epi32 (0, 0, -1, -1);
+      for (; x + 4 <= count; x += 4) {
+        __m128i colors = _mm_srli_epi32 (
+          _mm_loadu_si128 ((const __m128i*)(pSource + x)), 8);
+        __m128i pairs = _mm_or_si128 (_mm_and_si128 (colors, evenColor),
+          _mm_srli_epi64 (_mm_andnot_si128 (evenColor, colors), 8));
+        __m128i packed = _mm_or_si128 (_mm_and_si128 (pairs, lowPair),
+          _mm_srli_si128 (_mm_andnot_si128 (lowPair, pairs), 2));
+        _mm_storel_epi64 ((__m128i*)(pDest + x * 3), packed);
+        int last = _mm_cvtsi128_si32 (_mm_srli_si128 (packed, 8));
+        memcpy (pDest + x * 3 + 8, &last, 4);
+      }
+    #endif
+      for (; x < count; x++) {
+        pDest[x * 3    ] = pSource[x].blue ;
+        pDest[x * 3 + 1] = pSource[x].green;
+        pDest[x * 3 + 2] = pSource[x].red  ;
+      }
+    }
+
+    // Packs count elevations into 16-bit integers of half a meter each, in
+    // little endian format.  Elevations out of range are clamped to it.
+    inline void PackElevations (const float* pSource, noise::uint8* pDest,
+      int count)
+    {
+      int x = 0;
+    #ifdef NOISEUTILS_SSE2
+      const __m128 scale   = _mm_set1_ps (2.0f);
+      const __m128 lowest  = _mm_set1_ps (-32768.0f);
+      const __m128 highest = _mm_set1_ps ( 32767.0f);
+      __m128i scaled[2];
+      for (; x + 8 <= count; x += 8) {
+        for (int i = 0; i < 2; i++) {
+          // Clamping first keeps the conversion in range, and takes NaNs to
+          // the lowest elevation like the loop below.  The conversion
+          // truncates, so values it rounded up are taken down by one.
+          __m128 value = _mm_min_ps (_mm_max_ps (_mm_mul_ps (
+            _mm_loadu_ps (pSource + x + i * 4), scale), lowest), highest);
+          __m128i truncated = _mm_cvttps_epi32 (value);
+          scaled[i] = _mm_add_epi32 (truncated, _mm_castps_si128 (
+            _mm_cmplt_ps (value, _mm_cvtepi32_ps (truncated))));
+        }
+        _mm_storeu_si128 ((__m128i*)(pDest + x * 2),
+          _mm_packs_epi32 (scaled[0], scaled[1]));
+      }
+    #endif
+      for (; x < count; x++) {
+        float value = floorf (pSource[x] * 2.0f);
+        if (!(value >= -32768.0f)) {
+          value = -32768.0f;
+        } else if (value > 32767.0f) {
+          value = 32767.0f;
+        }
+        UnpackLittle16 (pDest + x * 2, (noise::uint16)(int16)value);
+      }
+    }
+
+    // Writes lineCount lines of lineSize bytes each to the file, filling
+    // each one with fillLine.  The lines are filled a band at a time, in
+    // parallel on the task runner if there is one, and each band is written
+    // in one call while the next one is filled.  Returns false if the file
+    // could not be written.
+    bool WriteLines (std::ofstream& os, int lineCount, size_t lineSize,
+      TaskRunner* pTaskRunner,
+      const std::function<void (int line, noise::uint8* pDest)>& fillLine)
+    {
+      if (lineCount <= 0 || lineSize == 0) {
+        return true;
+      }
+      int bandHeight = (int)std::max (WRITER_BAND_SIZE / lineSize,
+        (size_t)1);
+      bandHeight = std::min (bandHeight, lineCount);
+
+      std::vector<noise::uint8> bands[2];
+      try {
+        bands[0].resize ((size_t)bandHeight * lineSize);
+        bands[1].resize ((size_t)bandHeight * lineSize);
+      }
+      catch (...) {
+        throw noise::ExceptionOutOfMemory ();
+      }
+
+      std::thread writer;
+      bool failed = false;
+      for (int first = 0, band = 0; first < lineCount;
+        first += bandHeight, band ^= 1) {
+        int count = std::min (bandHeight, lineCount - first);
+        noise::uint8* pBand = &bands[band][0];
+        auto fillBatch = [&] (int batch) {
+          int end = std::min ((batch + 1) * WRITER_LINE_BATCH, count);
+          for (int line = batch * WRITER_LINE_BATCH; line < end; line++) {
+            fillLine (first + line, pBand + (size_t)line * lineSize);
+          }
+        };
+        int batchCount = (count + WRITER_LINE_BATCH - 1) / WRITER_LINE_BATCH;
+        if (pTaskRunner != NULL) {
+          pTaskRunner->Run (batchCount, fillBatch);
+        } else {
+          for (int batch = 0; batch < batchCount; batch++) {
+            fillBatch (batch);
+          }
+        }
+
+        // The band before this one has to be out of the other buffer before
+        // it is filled again.
+        if (writer.joinable ()) {
+          writer.join ();
+        }
+        if (failed) {
+          break;
+        }
+        size_t size = (size_t)count * lineSize;
+        writer = std::thread ([&os, &failed, pBand, size] () {
+          os.write ((const char*)pBand, size);
+          failed = os.fail () || os.bad ();
+        });
+      }
+      if (writer.joinable ()) {
+        writer.join ();
+      }
+      return !failed;
+    }
+
+    // Determines if two colors are the same in every channel.
+    inline bool SameColor (const Color& color0, const Color& color1)
+    {
+      return color0.red   == color1.red
+          && color0.green == color1.green
+          && color0.blue  == color1.blue
+          && color0.alpha == color1.alpha;
+    }
+
+    // Encodes the lines first to end - 1 of an image in QOI format, counting
+    // from the top, given the color just before them.  The colors the
+    // decoder remembers from earlier bands are never referred to, so bands
+    // encoded separately join into one stream.
+    void EncodeQOIBand (Image& image, int first, int end, Color previous,
+      std::vector<noise::uint8>& out)
+    {
+      // Colors by hash, and whether this band stored them.
+      Color index[64];
+      bool stored[64] = { false };
+      int run = 0;
+
+      // No color takes more than five bytes.
+      int width  = image.GetWidth  ();
+      int height = image.GetHeight ();
+      size_t start = out.size ();
+      out.resize (start + (size_t)width * (end - first) * 5);
+      noise::uint8* pDest = out.data () + start;
+
+      for (int line = first; line < end; line++) {
+        const Color* pSource = image.GetConstSlabPtr (height - 1 - line);
+        for (int x = 0; x < width; x++) {
+          const Color& color = pSource[x];
+          if (SameColor (color, previous)) {
+            if (++run == 62) {
+              *pDest++ = (noise::uint8)(0xc0 | (run - 1));
+              run = 0;
+            }
+            continue;
+          }
+          if (run > 0) {
+            *pDest++ = (noise::uint8)(0xc0 | (run - 1));
+            run = 0;
+          }
+
+          int hash = (color.red * 3 + color.green * 5 + color.blue * 7
+            + color.alpha * 11) & 63;
+          if (stored[hash] && SameColor (index[hash], color)) {
+            *pDest++ = (noise::uint8)hash;
+          } else {
+            index[hash] = color;
+            stored[hash] = true;
+            if (color.alpha == previous.alpha) {
+              // Differences wrap around, as the decoder adds them.
+              int dr = (signed char)(color.red   - previous.red  );
+              int dg = (signed char)(color.green - previous.green);
+              int db = (signed char)(color.blue  - previous.blue );
+              int drg = dr - dg;
+              int dbg = db - dg;
+              if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1
+                && db >= -2 && db <= 1) {
+                *pDest++ = (noise::uint8)(0x40 | ((dr + 2) << 4)
+                  | ((dg + 2) << 2) | (db + 2));
+              } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7
+                && dbg >= -8 && dbg <= 7) {
+                *pDest++ = (noise::uint8)(0x80 | (dg + 32));
+                *pDest++ = (noise::uint8)(((drg + 8) << 4) | (dbg + 8));
+              } else {
+                *pDest++ = 0xfe;
+                *pDest++ = color.red  ;
+                *pDest++ = color.green;
+                *pDest++ = color.blue ;
+              }
+            } else {
+              *pDest++ = 0xff;
+              *pDest++ = color.red  ;
+              *pDest++ = color.green;
+              *pDest++ = color.blue ;
+              *pDest++ = color.alpha;
+            }
+          }
+          previous = color;
+        }
+      }
+      if (run > 0) {
+        *pDest++ = (noise::uint8)(0xc0 | (run - 1));
+      }
+      out.resize (pDest - out.data ());
+    }
+
   }
 
 }
@@ -581,25 +834,13 @@ void WriterBMP::WriteDestFile ()
   int bufferSize = CalcWidthByteCount (width);
   int destSize   = bufferSize * height;
 
-  // This buffer holds one horizontal line in the destination file.
-  noise::uint8* pLineBuffer = NULL;
-
   // File object used to write the file.
   std::ofstream os;
   os.clear ();
-  
-  // Allocate a buffer to hold one horizontal line in the bitmap.
-  try {
-    pLineBuffer = new noise::uint8[bufferSize];
-  }
-  catch (...) {
-    throw noise::ExceptionOutOfMemory ();
-  }
 
   // Open the destination file.
   os.open (m_destFilename.c_str (), std::ios::out | std::ios::binary);
   if (os.fail () || os.bad ()) {
-    delete[] pLineBuffer;
     throw noise::ExceptionUnknown ();
   }
 
@@ -611,7 +852,9 @@ void WriterBMP::WriteDestFile ()
   os.write ((char*)UnpackLittle32 (d, (noise::uint32)BMP_HEADER_SIZE), 4);
   os.write ((char*)UnpackLittle32 (d, 40), 4);   // Palette offset
   os.write ((char*)UnpackLittle32 (d, (noise::uint32)width ), 4);
-  os.write ((char*)UnpackLittle32 (d, (noise::uint32)height), 4);
+  // Top-down bitmaps are stored with a negative height.
+  os.write ((char*)UnpackLittle32 (d,
+    (noise::uint32)(m_topDown ? -height : height)), 4);
   os.write ((char*)UnpackLittle16 (d, 1 ), 2);   // Planes per pixel
   os.write ((char*)UnpackLittle16 (d, 24), 2);   // Bits per plane
   os.write ("\0\0\0\0", 4); // Compression (0 = none)
@@ -624,34 +867,27 @@ void WriterBMP::WriteDestFile ()
     os.clear ();
     os.close ();
     os.clear ();
-    delete[] pLineBuffer;
     throw noise::ExceptionUnknown ();
   }
 
-  // Build and write each horizontal line to the file.
-  for (int y = 0; y < height; y++) {
-    memset (pLineBuffer, 0, bufferSize);
-    Color* pSource = m_pSourceImage->GetSlabPtr (y);
-    noise::uint8* pDest   = pLineBuffer;
-    for (int x = 0; x < width; x++) {
-      *pDest++ = pSource->blue ;
-      *pDest++ = pSource->green;
-      *pDest++ = pSource->red  ;
-      ++pSource;
-    }
-    os.write ((char*)pLineBuffer, (size_t)bufferSize);
-    if (os.fail () || os.bad ()) {
-      os.clear ();
-      os.close ();
-      os.clear ();
-      delete[] pLineBuffer;
-      throw noise::ExceptionUnknown ();
-    }
+  // Build and write the horizontal lines, padding included, to the file.
+  const Image& source = *m_pSourceImage;
+  bool topDown = m_topDown;
+  bool written = WriteLines (os, height, (size_t)bufferSize, m_pTaskRunner,
+    [&] (int line, noise::uint8* pDest) {
+      int y = topDown ? height - 1 - line : line;
+      PackBGR (source.GetConstSlabPtr (y), pDest, width);
+      memset (pDest + width * 3, 0, bufferSize - width * 3);
+    });
+  if (!written) {
+    os.clear ();
+    os.close ();
+    os.clear ();
+    throw noise::ExceptionUnknown ();
   }
 
   os.close ();
   os.clear ();
-  delete[] pLineBuffer;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -672,28 +908,15 @@ void WriterTER::WriteDestFile ()
   int height = m_pSourceNoiseMap->GetHeight ();
 
   int bufferSize = CalcWidthByteCount (width);
-  int destSize   = bufferSize * height;
-
-  // This buffer holds one horizontal line in the destination file.
-  noise::uint8* pLineBuffer = NULL;
 
   // File object used to write the file.
   std::ofstream os;
   os.clear ();
 
-  // Allocate a buffer to hold one horizontal line in the height map.
-  try {
-    pLineBuffer = new noise::uint8[bufferSize];
-  }
-  catch (...) {
-    throw noise::ExceptionOutOfMemory ();
-  }
-
   // Open the destination file.
   os.open (m_destFilename.c_str (), std::ios::out | std::ios::binary);
   if (os.fail () || os.bad ()) {
     os.clear ();
-    delete[] pLineBuffer;
     throw noise::ExceptionUnknown ();
   }
 
@@ -721,33 +944,96 @@ void WriterTER::WriteDestFile ()
     os.clear ();
     os.close ();
     os.clear ();
-    delete[] pLineBuffer;
     throw noise::ExceptionUnknown ();
   }
 
-  // Build and write each horizontal line to the file.
-  for (int y = 0; y < height; y++) {
-    float* pSource = m_pSourceNoiseMap->GetSlabPtr (y);
-    noise::uint8* pDest   = pLineBuffer;
-    for (int x = 0; x < width; x++) {
-      int16 scaledHeight = (int16)(floor (*pSource * 2.0));
-      UnpackLittle16 (pDest, scaledHeight);
-      pDest += 2;
-      ++pSource;
-    }
-    os.write ((char*)pLineBuffer, (size_t)bufferSize);
-    if (os.fail () || os.bad ()) {
-      os.clear ();
-      os.close ();
-      os.clear ();
-      delete[] pLineBuffer;
-      throw noise::ExceptionUnknown ();
+  // Build and write the horizontal lines to the file.
+  const NoiseMap& source = *m_pSourceNoiseMap;
+  bool written = WriteLines (os, height, (size_t)bufferSize, m_pTaskRunner,
+    [&] (int line, noise::uint8* pDest) {
+      PackElevations (source.GetConstSlabPtr (line), pDest, width);
+    });
+  if (!written) {
+    os.clear ();
+    os.close ();
+    os.clear ();
+    throw noise::ExceptionUnknown ();
+  }
+
+  os.close ();
+  os.clear ();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// WriterQOI class
+
+void WriterQOI::WriteDestFile ()
+{
+  if (m_pSourceImage == NULL) {
+    throw noise::ExceptionInvalidParam ();
+  }
+
+  int width  = m_pSourceImage->GetWidth  ();
+  int height = m_pSourceImage->GetHeight ();
+
+  // Encode the bands side by side.  Each one follows the last color of the
+  // line above it, or the color the decoder starts with.
+  int bandCount = (height + QOI_BAND_HEIGHT - 1) / QOI_BAND_HEIGHT;
+  std::vector<std::vector<noise::uint8> > bands;
+  try {
+    bands.resize (bandCount);
+    Image& source = *m_pSourceImage;
+    auto encodeBand = [&] (int band) {
+      int first = band * QOI_BAND_HEIGHT;
+      Color previous (0, 0, 0, 255);
+      if (first > 0 && width > 0) {
+        previous = source.GetConstSlabPtr (height - first)[width - 1];
+      }
+      EncodeQOIBand (source, first, std::min (first + QOI_BAND_HEIGHT,
+        height), previous, bands[band]);
+    };
+    if (m_pTaskRunner != NULL) {
+      m_pTaskRunner->Run (bandCount, encodeBand);
+    } else {
+      for (int band = 0; band < bandCount; band++) {
+        encodeBand (band);
+      }
     }
   }
+  catch (...) {
+    throw noise::ExceptionOutOfMemory ();
+  }
+
+  // File object used to write the file.
+  std::ofstream os;
+  os.clear ();
+
+  // Open the destination file.
+  os.open (m_destFilename.c_str (), std::ios::out | std::ios::binary);
+  if (os.fail () || os.bad ()) {
+    os.clear ();
+    throw noise::ExceptionUnknown ();
+  }
+
+  // Build the header, then write the bands and the end marker.
+  noise::uint8 d[4];
+  os.write ("qoif", 4);
+  os.write ((char*)UnpackBig32 (d, (noise::uint32)width ), 4);
+  os.write ((char*)UnpackBig32 (d, (noise::uint32)height), 4);
+  os.write ("\x04\0", 2); // Four channels, sRGB
+  for (int band = 0; band < bandCount; band++) {
+    os.write ((const char*)bands[band].data (), bands[band].size ());
+  }
+  os.write ("\0\0\0\0\0\0\0\x01", 8);
+  if (os.fail () || os.bad ()) {
+    os.clear ();
+    os.close ();
+    os.clear ();
+    throw noise::ExceptionUnknown ();
+  }
 
   os.close ();
   os.clear ();
-  delete[] pLineBuffer;
 }
 
 /////////////////////////////////////////////////////////////////////////////
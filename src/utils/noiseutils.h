@@ -25,6 +25,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <functional>
 #include <string>
 
 #include <noise/noise.h>
@@ -97,6 +98,30 @@ namespace noise
     /// method.
     typedef void(*NoiseMapCallback) (int row);
 
+    /// Runs the independent tasks of a builder or renderer.
+    ///
+    /// Builders and renderers given a task runner hand it the pieces of
+    /// their work instead of running them one after another or starting
+    /// threads of their own, so an application can share one pool of
+    /// threads between all of them.
+    class TaskRunner
+    {
+
+      public:
+
+        /// Destructor.
+        virtual ~TaskRunner ()
+        {
+        }
+
+        /// Calls @a task with every index from 0 to @a count - 1, in any
+        /// order and possibly in parallel, and returns once all calls have
+        /// returned.
+        virtual void Run (int count, const std::function<void (int)>& task)
+          = 0;
+
+    };
+
     /// Number of meters per point in a Terragen terrain (TER) file.
     const double DEFAULT_METERS_PER_POINT = 30.0;
 
@@ -1109,6 +1134,14 @@ namespace noise
     ///
     /// The SetDestFilename() and SetSourceImage() methods must be called
     /// before calling the WriteDestFile() method.
+    ///
+    /// <b>Writing large images</b>
+    ///
+    /// The lines are converted in bands of a few megabytes, in parallel on a
+    /// task runner if one is set, and each band is written in one call while
+    /// the next one is converted.  Bitmaps are normally stored bottom up;
+    /// call SetTopDown() to store them top down instead, which lets readers
+    /// that map the file hand it on in one piece.
     class WriterBMP
     {
 
@@ -1116,7 +1149,9 @@ namespace noise
 
         /// Constructor.
         WriterBMP ():
-          m_pSourceImage (NULL)
+          m_pSourceImage (NULL),
+          m_pTaskRunner (NULL),
+          m_topDown (false)
         {
         }
 
@@ -1128,6 +1163,24 @@ namespace noise
           return m_destFilename;
         }
 
+        /// Returns the task runner the lines are converted on, or NULL to
+        /// convert them on the calling thread.
+        TaskRunner* GetTaskRunner () const
+        {
+          return m_pTaskRunner;
+        }
+
+        /// Determines if the lines are stored from the top of the image
+        /// down.
+        ///
+        /// @returns
+        /// - @a true if the lines are stored top down.
+        /// - @a false if the lines are stored bottom up.
+        bool IsTopDown () const
+        {
+          return m_topDown;
+        }
+
         /// Sets the name of the file to write.
         ///
         /// @param filename The name of the file to write.
@@ -1149,6 +1202,27 @@ namespace noise
           m_pSourceImage = &sourceImage;
         }
 
+        /// Sets the task runner the lines are converted on.
+        ///
+        /// @param pTaskRunner The task runner, or NULL to convert the lines
+        /// on the calling thread.
+        void SetTaskRunner (TaskRunner* pTaskRunner)
+        {
+          m_pTaskRunner = pTaskRunner;
+        }
+
+        /// Sets the order the lines are stored in.
+        ///
+        /// @param topDown @a true to store the lines from the top of the
+        /// image down, @a false to store them bottom up.
+        ///
+        /// Top-down bitmaps are stored with a negative height, which some
+        /// older readers do not accept.
+        void SetTopDown (bool topDown)
+        {
+          m_topDown = topDown;
+        }
+
         /// Writes the contents of the image object to the file.
         ///
         /// @pre SetDestFilename() has been previously called.
@@ -1183,6 +1257,12 @@ namespace noise
         /// A pointer to the image object that will be written to the file.
         Image* m_pSourceImage;
 
+        /// Task runner the lines are converted on, or NULL.
+        TaskRunner* m_pTaskRunner;
+
+        /// Determines if the lines are stored top down.
+        bool m_topDown;
+
     };
 
     /// Terragen Terrain writer class.
@@ -1205,6 +1285,10 @@ namespace noise
     ///
     /// The SetDestFilename() and SetSourceNoiseMap() methods must be called
     /// before calling the WriteDestFile() method.
+    ///
+    /// The lines are converted in bands of a few megabytes, in parallel on a
+    /// task runner if one is set, and each band is written in one call while
+    /// the next one is converted.
     class WriterTER
     {
 
@@ -1212,8 +1296,9 @@ namespace noise
 
         /// Constructor.
         WriterTER ():
+          m_metersPerPoint (DEFAULT_METERS_PER_POINT),
           m_pSourceNoiseMap (NULL),
-          m_metersPerPoint (DEFAULT_METERS_PER_POINT)
+          m_pTaskRunner (NULL)
         {
         }
 
@@ -1234,6 +1319,13 @@ namespace noise
           return m_metersPerPoint;
         }
 
+        /// Returns the task runner the lines are converted on, or NULL to
+        /// convert them on the calling thread.
+        TaskRunner* GetTaskRunner () const
+        {
+          return m_pTaskRunner;
+        }
+
         /// Sets the name of the file to write.
         ///
         /// @param filename The name of the file to write.
@@ -1265,6 +1357,15 @@ namespace noise
           m_pSourceNoiseMap = &sourceNoiseMap;
         }
 
+        /// Sets the task runner the lines are converted on.
+        ///
+        /// @param pTaskRunner The task runner, or NULL to convert the lines
+        /// on the calling thread.
+        void SetTaskRunner (TaskRunner* pTaskRunner)
+        {
+          m_pTaskRunner = pTaskRunner;
+        }
+
         /// Writes the contents of the noise map object to the file.
         ///
         /// @pre SetDestFilename() has been previously called.
@@ -1303,6 +1404,116 @@ namespace noise
         /// A pointer to the noise map that will be written to the file.
         NoiseMap* m_pSourceNoiseMap;
 
+        /// Task runner the lines are converted on, or NULL.
+        TaskRunner* m_pTaskRunner;
+
+    };
+
+    /// Quite OK Image writer class.
+    ///
+    /// This class creates a file in Quite OK Image (*.qoi) format given the
+    /// contents of an image object.  QOI is lossless like PNG, but encodes
+    /// in a single pass over the pixels with no entropy coder, many times
+    /// faster than PNG, which suits previews of large images.
+    ///
+    /// <b>Writing the image</b>
+    ///
+    /// To write the image to a file, perform the following steps:
+    /// - Pass the filename to the SetDestFilename() method.
+    /// - Pass an Image object to the SetSourceImage() method.
+    /// - Call the WriteDestFile() method.
+    ///
+    /// The SetDestFilename() and SetSourceImage() methods must be called
+    /// before calling the WriteDestFile() method.
+    ///
+    /// The image is encoded in bands of lines, in parallel on a task runner
+    /// if one is set.  A band refers to the color just before it, which it
+    /// can compute from the image, but never to the colors the decoder
+    /// remembers from earlier bands, so the bands join into one stream any
+    /// QOI decoder reads.
+    class WriterQOI
+    {
+
+      public:
+
+        /// Constructor.
+        WriterQOI ():
+          m_pSourceImage (NULL),
+          m_pTaskRunner (NULL)
+        {
+        }
+
+        /// Returns the name of the file to write.
+        ///
+        /// @returns The name of the file to write.
+        std::string GetDestFilename () const
+        {
+          return m_destFilename;
+        }
+
+        /// Returns the task runner the bands are encoded on, or NULL to
+        /// encode them on the calling thread.
+        TaskRunner* GetTaskRunner () const
+        {
+          return m_pTaskRunner;
+        }
+
+        /// Sets the name of the file to write.
+        ///
+        /// @param filename The name of the file to write.
+        ///
+        /// Call this method before calling the WriteDestFile() method.
+        void SetDestFilename (const std::string& filename)
+        {
+          m_destFilename = filename;
+        }
+
+        /// Sets the image object that is written to the file.
+        ///
+        /// @param sourceImage The image object to write.
+        ///
+        /// This object only stores a pointer to an image object, so make sure
+        /// this object exists before calling the WriteDestFile() method.
+        void SetSourceImage (Image& sourceImage)
+        {
+          m_pSourceImage = &sourceImage;
+        }
+
+        /// Sets the task runner the bands are encoded on.
+        ///
+        /// @param pTaskRunner The task runner, or NULL to encode the bands
+        /// on the calling thread.
+        void SetTaskRunner (TaskRunner* pTaskRunner)
+        {
+          m_pTaskRunner = pTaskRunner;
+        }
+
+        /// Writes the contents of the image object to the file.
+        ///
+        /// @pre SetDestFilename() has been previously called.
+        /// @pre SetSourceImage() has been previously called.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        /// @throw noise::ExceptionOutOfMemory Out of memory.
+        /// @throw noise::ExceptionUnknown An unknown exception occurred.
+        /// Possibly the file could not be written.
+        ///
+        /// This method encodes the contents of the image and writes it to a
+        /// file.  The top line of the image is stored first, as QOI
+        /// requires.  The alpha channel is stored along with the colors.
+        void WriteDestFile ();
+
+      protected:
+
+        /// Name of the file to write.
+        std::string m_destFilename;
+
+        /// A pointer to the image object that will be written to the file.
+        Image* m_pSourceImage;
+
+        /// Task runner the bands are encoded on, or NULL.
+        TaskRunner* m_pTaskRunner;
+
     };
 
     /// Abstract base class for a noise-map builder
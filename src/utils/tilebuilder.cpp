@@ -0,0 +1,151 @@
+// tilebuilder.cpp
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include "tilebuilder.h"
+#include "../modules/bounds.h"
+#include "../modules/gradient.h"
+#include "../modules/lod.h"
+
+using namespace noise;
+using namespace noise::utils;
+
+NoiseMapBuilderPlaneTiled::NoiseMapBuilderPlaneTiled ():
+  m_bumpHeight (DEFAULT_BUILDER_BUMP_HEIGHT),
+  m_pDestNormalMap (NULL),
+  m_simplifiedTileCount (0),
+  m_pTaskRunner (NULL),
+  m_tileSize (DEFAULT_BUILDER_TILE_SIZE)
+{
+}
+
+void NoiseMapBuilderPlaneTiled::Build ()
+{
+  if (IsSeamlessEnabled ()) {
+    m_simplifiedTileCount = 0;
+    NoiseMapBuilderPlane::Build ();
+    return;
+  }
+
+  double lowerXBound = GetLowerXBound ();
+  double upperXBound = GetUpperXBound ();
+  double lowerZBound = GetLowerZBound ();
+  double upperZBound = GetUpperZBound ();
+  if ( upperXBound <= lowerXBound
+    || upperZBound <= lowerZBound
+    || m_destWidth <= 0
+    || m_destHeight <= 0
+    || m_pSourceModule == NULL
+    || m_pDestNoiseMap == NULL) {
+    throw noise::ExceptionInvalidParam ();
+  }
+
+  m_pDestNoiseMap->SetSize (m_destWidth, m_destHeight);
+  if (m_pDestNormalMap != NULL) {
+    m_pDestNormalMap->SetSize (m_destWidth, m_destHeight);
+  }
+
+  // NoiseMapBuilderPlane steps through the bounds by repeated addition;
+  // the sample positions are generated the same way so the values match.
+  double xDelta = (upperXBound - lowerXBound) / (double)m_destWidth ;
+  double zDelta = (upperZBound - lowerZBound) / (double)m_destHeight;
+  std::vector<double> xCur (m_destWidth);
+  std::vector<double> zCur (m_destHeight);
+  xCur[0] = lowerXBound;
+  for (int x = 1; x < m_destWidth; x++) {
+    xCur[x] = xCur[x - 1] + xDelta;
+  }
+  zCur[0] = lowerZBound;
+  for (int z = 1; z < m_destHeight; z++) {
+    zCur[z] = zCur[z - 1] + zDelta;
+  }
+
+  // Tasks may run on other threads, which have their own sample spacing.
+  double spacing = module::GetSampleSpacing ();
+  std::atomic<int> simplifiedTileCount (0);
+  int tilesAcross = (m_destWidth + m_tileSize - 1) / m_tileSize;
+
+  for (int tileZ = 0; tileZ < m_destHeight; tileZ += m_tileSize) {
+    int tileHeight = std::min (m_tileSize, m_destHeight - tileZ);
+
+    auto buildTile = [&] (int tile) {
+      module::SampleSpacingScope spacingScope (spacing);
+      int tileX = tile * m_tileSize;
+      int tileWidth = std::min (m_tileSize, m_destWidth - tileX);
+
+      // The plane model samples the module at y = 0.
+      module::Region region;
+      region.lowerX = xCur[tileX];
+      region.upperX = xCur[tileX + tileWidth - 1];
+      region.lowerY = 0.0;
+      region.upperY = 0.0;
+      region.lowerZ = zCur[tileZ];
+      region.upperZ = zCur[tileZ + tileHeight - 1];
+
+      module::ModuleArena arena;
+      const module::Module& tileModule = module::Simplify (*m_pSourceModule,
+        region, arena);
+      if (&tileModule != m_pSourceModule) {
+        simplifiedTileCount++;
+      }
+
+      if (m_pDestNormalMap == NULL) {
+        for (int z = tileZ; z < tileZ + tileHeight; z++) {
+          float* pDest = m_pDestNoiseMap->GetSlabPtr (tileX, z);
+          for (int x = tileX; x < tileX + tileWidth; x++) {
+            *pDest++ = (float)tileModule.GetValue (xCur[x], 0, zCur[z]);
+          }
+        }
+      } else {
+        for (int z = tileZ; z < tileZ + tileHeight; z++) {
+          float* pDest = m_pDestNoiseMap->GetSlabPtr (tileX, z);
+          Color* pNormal = m_pDestNormalMap->GetSlabPtr (tileX, z);
+          for (int x = tileX; x < tileX + tileWidth; x++) {
+            module::ValueGradient sample = module::GetValueGradient (
+              tileModule, xCur[x], 0, zCur[z]);
+            *pDest++ = (float)sample.value;
+            *pNormal++ = CalcNormalColor (sample.dx, sample.dz);
+          }
+        }
+      }
+    };
+
+    if (m_pTaskRunner != NULL) {
+      m_pTaskRunner->Run (tilesAcross, buildTile);
+    } else {
+      for (int tile = 0; tile < tilesAcross; tile++) {
+        buildTile (tile);
+      }
+    }
+
+    if (m_pCallback != NULL) {
+      for (int z = tileZ; z < tileZ + tileHeight; z++) {
+        m_pCallback (z);
+      }
+    }
+  }
+  m_simplifiedTileCount = simplifiedTileCount;
+}
+
+Color NoiseMapBuilderPlaneTiled::CalcNormalColor (double dx, double dz) const
+{
+  // Same normal and encoding as RendererNormalMap::CalcNormalColor(), with
+  // the differences to the neighbouring samples replaced by the slopes.
+  double ncr = -dx * m_bumpHeight;
+  double ncu = -dz * m_bumpHeight;
+  double d = sqrt ((ncu * ncu) + (ncr * ncr) + 1);
+  double vxc = ncr / d;
+  double vyc = ncu / d;
+  double vzc = 1.0 / d;
+
+  noise::uint8 xc, yc, zc;
+  xc = (noise::uint8)((noise::uint)((floor)((vxc + 1.0) * 127.5)) & 0xff);
+  yc = (noise::uint8)((noise::uint)((floor)((vyc + 1.0) * 127.5)) & 0xff);
+  zc = (noise::uint8)((noise::uint)((floor)((vzc + 1.0) * 127.5)) & 0xff);
+
+  return Color (xc, yc, zc, 0);
+}
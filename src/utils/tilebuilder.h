@@ -0,0 +1,168 @@
+// tilebuilder.h
+//
+
+#ifndef TILEBUILDER_H
+#define TILEBUILDER_H
+
+#include "noiseutils.h"
+
+namespace noise
+{
+
+  namespace utils
+  {
+
+    /// Default width and height of the tiles built by
+    /// NoiseMapBuilderPlaneTiled, in points.
+    const int DEFAULT_BUILDER_TILE_SIZE = 32;
+
+    /// Default bump height of the normal map built by
+    /// NoiseMapBuilderPlaneTiled.
+    const double DEFAULT_BUILDER_BUMP_HEIGHT = 1.0;
+
+    /// Builds a planar noise map one tile at a time, evaluating only the
+    /// branches of the module graph each tile actually uses.
+    ///
+    /// Before filling a tile, this builder bounds the module graph over the
+    /// tile (see noise::module::GetBounds()) and simplifies it, replacing
+    /// every Select whose control value stays on one side of its bounds for
+    /// the whole tile with the source module it picks.  Tiles that fall
+    /// entirely on the flat side of a Select never evaluate the other
+    /// branch.
+    ///
+    /// The output is identical to NoiseMapBuilderPlane: the samples are
+    /// taken at exactly the same input values, and simplification never
+    /// changes the value of a sample.  Seamless maps blend samples from
+    /// outside the bounds, so they are built by NoiseMapBuilderPlane.
+    ///
+    /// If a destination normal map is set, the builder also fills it with
+    /// the exact surface normal at every sample, taken from the analytic
+    /// gradient of the module (see noise::module::GetValueGradient()), in
+    /// the same pass.  Unlike RendererNormalMap, which differences
+    /// neighbouring samples, this does not blur features smaller than the
+    /// sample spacing into the normals.
+    ///
+    /// If a task runner is set, the tiles of each row of tiles are built as
+    /// separate tasks.  The callback is still called on the building thread,
+    /// once a whole row of tiles is done.
+    class NoiseMapBuilderPlaneTiled: public NoiseMapBuilderPlane
+    {
+
+      public:
+
+        /// Constructor.
+        NoiseMapBuilderPlaneTiled ();
+
+        virtual void Build ();
+
+        /// Returns the bump height of the normal map.
+        double GetBumpHeight () const
+        {
+          return m_bumpHeight;
+        }
+
+        /// Returns the number of tiles in the last build whose module graph
+        /// could be simplified.
+        int GetSimplifiedTileCount () const
+        {
+          return m_simplifiedTileCount;
+        }
+
+        /// Returns the width and height of a tile, in points.
+        int GetTileSize () const
+        {
+          return m_tileSize;
+        }
+
+        /// Returns the task runner the tiles are built on, or NULL to build
+        /// them on the calling thread.
+        TaskRunner* GetTaskRunner () const
+        {
+          return m_pTaskRunner;
+        }
+
+        /// Sets the bump height of the normal map.
+        ///
+        /// @param bumpHeight The bump height.
+        ///
+        /// The normal map holds the normals of the surface whose height
+        /// above the point ( @a x, @a z ) of the input plane is
+        /// @a bumpHeight times the output value of the source module at
+        /// that point.  Like RendererNormalMap, the x and z components of
+        /// the normal are stored in the red and green channels and the
+        /// vertical component in the blue channel, each mapped from
+        /// -1.0 .. +1.0 to 0 .. 255.
+        void SetBumpHeight (double bumpHeight)
+        {
+          m_bumpHeight = bumpHeight;
+        }
+
+        /// Sets the destination normal map.
+        ///
+        /// @param destNormalMap The normal map that receives the surface
+        /// normals, the same size as the noise map.
+        ///
+        /// The destination normal map must exist throughout the lifetime of
+        /// this object unless another normal map replaces it.
+        void SetDestNormalMap (Image& destNormalMap)
+        {
+          m_pDestNormalMap = &destNormalMap;
+        }
+
+        /// Sets the task runner the tiles are built on.
+        ///
+        /// @param pTaskRunner The task runner, or NULL to build the tiles on
+        /// the calling thread.
+        ///
+        /// The source module must be safe to evaluate from several threads
+        /// at once.  Each task builds with the sample spacing of the thread
+        /// calling Build() (see noise::module::SampleSpacingScope).
+        void SetTaskRunner (TaskRunner* pTaskRunner)
+        {
+          m_pTaskRunner = pTaskRunner;
+        }
+
+        /// Sets the width and height of a tile, in points.
+        ///
+        /// @pre The tile size is positive.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        ///
+        /// Smaller tiles get tighter bounds, so more of them can skip a
+        /// branch, but each tile pays for bounding the graph.
+        void SetTileSize (int tileSize)
+        {
+          if (tileSize <= 0) {
+            throw noise::ExceptionInvalidParam ();
+          }
+          m_tileSize = tileSize;
+        }
+
+      private:
+
+        /// Calculates the normal map color of a sample from the slopes of
+        /// the source module along @a x and @a z.
+        Color CalcNormalColor (double dx, double dz) const;
+
+        /// Bump height of the normal map.
+        double m_bumpHeight;
+
+        /// Destination normal map, or NULL to build only the noise map.
+        Image* m_pDestNormalMap;
+
+        /// Number of simplified tiles in the last build.
+        int m_simplifiedTileCount;
+
+        /// Task runner the tiles are built on, or NULL.
+        TaskRunner* m_pTaskRunner;
+
+        /// Width and height of a tile, in points.
+        int m_tileSize;
+
+    };
+
+  }
+
+}
+
+#endif